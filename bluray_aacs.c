@@ -0,0 +1,600 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bluray_aacs.h"
+#include "bluray_keydb.h"
+
+// AACS content IV, the same for every unit
+static const uint8_t bluray_aacs_iv[BLURAY_AES_BLOCK_SIZE] = { 0x0b, 0xa0, 0xf8, 0xdd, 0xfe, 0xa6, 0x1f, 0xb3, 0xd8, 0xdf, 0x9f, 0x56, 0x6a, 0x05, 0x0f, 0x78 };
+
+void bluray_aacs_init(struct bluray_aacs *aacs) {
+
+	aacs->unit_keys = NULL;
+	aacs->num_unit_keys = 0;
+
+}
+
+static int bluray_aacs_add_key(struct bluray_aacs *aacs, const uint8_t key[BLURAY_AES_BLOCK_SIZE]) {
+
+	struct bluray_aes *unit_keys = realloc(aacs->unit_keys, (aacs->num_unit_keys + 1) * sizeof(struct bluray_aes));
+	if(unit_keys == NULL)
+		return 1;
+
+	aacs->unit_keys = unit_keys;
+	bluray_aes_init(&aacs->unit_keys[aacs->num_unit_keys], key);
+	aacs->num_unit_keys++;
+
+	return 0;
+
+}
+
+/**
+ * Decrypt the unit keys in Unit_Key_RO.inf with the volume unique key. The
+ * file starts with where the keys are, which starts with how many there are,
+ * and the keys themselves are 48 bytes apart after that.
+ */
+static int bluray_aacs_vuk_keys(struct bluray_aacs *aacs, const char *device_filename, const uint8_t vuk[BLURAY_KEYDB_KEY_LENGTH]) {
+
+	uint8_t *data = NULL;
+	size_t length = 0;
+
+	if(bluray_keydb_unit_key_file(device_filename, &data, &length))
+		return 1;
+
+	struct bluray_aes aes;
+	uint8_t key[BLURAY_AES_BLOCK_SIZE];
+	uint32_t position = 0;
+	uint16_t num_keys = 0;
+	uint16_t ix = 0;
+	int retval = 0;
+
+	if(length >= 4)
+		position = (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 | (uint32_t)data[2] << 8 | data[3];
+
+	if(length < 4 || (uint64_t)position + 2 > length) {
+		free(data);
+		return 1;
+	}
+
+	num_keys = (uint16_t)(data[position] << 8 | data[position + 1]);
+	if(num_keys == 0 || (uint64_t)position + 48 * (uint64_t)num_keys + 16 > length) {
+		free(data);
+		return 1;
+	}
+
+	bluray_aes_init(&aes, vuk);
+	for(ix = 0; ix < num_keys && retval == 0; ix++) {
+		bluray_aes_decrypt(&aes, data + position + 48 * (ix + 1), key);
+		retval = bluray_aacs_add_key(aacs, key);
+	}
+
+	free(data);
+
+	return retval;
+
+}
+
+/**
+ * Get the disc's unit keys from its KEYDB entry, either listed there or
+ * decrypted with its volume unique key
+ */
+int bluray_aacs_keys(struct bluray_aacs *aacs, const char *device_filename, const char *key_db_filename) {
+
+	char disc_id[BLURAY_KEYDB_DISC_ID_STRLEN];
+	char filename[PATH_MAX];
+	char cache_filename[PATH_MAX];
+	const char *keys_filename = filename;
+	struct bluray_keydb_keys keys;
+	uint32_t ix = 0;
+
+	bluray_aacs_free(aacs);
+
+	if(bluray_keydb_disc_id(device_filename, disc_id) || bluray_keydb_filename(filename, PATH_MAX, key_db_filename))
+		return 1;
+
+	if(bluray_keydb_cache_filename(cache_filename, PATH_MAX, disc_id) == 0 && bluray_keydb_cached(cache_filename, filename) == BLURAY_KEYDB_ENTRY)
+		keys_filename = cache_filename;
+
+	if(bluray_keydb_disc_keys(keys_filename, disc_id, &keys))
+		return 1;
+
+	if(keys.num_unit_keys) {
+		for(ix = 0; ix < keys.num_unit_keys; ix++) {
+			if(bluray_aacs_add_key(aacs, keys.unit_keys[ix])) {
+				bluray_aacs_free(aacs);
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	if(bluray_aacs_vuk_keys(aacs, device_filename, keys.vuk)) {
+		bluray_aacs_free(aacs);
+		return 1;
+	}
+
+	return 0;
+
+}
+
+void bluray_aacs_free(struct bluray_aacs *aacs) {
+
+	free(aacs->unit_keys);
+	bluray_aacs_init(aacs);
+
+}
+
+static bool bluray_aacs_verify(const uint8_t *unit) {
+
+	uint32_t offset = 0;
+	for(offset = 0; offset < BLURAY_AACS_UNIT_SIZE; offset += 192) {
+		if(unit[offset + 4] != 0x47)
+			return false;
+	}
+
+	return true;
+
+}
+
+/**
+ * Decrypt an aligned unit in place, starting with the unit key in key_ix,
+ * which is set to the one that worked. copy is room for a unit, to go back to
+ * the encrypted data when a key doesn't work. Units that aren't encrypted are
+ * left as they are.
+ */
+int bluray_aacs_decrypt_unit(const struct bluray_aacs *aacs, uint8_t *unit, uint8_t *copy, uint32_t *key_ix) {
+
+	struct bluray_aes aes;
+	uint8_t key[BLURAY_AES_BLOCK_SIZE];
+	uint32_t try = 0;
+	uint32_t ix = 0;
+	uint32_t offset = 0;
+
+	// Copy permission bits, clear for units that aren't encrypted
+	if((unit[0] & 0xc0) == 0)
+		return 0;
+
+	if(aacs->num_unit_keys == 0)
+		return 1;
+
+	memcpy(copy, unit, BLURAY_AACS_UNIT_SIZE);
+
+	for(try = 0; try < aacs->num_unit_keys; try++) {
+
+		ix = (*key_ix + try) % aacs->num_unit_keys;
+		if(try)
+			memcpy(unit, copy, BLURAY_AACS_UNIT_SIZE);
+
+		bluray_aes_encrypt(&aacs->unit_keys[ix], unit, key);
+		for(offset = 0; offset < BLURAY_AES_BLOCK_SIZE; offset++)
+			key[offset] ^= unit[offset];
+
+		bluray_aes_init(&aes, key);
+		bluray_aes_cbc_decrypt(&aes, bluray_aacs_iv, unit + BLURAY_AES_BLOCK_SIZE, BLURAY_AACS_UNIT_SIZE - BLURAY_AES_BLOCK_SIZE);
+
+		if(bluray_aacs_verify(unit)) {
+			for(offset = 0; offset < BLURAY_AACS_UNIT_SIZE; offset += 192)
+				unit[offset] &= 0x3f;
+			*key_ix = ix;
+			return 0;
+		}
+
+	}
+
+	return 1;
+
+}
+
+static int bluray_aacs_pread(int fd, uint8_t *buffer, size_t length, uint64_t offset) {
+
+	ssize_t retval = 0;
+
+	while(length) {
+		retval = pread(fd, buffer, length, (off_t)offset);
+		if(retval == -1 && errno == EINTR)
+			continue;
+		if(retval <= 0)
+			return 1;
+		buffer += retval;
+		length -= (size_t)retval;
+		offset += (uint64_t)retval;
+	}
+
+	return 0;
+
+}
+
+/**
+ * Read part of a clip's stream file, from its own file or from the extents
+ * it has in the image
+ */
+static int bluray_aacs_read_clip(struct bluray_aacs_title *aacs_title, const struct bluray_aacs_clip *clip, uint8_t *buffer, size_t length, uint64_t offset) {
+
+	if(clip->fd != -1)
+		return bluray_aacs_pread(clip->fd, buffer, length, offset);
+
+	const struct bluray_udf_extent *extent = NULL;
+	uint64_t extent_start = 0;
+	uint64_t extent_end = 0;
+	uint64_t from = 0;
+	uint64_t to = 0;
+	size_t ix = 0;
+
+	for(ix = 0; ix < clip->num_extents && length; ix++) {
+
+		extent = &clip->extents[ix];
+		extent_end = extent_start + extent->length;
+
+		if(offset < extent_end) {
+
+			from = offset;
+			to = (offset + length < extent_end ? offset + length : extent_end);
+
+			if(extent->sector == BLURAY_UDF_UNRECORDED)
+				memset(buffer, 0, (size_t)(to - from));
+			else if(bluray_aacs_pread(aacs_title->image_fd, buffer, (size_t)(to - from), (uint64_t)extent->sector * BLURAY_UDF_SECTOR + (from - extent_start)))
+				return 1;
+
+			buffer += to - from;
+			length -= (size_t)(to - from);
+			offset = to;
+
+		}
+
+		extent_start = extent_end;
+
+	}
+
+	return (length != 0);
+
+}
+
+static int bluray_aacs_read_chunk(struct bluray_aacs_title *aacs_title, const struct bluray_aacs_chunk *chunk, uint8_t *data, uint8_t *copy, uint32_t *key_ix) {
+
+	uint32_t offset = 0;
+
+	if(bluray_aacs_read_clip(aacs_title, &aacs_title->clips[chunk->clip_ix], data, chunk->length, chunk->offset))
+		return 1;
+
+	for(offset = 0; offset + BLURAY_AACS_UNIT_SIZE <= chunk->length; offset += BLURAY_AACS_UNIT_SIZE) {
+		if(bluray_aacs_decrypt_unit(aacs_title->aacs, data + offset, copy, key_ix))
+			return 1;
+	}
+
+	// A unit cut short at the end of the file can't have been encrypted
+	if(offset < chunk->length && (data[offset] & 0xc0))
+		return 1;
+
+	return 0;
+
+}
+
+/**
+ * Decrypt the next chunk that has a free slot, until all of them are done
+ */
+static void *bluray_aacs_worker(void *arg) {
+
+	struct bluray_aacs_title *aacs_title = arg;
+	struct bluray_aacs_slot *slot = NULL;
+	uint8_t copy[BLURAY_AACS_UNIT_SIZE];
+	uint32_t key_ix = 0;
+	uint64_t chunk_ix = 0;
+	bool error = false;
+
+	pthread_mutex_lock(&aacs_title->mutex);
+
+	while(true) {
+
+		while(!aacs_title->quit && aacs_title->next_chunk < aacs_title->num_chunks && aacs_title->next_chunk >= aacs_title->read_chunk + aacs_title->num_slots)
+			pthread_cond_wait(&aacs_title->cond, &aacs_title->mutex);
+
+		if(aacs_title->quit || aacs_title->next_chunk >= aacs_title->num_chunks)
+			break;
+
+		chunk_ix = aacs_title->next_chunk++;
+		slot = &aacs_title->slots[chunk_ix % aacs_title->num_slots];
+
+		pthread_mutex_unlock(&aacs_title->mutex);
+		error = (bluray_aacs_read_chunk(aacs_title, &aacs_title->chunks[chunk_ix], slot->data, copy, &key_ix) != 0);
+		pthread_mutex_lock(&aacs_title->mutex);
+
+		slot->error = error;
+		slot->ready = chunk_ix + 1;
+		pthread_cond_broadcast(&aacs_title->cond);
+
+	}
+
+	pthread_mutex_unlock(&aacs_title->mutex);
+
+	return NULL;
+
+}
+
+static int bluray_aacs_open_clip(struct bluray_aacs_clip *clip, struct bluray_bdmv *bdmv, const char *clip_id) {
+
+	char filename[PATH_MAX];
+	struct stat st;
+
+	clip->fd = -1;
+	clip->extents = NULL;
+	clip->num_extents = 0;
+	clip->file_size = 0;
+
+	if(bdmv->image != NULL) {
+		snprintf(filename, PATH_MAX, "BDMV/STREAM/%s.m2ts", clip_id);
+		return bluray_udf_extents(&bdmv->udf, filename, &clip->extents, &clip->num_extents, &clip->file_size);
+	}
+
+	if(snprintf(filename, PATH_MAX, "%s/BDMV/STREAM/%s.m2ts", bdmv->dirname, clip_id) >= PATH_MAX)
+		return 1;
+
+	clip->fd = open(filename, O_RDONLY);
+	if(clip->fd == -1)
+		return 1;
+
+	if(fstat(clip->fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+		close(clip->fd);
+		clip->fd = -1;
+		return 1;
+	}
+
+	clip->file_size = (uint64_t)st.st_size;
+
+	return 0;
+
+}
+
+static int bluray_aacs_add_chunk(struct bluray_aacs_title *aacs_title, size_t *chunks_size, uint32_t clip_ix, uint64_t offset, uint64_t length, uint64_t from, uint64_t to) {
+
+	if(aacs_title->num_chunks == *chunks_size) {
+		size_t size = (*chunks_size ? *chunks_size * 2 : 64);
+		struct bluray_aacs_chunk *chunks = realloc(aacs_title->chunks, size * sizeof(struct bluray_aacs_chunk));
+		if(chunks == NULL)
+			return 1;
+		aacs_title->chunks = chunks;
+		*chunks_size = size;
+	}
+
+	struct bluray_aacs_chunk *chunk = &aacs_title->chunks[aacs_title->num_chunks];
+	chunk->clip_ix = clip_ix;
+	chunk->offset = offset;
+	chunk->length = (uint32_t)length;
+	chunk->skip = (uint32_t)(from > offset ? from - offset : 0);
+	chunk->keep = (uint32_t)((to < offset + length ? to : offset + length) - (offset + chunk->skip));
+	aacs_title->num_chunks++;
+
+	return 0;
+
+}
+
+/**
+ * Split the clips' parts of the title's range, start to end in bytes, into
+ * chunks of whole units. A chunk only starts a unit early, or ends a unit
+ * late, to keep decrypting whole units; what's outside the range is skipped.
+ */
+static int bluray_aacs_plan(struct bluray_aacs_title *aacs_title, uint64_t start, uint64_t end) {
+
+	struct bluray_aacs_clip *clip = NULL;
+	size_t chunks_size = 0;
+	uint64_t title_position = 0;
+	uint64_t clip_length = 0;
+	uint64_t from = 0;
+	uint64_t to = 0;
+	uint64_t offset = 0;
+	uint64_t last = 0;
+	uint32_t clip_ix = 0;
+
+	for(clip_ix = 0; clip_ix < aacs_title->num_clips; clip_ix++, title_position += clip_length) {
+
+		clip = &aacs_title->clips[clip_ix];
+		clip_length = clip->end - clip->start;
+
+		if(end <= title_position || start >= title_position + clip_length)
+			continue;
+
+		from = clip->start + (start > title_position ? start - title_position : 0);
+		to = clip->start + (end < title_position + clip_length ? end - title_position : clip_length);
+
+		offset = from - from % BLURAY_AACS_UNIT_SIZE;
+		last = (to + BLURAY_AACS_UNIT_SIZE - 1) / BLURAY_AACS_UNIT_SIZE * BLURAY_AACS_UNIT_SIZE;
+		if(last > clip->file_size)
+			last = clip->file_size;
+		if(last < to)
+			return 1;
+
+		for(; offset < last; offset += BLURAY_AACS_CHUNK_SIZE) {
+			if(bluray_aacs_add_chunk(aacs_title, &chunks_size, clip_ix, offset, (last - offset < BLURAY_AACS_CHUNK_SIZE ? last - offset : BLURAY_AACS_CHUNK_SIZE), from, to))
+				return 1;
+		}
+
+	}
+
+	return 0;
+
+}
+
+/**
+ * Open a title of a disc image or directory for reading from start to end,
+ * byte positions in the title like bd_seek() takes, and start the workers.
+ * With no workers given, there's one for each CPU. The title's size is set,
+ * to check it's the same one libbluray has.
+ */
+int bluray_aacs_title_open(struct bluray_aacs_title *aacs_title, const struct bluray_aacs *aacs, struct bluray_bdmv *bdmv, const char *device_filename, uint32_t title_ix, uint8_t angle_ix, uint64_t start, uint64_t end, uint32_t workers) {
+
+	memset(aacs_title, 0, sizeof(struct bluray_aacs_title));
+	aacs_title->aacs = aacs;
+	aacs_title->image_fd = -1;
+
+	struct bluray_bdmv_range *ranges = NULL;
+	uint32_t num_ranges = 0;
+	uint32_t ix = 0;
+	int retval = 0;
+
+	if(bluray_bdmv_clip_ranges(bdmv, title_ix, angle_ix, &ranges, &num_ranges))
+		return 1;
+
+	if(num_ranges) {
+		aacs_title->clips = calloc(num_ranges, sizeof(struct bluray_aacs_clip));
+		if(aacs_title->clips == NULL)
+			retval = 1;
+	}
+
+	for(ix = 0; ix < num_ranges && retval == 0; ix++) {
+		retval = bluray_aacs_open_clip(&aacs_title->clips[ix], bdmv, ranges[ix].clip_id);
+		aacs_title->clips[ix].start = (uint64_t)ranges[ix].start_pkt * 192;
+		aacs_title->clips[ix].end = (uint64_t)ranges[ix].end_pkt * 192;
+		aacs_title->size += aacs_title->clips[ix].end - aacs_title->clips[ix].start;
+		aacs_title->num_clips++;
+	}
+
+	free(ranges);
+
+	if(retval == 0 && bdmv->image != NULL) {
+		aacs_title->image_fd = open(device_filename, O_RDONLY);
+		if(aacs_title->image_fd == -1)
+			retval = 1;
+	}
+
+	if(end > aacs_title->size)
+		end = aacs_title->size;
+
+	if(retval == 0 && start < end)
+		retval = bluray_aacs_plan(aacs_title, start, end);
+
+	if(retval) {
+		bluray_aacs_title_close(aacs_title);
+		return 1;
+	}
+
+	if(workers == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		workers = (cpus > 0 ? (uint32_t)cpus : 1);
+	}
+	if(workers > BLURAY_AACS_MAX_WORKERS)
+		workers = BLURAY_AACS_MAX_WORKERS;
+
+	// Two slots for each worker, so they can carry on while the oldest
+	// chunks are read
+	aacs_title->num_slots = workers * 2;
+	aacs_title->slots = calloc(aacs_title->num_slots, sizeof(struct bluray_aacs_slot));
+	if(aacs_title->slots == NULL) {
+		aacs_title->num_slots = 0;
+		bluray_aacs_title_close(aacs_title);
+		return 1;
+	}
+
+	for(ix = 0; ix < aacs_title->num_slots; ix++) {
+		aacs_title->slots[ix].data = malloc(BLURAY_AACS_CHUNK_SIZE);
+		if(aacs_title->slots[ix].data == NULL) {
+			bluray_aacs_title_close(aacs_title);
+			return 1;
+		}
+	}
+
+	pthread_mutex_init(&aacs_title->mutex, NULL);
+	pthread_cond_init(&aacs_title->cond, NULL);
+
+	for(ix = 0; ix < workers; ix++) {
+		if(pthread_create(&aacs_title->workers[aacs_title->num_workers], NULL, bluray_aacs_worker, aacs_title) == 0)
+			aacs_title->num_workers++;
+	}
+
+	if(aacs_title->num_workers == 0) {
+		bluray_aacs_title_close(aacs_title);
+		return 1;
+	}
+
+	return 0;
+
+}
+
+/**
+ * Read the title in order, like bd_read(). Returns 0 at the end of the range
+ * and -1 if a chunk couldn't be read or decrypted.
+ */
+int64_t bluray_aacs_title_read(struct bluray_aacs_title *aacs_title, uint8_t *buffer, size_t length) {
+
+	const struct bluray_aacs_chunk *chunk = NULL;
+	struct bluray_aacs_slot *slot = NULL;
+	size_t copied = 0;
+	size_t amount = 0;
+
+	while(copied < length && aacs_title->read_chunk < aacs_title->num_chunks) {
+
+		chunk = &aacs_title->chunks[aacs_title->read_chunk];
+		slot = &aacs_title->slots[aacs_title->read_chunk % aacs_title->num_slots];
+
+		// Wait for the chunk once, then read it without locking
+		if(!aacs_title->read_ready) {
+			pthread_mutex_lock(&aacs_title->mutex);
+			while(slot->ready != aacs_title->read_chunk + 1)
+				pthread_cond_wait(&aacs_title->cond, &aacs_title->mutex);
+			pthread_mutex_unlock(&aacs_title->mutex);
+			if(slot->error)
+				return -1;
+			aacs_title->read_ready = true;
+		}
+
+		amount = chunk->keep - aacs_title->read_offset;
+		if(amount > length - copied)
+			amount = length - copied;
+
+		memcpy(buffer + copied, slot->data + chunk->skip + aacs_title->read_offset, amount);
+		copied += amount;
+		aacs_title->read_offset += (uint32_t)amount;
+
+		// Give the slot back to the workers
+		if(aacs_title->read_offset == chunk->keep) {
+			pthread_mutex_lock(&aacs_title->mutex);
+			aacs_title->read_chunk++;
+			aacs_title->read_offset = 0;
+			aacs_title->read_ready = false;
+			pthread_cond_broadcast(&aacs_title->cond);
+			pthread_mutex_unlock(&aacs_title->mutex);
+		}
+
+	}
+
+	return (int64_t)copied;
+
+}
+
+void bluray_aacs_title_close(struct bluray_aacs_title *aacs_title) {
+
+	uint32_t ix = 0;
+
+	if(aacs_title->num_workers) {
+		pthread_mutex_lock(&aacs_title->mutex);
+		aacs_title->quit = true;
+		pthread_cond_broadcast(&aacs_title->cond);
+		pthread_mutex_unlock(&aacs_title->mutex);
+		for(ix = 0; ix < aacs_title->num_workers; ix++)
+			pthread_join(aacs_title->workers[ix], NULL);
+		pthread_mutex_destroy(&aacs_title->mutex);
+		pthread_cond_destroy(&aacs_title->cond);
+	}
+
+	for(ix = 0; ix < aacs_title->num_slots; ix++)
+		free(aacs_title->slots[ix].data);
+
+	for(ix = 0; ix < aacs_title->num_clips; ix++) {
+		if(aacs_title->clips[ix].fd != -1)
+			close(aacs_title->clips[ix].fd);
+		free(aacs_title->clips[ix].extents);
+	}
+
+	if(aacs_title->image_fd != -1)
+		close(aacs_title->image_fd);
+
+	free(aacs_title->slots);
+	free(aacs_title->clips);
+	free(aacs_title->chunks);
+	memset(aacs_title, 0, sizeof(struct bluray_aacs_title));
+	aacs_title->image_fd = -1;
+
+}
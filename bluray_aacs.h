@@ -0,0 +1,122 @@
+#ifndef BLURAY_INFO_AACS_H
+#define BLURAY_INFO_AACS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "bluray_aes.h"
+#include "bluray_bdmv.h"
+#include "bluray_udf.h"
+
+/**
+ * Reading a title from a disc image or directory, decrypting it in parallel
+ *
+ * libbluray has libaacs decrypt each aligned unit of a stream file as it's
+ * read, on the thread calling bd_read(), so copying an encrypted title from
+ * fast storage is limited to one core doing AES. This reads the title's
+ * stream files itself instead, in large chunks of whole units, and decrypts
+ * them on a pool of worker threads, using AES-NI where the CPU has it. The
+ * chunks are handed back in order, so reading the title returns the same
+ * bytes as reading it through libbluray, from the same clip ranges (see
+ * bluray_bdmv_clip_ranges()).
+ *
+ * libaacs doesn't give out the unit keys, so they're read from the KEYDB the
+ * same way it does: the disc's entry, found by its disc ID, has either the
+ * unit keys themselves or the volume unique key, which decrypts the ones in
+ * AACS/Unit_Key_RO.inf. The per-disc KEYDB cache is used when it's up to
+ * date. Discs with only a media key or processing keys in the KEYDB, and
+ * discs with BD+, which changes the stream after decryption, have to be read
+ * through libbluray.
+ *
+ * Each unit is decrypted like libaacs does: its first 16 bytes are plain, and
+ * encrypted with the unit key they make the key for the rest, which is AES-CBC.
+ * Which unit key a clip uses isn't looked up; the last one that worked is
+ * tried first, then the others, and the right one is the one that leaves a
+ * transport stream sync byte at the start of every packet.
+ */
+
+#define BLURAY_AACS_UNIT_SIZE 6144
+
+// Units read and decrypted by a worker at a time, 768 KB
+#define BLURAY_AACS_CHUNK_UNITS 128
+#define BLURAY_AACS_CHUNK_SIZE (BLURAY_AACS_CHUNK_UNITS * BLURAY_AACS_UNIT_SIZE)
+
+#define BLURAY_AACS_MAX_WORKERS 32
+
+struct bluray_aacs {
+	struct bluray_aes *unit_keys;
+	uint32_t num_unit_keys;
+};
+
+/**
+ * A clip's part of the title, and where its stream file is: a file of its own
+ * in a directory, or extents of the image
+ */
+struct bluray_aacs_clip {
+	int fd;
+	struct bluray_udf_extent *extents;
+	size_t num_extents;
+	uint64_t file_size;
+	uint64_t start;
+	uint64_t end;
+};
+
+/**
+ * A chunk of a stream file to read, and the part of it that's in the
+ * requested range of the title
+ */
+struct bluray_aacs_chunk {
+	uint32_t clip_ix;
+	uint64_t offset;
+	uint32_t length;
+	uint32_t skip;
+	uint32_t keep;
+};
+
+/**
+ * Slots chunks are decrypted into, ready holding the number of the chunk
+ * they have, plus one
+ */
+struct bluray_aacs_slot {
+	uint8_t *data;
+	uint64_t ready;
+	bool error;
+};
+
+struct bluray_aacs_title {
+	const struct bluray_aacs *aacs;
+	int image_fd;
+	struct bluray_aacs_clip *clips;
+	uint32_t num_clips;
+	uint64_t size;
+	struct bluray_aacs_chunk *chunks;
+	uint64_t num_chunks;
+	struct bluray_aacs_slot *slots;
+	uint32_t num_slots;
+	pthread_t workers[BLURAY_AACS_MAX_WORKERS];
+	uint32_t num_workers;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool quit;
+	uint64_t next_chunk;
+	uint64_t read_chunk;
+	uint32_t read_offset;
+	bool read_ready;
+};
+
+void bluray_aacs_init(struct bluray_aacs *aacs);
+
+int bluray_aacs_keys(struct bluray_aacs *aacs, const char *device_filename, const char *key_db_filename);
+
+void bluray_aacs_free(struct bluray_aacs *aacs);
+
+int bluray_aacs_decrypt_unit(const struct bluray_aacs *aacs, uint8_t *unit, uint8_t *copy, uint32_t *key_ix);
+
+int bluray_aacs_title_open(struct bluray_aacs_title *aacs_title, const struct bluray_aacs *aacs, struct bluray_bdmv *bdmv, const char *device_filename, uint32_t title_ix, uint8_t angle_ix, uint64_t start, uint64_t end, uint32_t workers);
+
+int64_t bluray_aacs_title_read(struct bluray_aacs_title *aacs_title, uint8_t *buffer, size_t length);
+
+void bluray_aacs_title_close(struct bluray_aacs_title *aacs_title);
+
+#endif
@@ -0,0 +1,368 @@
+#include <string.h>
+#include <pthread.h>
+#include "config.h"
+#include "bluray_aes.h"
+
+#if defined(HAVE_WMMINTRIN_H) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLURAY_AES_NI
+#include <wmmintrin.h>
+#endif
+
+static uint8_t bluray_aes_sbox[256];
+static uint8_t bluray_aes_inv_sbox[256];
+static uint8_t bluray_aes_mul[4][256];
+static bool bluray_aes_has_ni = false;
+static pthread_once_t bluray_aes_once = PTHREAD_ONCE_INIT;
+
+// Factors of InvMixColumns, the rows of bluray_aes_mul
+enum { MUL_9, MUL_11, MUL_13, MUL_14 };
+
+#define BLURAY_AES_ROTL8(x, n) ((uint8_t)(((x) << (n)) | ((x) >> (8 - (n)))))
+
+static uint8_t bluray_aes_xtime(uint8_t x) {
+
+	return (uint8_t)((x << 1) ^ (x & 0x80 ? 0x1b : 0));
+
+}
+
+static uint8_t bluray_aes_gf_mul(uint8_t a, uint8_t b) {
+
+	uint8_t product = 0;
+
+	while(b) {
+		if(b & 1)
+			product ^= a;
+		a = bluray_aes_xtime(a);
+		b >>= 1;
+	}
+
+	return product;
+
+}
+
+/**
+ * Build the S-boxes by walking GF(2^8) with generator 3 and its inverse at
+ * the same time, so each step has an element and its multiplicative inverse.
+ */
+static void bluray_aes_tables(void) {
+
+	uint8_t p = 1;
+	uint8_t q = 1;
+	uint8_t x = 0;
+	int ix = 0;
+
+	do {
+		p = p ^ bluray_aes_xtime(p);
+		q ^= q << 1;
+		q ^= q << 2;
+		q ^= q << 4;
+		if(q & 0x80)
+			q ^= 0x09;
+		x = q ^ BLURAY_AES_ROTL8(q, 1) ^ BLURAY_AES_ROTL8(q, 2) ^ BLURAY_AES_ROTL8(q, 3) ^ BLURAY_AES_ROTL8(q, 4);
+		bluray_aes_sbox[p] = x ^ 0x63;
+	} while(p != 1);
+	bluray_aes_sbox[0] = 0x63;
+
+	for(ix = 0; ix < 256; ix++) {
+		bluray_aes_inv_sbox[bluray_aes_sbox[ix]] = (uint8_t)ix;
+		bluray_aes_mul[MUL_9][ix] = bluray_aes_gf_mul((uint8_t)ix, 9);
+		bluray_aes_mul[MUL_11][ix] = bluray_aes_gf_mul((uint8_t)ix, 11);
+		bluray_aes_mul[MUL_13][ix] = bluray_aes_gf_mul((uint8_t)ix, 13);
+		bluray_aes_mul[MUL_14][ix] = bluray_aes_gf_mul((uint8_t)ix, 14);
+	}
+
+#ifdef BLURAY_AES_NI
+	__builtin_cpu_init();
+	bluray_aes_has_ni = __builtin_cpu_supports("aes") && __builtin_cpu_supports("sse2");
+#endif
+
+}
+
+static void bluray_aes_inv_mix_columns(uint8_t s[BLURAY_AES_BLOCK_SIZE]) {
+
+	uint8_t a[4];
+	uint8_t c = 0;
+
+	for(c = 0; c < 4; c++) {
+		memcpy(a, s + 4 * c, 4);
+		s[4 * c] = bluray_aes_mul[MUL_14][a[0]] ^ bluray_aes_mul[MUL_11][a[1]] ^ bluray_aes_mul[MUL_13][a[2]] ^ bluray_aes_mul[MUL_9][a[3]];
+		s[4 * c + 1] = bluray_aes_mul[MUL_9][a[0]] ^ bluray_aes_mul[MUL_14][a[1]] ^ bluray_aes_mul[MUL_11][a[2]] ^ bluray_aes_mul[MUL_13][a[3]];
+		s[4 * c + 2] = bluray_aes_mul[MUL_13][a[0]] ^ bluray_aes_mul[MUL_9][a[1]] ^ bluray_aes_mul[MUL_14][a[2]] ^ bluray_aes_mul[MUL_11][a[3]];
+		s[4 * c + 3] = bluray_aes_mul[MUL_11][a[0]] ^ bluray_aes_mul[MUL_13][a[1]] ^ bluray_aes_mul[MUL_9][a[2]] ^ bluray_aes_mul[MUL_14][a[3]];
+	}
+
+}
+
+static void bluray_aes_add_round_key(uint8_t s[BLURAY_AES_BLOCK_SIZE], const uint8_t key[BLURAY_AES_BLOCK_SIZE]) {
+
+	uint8_t ix = 0;
+	for(ix = 0; ix < BLURAY_AES_BLOCK_SIZE; ix++)
+		s[ix] ^= key[ix];
+
+}
+
+#ifdef BLURAY_AES_NI
+
+__attribute__((target("aes,sse2")))
+static void bluray_aes_ni_encrypt(const struct bluray_aes *aes, const uint8_t in[BLURAY_AES_BLOCK_SIZE], uint8_t out[BLURAY_AES_BLOCK_SIZE]) {
+
+	__m128i x = _mm_loadu_si128((const __m128i *)in);
+	uint8_t round = 0;
+
+	x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)aes->encrypt_keys[0]));
+	for(round = 1; round < BLURAY_AES_ROUNDS; round++)
+		x = _mm_aesenc_si128(x, _mm_loadu_si128((const __m128i *)aes->encrypt_keys[round]));
+	x = _mm_aesenclast_si128(x, _mm_loadu_si128((const __m128i *)aes->encrypt_keys[BLURAY_AES_ROUNDS]));
+
+	_mm_storeu_si128((__m128i *)out, x);
+
+}
+
+__attribute__((target("aes,sse2")))
+static void bluray_aes_ni_decrypt(const struct bluray_aes *aes, const uint8_t in[BLURAY_AES_BLOCK_SIZE], uint8_t out[BLURAY_AES_BLOCK_SIZE]) {
+
+	__m128i x = _mm_loadu_si128((const __m128i *)in);
+	uint8_t round = 0;
+
+	x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)aes->decrypt_keys[0]));
+	for(round = 1; round < BLURAY_AES_ROUNDS; round++)
+		x = _mm_aesdec_si128(x, _mm_loadu_si128((const __m128i *)aes->decrypt_keys[round]));
+	x = _mm_aesdeclast_si128(x, _mm_loadu_si128((const __m128i *)aes->decrypt_keys[BLURAY_AES_ROUNDS]));
+
+	_mm_storeu_si128((__m128i *)out, x);
+
+}
+
+/**
+ * CBC decryption, four blocks at a time so the AES unit's pipeline stays
+ * full, then one at a time for what's left
+ */
+__attribute__((target("aes,sse2")))
+static void bluray_aes_ni_cbc_decrypt(const struct bluray_aes *aes, const uint8_t iv[BLURAY_AES_BLOCK_SIZE], uint8_t *data, size_t length) {
+
+	__m128i keys[BLURAY_AES_ROUNDS + 1];
+	__m128i prev = _mm_loadu_si128((const __m128i *)iv);
+	__m128i c0, c1, c2, c3;
+	__m128i x0, x1, x2, x3;
+	__m128i *block = (__m128i *)data;
+	size_t blocks = length / BLURAY_AES_BLOCK_SIZE;
+	size_t ix = 0;
+	uint8_t round = 0;
+
+	for(round = 0; round <= BLURAY_AES_ROUNDS; round++)
+		keys[round] = _mm_loadu_si128((const __m128i *)aes->decrypt_keys[round]);
+
+	for(ix = 0; ix + 4 <= blocks; ix += 4) {
+
+		c0 = _mm_loadu_si128(block + ix);
+		c1 = _mm_loadu_si128(block + ix + 1);
+		c2 = _mm_loadu_si128(block + ix + 2);
+		c3 = _mm_loadu_si128(block + ix + 3);
+
+		x0 = _mm_xor_si128(c0, keys[0]);
+		x1 = _mm_xor_si128(c1, keys[0]);
+		x2 = _mm_xor_si128(c2, keys[0]);
+		x3 = _mm_xor_si128(c3, keys[0]);
+
+		for(round = 1; round < BLURAY_AES_ROUNDS; round++) {
+			x0 = _mm_aesdec_si128(x0, keys[round]);
+			x1 = _mm_aesdec_si128(x1, keys[round]);
+			x2 = _mm_aesdec_si128(x2, keys[round]);
+			x3 = _mm_aesdec_si128(x3, keys[round]);
+		}
+
+		x0 = _mm_aesdeclast_si128(x0, keys[BLURAY_AES_ROUNDS]);
+		x1 = _mm_aesdeclast_si128(x1, keys[BLURAY_AES_ROUNDS]);
+		x2 = _mm_aesdeclast_si128(x2, keys[BLURAY_AES_ROUNDS]);
+		x3 = _mm_aesdeclast_si128(x3, keys[BLURAY_AES_ROUNDS]);
+
+		_mm_storeu_si128(block + ix, _mm_xor_si128(x0, prev));
+		_mm_storeu_si128(block + ix + 1, _mm_xor_si128(x1, c0));
+		_mm_storeu_si128(block + ix + 2, _mm_xor_si128(x2, c1));
+		_mm_storeu_si128(block + ix + 3, _mm_xor_si128(x3, c2));
+
+		prev = c3;
+
+	}
+
+	for(; ix < blocks; ix++) {
+
+		c0 = _mm_loadu_si128(block + ix);
+		x0 = _mm_xor_si128(c0, keys[0]);
+		for(round = 1; round < BLURAY_AES_ROUNDS; round++)
+			x0 = _mm_aesdec_si128(x0, keys[round]);
+		x0 = _mm_aesdeclast_si128(x0, keys[BLURAY_AES_ROUNDS]);
+		_mm_storeu_si128(block + ix, _mm_xor_si128(x0, prev));
+		prev = c0;
+
+	}
+
+}
+
+#endif
+
+bool bluray_aes_ni(void) {
+
+	pthread_once(&bluray_aes_once, bluray_aes_tables);
+
+	return bluray_aes_has_ni;
+
+}
+
+/**
+ * Expand the key for both directions. Decryption keys are for the equivalent
+ * inverse cipher (AESDEC): the encryption keys in reverse, with
+ * InvMixColumns applied to all but the first and last.
+ */
+void bluray_aes_init(struct bluray_aes *aes, const uint8_t key[BLURAY_AES_BLOCK_SIZE]) {
+
+	uint8_t *w = &aes->encrypt_keys[0][0];
+	uint8_t t[4];
+	uint8_t rcon = 1;
+	uint8_t tmp = 0;
+	uint8_t ix = 0;
+
+	pthread_once(&bluray_aes_once, bluray_aes_tables);
+
+	memcpy(w, key, BLURAY_AES_BLOCK_SIZE);
+
+	for(ix = 4; ix < 4 * (BLURAY_AES_ROUNDS + 1); ix++) {
+		memcpy(t, w + 4 * (ix - 1), 4);
+		if(ix % 4 == 0) {
+			tmp = t[0];
+			t[0] = bluray_aes_sbox[t[1]] ^ rcon;
+			t[1] = bluray_aes_sbox[t[2]];
+			t[2] = bluray_aes_sbox[t[3]];
+			t[3] = bluray_aes_sbox[tmp];
+			rcon = bluray_aes_xtime(rcon);
+		}
+		w[4 * ix] = w[4 * (ix - 4)] ^ t[0];
+		w[4 * ix + 1] = w[4 * (ix - 4) + 1] ^ t[1];
+		w[4 * ix + 2] = w[4 * (ix - 4) + 2] ^ t[2];
+		w[4 * ix + 3] = w[4 * (ix - 4) + 3] ^ t[3];
+	}
+
+	for(ix = 0; ix <= BLURAY_AES_ROUNDS; ix++) {
+		memcpy(aes->decrypt_keys[ix], aes->encrypt_keys[BLURAY_AES_ROUNDS - ix], BLURAY_AES_BLOCK_SIZE);
+		if(ix > 0 && ix < BLURAY_AES_ROUNDS)
+			bluray_aes_inv_mix_columns(aes->decrypt_keys[ix]);
+	}
+
+	aes->aes_ni = bluray_aes_has_ni;
+
+}
+
+void bluray_aes_encrypt(const struct bluray_aes *aes, const uint8_t in[BLURAY_AES_BLOCK_SIZE], uint8_t out[BLURAY_AES_BLOCK_SIZE]) {
+
+	uint8_t s[BLURAY_AES_BLOCK_SIZE];
+	uint8_t r[BLURAY_AES_BLOCK_SIZE];
+	uint8_t a[4];
+	uint8_t round = 0;
+	uint8_t row = 0;
+	uint8_t c = 0;
+
+#ifdef BLURAY_AES_NI
+	if(aes->aes_ni) {
+		bluray_aes_ni_encrypt(aes, in, out);
+		return;
+	}
+#endif
+
+	memcpy(s, in, BLURAY_AES_BLOCK_SIZE);
+	bluray_aes_add_round_key(s, aes->encrypt_keys[0]);
+
+	for(round = 1; round <= BLURAY_AES_ROUNDS; round++) {
+
+		// SubBytes and ShiftRows
+		for(c = 0; c < 4; c++) {
+			for(row = 0; row < 4; row++)
+				r[row + 4 * c] = bluray_aes_sbox[s[row + 4 * ((c + row) % 4)]];
+		}
+
+		// MixColumns, except in the last round
+		if(round < BLURAY_AES_ROUNDS) {
+			for(c = 0; c < 4; c++) {
+				memcpy(a, r + 4 * c, 4);
+				r[4 * c] = bluray_aes_xtime(a[0] ^ a[1]) ^ a[1] ^ a[2] ^ a[3];
+				r[4 * c + 1] = bluray_aes_xtime(a[1] ^ a[2]) ^ a[2] ^ a[3] ^ a[0];
+				r[4 * c + 2] = bluray_aes_xtime(a[2] ^ a[3]) ^ a[3] ^ a[0] ^ a[1];
+				r[4 * c + 3] = bluray_aes_xtime(a[3] ^ a[0]) ^ a[0] ^ a[1] ^ a[2];
+			}
+		}
+
+		bluray_aes_add_round_key(r, aes->encrypt_keys[round]);
+		memcpy(s, r, BLURAY_AES_BLOCK_SIZE);
+
+	}
+
+	memcpy(out, s, BLURAY_AES_BLOCK_SIZE);
+
+}
+
+void bluray_aes_decrypt(const struct bluray_aes *aes, const uint8_t in[BLURAY_AES_BLOCK_SIZE], uint8_t out[BLURAY_AES_BLOCK_SIZE]) {
+
+	uint8_t s[BLURAY_AES_BLOCK_SIZE];
+	uint8_t r[BLURAY_AES_BLOCK_SIZE];
+	uint8_t round = 0;
+	uint8_t row = 0;
+	uint8_t c = 0;
+
+#ifdef BLURAY_AES_NI
+	if(aes->aes_ni) {
+		bluray_aes_ni_decrypt(aes, in, out);
+		return;
+	}
+#endif
+
+	memcpy(s, in, BLURAY_AES_BLOCK_SIZE);
+	bluray_aes_add_round_key(s, aes->encrypt_keys[BLURAY_AES_ROUNDS]);
+
+	for(round = BLURAY_AES_ROUNDS; round > 0; round--) {
+
+		// InvShiftRows and InvSubBytes
+		for(c = 0; c < 4; c++) {
+			for(row = 0; row < 4; row++)
+				r[row + 4 * c] = bluray_aes_inv_sbox[s[row + 4 * ((c + 4 - row) % 4)]];
+		}
+
+		bluray_aes_add_round_key(r, aes->encrypt_keys[round - 1]);
+
+		// InvMixColumns, except in the last round
+		if(round > 1)
+			bluray_aes_inv_mix_columns(r);
+
+		memcpy(s, r, BLURAY_AES_BLOCK_SIZE);
+
+	}
+
+	memcpy(out, s, BLURAY_AES_BLOCK_SIZE);
+
+}
+
+/**
+ * Decrypt data in place. length is a multiple of BLURAY_AES_BLOCK_SIZE; any
+ * bytes past the last whole block are left alone.
+ */
+void bluray_aes_cbc_decrypt(const struct bluray_aes *aes, const uint8_t iv[BLURAY_AES_BLOCK_SIZE], uint8_t *data, size_t length) {
+
+	uint8_t prev[BLURAY_AES_BLOCK_SIZE];
+	uint8_t cipher[BLURAY_AES_BLOCK_SIZE];
+	size_t offset = 0;
+
+#ifdef BLURAY_AES_NI
+	if(aes->aes_ni) {
+		bluray_aes_ni_cbc_decrypt(aes, iv, data, length);
+		return;
+	}
+#endif
+
+	memcpy(prev, iv, BLURAY_AES_BLOCK_SIZE);
+
+	for(offset = 0; offset + BLURAY_AES_BLOCK_SIZE <= length; offset += BLURAY_AES_BLOCK_SIZE) {
+		memcpy(cipher, data + offset, BLURAY_AES_BLOCK_SIZE);
+		bluray_aes_decrypt(aes, cipher, data + offset);
+		bluray_aes_add_round_key(data + offset, prev);
+		memcpy(prev, cipher, BLURAY_AES_BLOCK_SIZE);
+	}
+
+}
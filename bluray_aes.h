@@ -0,0 +1,37 @@
+#ifndef BLURAY_INFO_AES_H
+#define BLURAY_INFO_AES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * AES-128 (FIPS 197), for decrypting AACS aligned units
+ *
+ * AACS only needs a block encryption, to make each unit's key, and CBC
+ * decryption of the rest of the unit. Where the CPU has AES-NI, both use it,
+ * and CBC decryption works on several blocks at a time, since each block only
+ * depends on its own ciphertext and the one before. Elsewhere, it's done a
+ * byte at a time.
+ */
+
+#define BLURAY_AES_BLOCK_SIZE 16
+#define BLURAY_AES_ROUNDS 10
+
+struct bluray_aes {
+	uint8_t encrypt_keys[BLURAY_AES_ROUNDS + 1][BLURAY_AES_BLOCK_SIZE];
+	uint8_t decrypt_keys[BLURAY_AES_ROUNDS + 1][BLURAY_AES_BLOCK_SIZE];
+	bool aes_ni;
+};
+
+bool bluray_aes_ni(void);
+
+void bluray_aes_init(struct bluray_aes *aes, const uint8_t key[BLURAY_AES_BLOCK_SIZE]);
+
+void bluray_aes_encrypt(const struct bluray_aes *aes, const uint8_t in[BLURAY_AES_BLOCK_SIZE], uint8_t out[BLURAY_AES_BLOCK_SIZE]);
+
+void bluray_aes_decrypt(const struct bluray_aes *aes, const uint8_t in[BLURAY_AES_BLOCK_SIZE], uint8_t out[BLURAY_AES_BLOCK_SIZE]);
+
+void bluray_aes_cbc_decrypt(const struct bluray_aes *aes, const uint8_t iv[BLURAY_AES_BLOCK_SIZE], uint8_t *data, size_t length);
+
+#endif
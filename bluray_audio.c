@@ -167,3 +167,23 @@ void bluray_audio_rate(char *str, uint8_t rate) {
 	}
 
 }
+
+/**
+ * Fill in everything displayed about an audio stream, with libbluray's codes
+ * for its enumerated values along with their names
+ */
+void bluray_audio_stream(struct bluray_handle_audio *audio, const BLURAY_STREAM_INFO *bd_stream) {
+
+	memset(audio, 0, sizeof(struct bluray_handle_audio));
+	audio->pid = bd_stream->pid;
+	audio->coding_type = bd_stream->coding_type;
+	bluray_audio_lang(audio->lang, (uint8_t *)bd_stream->lang);
+	bluray_audio_codec(audio->codec, bd_stream->coding_type);
+	bluray_audio_codec_name(audio->codec_name, bd_stream->coding_type);
+	bluray_audio_format(audio->format, bd_stream->format);
+	bluray_audio_rate(audio->rate, bd_stream->rate);
+	audio->secondary = bluray_audio_secondary_stream(bd_stream->coding_type);
+	audio->format_code = bd_stream->format;
+	audio->rate_code = bd_stream->rate;
+
+}
@@ -9,6 +9,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include "libbluray/bluray.h"
+#include "bluray_handle.h"
 
 struct bluray_audio {
 	char lang[BLURAY_INFO_AUDIO_LANG_STRLEN];
@@ -30,4 +31,6 @@ void bluray_audio_format(char *str, uint8_t aspect);
 
 void bluray_audio_rate(char *str, uint8_t rate);
 
+void bluray_audio_stream(struct bluray_handle_audio *audio, const BLURAY_STREAM_INFO *bd_stream);
+
 #endif
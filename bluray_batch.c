@@ -0,0 +1,502 @@
+#include <stdlib.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "bluray_batch.h"
+#include "bluray_handle.h"
+#include "bluray_report.h"
+
+void bluray_batch_init(struct bluray_batch *batch, const char *key_db_filename) {
+
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	batch->key_db_filename = key_db_filename;
+	batch->jobs = (cpus > 0 ? (uint32_t)cpus : 1);
+	batch->timeout = BLURAY_BATCH_TIMEOUT;
+	batch->paths = NULL;
+	batch->num_paths = 0;
+	batch->paths_size = 0;
+	batch->discs_ok = 0;
+	batch->discs_failed = 0;
+	batch->discs_timed_out = 0;
+	batch->record_cb = NULL;
+	batch->user_data = NULL;
+
+}
+
+void bluray_batch_free(struct bluray_batch *batch) {
+
+	size_t ix = 0;
+	for(ix = 0; ix < batch->num_paths; ix++)
+		free(batch->paths[ix]);
+
+	free(batch->paths);
+	batch->paths = NULL;
+	batch->num_paths = 0;
+	batch->paths_size = 0;
+
+}
+
+static int bluray_batch_add(struct bluray_batch *batch, const char *path) {
+
+	if(batch->num_paths == batch->paths_size) {
+		size_t size = (batch->paths_size ? batch->paths_size * 2 : 256);
+		char **paths = realloc(batch->paths, size * sizeof(char *));
+		if(paths == NULL)
+			return 1;
+		batch->paths = paths;
+		batch->paths_size = size;
+	}
+
+	batch->paths[batch->num_paths] = strdup(path);
+	if(batch->paths[batch->num_paths] == NULL)
+		return 1;
+	batch->num_paths++;
+
+	return 0;
+
+}
+
+static bool bluray_batch_iso(const char *filename) {
+
+	size_t length = strlen(filename);
+
+	return (length > 4 && strcasecmp(filename + length - 4, ".iso") == 0);
+
+}
+
+/**
+ * A directory is a disc if it has a BDMV/index.bdmv
+ */
+static bool bluray_batch_disc_dir(const char *dirname) {
+
+	char filename[PATH_MAX];
+	struct stat index_stat;
+
+	if(snprintf(filename, PATH_MAX, "%s/BDMV/index.bdmv", dirname) >= PATH_MAX)
+		return false;
+
+	return (stat(filename, &index_stat) == 0 && S_ISREG(index_stat.st_mode));
+
+}
+
+/**
+ * Look for discs under a directory. Symbolic links are not followed, and
+ * disc folders are not searched any further.
+ */
+static int bluray_batch_walk(struct bluray_batch *batch, const char *dirname) {
+
+	if(bluray_batch_disc_dir(dirname))
+		return bluray_batch_add(batch, dirname);
+
+	DIR *dir = opendir(dirname);
+	if(dir == NULL) {
+		fprintf(stderr, "Could not open directory %s: %s\n", dirname, strerror(errno));
+		return 0;
+	}
+
+	int retval = 0;
+	struct dirent *entry = NULL;
+	struct stat entry_stat;
+	char filename[PATH_MAX];
+
+	while(retval == 0 && (entry = readdir(dir)) != NULL) {
+
+		if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			continue;
+
+		if(snprintf(filename, PATH_MAX, "%s/%s", dirname, entry->d_name) >= PATH_MAX)
+			continue;
+
+		if(lstat(filename, &entry_stat))
+			continue;
+
+		if(S_ISDIR(entry_stat.st_mode))
+			retval = bluray_batch_walk(batch, filename);
+		else if(S_ISREG(entry_stat.st_mode) && bluray_batch_iso(entry->d_name))
+			retval = bluray_batch_add(batch, filename);
+
+	}
+
+	closedir(dir);
+
+	return retval;
+
+}
+
+static int bluray_batch_compare(const void *a, const void *b) {
+
+	return strcmp(*(char * const *)a, *(char * const *)b);
+
+}
+
+/**
+ * Add the discs from a directory, or from a list file with one path per line.
+ * Blank lines and lines starting with # are skipped in list files.
+ */
+int bluray_batch_find(struct bluray_batch *batch, const char *source) {
+
+	struct stat source_stat;
+	if(stat(source, &source_stat)) {
+		fprintf(stderr, "Could not open %s: %s\n", source, strerror(errno));
+		return 1;
+	}
+
+	int retval = 0;
+
+	if(S_ISDIR(source_stat.st_mode)) {
+
+		// Trailing slashes would be doubled up in the paths
+		char dirname[PATH_MAX];
+		snprintf(dirname, PATH_MAX, "%s", source);
+		size_t length = strlen(dirname);
+		while(length > 1 && dirname[length - 1] == '/')
+			dirname[--length] = '\0';
+
+		retval = bluray_batch_walk(batch, dirname);
+
+	} else if(bluray_batch_iso(source)) {
+
+		retval = bluray_batch_add(batch, source);
+
+	} else {
+
+		FILE *list = fopen(source, "r");
+		if(list == NULL) {
+			fprintf(stderr, "Could not open %s: %s\n", source, strerror(errno));
+			return 1;
+		}
+
+		char line[PATH_MAX];
+		size_t length = 0;
+		while(retval == 0 && fgets(line, PATH_MAX, list) != NULL) {
+			length = strlen(line);
+			while(length && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+				line[--length] = '\0';
+			if(length == 0 || line[0] == '#')
+				continue;
+			retval = bluray_batch_add(batch, line);
+		}
+
+		fclose(list);
+
+	}
+
+	if(retval) {
+		fprintf(stderr, "Could not allocate memory for disc list\n");
+		return 1;
+	}
+
+	qsort(batch->paths, batch->num_paths, sizeof(char *), bluray_batch_compare);
+
+	return 0;
+
+}
+
+/**
+ * Scan one disc and write its record to fd. This runs in the child process.
+ */
+static int bluray_batch_disc(struct bluray_batch *batch, const char *path, int fd) {
+
+	struct bluray_json json;
+	if(bluray_json_init(&json, NULL, BLURAY_JSON_FORMAT_NDJSON))
+		return 1;
+
+	int retval = 0;
+	uint32_t title_ix = 0;
+	bluray_handle *handle = bluray_handle_open(path, batch->key_db_filename);
+	char id[BLURAY_REPORT_ID_STRLEN];
+
+	bluray_report_id(id, handle, path);
+
+	bluray_json_object_open(&json, NULL);
+	bluray_json_string(&json, "id", id);
+	bluray_json_string(&json, "path", path);
+
+	if(handle == NULL) {
+		bluray_report_error(&json, "could not open disc");
+		retval = 1;
+	} else {
+		bluray_report_disc(&json, handle);
+		bluray_json_array_open(&json, "titles");
+		for(title_ix = 0; title_ix < bluray_handle_titles(handle); title_ix++)
+			bluray_report_title(&json, handle, title_ix, true);
+		bluray_json_array_close(&json);
+		bluray_handle_close(handle);
+	}
+
+	bluray_json_object_close(&json);
+	bluray_json_end(&json);
+
+	char *buffer = json.buffer;
+	size_t length = json.length;
+	ssize_t written = 0;
+	while(length > 0) {
+		written = write(fd, buffer, length);
+		if(written < 0 && errno == EINTR)
+			continue;
+		if(written <= 0) {
+			retval = 1;
+			break;
+		}
+		buffer += written;
+		length -= (size_t)written;
+	}
+
+	bluray_json_free(&json);
+
+	return retval;
+
+}
+
+static int bluray_batch_start(struct bluray_batch *batch, struct bluray_batch_job *job, size_t path_ix, FILE *io) {
+
+	int fds[2];
+	if(pipe(fds))
+		return 1;
+
+	// Anything still buffered would be written out a second time by the child
+	fflush(io);
+
+	pid_t pid = fork();
+	if(pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return 1;
+	}
+
+	if(pid == 0) {
+		close(fds[0]);
+		_exit(bluray_batch_disc(batch, batch->paths[path_ix], fds[1]));
+	}
+
+	close(fds[1]);
+
+	job->pid = pid;
+	job->fd = fds[0];
+	job->path_ix = path_ix;
+	job->started = time(NULL);
+	job->timed_out = false;
+	job->too_large = false;
+	job->length = 0;
+
+	return 0;
+
+}
+
+/**
+ * Pass a record on to the callback, or write it out
+ */
+static void bluray_batch_record(struct bluray_batch *batch, size_t path_ix, const char *record, size_t length, FILE *io) {
+
+	if(batch->record_cb != NULL) {
+		batch->record_cb(batch->paths[path_ix], record, length, batch->user_data);
+		return;
+	}
+
+	fwrite(record, 1, length, io);
+	fflush(io);
+
+}
+
+/**
+ * Reap a child and send on its record, or an error record if it didn't
+ * send a complete one
+ */
+static void bluray_batch_finish(struct bluray_batch *batch, struct bluray_batch_job *job, FILE *io) {
+
+	int status = 0;
+
+	close(job->fd);
+	job->fd = -1;
+	while(waitpid(job->pid, &status, 0) < 0 && errno == EINTR);
+	job->pid = 0;
+
+	bool complete = (!job->timed_out && !job->too_large && job->length > 0 && job->buffer[job->length - 1] == '\n');
+
+	if(complete) {
+		if(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+			batch->discs_ok++;
+		else
+			batch->discs_failed++;
+		bluray_batch_record(batch, job->path_ix, job->buffer, job->length, io);
+		return;
+	}
+
+	char error[64];
+	if(job->timed_out) {
+		snprintf(error, sizeof(error), "timed out after %u seconds", batch->timeout);
+		batch->discs_timed_out++;
+	} else if(job->too_large) {
+		snprintf(error, sizeof(error), "record too large");
+		batch->discs_failed++;
+	} else if(WIFSIGNALED(status)) {
+		snprintf(error, sizeof(error), "crashed with signal %d", WTERMSIG(status));
+		batch->discs_failed++;
+	} else {
+		snprintf(error, sizeof(error), "incomplete record");
+		batch->discs_failed++;
+	}
+
+	const char *path = batch->paths[job->path_ix];
+	struct bluray_json json;
+	if(bluray_json_init(&json, NULL, BLURAY_JSON_FORMAT_NDJSON) == 0) {
+		bluray_json_object_open(&json, NULL);
+		bluray_json_string(&json, "id", path);
+		bluray_json_string(&json, "path", path);
+		bluray_report_error(&json, error);
+		bluray_json_object_close(&json);
+		bluray_json_end(&json);
+		bluray_batch_record(batch, job->path_ix, json.buffer, json.length, io);
+	}
+	bluray_json_free(&json);
+
+}
+
+/**
+ * Read what a child has sent so far. Returns 1 once it has hung up.
+ */
+static int bluray_batch_read(struct bluray_batch_job *job) {
+
+	if(job->size - job->length < 4096) {
+		size_t size = (job->size ? job->size * 2 : 65536);
+		char *buffer = NULL;
+		if(size > BLURAY_BATCH_RECORD_MAX || (buffer = realloc(job->buffer, size)) == NULL) {
+			// Too big to keep; drop it and report that, not the kill
+			job->too_large = true;
+			kill(job->pid, SIGKILL);
+			job->length = 0;
+			return 1;
+		}
+		job->buffer = buffer;
+		job->size = size;
+	}
+
+	ssize_t bytes_read = read(job->fd, job->buffer + job->length, job->size - job->length);
+
+	if(bytes_read < 0 && (errno == EINTR || errno == EAGAIN))
+		return 0;
+
+	if(bytes_read <= 0)
+		return 1;
+
+	job->length += (size_t)bytes_read;
+
+	return 0;
+
+}
+
+/**
+ * Scan all the discs found, writing one record per disc to io, or passing it
+ * to record_cb if it's set, then display a summary on stderr
+ */
+int bluray_batch_run(struct bluray_batch *batch, FILE *io) {
+
+	if(batch->jobs == 0)
+		batch->jobs = 1;
+
+	struct bluray_batch_job *jobs = calloc(batch->jobs, sizeof(struct bluray_batch_job));
+	struct pollfd *pollfds = calloc(batch->jobs, sizeof(struct pollfd));
+	if(jobs == NULL || pollfds == NULL) {
+		free(jobs);
+		free(pollfds);
+		fprintf(stderr, "Could not allocate memory for batch jobs\n");
+		return 1;
+	}
+
+	uint32_t ix = 0;
+	for(ix = 0; ix < batch->jobs; ix++)
+		jobs[ix].fd = -1;
+
+	struct timespec start_time;
+	struct timespec end_time;
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+	size_t next_path_ix = 0;
+	uint32_t running = 0;
+	nfds_t num_pollfds = 0;
+	time_t now = 0;
+	int retval = 0;
+
+	while(next_path_ix < batch->num_paths || running > 0) {
+
+		// Fill the free slots
+		for(ix = 0; ix < batch->jobs && next_path_ix < batch->num_paths; ix++) {
+			if(jobs[ix].fd != -1)
+				continue;
+			if(bluray_batch_start(batch, &jobs[ix], next_path_ix, io)) {
+				fprintf(stderr, "Could not start job for %s: %s\n", batch->paths[next_path_ix], strerror(errno));
+				retval = 1;
+				break;
+			}
+			next_path_ix++;
+			running++;
+		}
+
+		if(retval && running == 0)
+			break;
+
+		num_pollfds = 0;
+		for(ix = 0; ix < batch->jobs; ix++) {
+			pollfds[ix].fd = jobs[ix].fd;
+			pollfds[ix].events = POLLIN;
+			pollfds[ix].revents = 0;
+			if(jobs[ix].fd != -1)
+				num_pollfds = ix + 1;
+		}
+
+		if(poll(pollfds, num_pollfds, 1000) < 0 && errno != EINTR)
+			break;
+
+		now = time(NULL);
+
+		for(ix = 0; ix < num_pollfds; ix++) {
+
+			if(jobs[ix].fd == -1)
+				continue;
+
+			if(pollfds[ix].revents && bluray_batch_read(&jobs[ix])) {
+				bluray_batch_finish(batch, &jobs[ix], io);
+				running--;
+				continue;
+			}
+
+			// Its pipe is closed once it has been killed, and finished above
+			if(!jobs[ix].timed_out && now - jobs[ix].started >= (time_t)batch->timeout) {
+				kill(jobs[ix].pid, SIGKILL);
+				jobs[ix].timed_out = true;
+			}
+
+		}
+
+		if(retval)
+			next_path_ix = batch->num_paths;
+
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end_time);
+	double seconds = (double)(end_time.tv_sec - start_time.tv_sec) + (double)(end_time.tv_nsec - start_time.tv_nsec) / 1000000000;
+	uint64_t discs = batch->discs_ok + batch->discs_failed + batch->discs_timed_out;
+
+	fprintf(stderr, "Scanned %" PRIu64 " discs in %.2f seconds (%.2f discs/sec, %" PRIu32 " jobs): %" PRIu64 " ok, %" PRIu64 " failed, %" PRIu64 " timed out\n", discs, seconds, (seconds > 0 ? discs / seconds : 0), batch->jobs, batch->discs_ok, batch->discs_failed, batch->discs_timed_out);
+
+	for(ix = 0; ix < batch->jobs; ix++)
+		free(jobs[ix].buffer);
+	free(jobs);
+	free(pollfds);
+
+	if(retval || batch->discs_failed || batch->discs_timed_out)
+		return 1;
+
+	return 0;
+
+}
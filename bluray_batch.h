@@ -0,0 +1,69 @@
+#ifndef BLURAY_INFO_BATCH_H
+#define BLURAY_INFO_BATCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "bluray_json.h"
+
+/**
+ * bluray_info --batch: scan a library of discs
+ *
+ * The source is either a directory, which is searched for ISO files and
+ * folders with a BDMV/index.bdmv, or a file listing one disc path per line.
+ *
+ * Each disc is scanned in a child process, with up to jobs running at once.
+ * A disc that hangs or crashes libbluray only takes down its own child: it is
+ * killed after timeout seconds and reported as an error, and the rest of the
+ * scan carries on. Each child sends back one NDJSON record, which is written
+ * out as soon as it's complete, so records are in the order discs finish.
+ *
+ * Records start with an "id" key identifying the disc (see bluray_report_id())
+ * followed by its "path", which --watch relies on to read its index back.
+ */
+
+#define BLURAY_BATCH_TIMEOUT 120
+#define BLURAY_BATCH_RECORD_MAX 16777216
+
+struct bluray_batch_job {
+	pid_t pid;
+	int fd;
+	size_t path_ix;
+	time_t started;
+	bool timed_out;
+	bool too_large;
+	char *buffer;
+	size_t length;
+	size_t size;
+};
+
+/**
+ * Receives each record, a complete line of NDJSON, instead of it being written out
+ */
+typedef void (*bluray_batch_record_cb)(const char *path, const char *record, size_t length, void *user_data);
+
+struct bluray_batch {
+	const char *key_db_filename;
+	uint32_t jobs;
+	uint32_t timeout;
+	char **paths;
+	size_t num_paths;
+	size_t paths_size;
+	uint64_t discs_ok;
+	uint64_t discs_failed;
+	uint64_t discs_timed_out;
+	bluray_batch_record_cb record_cb;
+	void *user_data;
+};
+
+void bluray_batch_init(struct bluray_batch *batch, const char *key_db_filename);
+
+void bluray_batch_free(struct bluray_batch *batch);
+
+int bluray_batch_find(struct bluray_batch *batch, const char *source);
+
+int bluray_batch_run(struct bluray_batch *batch, FILE *io);
+
+#endif
@@ -0,0 +1,971 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bluray_bdmv.h"
+#include "bluray_trace.h"
+
+/**
+ * A file's contents: a mapping of the file in a disc directory, or a pointer
+ * into the image, which is only copied when it's not in one piece
+ */
+struct bluray_bdmv_file {
+	const uint8_t *data;
+	size_t length;
+	void *map;
+	uint8_t *copy;
+};
+
+static int bluray_bdmv_read(struct bluray_bdmv *bdmv, const char *filename, struct bluray_bdmv_file *file) {
+
+	memset(file, 0, sizeof(struct bluray_bdmv_file));
+
+	if(bdmv->image != NULL)
+		return bluray_udf_file(&bdmv->udf, filename, &file->data, &file->length, &file->copy);
+
+	char path[PATH_MAX];
+	if(snprintf(path, PATH_MAX, "%s/%s", bdmv->dirname, filename) >= PATH_MAX)
+		return 1;
+
+	int fd = open(path, O_RDONLY);
+	if(fd == -1)
+		return 1;
+
+	struct stat st;
+	if(fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		close(fd);
+		return 1;
+	}
+
+	void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+		return 1;
+
+	file->map = map;
+	file->data = map;
+	file->length = (size_t)st.st_size;
+
+	return 0;
+
+}
+
+static void bluray_bdmv_release(struct bluray_bdmv_file *file) {
+
+	if(file->map != NULL)
+		munmap(file->map, file->length);
+	free(file->copy);
+
+	file->map = NULL;
+	file->copy = NULL;
+	file->data = NULL;
+
+}
+
+static void bluray_bdmv_free_list(char **names, size_t num_names) {
+
+	size_t ix = 0;
+	for(ix = 0; ix < num_names; ix++)
+		free(names[ix]);
+
+	free(names);
+
+}
+
+/**
+ * List a directory, in the same order as libbluray does: as readdir() returns
+ * them, or as they are recorded in the image
+ */
+static int bluray_bdmv_list(struct bluray_bdmv *bdmv, const char *dirname, char ***names, size_t *num_names) {
+
+	if(bdmv->image != NULL)
+		return bluray_udf_dir(&bdmv->udf, dirname, names, num_names);
+
+	*names = NULL;
+	*num_names = 0;
+
+	char path[PATH_MAX];
+	if(snprintf(path, PATH_MAX, "%s/%s", bdmv->dirname, dirname) >= PATH_MAX)
+		return 1;
+
+	DIR *dir = opendir(path);
+	if(dir == NULL)
+		return 1;
+
+	struct dirent *entry = NULL;
+	size_t size = 0;
+	char **p = NULL;
+	int retval = 0;
+
+	while((entry = readdir(dir)) != NULL) {
+
+		if(*num_names == size) {
+			size = (size ? size * 2 : 64);
+			p = realloc(*names, size * sizeof(char *));
+			if(p == NULL) {
+				retval = 1;
+				break;
+			}
+			*names = p;
+		}
+
+		(*names)[*num_names] = strdup(entry->d_name);
+		if((*names)[*num_names] == NULL) {
+			retval = 1;
+			break;
+		}
+		(*num_names)++;
+
+	}
+
+	closedir(dir);
+
+	if(retval) {
+		bluray_bdmv_free_list(*names, *num_names);
+		*names = NULL;
+		*num_names = 0;
+	}
+
+	return retval;
+
+}
+
+/**
+ * Parse a file in BDMV, falling back to the copy in BDMV/BACKUP like libbluray
+ * does when it's damaged
+ */
+static int bluray_bdmv_parse(struct bluray_bdmv *bdmv, const char *dirname, const char *filename, void *parsed, int (*parse)(void *parsed, const uint8_t *data, size_t length)) {
+
+	char path[PATH_MAX];
+	struct bluray_bdmv_file file;
+	int retval = 1;
+	uint8_t backup = 0;
+
+	for(backup = 0; backup < 2 && retval; backup++) {
+
+		if(snprintf(path, PATH_MAX, "BDMV/%s%s/%s", (backup ? "BACKUP/" : ""), dirname, filename) >= PATH_MAX)
+			return 1;
+
+		if(bluray_bdmv_read(bdmv, path, &file))
+			continue;
+
+		retval = parse(parsed, file.data, file.length);
+		bluray_bdmv_release(&file);
+
+	}
+
+	return retval;
+
+}
+
+static int bluray_bdmv_parse_mpls(void *parsed, const uint8_t *data, size_t length) {
+
+	return bluray_mpls_parse(parsed, data, length);
+
+}
+
+static int bluray_bdmv_parse_clpi(void *parsed, const uint8_t *data, size_t length) {
+
+	return bluray_clpi_parse(parsed, data, length);
+
+}
+
+/**
+ * Get a clip's info, parsing it the first time it's used. Clips that can't be
+ * read are remembered as well, and return NULL. The list is kept with the
+ * most recently used clip last, and the info stays where it is until
+ * bluray_bdmv_trim_clips() drops it.
+ */
+static const struct bluray_clpi *bluray_bdmv_clpi(struct bluray_bdmv *bdmv, const char *clip_id) {
+
+	struct bluray_bdmv_clip *found = NULL;
+	size_t ix = 0;
+	for(ix = 0; ix < bdmv->num_clips; ix++) {
+		if(strcmp(bdmv->clips[ix]->clip_id, clip_id) == 0) {
+			found = bdmv->clips[ix];
+			memmove(bdmv->clips + ix, bdmv->clips + ix + 1, (bdmv->num_clips - ix - 1) * sizeof(struct bluray_bdmv_clip *));
+			bdmv->clips[bdmv->num_clips - 1] = found;
+			return (found->valid ? &found->clpi : NULL);
+		}
+	}
+
+	if(bdmv->num_clips == bdmv->clips_size) {
+		size_t size = (bdmv->clips_size ? bdmv->clips_size * 2 : 64);
+		struct bluray_bdmv_clip **clips = realloc(bdmv->clips, size * sizeof(struct bluray_bdmv_clip *));
+		if(clips == NULL)
+			return NULL;
+		bdmv->clips = clips;
+		bdmv->clips_size = size;
+	}
+
+	struct bluray_bdmv_clip *clip = malloc(sizeof(struct bluray_bdmv_clip));
+	if(clip == NULL)
+		return NULL;
+
+	char filename[16];
+	snprintf(clip->clip_id, sizeof(clip->clip_id), "%s", clip_id);
+	snprintf(filename, sizeof(filename), "%s.clpi", clip_id);
+	clip->valid = (bluray_bdmv_parse(bdmv, "CLIPINF", filename, &clip->clpi, bluray_bdmv_parse_clpi) == 0);
+	bdmv->clips[bdmv->num_clips++] = clip;
+
+	return (clip->valid ? &clip->clpi : NULL);
+
+}
+
+static void bluray_bdmv_free_clip(struct bluray_bdmv_clip *clip) {
+
+	if(clip->valid)
+		bluray_clpi_free(&clip->clpi);
+	free(clip);
+
+}
+
+/**
+ * Drop the least recently used clips' info, so no more than
+ * BLURAY_BDMV_CLIPS_MAX are kept whatever the number of titles. This is only
+ * done before a title is looked at, since its items keep pointers to the info
+ * until it's finished with.
+ */
+static void bluray_bdmv_trim_clips(struct bluray_bdmv *bdmv) {
+
+	if(bdmv->num_clips <= BLURAY_BDMV_CLIPS_MAX)
+		return;
+
+	size_t drop = bdmv->num_clips - BLURAY_BDMV_CLIPS_MAX;
+	size_t ix = 0;
+	for(ix = 0; ix < drop; ix++)
+		bluray_bdmv_free_clip(bdmv->clips[ix]);
+
+	memmove(bdmv->clips, bdmv->clips + drop, BLURAY_BDMV_CLIPS_MAX * sizeof(struct bluray_bdmv_clip *));
+	bdmv->num_clips = BLURAY_BDMV_CLIPS_MAX;
+
+}
+
+/**
+ * Play items are the same if they play the same part of the same clip
+ */
+static bool bluray_bdmv_same_item(const struct bluray_mpls_item *a, const struct bluray_mpls_item *b) {
+
+	return (strcmp(a->clips[0].clip_id, b->clips[0].clip_id) == 0 && a->in_time == b->in_time && a->out_time == b->out_time);
+
+}
+
+/**
+ * Playlists are duplicates if they have the same play items and marks
+ */
+static bool bluray_bdmv_same_playlist(const struct bluray_mpls *a, const struct bluray_mpls *b) {
+
+	if(a->num_items != b->num_items || a->num_marks != b->num_marks || a->num_sub_paths != b->num_sub_paths)
+		return false;
+
+	uint16_t ix = 0;
+	for(ix = 0; ix < a->num_marks; ix++) {
+		if(a->marks[ix].mark_type != b->marks[ix].mark_type || a->marks[ix].item_ref != b->marks[ix].item_ref || a->marks[ix].time != b->marks[ix].time)
+			return false;
+	}
+
+	for(ix = 0; ix < a->num_items; ix++) {
+		if(!bluray_bdmv_same_item(&a->items[ix], &b->items[ix]))
+			return false;
+	}
+
+	return true;
+
+}
+
+/**
+ * Whether a playlist plays any item more than repeats times
+ */
+static bool bluray_bdmv_repeats(const struct bluray_mpls *mpls, uint32_t repeats) {
+
+	uint16_t ix = 0;
+	uint16_t other_ix = 0;
+	uint32_t count = 0;
+
+	for(ix = 0; ix < mpls->num_items; ix++) {
+		count = 0;
+		for(other_ix = ix; other_ix < mpls->num_items; other_ix++) {
+			if(bluray_bdmv_same_item(&mpls->items[ix], &mpls->items[other_ix]))
+				count++;
+		}
+		if(count > repeats)
+			return true;
+	}
+
+	return false;
+
+}
+
+/**
+ * Build the title list from the playlists, the same way libbluray does for
+ * bd_get_titles(bd, TITLES_RELEVANT, 0)
+ */
+static int bluray_bdmv_titles(struct bluray_bdmv *bdmv) {
+
+	char **names = NULL;
+	size_t num_names = 0;
+
+	if(bluray_bdmv_list(bdmv, "BDMV/PLAYLIST", &names, &num_names))
+		return 1;
+
+	bdmv->titles = calloc(num_names ? num_names : 1, sizeof(struct bluray_bdmv_title));
+	if(bdmv->titles == NULL) {
+		bluray_bdmv_free_list(names, num_names);
+		return 1;
+	}
+
+	size_t ix = 0;
+	uint32_t title_ix = 0;
+	uint16_t item_ix = 0;
+	bool duplicate = false;
+	struct bluray_bdmv_title *title = NULL;
+
+	for(ix = 0; ix < num_names; ix++) {
+
+		if(names[ix][0] == '.')
+			continue;
+
+		title = &bdmv->titles[bdmv->num_titles];
+		if(bluray_bdmv_parse(bdmv, "PLAYLIST", names[ix], &title->mpls, bluray_bdmv_parse_mpls))
+			continue;
+
+		duplicate = false;
+		for(title_ix = 0; title_ix < bdmv->num_titles && !duplicate; title_ix++)
+			duplicate = bluray_bdmv_same_playlist(&title->mpls, &bdmv->titles[title_ix].mpls);
+
+		if(duplicate || bluray_bdmv_repeats(&title->mpls, 2)) {
+			bluray_mpls_free(&title->mpls);
+			continue;
+		}
+
+		snprintf(title->filename, sizeof(title->filename), "%s", names[ix]);
+		title->playlist = (uint32_t)strtoul(names[ix], NULL, 10);
+		title->duration = 0;
+		for(item_ix = 0; item_ix < title->mpls.num_items; item_ix++)
+			title->duration += (uint32_t)(title->mpls.items[item_ix].out_time - title->mpls.items[item_ix].in_time);
+		title->duration *= 2;
+
+		bdmv->num_titles++;
+
+	}
+
+	bluray_bdmv_free_list(names, num_names);
+
+	return 0;
+
+}
+
+/**
+ * Open a disc directory or image for reading files from. Anything else, like a
+ * device, is left to libbluray.
+ */
+static int bluray_bdmv_mount(struct bluray_bdmv *bdmv, const char *path) {
+
+	memset(bdmv, 0, sizeof(struct bluray_bdmv));
+
+	struct stat st;
+	if(stat(path, &st) == -1)
+		return 1;
+
+	if(S_ISDIR(st.st_mode)) {
+
+		bdmv->dirname = strdup(path);
+		if(bdmv->dirname == NULL)
+			return 1;
+
+	} else if(S_ISREG(st.st_mode) && st.st_size > 0) {
+
+		int fd = open(path, O_RDONLY);
+		if(fd == -1)
+			return 1;
+
+		void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if(map == MAP_FAILED)
+			return 1;
+
+		bdmv->image = map;
+		bdmv->image_size = (size_t)st.st_size;
+
+		if(bluray_udf_open(&bdmv->udf, bdmv->image, bdmv->image_size)) {
+			bluray_bdmv_close(bdmv);
+			return 1;
+		}
+
+	} else {
+		return 1;
+	}
+
+	return 0;
+
+}
+
+int bluray_bdmv_open(struct bluray_bdmv *bdmv, const char *path) {
+
+	if(bluray_bdmv_mount(bdmv, path))
+		return 1;
+
+	if(bluray_bdmv_titles(bdmv)) {
+		bluray_bdmv_close(bdmv);
+		return 1;
+	}
+
+	return 0;
+
+}
+
+void bluray_bdmv_close(struct bluray_bdmv *bdmv) {
+
+	uint32_t title_ix = 0;
+	for(title_ix = 0; title_ix < bdmv->num_titles; title_ix++)
+		bluray_mpls_free(&bdmv->titles[title_ix].mpls);
+
+	size_t clip_ix = 0;
+	for(clip_ix = 0; clip_ix < bdmv->num_clips; clip_ix++)
+		bluray_bdmv_free_clip(bdmv->clips[clip_ix]);
+
+	if(bdmv->image != NULL) {
+		bluray_udf_close(&bdmv->udf);
+		munmap(bdmv->image, bdmv->image_size);
+	}
+
+	free(bdmv->titles);
+	free(bdmv->clips);
+	free(bdmv->dirname);
+	memset(bdmv, 0, sizeof(struct bluray_bdmv));
+
+}
+
+static int bluray_bdmv_compare_names(const void *a, const void *b) {
+
+	return strcasecmp(*(char * const *)a, *(char * const *)b);
+
+}
+
+static bool bluray_bdmv_has_extension(const char *filename, const char *extension) {
+
+	size_t length = strlen(filename);
+	size_t extension_length = strlen(extension);
+
+	if(filename[0] == '.' || length <= extension_length)
+		return false;
+
+	return strcasecmp(filename + length - extension_length, extension) == 0;
+
+}
+
+/**
+ * Hash one file into the fingerprint: its name in upper case, its length and
+ * its contents, so that files can't run into each other
+ */
+static int bluray_bdmv_hash_file(struct bluray_bdmv *bdmv, struct bluray_sha256 *sha256, const char *dirname, const char *filename, bool required) {
+
+	char path[PATH_MAX];
+	struct bluray_bdmv_file file;
+	uint8_t header[8];
+	size_t ix = 0;
+
+	if(snprintf(path, PATH_MAX, "%s/%s", dirname, filename) >= PATH_MAX)
+		return 1;
+
+	if(bluray_bdmv_read(bdmv, path, &file))
+		return (required ? 1 : 0);
+
+	for(ix = 0; path[ix] != '\0'; ix++)
+		path[ix] = (char)toupper((unsigned char)path[ix]);
+	bluray_sha256_update(sha256, (const uint8_t *)path, ix + 1);
+
+	for(ix = 0; ix < 8; ix++)
+		header[ix] = (uint8_t)((uint64_t)file.length >> (56 - 8 * ix));
+	bluray_sha256_update(sha256, header, 8);
+
+	bluray_sha256_update(sha256, file.data, file.length);
+	bluray_bdmv_release(&file);
+
+	return 0;
+
+}
+
+static int bluray_bdmv_hash_dir(struct bluray_bdmv *bdmv, struct bluray_sha256 *sha256, const char *dirname, const char *extension) {
+
+	char **names = NULL;
+	size_t num_names = 0;
+	size_t ix = 0;
+	int retval = 0;
+
+	if(bluray_bdmv_list(bdmv, dirname, &names, &num_names))
+		return 1;
+
+	// Listing order differs between a directory and an image, the names don't
+	if(num_names)
+		qsort(names, num_names, sizeof(char *), bluray_bdmv_compare_names);
+
+	for(ix = 0; ix < num_names && retval == 0; ix++) {
+		if(bluray_bdmv_has_extension(names[ix], extension))
+			retval = bluray_bdmv_hash_file(bdmv, sha256, dirname, names[ix], true);
+	}
+
+	bluray_bdmv_free_list(names, num_names);
+
+	return retval;
+
+}
+
+/**
+ * Fingerprint a disc directory or image by hashing its navigation files:
+ * index.bdmv, MovieObject.bdmv and every playlist and clip info file, in name
+ * order. Stream files are never read, so this is a few MBs at most, and the
+ * result is the same for a disc and any copy of it.
+ */
+int bluray_bdmv_fingerprint(const char *path, uint8_t digest[BLURAY_SHA256_LENGTH]) {
+
+	struct bluray_bdmv bdmv;
+	struct bluray_sha256 sha256;
+	int retval = 0;
+
+	if(bluray_bdmv_mount(&bdmv, path))
+		return 1;
+
+	bluray_sha256_init(&sha256);
+
+	if(bluray_bdmv_hash_file(&bdmv, &sha256, "BDMV", "index.bdmv", true))
+		retval = 1;
+	else if(bluray_bdmv_hash_file(&bdmv, &sha256, "BDMV", "MovieObject.bdmv", false))
+		retval = 1;
+	else if(bluray_bdmv_hash_dir(&bdmv, &sha256, "BDMV/PLAYLIST", ".mpls"))
+		retval = 1;
+	else if(bluray_bdmv_hash_dir(&bdmv, &sha256, "BDMV/CLIPINF", ".clpi"))
+		retval = 1;
+
+	bluray_bdmv_close(&bdmv);
+
+	if(retval == 0)
+		bluray_sha256_final(&sha256, digest);
+
+	return retval;
+
+}
+
+/**
+ * Check that the title list is the same one libbluray has: the same number
+ * of titles, and each one the same playlist, in the same order, so every
+ * title number means the same title. It wouldn't be if libbluray reads the
+ * disc differently, like through a virtual package, or filters duplicate
+ * playlists differently.
+ */
+bool bluray_bdmv_matches(struct bluray_bdmv *bdmv, struct bluray *bd, uint32_t titles, uint32_t main_title) {
+
+	if(bdmv->num_titles != titles)
+		return false;
+
+	if(titles == 0)
+		return true;
+
+	if(main_title >= titles)
+		return false;
+
+	uint64_t trace_start = 0;
+	BLURAY_TITLE_INFO *bd_title = NULL;
+	bool matches = true;
+	uint32_t ix = 0;
+
+	for(ix = 0; matches && ix < titles; ix++) {
+
+		trace_start = bluray_trace_begin();
+		bd_title = bd_get_title_info(bd, ix, 0);
+		bluray_trace_end("bd_get_title_info", trace_start, ix, BLURAY_TRACE_NONE);
+
+		if(bd_title == NULL)
+			return false;
+
+		matches = (bd_title->playlist == bdmv->titles[ix].playlist);
+
+		bd_free_title_info(bd_title);
+
+	}
+
+	return matches;
+
+}
+
+/**
+ * Copy a play item's streams, with the aspect ratio from the clip info
+ */
+static int bluray_bdmv_streams(BLURAY_STREAM_INFO **streams, const struct bluray_mpls_stream *mpls_streams, uint8_t count, const struct bluray_clpi *clpi) {
+
+	*streams = NULL;
+
+	if(count == 0)
+		return 0;
+
+	*streams = calloc(count, sizeof(BLURAY_STREAM_INFO));
+	if(*streams == NULL)
+		return 1;
+
+	uint8_t ix = 0;
+	BLURAY_STREAM_INFO *stream = NULL;
+	for(ix = 0; ix < count; ix++) {
+		stream = &(*streams)[ix];
+		stream->coding_type = mpls_streams[ix].coding_type;
+		stream->format = mpls_streams[ix].format;
+		stream->rate = mpls_streams[ix].rate;
+		stream->char_code = mpls_streams[ix].char_code;
+		memcpy(stream->lang, mpls_streams[ix].lang, 4);
+		stream->pid = mpls_streams[ix].pid;
+		stream->aspect = (clpi != NULL ? bluray_clpi_aspect(clpi, mpls_streams[ix].pid) : 0);
+		if(mpls_streams[ix].stream_type == 2 || mpls_streams[ix].stream_type == 3)
+			stream->subpath_id = mpls_streams[ix].subpath_id;
+		else
+			stream->subpath_id = UINT8_MAX;
+	}
+
+	return 0;
+
+}
+
+/**
+ * Positions of a play item's clip, in source packets and ticks
+ */
+struct bluray_bdmv_position {
+	const struct bluray_clpi *clpi;
+	uint8_t stc_id;
+	uint32_t start_pkt;
+	uint32_t title_pkt;
+	uint32_t title_time;
+};
+
+/**
+ * Get the packets of a play item's clip that are played: from its in time,
+ * except for seamless connections, which carry on from the start of the clip,
+ * to its out time
+ */
+static void bluray_bdmv_item_packets(struct bluray_bdmv *bdmv, const struct bluray_mpls_item *item, uint8_t angle_ix, const struct bluray_clpi **clpi, uint32_t *start_pkt, uint32_t *end_pkt) {
+
+	const struct bluray_mpls_clip *clip = &item->clips[angle_ix < item->angle_count ? angle_ix : 0];
+
+	*clpi = bluray_bdmv_clpi(bdmv, clip->clip_id);
+	*start_pkt = 0;
+	*end_pkt = 0;
+
+	if(*clpi == NULL)
+		return;
+
+	if(item->connection_condition != 5 && item->connection_condition != 6 && item->in_time)
+		*start_pkt = bluray_clpi_spn(*clpi, item->in_time, true, clip->stc_id);
+	*end_pkt = bluray_clpi_spn(*clpi, item->out_time, false, clip->stc_id);
+
+}
+
+/**
+ * Fill in a mark's start, clip and offset. The offset is in the same packets
+ * as the title size, which is what bd_chapter_pos() returns.
+ */
+static void bluray_bdmv_mark(BLURAY_TITLE_MARK *mark, const struct bluray_mpls *mpls, const struct bluray_mpls_mark *mpls_mark, const struct bluray_bdmv_position *positions, uint32_t *title_time) {
+
+	mark->type = mpls_mark->mark_type;
+	mark->clip_ref = mpls_mark->item_ref;
+	mark->offset = 0;
+	*title_time = 0;
+
+	if(mpls_mark->item_ref >= mpls->num_items)
+		return;
+
+	const struct bluray_bdmv_position *position = &positions[mpls_mark->item_ref];
+	uint32_t clip_pkt = position->start_pkt;
+	if(position->clpi != NULL)
+		clip_pkt = bluray_clpi_spn(position->clpi, mpls_mark->time, true, position->stc_id);
+
+	mark->offset = (uint64_t)(uint32_t)(position->title_pkt + clip_pkt - position->start_pkt) * 192;
+	*title_time = position->title_time + mpls_mark->time - mpls->items[mpls_mark->item_ref].in_time;
+	mark->start = (uint64_t)*title_time * 2;
+
+}
+
+/**
+ * Mark durations run until the next one, or to the end of the title for the
+ * last one, unless the playlist sets one
+ */
+static void bluray_bdmv_durations(BLURAY_TITLE_MARK *marks, const uint32_t *times, const uint32_t *durations, uint32_t count, uint32_t title_duration) {
+
+	uint32_t ix = 0;
+	uint32_t prev_ix = UINT32_MAX;
+	uint32_t duration = 0;
+
+	for(ix = 0; ix < count; ix++) {
+		marks[ix].duration = 0;
+		if(durations[ix] != 0) {
+			marks[ix].duration = (uint64_t)durations[ix] * 2;
+		} else if(prev_ix != UINT32_MAX && times[prev_ix] < times[ix]) {
+			duration = times[ix] - times[prev_ix];
+			marks[prev_ix].duration = (uint64_t)duration * 2;
+		}
+		prev_ix = ix;
+	}
+
+	if(prev_ix != UINT32_MAX && marks[prev_ix].duration == 0) {
+		duration = title_duration - times[prev_ix];
+		marks[prev_ix].duration = (uint64_t)duration * 2;
+	}
+
+}
+
+/**
+ * Get a title's info, which is the same as bd_get_title_info() returns. Free
+ * it with bluray_bdmv_free_title_info().
+ */
+BLURAY_TITLE_INFO *bluray_bdmv_title_info(struct bluray_bdmv *bdmv, uint32_t title_ix, uint8_t angle_ix) {
+
+	if(title_ix >= bdmv->num_titles)
+		return NULL;
+
+	const struct bluray_mpls *mpls = &bdmv->titles[title_ix].mpls;
+
+	bluray_bdmv_trim_clips(bdmv);
+
+	BLURAY_TITLE_INFO *title_info = calloc(1, sizeof(BLURAY_TITLE_INFO));
+	if(title_info == NULL)
+		return NULL;
+
+	title_info->idx = title_ix;
+	title_info->playlist = bdmv->titles[title_ix].playlist;
+	title_info->mvc_base_view_r_flag = mpls->mvc_base_view_r_flag;
+	title_info->clip_count = mpls->num_items;
+	title_info->angle_count = 0;
+
+	struct bluray_bdmv_position *positions = calloc(mpls->num_items ? mpls->num_items : 1, sizeof(struct bluray_bdmv_position));
+	if(mpls->num_items)
+		title_info->clips = calloc(mpls->num_items, sizeof(BLURAY_CLIP_INFO));
+	if(positions == NULL || (mpls->num_items && title_info->clips == NULL)) {
+		free(positions);
+		bluray_bdmv_free_title_info(title_info);
+		return NULL;
+	}
+
+	uint16_t ix = 0;
+	uint8_t item_angle_ix = 0;
+	uint32_t end_pkt = 0;
+	uint32_t title_pkt = 0;
+	uint32_t title_time = 0;
+	const struct bluray_mpls_item *item = NULL;
+	const struct bluray_mpls_clip *clip = NULL;
+	struct bluray_bdmv_position *position = NULL;
+	BLURAY_CLIP_INFO *clip_info = NULL;
+	int retval = 0;
+
+	for(ix = 0; ix < mpls->num_items; ix++) {
+
+		item = &mpls->items[ix];
+		item_angle_ix = (angle_ix < item->angle_count ? angle_ix : 0);
+		clip = &item->clips[item_angle_ix];
+		position = &positions[ix];
+		clip_info = &title_info->clips[ix];
+
+		if(item->angle_count > title_info->angle_count)
+			title_info->angle_count = item->angle_count;
+
+		bluray_bdmv_item_packets(bdmv, item, angle_ix, &position->clpi, &position->start_pkt, &end_pkt);
+		position->stc_id = clip->stc_id;
+		position->title_pkt = title_pkt;
+		position->title_time = title_time;
+
+		memcpy(clip_info->clip_id, clip->clip_id, sizeof(clip_info->clip_id));
+		clip_info->pkt_count = end_pkt - position->start_pkt;
+		clip_info->still_mode = item->still_mode;
+		clip_info->still_time = item->still_time;
+		clip_info->start_time = (uint64_t)title_time * 2;
+		clip_info->in_time = (uint64_t)item->in_time * 2;
+		clip_info->out_time = (uint64_t)item->out_time * 2;
+		clip_info->video_stream_count = item->num_video;
+		clip_info->audio_stream_count = item->num_audio;
+		clip_info->pg_stream_count = item->num_pg;
+		clip_info->ig_stream_count = item->num_ig;
+		clip_info->sec_audio_stream_count = item->num_secondary_audio;
+		clip_info->sec_video_stream_count = item->num_secondary_video;
+
+		retval |= bluray_bdmv_streams(&clip_info->video_streams, item->video, item->num_video, position->clpi);
+		retval |= bluray_bdmv_streams(&clip_info->audio_streams, item->audio, item->num_audio, position->clpi);
+		retval |= bluray_bdmv_streams(&clip_info->pg_streams, item->pg, item->num_pg, position->clpi);
+		retval |= bluray_bdmv_streams(&clip_info->ig_streams, item->ig, item->num_ig, position->clpi);
+		retval |= bluray_bdmv_streams(&clip_info->sec_audio_streams, item->secondary_audio, item->num_secondary_audio, position->clpi);
+		retval |= bluray_bdmv_streams(&clip_info->sec_video_streams, item->secondary_video, item->num_secondary_video, position->clpi);
+
+		title_pkt += clip_info->pkt_count;
+		title_time += item->out_time - item->in_time;
+
+	}
+
+	title_info->duration = (uint64_t)title_time * 2;
+
+	// Chapters are the entry marks
+	uint32_t chapter_count = 0;
+	for(ix = 0; ix < mpls->num_marks; ix++) {
+		if(mpls->marks[ix].mark_type == BLURAY_MPLS_MARK_ENTRY)
+			chapter_count++;
+	}
+
+	uint32_t *times = calloc(mpls->num_marks ? mpls->num_marks : 1, sizeof(uint32_t));
+	uint32_t *durations = calloc(mpls->num_marks ? mpls->num_marks : 1, sizeof(uint32_t));
+	if(mpls->num_marks)
+		title_info->marks = calloc(mpls->num_marks, sizeof(BLURAY_TITLE_MARK));
+	if(chapter_count)
+		title_info->chapters = calloc(chapter_count, sizeof(BLURAY_TITLE_CHAPTER));
+	if(retval || times == NULL || durations == NULL || (mpls->num_marks && title_info->marks == NULL) || (chapter_count && title_info->chapters == NULL)) {
+		free(times);
+		free(durations);
+		free(positions);
+		bluray_bdmv_free_title_info(title_info);
+		return NULL;
+	}
+
+	BLURAY_TITLE_MARK *mark = NULL;
+	title_info->mark_count = mpls->num_marks;
+	for(ix = 0; ix < mpls->num_marks; ix++) {
+		mark = &title_info->marks[ix];
+		mark->idx = ix;
+		bluray_bdmv_mark(mark, mpls, &mpls->marks[ix], positions, &times[ix]);
+		durations[ix] = mpls->marks[ix].duration;
+	}
+	bluray_bdmv_durations(title_info->marks, times, durations, mpls->num_marks, title_time);
+
+	// Chapter durations only count the entry marks
+	BLURAY_TITLE_MARK *chapter_marks = calloc(chapter_count ? chapter_count : 1, sizeof(BLURAY_TITLE_MARK));
+	if(chapter_marks == NULL) {
+		free(times);
+		free(durations);
+		free(positions);
+		bluray_bdmv_free_title_info(title_info);
+		return NULL;
+	}
+
+	uint32_t chapter_ix = 0;
+	for(ix = 0; ix < mpls->num_marks; ix++) {
+		if(mpls->marks[ix].mark_type != BLURAY_MPLS_MARK_ENTRY)
+			continue;
+		chapter_marks[chapter_ix] = title_info->marks[ix];
+		times[chapter_ix] = times[ix];
+		durations[chapter_ix] = durations[ix];
+		chapter_ix++;
+	}
+	bluray_bdmv_durations(chapter_marks, times, durations, chapter_count, title_time);
+
+	title_info->chapter_count = chapter_count;
+	for(chapter_ix = 0; chapter_ix < chapter_count; chapter_ix++) {
+		title_info->chapters[chapter_ix].idx = chapter_ix;
+		title_info->chapters[chapter_ix].start = chapter_marks[chapter_ix].start;
+		title_info->chapters[chapter_ix].duration = chapter_marks[chapter_ix].duration;
+		title_info->chapters[chapter_ix].offset = chapter_marks[chapter_ix].offset;
+		title_info->chapters[chapter_ix].clip_ref = chapter_marks[chapter_ix].clip_ref;
+	}
+
+	free(chapter_marks);
+	free(times);
+	free(durations);
+	free(positions);
+
+	return title_info;
+
+}
+
+/**
+ * Get the parts of the stream files a title plays, in order, which is what
+ * reading it through libbluray returns. Free the ranges afterwards.
+ */
+int bluray_bdmv_clip_ranges(struct bluray_bdmv *bdmv, uint32_t title_ix, uint8_t angle_ix, struct bluray_bdmv_range **ranges, uint32_t *num_ranges) {
+
+	*ranges = NULL;
+	*num_ranges = 0;
+
+	if(title_ix >= bdmv->num_titles)
+		return 1;
+
+	const struct bluray_mpls *mpls = &bdmv->titles[title_ix].mpls;
+	if(mpls->num_items == 0)
+		return 0;
+
+	bluray_bdmv_trim_clips(bdmv);
+
+	*ranges = calloc(mpls->num_items, sizeof(struct bluray_bdmv_range));
+	if(*ranges == NULL)
+		return 1;
+
+	const struct bluray_mpls_item *item = NULL;
+	const struct bluray_clpi *clpi = NULL;
+	struct bluray_bdmv_range *range = NULL;
+	uint16_t ix = 0;
+
+	for(ix = 0; ix < mpls->num_items; ix++) {
+
+		item = &mpls->items[ix];
+		range = &(*ranges)[ix];
+
+		memcpy(range->clip_id, item->clips[angle_ix < item->angle_count ? angle_ix : 0].clip_id, sizeof(range->clip_id));
+		bluray_bdmv_item_packets(bdmv, item, angle_ix, &clpi, &range->start_pkt, &range->end_pkt);
+
+		if(range->end_pkt < range->start_pkt)
+			range->end_pkt = range->start_pkt;
+
+	}
+
+	*num_ranges = mpls->num_items;
+
+	return 0;
+
+}
+
+void bluray_bdmv_free_title_info(BLURAY_TITLE_INFO *title_info) {
+
+	if(title_info == NULL)
+		return;
+
+	uint32_t ix = 0;
+	for(ix = 0; title_info->clips != NULL && ix < title_info->clip_count; ix++) {
+		free(title_info->clips[ix].video_streams);
+		free(title_info->clips[ix].audio_streams);
+		free(title_info->clips[ix].pg_streams);
+		free(title_info->clips[ix].ig_streams);
+		free(title_info->clips[ix].sec_audio_streams);
+		free(title_info->clips[ix].sec_video_streams);
+	}
+
+	free(title_info->clips);
+	free(title_info->chapters);
+	free(title_info->marks);
+	free(title_info);
+
+}
+
+/**
+ * Initialize and populate a bluray_title struct, like bluray_title_init().
+ * The title size is set as well, since it's worked out with the title info.
+ */
+int bluray_bdmv_title_init(struct bluray_bdmv *bdmv, struct bluray_title *bluray_title, uint32_t title_ix, uint8_t angle_ix) {
+
+	bluray_title_reset(bluray_title, title_ix);
+
+	uint64_t trace_start = bluray_trace_begin();
+	BLURAY_TITLE_INFO *title_info = NULL;
+	title_info = bluray_bdmv_title_info(bdmv, title_ix, angle_ix);
+	bluray_trace_end("bdmv_title_info", trace_start, title_ix, BLURAY_TRACE_NONE);
+	if(title_info == NULL)
+		return 3;
+
+	bluray_title_populate(bluray_title, title_info, bluray_bdmv_free_title_info);
+
+	uint32_t packets = 0;
+	uint32_t ix = 0;
+	for(ix = 0; ix < title_info->clip_count; ix++)
+		packets += title_info->clips[ix].pkt_count;
+
+	bluray_title->size = (uint64_t)packets * 192;
+	bluray_title->size_mbs = ceil((double)bluray_title->size / 1048576);
+
+	return 0;
+
+}
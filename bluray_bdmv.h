@@ -0,0 +1,92 @@
+#ifndef BLURAY_INFO_BDMV_H
+#define BLURAY_INFO_BDMV_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "libbluray/bluray.h"
+#include "bluray_open.h"
+#include "bluray_mpls.h"
+#include "bluray_udf.h"
+#include "bluray_sha256.h"
+
+/**
+ * Titles read straight from the playlists and clip info on a disc
+ *
+ * For displaying titles, libbluray's title machinery is slow: getting a
+ * title's info, size and chapter positions selects it for playback and parses
+ * its playlist and clip info files again for every call. This reads each file
+ * once, from a disc directory or an image (through bluray_udf), and fills in
+ * the same BLURAY_TITLE_INFO libbluray would.
+ *
+ * The title list is put together like libbluray's TITLES_RELEVANT list:
+ * playlists in directory order, leaving out duplicates and ones that repeat a
+ * clip more than twice. Positions come from the EP maps, looked up the same way,
+ * so the title size and chapter offsets are the ones libbluray would return.
+ *
+ * Nothing is decrypted, playlists and clip info never are. Disc-level info
+ * (index.bdmv, AACS, BD-J, the main title) still comes from libbluray.
+ *
+ * bluray_bdmv_fingerprint() hashes the same navigation files, without parsing
+ * them, for an identity that doesn't depend on AACS or the volume name.
+ *
+ * bluray_bdmv_clip_ranges() lists the parts of the stream files a title plays,
+ * for reading them without libbluray (see bluray_aacs).
+ */
+
+// Clip info kept parsed at once; titles share clips, and a clip's EP map is
+// several KBs, so the rest are parsed again when they're used
+#define BLURAY_BDMV_CLIPS_MAX 256
+
+struct bluray_bdmv_title {
+	char filename[16];
+	uint32_t playlist;
+	uint64_t duration;
+	struct bluray_mpls mpls;
+};
+
+struct bluray_bdmv_clip {
+	char clip_id[6];
+	bool valid;
+	struct bluray_clpi clpi;
+};
+
+/**
+ * A play item's part of its stream file, BDMV/STREAM/<clip id>.m2ts, in
+ * source packets
+ */
+struct bluray_bdmv_range {
+	char clip_id[6];
+	uint32_t start_pkt;
+	uint32_t end_pkt;
+};
+
+struct bluray_bdmv {
+	char *dirname;
+	uint8_t *image;
+	size_t image_size;
+	struct bluray_udf udf;
+	struct bluray_bdmv_title *titles;
+	uint32_t num_titles;
+	struct bluray_bdmv_clip **clips;
+	size_t num_clips;
+	size_t clips_size;
+};
+
+int bluray_bdmv_open(struct bluray_bdmv *bdmv, const char *path);
+
+void bluray_bdmv_close(struct bluray_bdmv *bdmv);
+
+int bluray_bdmv_fingerprint(const char *path, uint8_t digest[BLURAY_SHA256_LENGTH]);
+
+bool bluray_bdmv_matches(struct bluray_bdmv *bdmv, struct bluray *bd, uint32_t titles, uint32_t main_title);
+
+BLURAY_TITLE_INFO *bluray_bdmv_title_info(struct bluray_bdmv *bdmv, uint32_t title_ix, uint8_t angle_ix);
+
+int bluray_bdmv_clip_ranges(struct bluray_bdmv *bdmv, uint32_t title_ix, uint8_t angle_ix, struct bluray_bdmv_range **ranges, uint32_t *num_ranges);
+
+void bluray_bdmv_free_title_info(BLURAY_TITLE_INFO *title_info);
+
+int bluray_bdmv_title_init(struct bluray_bdmv *bdmv, struct bluray_title *bluray_title, uint32_t title_ix, uint8_t angle_ix);
+
+#endif
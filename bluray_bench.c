@@ -0,0 +1,482 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "config.h"
+#include "bluray_fixture.h"
+
+/**
+ * bluray_bench - time bluray_info against synthetic discs of growing size
+ *
+ * For each size, a disc with that many playlists is written with the fixture
+ * generator, and bluray_info is run on it in text, JSON and chapters mode.
+ * The best wall time, the peak RSS and the number of calls to each libbluray
+ * function (read from bluray_info --timings) are written to a CSV file, one
+ * row per size and mode, so a scaling regression shows up as a row that grows
+ * faster than the others.
+ *
+ * With --max-rss-growth, it's a test as well: it fails if a mode's peak RSS on
+ * the largest disc is more than that many KBs over the smallest one, or if
+ * bluray_info fails on any of them. Titles are looked at one at a time, so
+ * memory should stay flat in the number of titles, apart from the playlists
+ * themselves.
+ *
+ * Run with make bench-info.
+ */
+
+#define BLURAY_BENCH_SIZES "10,100,500,1000,2000"
+#define BLURAY_BENCH_RUNS 3
+#define BLURAY_BENCH_PATH_MAX 4096
+#define BLURAY_BENCH_STDERR_MAX 65536
+
+struct bluray_bench_mode {
+	const char *name;
+	const char *args[3];
+};
+
+static const struct bluray_bench_mode bluray_bench_modes[] = {
+	{ "text", { NULL, NULL, NULL } },
+	{ "json", { "--json", NULL, NULL } },
+	{ "chapters", { "--json", "--chapters", NULL } },
+};
+
+// The calls traced by bluray_info, in the order of the CSV columns
+static const char *bluray_bench_calls[] = { "bd_open_disc", "bd_get_disc_info", "bd_get_titles", "bd_get_main_title", "bd_get_meta", "bd_get_title_info", "bd_get_title_size", "bdmv_open", "bdmv_title_info" };
+
+#define BLURAY_BENCH_NUM_CALLS (sizeof(bluray_bench_calls) / sizeof(bluray_bench_calls[0]))
+#define BLURAY_BENCH_NUM_MODES (sizeof(bluray_bench_modes) / sizeof(bluray_bench_modes[0]))
+
+struct bluray_bench_result {
+	int status;
+	uint64_t wall_usecs;
+	uint64_t peak_rss;
+	uint64_t calls[BLURAY_BENCH_NUM_CALLS];
+};
+
+static uint64_t bluray_bench_clock(void) {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+
+}
+
+/**
+ * Read the call counts out of the --timings table
+ */
+static void bluray_bench_timings(struct bluray_bench_result *result, char *output) {
+
+	char name[64];
+	uint64_t calls = 0;
+	size_t call_ix = 0;
+	char *line = strtok(output, "\n");
+
+	while(line != NULL) {
+		if(sscanf(line, "%63s %" SCNu64, name, &calls) == 2) {
+			for(call_ix = 0; call_ix < BLURAY_BENCH_NUM_CALLS; call_ix++) {
+				if(strcmp(name, bluray_bench_calls[call_ix]) == 0)
+					result->calls[call_ix] = calls;
+			}
+		}
+		line = strtok(NULL, "\n");
+	}
+
+}
+
+/**
+ * Run bluray_info once, with its output thrown away and stderr kept for the
+ * timings
+ */
+static int bluray_bench_run(struct bluray_bench_result *result, const char *bluray_info, const char *device_filename, const struct bluray_bench_mode *mode) {
+
+	const char *argv[8];
+	size_t argc = 0;
+	size_t arg_ix = 0;
+
+	argv[argc++] = bluray_info;
+	argv[argc++] = device_filename;
+	for(arg_ix = 0; arg_ix < 3 && mode->args[arg_ix] != NULL; arg_ix++)
+		argv[argc++] = mode->args[arg_ix];
+	argv[argc++] = "--timings";
+	argv[argc] = NULL;
+
+	int fds[2];
+	if(pipe(fds)) {
+		fprintf(stderr, "Could not create pipe: %s\n", strerror(errno));
+		return 1;
+	}
+
+	uint64_t started = bluray_bench_clock();
+
+	pid_t pid = fork();
+	if(pid == -1) {
+		fprintf(stderr, "Could not fork: %s\n", strerror(errno));
+		close(fds[0]);
+		close(fds[1]);
+		return 1;
+	}
+
+	if(pid == 0) {
+		int null_fd = open("/dev/null", O_WRONLY);
+		if(null_fd != -1)
+			dup2(null_fd, STDOUT_FILENO);
+		dup2(fds[1], STDERR_FILENO);
+		close(fds[0]);
+		execv(bluray_info, (char * const *)argv);
+		fprintf(stderr, "Could not run %s: %s\n", bluray_info, strerror(errno));
+		_exit(127);
+	}
+
+	close(fds[1]);
+
+	char *output = malloc(BLURAY_BENCH_STDERR_MAX);
+	size_t length = 0;
+	ssize_t bytes = 0;
+	while(output != NULL && (bytes = read(fds[0], output + length, BLURAY_BENCH_STDERR_MAX - 1 - length)) > 0) {
+		length += (size_t)bytes;
+		if(length == BLURAY_BENCH_STDERR_MAX - 1)
+			break;
+	}
+	close(fds[0]);
+
+	int status = 0;
+	struct rusage rusage;
+	memset(&rusage, 0, sizeof(rusage));
+	while(wait4(pid, &status, 0, &rusage) == -1 && errno == EINTR)
+		;
+
+	result->wall_usecs = bluray_bench_clock() - started;
+	result->peak_rss = (uint64_t)rusage.ru_maxrss;
+	result->status = (WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+	memset(result->calls, 0, sizeof(result->calls));
+
+	if(output != NULL) {
+		output[length] = '\0';
+		if(result->status)
+			fprintf(stderr, "%s", output);
+		bluray_bench_timings(result, output);
+		free(output);
+	}
+
+	return 0;
+
+}
+
+/**
+ * Remove a disc written by the fixture generator
+ */
+static void bluray_bench_remove(const char *path) {
+
+	char filename[BLURAY_BENCH_PATH_MAX];
+	struct stat st;
+	struct dirent *entry = NULL;
+
+	DIR *dir = opendir(path);
+	if(dir != NULL) {
+		while((entry = readdir(dir)) != NULL) {
+			if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+				continue;
+			snprintf(filename, sizeof(filename), "%s/%s", path, entry->d_name);
+			if(lstat(filename, &st) == 0 && S_ISDIR(st.st_mode))
+				bluray_bench_remove(filename);
+			else
+				unlink(filename);
+		}
+		closedir(dir);
+	}
+
+	rmdir(path);
+
+}
+
+int main(int argc, char **argv) {
+
+	struct bluray_fixture fixture;
+	bluray_fixture_init(&fixture);
+
+	const char *bluray_info = "./bluray_info";
+	const char *csv_filename = "bench-info.csv";
+	const char *bench_dirname = "bench-info.d";
+	const char *fixture_dirname = NULL;
+	const char *key_db_filename = NULL;
+	const char *sizes = BLURAY_BENCH_SIZES;
+	unsigned long int runs = BLURAY_BENCH_RUNS;
+	uint64_t max_rss_growth = UINT64_MAX;
+	unsigned long int arg_number = 0;
+	bool invalid_opt = false;
+	int g_opt = 0;
+	int g_ix = 0;
+	struct option p_long_opts[] = {
+		{ "bluray-info", required_argument, NULL, 'i' },
+		{ "output", required_argument, NULL, 'o' },
+		{ "dir", required_argument, NULL, 'd' },
+		{ "sizes", required_argument, NULL, 's' },
+		{ "runs", required_argument, NULL, 'r' },
+		{ "max-rss-growth", required_argument, NULL, 'm' },
+		{ "fixture", required_argument, NULL, 'f' },
+		{ "playlists", required_argument, NULL, 'p' },
+		{ "clips", required_argument, NULL, 'C' },
+		{ "items", required_argument, NULL, 'I' },
+		{ "chapters", required_argument, NULL, 'c' },
+		{ "streams", required_argument, NULL, 'S' },
+		{ "duplicates", required_argument, NULL, 'D' },
+		{ "packets-per-second", required_argument, NULL, 'P' },
+		{ "fill", no_argument, NULL, 'F' },
+		{ "aacs", no_argument, NULL, 'A' },
+		{ "keydb", required_argument, NULL, 'k' },
+		{ "help", no_argument, NULL, 'h' },
+		{ "version", no_argument, NULL, 'Z' },
+		{ 0, 0, 0, 0 }
+	};
+	while((g_opt = getopt_long(argc, argv, "Ac:C:d:D:f:Fhi:I:k:m:o:p:P:r:s:S:", p_long_opts, &g_ix)) != -1) {
+
+		switch(g_opt) {
+
+			case 'A':
+				fixture.aacs = true;
+				break;
+
+			case 'c':
+				arg_number = strtoul(optarg, NULL, 10);
+				fixture.chapters = (uint32_t)arg_number;
+				break;
+
+			case 'C':
+				arg_number = strtoul(optarg, NULL, 10);
+				fixture.clips = (uint32_t)arg_number;
+				break;
+
+			case 'd':
+				bench_dirname = optarg;
+				break;
+
+			case 'D':
+				arg_number = strtoul(optarg, NULL, 10);
+				fixture.duplicates = (uint32_t)arg_number;
+				break;
+
+			case 'f':
+				fixture_dirname = optarg;
+				break;
+
+			case 'F':
+				fixture.fill = true;
+				break;
+
+			case 'i':
+				bluray_info = optarg;
+				break;
+
+			case 'I':
+				arg_number = strtoul(optarg, NULL, 10);
+				fixture.items = (uint32_t)arg_number;
+				break;
+
+			case 'k':
+				key_db_filename = optarg;
+				break;
+
+			case 'm':
+				max_rss_growth = strtoull(optarg, NULL, 10);
+				break;
+
+			case 'o':
+				csv_filename = optarg;
+				break;
+
+			case 'p':
+				arg_number = strtoul(optarg, NULL, 10);
+				fixture.playlists = (uint32_t)arg_number;
+				break;
+
+			case 'P':
+				arg_number = strtoul(optarg, NULL, 10);
+				fixture.packets_per_second = (uint32_t)arg_number;
+				break;
+
+			case 'r':
+				runs = strtoul(optarg, NULL, 10);
+				if(runs < 1)
+					runs = 1;
+				break;
+
+			case 's':
+				sizes = optarg;
+				break;
+
+			case 'S':
+				arg_number = strtoul(optarg, NULL, 10);
+				fixture.streams = (uint8_t)(arg_number > 32 ? 32 : arg_number);
+				break;
+
+			case 'Z':
+				printf("bluray_bench %s\n", PACKAGE_VERSION);
+				return 0;
+
+			case '?':
+				invalid_opt = true;
+			case 'h':
+				printf("bluray_bench %s - time bluray_info on synthetic discs\n", PACKAGE_VERSION);
+				printf("\n");
+				printf("Usage: bluray_bench [options]\n");
+				printf("\n");
+				printf("Benchmark:\n");
+				printf("  -i, --bluray-info <path> bluray_info program (default: ./bluray_info)\n");
+				printf("  -o, --output <filename>  CSV file (default: bench-info.csv)\n");
+				printf("  -d, --dir <path>         Directory for the discs (default: bench-info.d)\n");
+				printf("  -s, --sizes <list>       Numbers of playlists (default: %s)\n", BLURAY_BENCH_SIZES);
+				printf("  -r, --runs <number>      Runs of each mode, the fastest is kept (default: %u)\n", BLURAY_BENCH_RUNS);
+				printf("  -m, --max-rss-growth <KB> Fail if peak RSS grows more than this from the first size\n");
+				printf("\n");
+				printf("Discs:\n");
+				printf("  -f, --fixture <path>     Only write one disc to path\n");
+				printf("  -p, --playlists <number> Number of playlists with --fixture (default: %u)\n", BLURAY_FIXTURE_PLAYLISTS);
+				printf("  -C, --clips <number>     Number of clips (default: one per playlist)\n");
+				printf("  -I, --items <number>     Clips played by each playlist (default: 1)\n");
+				printf("  -c, --chapters <number>  Chapters per playlist (default: %u)\n", BLURAY_FIXTURE_CHAPTERS);
+				printf("  -S, --streams <number>   Audio and subtitle streams per clip (default: %u)\n", BLURAY_FIXTURE_STREAMS);
+				printf("  -D, --duplicates <number> Near-duplicates of the first playlist (default: 0)\n");
+				printf("  -P, --packets-per-second <number> Stream bitrate, in source packets (default: %u)\n", BLURAY_FIXTURE_PACKETS_PER_SECOND);
+				printf("  -F, --fill               Write every packet of the streams, not just the first unit\n");
+				printf("  -A, --aacs               Encrypt the streams, like AACS does\n");
+				printf("  -k, --keydb <filename>   Write a KEYDB.cfg with the encrypted disc's key\n");
+				printf("\n");
+				printf("Other:\n");
+				printf("  -h, --help               This output\n");
+				printf("      --version            Version information\n");
+				if(invalid_opt)
+					return 1;
+				return 0;
+
+			case 0:
+			default:
+				break;
+
+		}
+
+	}
+
+	if(fixture_dirname != NULL) {
+		if(bluray_fixture_write(&fixture, fixture_dirname))
+			return 1;
+		if(key_db_filename != NULL && fixture.aacs)
+			return bluray_fixture_keydb(fixture_dirname, key_db_filename);
+		return 0;
+	}
+
+	if(access(bluray_info, X_OK)) {
+		fprintf(stderr, "Could not find bluray_info at %s\n", bluray_info);
+		return 1;
+	}
+
+	FILE *csv = fopen(csv_filename, "w");
+	if(csv == NULL) {
+		fprintf(stderr, "Could not open %s: %s\n", csv_filename, strerror(errno));
+		return 1;
+	}
+
+	size_t call_ix = 0;
+	fprintf(csv, "playlists,clips,items,chapters,streams,duplicates,mode,runs,status,wall_ms,peak_rss_kb");
+	for(call_ix = 0; call_ix < BLURAY_BENCH_NUM_CALLS; call_ix++)
+		fprintf(csv, ",%s", bluray_bench_calls[call_ix]);
+	fprintf(csv, "\n");
+
+	char device_filename[BLURAY_BENCH_PATH_MAX];
+	const char *size_str = sizes;
+	char *size_end = NULL;
+	size_t mode_ix = 0;
+	unsigned long int run = 0;
+	struct bluray_bench_result result;
+	struct bluray_bench_result best;
+	uint64_t first_rss[BLURAY_BENCH_NUM_MODES];
+	uint32_t first_playlists = 0;
+	bool failed = false;
+	int retval = 0;
+
+	while(*size_str && retval == 0) {
+
+		arg_number = strtoul(size_str, &size_end, 10);
+		if(size_end == size_str || arg_number == 0) {
+			fprintf(stderr, "Invalid size list: %s\n", sizes);
+			retval = 1;
+			break;
+		}
+		size_str = (*size_end == ',' ? size_end + 1 : size_end);
+
+		fixture.playlists = (uint32_t)arg_number;
+		if(first_playlists == 0)
+			first_playlists = fixture.playlists;
+		snprintf(device_filename, sizeof(device_filename), "%s/%05lu", bench_dirname, arg_number);
+
+		mkdir(bench_dirname, 0755);
+		retval = bluray_fixture_write(&fixture, device_filename);
+		if(retval)
+			break;
+
+		for(mode_ix = 0; retval == 0 && mode_ix < BLURAY_BENCH_NUM_MODES; mode_ix++) {
+
+			for(run = 0; run < runs; run++) {
+				retval = bluray_bench_run(&result, bluray_info, device_filename, &bluray_bench_modes[mode_ix]);
+				if(retval)
+					break;
+				if(run == 0 || result.wall_usecs < best.wall_usecs)
+					best.wall_usecs = result.wall_usecs;
+				if(run == 0 || result.peak_rss > best.peak_rss)
+					best.peak_rss = result.peak_rss;
+				if(run == 0 || result.status)
+					best.status = result.status;
+				memcpy(best.calls, result.calls, sizeof(best.calls));
+			}
+
+			if(retval)
+				break;
+
+			fprintf(csv, "%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu8 ",%" PRIu32 ",%s,%lu,%d,%.3f,%" PRIu64, fixture.playlists, (fixture.clips ? fixture.clips : fixture.playlists), (fixture.items ? fixture.items : 1), fixture.chapters, fixture.streams, fixture.duplicates, bluray_bench_modes[mode_ix].name, runs, best.status, (double)best.wall_usecs / 1000, best.peak_rss);
+			for(call_ix = 0; call_ix < BLURAY_BENCH_NUM_CALLS; call_ix++)
+				fprintf(csv, ",%" PRIu64, best.calls[call_ix]);
+			fprintf(csv, "\n");
+			fflush(csv);
+
+			printf("%5" PRIu32 " playlists, %-8s %10.3f ms %8" PRIu64 " KB%s\n", fixture.playlists, bluray_bench_modes[mode_ix].name, (double)best.wall_usecs / 1000, best.peak_rss, (best.status ? ", failed" : ""));
+
+			if(best.status)
+				failed = true;
+
+			if(fixture.playlists == first_playlists)
+				first_rss[mode_ix] = best.peak_rss;
+			else if(best.peak_rss > first_rss[mode_ix] && best.peak_rss - first_rss[mode_ix] > max_rss_growth) {
+				fprintf(stderr, "Peak RSS in %s mode grew %" PRIu64 " KB from %" PRIu32 " to %" PRIu32 " playlists, more than %" PRIu64 " KB\n", bluray_bench_modes[mode_ix].name, best.peak_rss - first_rss[mode_ix], first_playlists, fixture.playlists, max_rss_growth);
+				failed = true;
+			}
+
+		}
+
+		bluray_bench_remove(device_filename);
+
+	}
+
+	rmdir(bench_dirname);
+
+	if(fclose(csv) != 0)
+		retval = 1;
+
+	if(failed && max_rss_growth != UINT64_MAX)
+		retval = 1;
+
+	return retval;
+
+}
@@ -0,0 +1,703 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "bluray_cache.h"
+#include "bluray_file.h"
+
+#define BLURAY_CACHE_INDEX_VERSION "bluray_info disc cache 1"
+
+// A disc in the cache directory, when trimming it
+struct bluray_cache_disc {
+	char name[NAME_MAX + 1];
+	time_t last_used;
+	uint64_t size;
+};
+
+struct bluray_cache_header {
+	char magic[8];
+	uint32_t playlist;
+	uint32_t length;
+	uint64_t block;
+	uint8_t angle;
+};
+
+void bluray_cache_init(struct bluray_cache *cache) {
+
+	memset(cache, 0, sizeof(struct bluray_cache));
+	cache->fd = -1;
+
+}
+
+bool bluray_cache_enabled(const struct bluray_cache *cache) {
+
+	return (cache != NULL && cache->fd != -1);
+
+}
+
+static uint32_t bluray_cache_hash(const struct bluray_cache *cache, uint32_t playlist, uint8_t angle_ix, uint64_t block) {
+
+	return (uint32_t)((block * 2654435761u + playlist * 40503u + angle_ix) % cache->hash_size);
+
+}
+
+static struct bluray_cache_block *bluray_cache_lookup(struct bluray_cache *cache, uint32_t playlist, uint8_t angle_ix, uint64_t block) {
+
+	struct bluray_cache_block *cached = cache->hash[bluray_cache_hash(cache, playlist, angle_ix, block)];
+
+	while(cached != NULL && (cached->playlist != playlist || cached->angle != angle_ix || cached->block != block))
+		cached = cached->hash_next;
+
+	return cached;
+
+}
+
+static void bluray_cache_unlink(struct bluray_cache *cache, struct bluray_cache_block *cached) {
+
+	if(cached->prev)
+		cached->prev->next = cached->next;
+	else
+		cache->blocks = cached->next;
+
+	if(cached->next)
+		cached->next->prev = cached->prev;
+	else
+		cache->last_block = cached->prev;
+
+	cached->prev = NULL;
+	cached->next = NULL;
+
+}
+
+static void bluray_cache_push(struct bluray_cache *cache, struct bluray_cache_block *cached) {
+
+	cached->prev = NULL;
+	cached->next = cache->blocks;
+	if(cache->blocks)
+		cache->blocks->prev = cached;
+	else
+		cache->last_block = cached;
+	cache->blocks = cached;
+
+}
+
+static void bluray_cache_add(struct bluray_cache *cache, struct bluray_cache_block *cached) {
+
+	uint32_t hash = bluray_cache_hash(cache, cached->playlist, cached->angle, cached->block);
+
+	cached->hash_next = cache->hash[hash];
+	cache->hash[hash] = cached;
+	cache->slots[cached->slot] = cached;
+	cache->used_slots++;
+
+}
+
+/**
+ * Forget a block, leaving its slot free
+ */
+static void bluray_cache_remove(struct bluray_cache *cache, struct bluray_cache_block *cached) {
+
+	struct bluray_cache_block **hash_prev = &cache->hash[bluray_cache_hash(cache, cached->playlist, cached->angle, cached->block)];
+
+	while(*hash_prev != cached)
+		hash_prev = &(*hash_prev)->hash_next;
+	*hash_prev = cached->hash_next;
+
+	bluray_cache_unlink(cache, cached);
+	cache->slots[cached->slot] = NULL;
+	cache->used_slots--;
+	if(cached->slot < cache->next_slot)
+		cache->next_slot = cached->slot;
+	cache->changed = true;
+
+	free(cached);
+
+}
+
+static int bluray_cache_compare_last_used(const void *a, const void *b) {
+
+	const struct bluray_cache_block *block_a = *(struct bluray_cache_block * const *)a;
+	const struct bluray_cache_block *block_b = *(struct bluray_cache_block * const *)b;
+
+	if(block_a->last_used < block_b->last_used)
+		return -1;
+
+	return (block_a->last_used > block_b->last_used);
+
+}
+
+static void bluray_cache_set_size(struct bluray_cache *cache, uint32_t playlist, uint8_t angle_ix, uint64_t size) {
+
+	struct bluray_cache_size *sizes = NULL;
+	uint32_t ix = 0;
+
+	for(ix = 0; ix < cache->num_sizes; ix++) {
+		if(cache->sizes[ix].playlist == playlist && cache->sizes[ix].angle == angle_ix) {
+			cache->sizes[ix].size = size;
+			return;
+		}
+	}
+
+	sizes = realloc(cache->sizes, ((size_t)cache->num_sizes + 1) * sizeof(struct bluray_cache_size));
+	if(sizes == NULL)
+		return;
+
+	cache->sizes = sizes;
+	cache->sizes[cache->num_sizes].playlist = playlist;
+	cache->sizes[cache->num_sizes].angle = angle_ix;
+	cache->sizes[cache->num_sizes].size = size;
+	cache->num_sizes++;
+
+}
+
+/**
+ * Read the index. Blocks in slots past the end of the cache, which happens
+ * when its size is lowered, are left out.
+ */
+static void bluray_cache_load(struct bluray_cache *cache) {
+
+	FILE *file = fopen(cache->index_filename, "r");
+	if(file == NULL)
+		return;
+
+	char line[128];
+	struct bluray_cache_block block;
+	struct bluray_cache_block *cached = NULL;
+	struct bluray_cache_block **loaded = NULL;
+	uint32_t num_loaded = 0;
+	uint32_t ix = 0;
+	uint64_t size = 0;
+
+	if(fgets(line, sizeof(line), file) == NULL || strncmp(line, BLURAY_CACHE_INDEX_VERSION "\n", sizeof(line))) {
+		fclose(file);
+		return;
+	}
+
+	loaded = calloc(cache->max_slots, sizeof(struct bluray_cache_block *));
+	if(loaded == NULL) {
+		fclose(file);
+		return;
+	}
+
+	while(fgets(line, sizeof(line), file) != NULL) {
+
+		if(sscanf(line, "clock %" SCNu64, &cache->clock) == 1)
+			continue;
+
+		if(sscanf(line, "size %" SCNu32 " %" SCNu8 " %" SCNu64, &block.playlist, &block.angle, &size) == 3) {
+			bluray_cache_set_size(cache, block.playlist, block.angle, size);
+			continue;
+		}
+
+		if(sscanf(line, "block %" SCNu32 " %" SCNu8 " %" SCNu64 " %" SCNu32 " %" SCNu32 " %" SCNu64, &block.playlist, &block.angle, &block.block, &block.slot, &block.length, &block.last_used) != 6)
+			continue;
+
+		if(block.slot >= cache->max_slots || cache->slots[block.slot] != NULL || block.length == 0 || block.length > BLURAY_CACHE_BLOCK_SIZE || bluray_cache_lookup(cache, block.playlist, block.angle, block.block) != NULL)
+			continue;
+
+		cached = malloc(sizeof(struct bluray_cache_block));
+		if(cached == NULL)
+			break;
+
+		*cached = block;
+		bluray_cache_add(cache, cached);
+		loaded[num_loaded++] = cached;
+
+	}
+
+	fclose(file);
+
+	// Most recently used first
+	qsort(loaded, num_loaded, sizeof(struct bluray_cache_block *), bluray_cache_compare_last_used);
+	for(ix = 0; ix < num_loaded; ix++)
+		bluray_cache_push(cache, loaded[ix]);
+
+	free(loaded);
+
+}
+
+/**
+ * Write the index under a temporary name and rename it, so it's never half
+ * written
+ */
+static int bluray_cache_save(struct bluray_cache *cache) {
+
+	char tmp_filename[PATH_MAX];
+	struct bluray_cache_block *cached = NULL;
+	FILE *file = bluray_file_create(cache->index_filename, tmp_filename);
+	uint32_t ix = 0;
+
+	if(file == NULL)
+		return 1;
+
+	fprintf(file, "%s\n", BLURAY_CACHE_INDEX_VERSION);
+	fprintf(file, "clock %" PRIu64 "\n", cache->clock);
+
+	for(ix = 0; ix < cache->num_sizes; ix++)
+		fprintf(file, "size %" PRIu32 " %" PRIu8 " %" PRIu64 "\n", cache->sizes[ix].playlist, cache->sizes[ix].angle, cache->sizes[ix].size);
+
+	for(cached = cache->blocks; cached != NULL; cached = cached->next)
+		fprintf(file, "block %" PRIu32 " %" PRIu8 " %" PRIu64 " %" PRIu32 " %" PRIu32 " %" PRIu64 "\n", cached->playlist, cached->angle, cached->block, cached->slot, cached->length, cached->last_used);
+
+	return bluray_file_replace(file, tmp_filename, cache->index_filename);
+
+}
+
+/**
+ * Open the cache for a disc, up to max_size bytes for all discs. Returns 1 if
+ * it can't be used, which leaves it off.
+ */
+int bluray_cache_open(struct bluray_cache *cache, const char *disc_id, uint64_t max_size) {
+
+	bluray_cache_init(cache);
+
+	cache->max_size = max_size;
+	cache->max_slots = (uint32_t)(max_size / BLURAY_CACHE_SLOT_SIZE);
+	if(cache->max_slots == 0 || disc_id == NULL || disc_id[0] == '\0')
+		return 1;
+
+	if(bluray_file_xdg_filename(cache->dirname, PATH_MAX, "XDG_CACHE_HOME", ".cache", "bluray_info/discs") || snprintf(cache->filename, PATH_MAX, "%s/%s.blocks", cache->dirname, disc_id) >= PATH_MAX || snprintf(cache->index_filename, PATH_MAX, "%s/%s.index", cache->dirname, disc_id) >= PATH_MAX)
+		return 1;
+
+	if(bluray_file_mkdirs(cache->filename))
+		return 1;
+
+	int fd = open(cache->filename, O_RDWR | O_CREAT, 0600);
+	if(fd == -1)
+		return 1;
+
+	// Another program has it
+	if(flock(fd, LOCK_EX | LOCK_NB) == -1) {
+		close(fd);
+		return 1;
+	}
+
+	cache->hash_size = cache->max_slots * 2 + 1;
+	cache->hash = calloc(cache->hash_size, sizeof(struct bluray_cache_block *));
+	cache->slots = calloc(cache->max_slots, sizeof(struct bluray_cache_block *));
+	if(cache->hash == NULL || cache->slots == NULL) {
+		free(cache->hash);
+		free(cache->slots);
+		close(fd);
+		bluray_cache_init(cache);
+		return 1;
+	}
+
+	bluray_cache_load(cache);
+
+	// Give back the space of slots past the end
+	struct stat st;
+	if(fstat(fd, &st) == 0 && (uint64_t)st.st_size > (uint64_t)cache->max_slots * BLURAY_CACHE_SLOT_SIZE) {
+		if(ftruncate(fd, (off_t)cache->max_slots * BLURAY_CACHE_SLOT_SIZE) == 0)
+			cache->changed = true;
+	}
+
+	cache->fd = fd;
+
+	return 0;
+
+}
+
+/**
+ * Remove the least recently used discs, other than this one, until all of
+ * them fit in the cache size. A disc's index is written each time it's used,
+ * so that's when it was last used. Discs that are open elsewhere are kept.
+ */
+static void bluray_cache_trim(struct bluray_cache *cache) {
+
+	DIR *dir = opendir(cache->dirname);
+	if(dir == NULL)
+		return;
+
+	struct bluray_cache_disc *discs = NULL;
+	struct bluray_cache_disc *p = NULL;
+	size_t num_discs = 0;
+	size_t size = 0;
+	size_t ix = 0;
+	size_t jx = 0;
+	uint64_t total_size = 0;
+	struct dirent *entry = NULL;
+	struct stat st;
+	char filename[PATH_MAX];
+	size_t length = 0;
+	int fd = -1;
+
+	while((entry = readdir(dir)) != NULL) {
+
+		length = strlen(entry->d_name);
+		if(length <= 6 || strcmp(entry->d_name + length - 6, ".index"))
+			continue;
+
+		if(num_discs == size) {
+			size = (size ? size * 2 : 16);
+			p = realloc(discs, size * sizeof(*discs));
+			if(p == NULL)
+				break;
+			discs = p;
+		}
+
+		memcpy(discs[num_discs].name, entry->d_name, length - 6);
+		discs[num_discs].name[length - 6] = '\0';
+
+		if(snprintf(filename, PATH_MAX, "%s/%s", cache->dirname, entry->d_name) >= PATH_MAX || stat(filename, &st) == -1)
+			continue;
+		discs[num_discs].last_used = st.st_mtime;
+
+		if(snprintf(filename, PATH_MAX, "%s/%s.blocks", cache->dirname, discs[num_discs].name) < PATH_MAX && stat(filename, &st) == 0)
+			discs[num_discs].size = (uint64_t)st.st_blocks * 512;
+		else
+			discs[num_discs].size = 0;
+		total_size += discs[num_discs].size;
+
+		num_discs++;
+
+	}
+
+	closedir(dir);
+
+	while(total_size > cache->max_size) {
+
+		// Oldest first
+		jx = num_discs;
+		for(ix = 0; ix < num_discs; ix++) {
+			if(snprintf(filename, PATH_MAX, "%s/%s.blocks", cache->dirname, discs[ix].name) >= PATH_MAX)
+				continue;
+			if(discs[ix].size && strcmp(filename, cache->filename) && (jx == num_discs || discs[ix].last_used < discs[jx].last_used))
+				jx = ix;
+		}
+		if(jx == num_discs)
+			break;
+
+		fd = -1;
+		if(snprintf(filename, PATH_MAX, "%s/%s.blocks", cache->dirname, discs[jx].name) < PATH_MAX)
+			fd = open(filename, O_RDWR);
+		if(fd != -1 && flock(fd, LOCK_EX | LOCK_NB) == 0) {
+			unlink(filename);
+			if(snprintf(filename, PATH_MAX, "%s/%s.index", cache->dirname, discs[jx].name) < PATH_MAX)
+				unlink(filename);
+			total_size -= discs[jx].size;
+		}
+		if(fd != -1)
+			close(fd);
+		discs[jx].size = 0;
+
+	}
+
+	free(discs);
+
+}
+
+void bluray_cache_close(struct bluray_cache *cache) {
+
+	if(!bluray_cache_enabled(cache))
+		return;
+
+	struct bluray_cache_block *cached = cache->blocks;
+	struct bluray_cache_block *next = NULL;
+
+	if(cache->changed)
+		bluray_cache_save(cache);
+
+	close(cache->fd);
+	cache->fd = -1;
+
+	bluray_cache_trim(cache);
+
+	while(cached != NULL) {
+		next = cached->next;
+		free(cached);
+		cached = next;
+	}
+
+	free(cache->hash);
+	free(cache->slots);
+	free(cache->sizes);
+	bluray_cache_init(cache);
+
+}
+
+/**
+ * Get a title's size from the cache. Returns 1 if it isn't there.
+ */
+int bluray_cache_title_size(struct bluray_cache *cache, struct bluray_title *bluray_title, uint8_t angle_ix) {
+
+	if(!bluray_cache_enabled(cache))
+		return 1;
+
+	uint32_t ix = 0;
+	for(ix = 0; ix < cache->num_sizes; ix++) {
+		if(cache->sizes[ix].playlist == bluray_title->playlist && cache->sizes[ix].angle == angle_ix) {
+			bluray_title->size = cache->sizes[ix].size;
+			bluray_title->size_mbs = ceil((double)bluray_title->size / 1048576);
+			return 0;
+		}
+	}
+
+	return 1;
+
+}
+
+void bluray_cache_set_title_size(struct bluray_cache *cache, const struct bluray_title *bluray_title, uint8_t angle_ix) {
+
+	if(!bluray_cache_enabled(cache) || bluray_title->size == 0)
+		return;
+
+	bluray_cache_set_size(cache, bluray_title->playlist, angle_ix, bluray_title->size);
+	cache->changed = true;
+
+}
+
+static void bluray_cache_header(struct bluray_cache_header *header, uint32_t playlist, uint8_t angle_ix, uint64_t block, uint32_t length) {
+
+	memset(header, 0, sizeof(struct bluray_cache_header));
+	memcpy(header->magic, "BDCACHE1", 8);
+	header->playlist = playlist;
+	header->angle = angle_ix;
+	header->block = block;
+	header->length = length;
+
+}
+
+static int bluray_cache_pread(int fd, void *data, size_t length, off_t offset) {
+
+	ssize_t bytes_read = 0;
+
+	while(length > 0) {
+		bytes_read = pread(fd, data, length, offset);
+		if(bytes_read < 0 && errno == EINTR)
+			continue;
+		if(bytes_read <= 0)
+			return 1;
+		data = (uint8_t *)data + bytes_read;
+		length -= (size_t)bytes_read;
+		offset += bytes_read;
+	}
+
+	return 0;
+
+}
+
+static int bluray_cache_pwrite(int fd, const void *data, size_t length, off_t offset) {
+
+	ssize_t written = 0;
+
+	while(length > 0) {
+		written = pwrite(fd, data, length, offset);
+		if(written < 0 && errno == EINTR)
+			continue;
+		if(written <= 0)
+			return 1;
+		data = (const uint8_t *)data + written;
+		length -= (size_t)written;
+		offset += written;
+	}
+
+	return 0;
+
+}
+
+/**
+ * Read a block of a title, into data of at least BLURAY_CACHE_BLOCK_SIZE
+ * bytes. Returns 1 if it isn't cached.
+ */
+int bluray_cache_read_block(struct bluray_cache *cache, uint32_t playlist, uint8_t angle_ix, uint64_t block, uint8_t *data, size_t *length) {
+
+	if(!bluray_cache_enabled(cache))
+		return 1;
+
+	struct bluray_cache_header header;
+	struct bluray_cache_header slot_header;
+	struct bluray_cache_block *cached = bluray_cache_lookup(cache, playlist, angle_ix, block);
+	off_t offset = 0;
+
+	if(cached == NULL) {
+		cache->misses++;
+		return 1;
+	}
+
+	offset = (off_t)cached->slot * BLURAY_CACHE_SLOT_SIZE;
+	bluray_cache_header(&header, playlist, angle_ix, block, cached->length);
+
+	if(bluray_cache_pread(cache->fd, &slot_header, sizeof(struct bluray_cache_header), offset) || memcmp(&header, &slot_header, sizeof(struct bluray_cache_header)) || bluray_cache_pread(cache->fd, data, cached->length, offset + BLURAY_CACHE_HEADER_SIZE)) {
+		bluray_cache_remove(cache, cached);
+		cache->misses++;
+		return 1;
+	}
+
+	*length = cached->length;
+
+	cached->last_used = ++cache->clock;
+	bluray_cache_unlink(cache, cached);
+	bluray_cache_push(cache, cached);
+	cache->hits++;
+	cache->changed = true;
+
+	return 0;
+
+}
+
+/**
+ * Keep a block of a title, in a free slot, or the least recently used one
+ */
+void bluray_cache_write_block(struct bluray_cache *cache, uint32_t playlist, uint8_t angle_ix, uint64_t block, const uint8_t *data, size_t length) {
+
+	if(!bluray_cache_enabled(cache) || length == 0 || length > BLURAY_CACHE_BLOCK_SIZE)
+		return;
+
+	struct bluray_cache_header header;
+	struct bluray_cache_block *cached = bluray_cache_lookup(cache, playlist, angle_ix, block);
+	uint32_t slot = 0;
+	off_t offset = 0;
+
+	if(cached != NULL) {
+		slot = cached->slot;
+		bluray_cache_remove(cache, cached);
+	} else if(cache->used_slots < cache->max_slots) {
+		slot = cache->next_slot;
+		while(cache->slots[slot] != NULL)
+			slot++;
+		cache->next_slot = slot + 1;
+	} else {
+		slot = cache->last_block->slot;
+		bluray_cache_remove(cache, cache->last_block);
+	}
+
+	// Clear the header first, so the slot's old block isn't taken for this one
+	// if writing it is cut short
+	offset = (off_t)slot * BLURAY_CACHE_SLOT_SIZE;
+	memset(&header, 0, sizeof(struct bluray_cache_header));
+	if(bluray_cache_pwrite(cache->fd, &header, sizeof(struct bluray_cache_header), offset) || bluray_cache_pwrite(cache->fd, data, length, offset + BLURAY_CACHE_HEADER_SIZE))
+		return;
+
+	bluray_cache_header(&header, playlist, angle_ix, block, (uint32_t)length);
+	if(bluray_cache_pwrite(cache->fd, &header, sizeof(struct bluray_cache_header), offset))
+		return;
+
+	cached = malloc(sizeof(struct bluray_cache_block));
+	if(cached == NULL)
+		return;
+
+	cached->playlist = playlist;
+	cached->angle = angle_ix;
+	cached->block = block;
+	cached->slot = slot;
+	cached->length = (uint32_t)length;
+	cached->last_used = ++cache->clock;
+	bluray_cache_add(cache, cached);
+	bluray_cache_push(cache, cached);
+	cache->changed = true;
+
+}
+
+/**
+ * Start reading a title through the cache. The title and angle must already
+ * be selected. The cache can be off, and then it's only read from the disc.
+ */
+int bluray_cache_title_open(struct bluray_cache_title *cache_title, struct bluray_cache *cache, struct bluray *bd, const struct bluray_title *bluray_title, uint8_t angle_ix) {
+
+	cache_title->cache = cache;
+	cache_title->bd = bd;
+	cache_title->title_ix = bluray_title->ix;
+	cache_title->playlist = bluray_title->playlist;
+	cache_title->angle = angle_ix;
+	cache_title->size = bluray_title->size;
+	cache_title->disc_position = UINT64_MAX;
+	cache_title->block = UINT64_MAX;
+	cache_title->length = 0;
+	cache_title->data = malloc(BLURAY_CACHE_BLOCK_SIZE);
+
+	return (cache_title->data == NULL);
+
+}
+
+/**
+ * Read the block a position is in from the disc. libbluray is only moved
+ * when it isn't there already, and the start of the title is selected again
+ * instead of seeked to, see bluray_copy.c. Blocks don't start on an aligned
+ * unit in a clip, so seeking reads forward to them, see bluray_title_seek().
+ */
+static int bluray_cache_title_fill(struct bluray_cache_title *cache_title, uint64_t block) {
+
+	uint64_t position = block * BLURAY_CACHE_BLOCK_SIZE;
+	uint64_t length = cache_title->size - position;
+	int bytes_read = 0;
+
+	if(length > BLURAY_CACHE_BLOCK_SIZE)
+		length = BLURAY_CACHE_BLOCK_SIZE;
+
+	if(cache_title->disc_position != position) {
+		cache_title->disc_position = UINT64_MAX;
+		if(position == 0) {
+			if(bd_select_title(cache_title->bd, cache_title->title_ix) == 0 || bd_select_angle(cache_title->bd, cache_title->angle) == 0)
+				return -1;
+		} else if(bluray_title_seek(cache_title->bd, position) < 0) {
+			return -1;
+		}
+		cache_title->disc_position = position;
+	}
+
+	cache_title->length = 0;
+	while(cache_title->length < length) {
+		bytes_read = bd_read(cache_title->bd, cache_title->data + cache_title->length, (int)(length - cache_title->length));
+		if(bytes_read < 0) {
+			cache_title->disc_position = UINT64_MAX;
+			return -1;
+		}
+		if(bytes_read == 0)
+			break;
+		cache_title->length += (size_t)bytes_read;
+		cache_title->disc_position += (uint64_t)bytes_read;
+	}
+
+	// Only whole blocks are kept
+	if(cache_title->length == length)
+		bluray_cache_write_block(cache_title->cache, cache_title->playlist, cache_title->angle, block, cache_title->data, cache_title->length);
+
+	return 0;
+
+}
+
+/**
+ * Read from a position in the title, up to the end of the block it's in.
+ * Returns the number of bytes read, 0 at the end of the title, or -1 if the
+ * disc couldn't be read.
+ */
+int64_t bluray_cache_title_read(struct bluray_cache_title *cache_title, uint64_t position, uint8_t *buffer, size_t length) {
+
+	uint64_t block = position / BLURAY_CACHE_BLOCK_SIZE;
+	size_t offset = (size_t)(position % BLURAY_CACHE_BLOCK_SIZE);
+
+	if(position >= cache_title->size)
+		return 0;
+
+	if(block != cache_title->block) {
+		cache_title->block = UINT64_MAX;
+		if(bluray_cache_read_block(cache_title->cache, cache_title->playlist, cache_title->angle, block, cache_title->data, &cache_title->length) && bluray_cache_title_fill(cache_title, block))
+			return -1;
+		cache_title->block = block;
+	}
+
+	if(offset >= cache_title->length)
+		return 0;
+
+	if(length > cache_title->length - offset)
+		length = cache_title->length - offset;
+
+	memcpy(buffer, cache_title->data + offset, length);
+
+	return (int64_t)length;
+
+}
+
+void bluray_cache_title_close(struct bluray_cache_title *cache_title) {
+
+	free(cache_title->data);
+	cache_title->data = NULL;
+
+}
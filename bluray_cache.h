@@ -0,0 +1,125 @@
+#ifndef BLURAY_INFO_CACHE_H
+#define BLURAY_INFO_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <limits.h>
+#include "libbluray/bluray.h"
+#include "bluray_open.h"
+
+/**
+ * Persistent disc cache, shared by bluray_info, bluray_copy, bluray_player
+ * and bluray_serve
+ *
+ * Reading an optical drive is slow, and seeking on it even more so. With
+ * --disc-cache, what the programs read through libbluray is kept on disk, so
+ * running one after another on the same disc only reads new data from the
+ * drive. Each disc has two files, named after its ID (see bluray_disc_id()):
+ *
+ *   $XDG_CACHE_HOME/bluray_info/discs/<disc id>.blocks (default ~/.cache)
+ *   $XDG_CACHE_HOME/bluray_info/discs/<disc id>.index
+ *
+ * The blocks file is a row of slots, each holding one block of a title's
+ * stream, as bd_read() returns it: decrypted, BLURAY_CACHE_BLOCK_SIZE bytes,
+ * starting at a multiple of it. Each slot starts with a header naming its
+ * block, so a slot that was rewritten without the index being saved is
+ * noticed. The index is text, one line per block with its slot and when it
+ * was last used, and one per title size, since getting a title's size from
+ * libbluray means selecting it and opening all its clips.
+ *
+ * The cache is limited to a size in MBs, for all discs together. Least
+ * recently used blocks of a disc are overwritten first, and when the discs
+ * take up more than the size, the least recently used discs are removed.
+ *
+ * Only one program uses a disc's cache at a time. The others read the disc
+ * as if it was off.
+ */
+
+// 32 aligned units of 6144 bytes
+#define BLURAY_CACHE_BLOCK_SIZE 196608
+
+// Header in front of each block, keeping the data page aligned
+#define BLURAY_CACHE_HEADER_SIZE 4096
+#define BLURAY_CACHE_SLOT_SIZE (BLURAY_CACHE_HEADER_SIZE + BLURAY_CACHE_BLOCK_SIZE)
+
+struct bluray_cache_block {
+	uint32_t playlist;
+	uint8_t angle;
+	uint64_t block;
+	uint32_t slot;
+	uint32_t length;
+	uint64_t last_used;
+	struct bluray_cache_block *hash_next;
+	struct bluray_cache_block *prev;
+	struct bluray_cache_block *next;
+};
+
+struct bluray_cache_size {
+	uint32_t playlist;
+	uint8_t angle;
+	uint64_t size;
+};
+
+struct bluray_cache {
+	int fd;
+	char dirname[PATH_MAX];
+	char filename[PATH_MAX];
+	char index_filename[PATH_MAX];
+	uint64_t max_size;
+	uint32_t max_slots;
+	struct bluray_cache_block **slots;
+	uint32_t used_slots;
+	uint32_t next_slot;
+	struct bluray_cache_block **hash;
+	uint32_t hash_size;
+	struct bluray_cache_block *blocks;
+	struct bluray_cache_block *last_block;
+	struct bluray_cache_size *sizes;
+	uint32_t num_sizes;
+	uint64_t clock;
+	uint64_t hits;
+	uint64_t misses;
+	bool changed;
+};
+
+/**
+ * Reading a title through the cache, for programs that would otherwise call
+ * bd_seek() and bd_read() on it themselves
+ */
+struct bluray_cache_title {
+	struct bluray_cache *cache;
+	struct bluray *bd;
+	uint32_t title_ix;
+	uint32_t playlist;
+	uint8_t angle;
+	uint64_t size;
+	uint64_t disc_position;
+	uint64_t block;
+	size_t length;
+	uint8_t *data;
+};
+
+void bluray_cache_init(struct bluray_cache *cache);
+
+int bluray_cache_open(struct bluray_cache *cache, const char *disc_id, uint64_t max_size);
+
+void bluray_cache_close(struct bluray_cache *cache);
+
+bool bluray_cache_enabled(const struct bluray_cache *cache);
+
+int bluray_cache_title_size(struct bluray_cache *cache, struct bluray_title *bluray_title, uint8_t angle_ix);
+
+void bluray_cache_set_title_size(struct bluray_cache *cache, const struct bluray_title *bluray_title, uint8_t angle_ix);
+
+int bluray_cache_read_block(struct bluray_cache *cache, uint32_t playlist, uint8_t angle_ix, uint64_t block, uint8_t *data, size_t *length);
+
+void bluray_cache_write_block(struct bluray_cache *cache, uint32_t playlist, uint8_t angle_ix, uint64_t block, const uint8_t *data, size_t length);
+
+int bluray_cache_title_open(struct bluray_cache_title *cache_title, struct bluray_cache *cache, struct bluray *bd, const struct bluray_title *bluray_title, uint8_t angle_ix);
+
+int64_t bluray_cache_title_read(struct bluray_cache_title *cache_title, uint64_t position, uint8_t *buffer, size_t length);
+
+void bluray_cache_title_close(struct bluray_cache_title *cache_title);
+
+#endif
@@ -0,0 +1,139 @@
+#include "bluray_cbor.h"
+
+/**
+ * Encode the initial byte and argument of a data item, using the shortest
+ * form. Returns the number of bytes written.
+ */
+size_t bluray_cbor_head(uint8_t *dest, uint8_t major, uint64_t value) {
+
+	uint8_t ib = (uint8_t)(major << 5);
+	size_t len = 0;
+	size_t ix = 0;
+
+	if(value < 24) {
+		dest[0] = ib | (uint8_t)value;
+		return 1;
+	}
+
+	if(value <= UINT8_MAX) {
+		dest[0] = ib | 24;
+		len = 1;
+	} else if(value <= UINT16_MAX) {
+		dest[0] = ib | 25;
+		len = 2;
+	} else if(value <= UINT32_MAX) {
+		dest[0] = ib | 26;
+		len = 4;
+	} else {
+		dest[0] = ib | 27;
+		len = 8;
+	}
+
+	// Arguments are big-endian
+	for(ix = 0; ix < len; ix++)
+		dest[len - ix] = (uint8_t)(value >> (8 * ix));
+
+	return len + 1;
+
+}
+
+static uint32_t bluray_cbor_hash(const char *str, size_t len) {
+
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	size_t ix = 0;
+
+	for(ix = 0; ix < len; ix++) {
+		hash ^= (uint8_t)str[ix];
+		hash *= 16777619u;
+	}
+
+	return hash;
+
+}
+
+/**
+ * A string only goes in the table if a reference to it would be shorter
+ * than the string itself, based on the index it would get.
+ */
+static bool bluray_cbor_strings_eligible(uint32_t index, size_t len) {
+
+	if(index < 24)
+		return len >= 3;
+	if(index < 256)
+		return len >= 4;
+	if(index < 65536)
+		return len >= 5;
+
+	return len >= 7;
+
+}
+
+struct bluray_cbor_strings *bluray_cbor_strings_init(void) {
+
+	struct bluray_cbor_strings *table = NULL;
+	table = calloc(1, sizeof(struct bluray_cbor_strings));
+
+	return table;
+
+}
+
+/**
+ * Start a new stringref namespace
+ */
+void bluray_cbor_strings_reset(struct bluray_cbor_strings *table) {
+
+	uint32_t ix = 0;
+
+	for(ix = 0; ix < BLURAY_CBOR_STRINGS_SIZE; ix++) {
+		free(table->strings[ix]);
+		table->strings[ix] = NULL;
+	}
+
+	table->count = 0;
+
+}
+
+void bluray_cbor_strings_free(struct bluray_cbor_strings *table) {
+
+	if(table == NULL)
+		return;
+
+	bluray_cbor_strings_reset(table);
+	free(table);
+
+}
+
+/**
+ * Look up a string in the table. Returns its index if it has already been
+ * sent, and -1 if it has to be written out in full. Strings that are written
+ * out are added to the table when they are eligible, the same way the decoder
+ * builds its own table.
+ */
+int64_t bluray_cbor_strings_lookup(struct bluray_cbor_strings *table, const char *str, size_t len) {
+
+	uint32_t slot = bluray_cbor_hash(str, len) & (BLURAY_CBOR_STRINGS_SIZE - 1);
+
+	while(table->strings[slot] != NULL) {
+		if(strlen(table->strings[slot]) == len && memcmp(table->strings[slot], str, len) == 0)
+			return table->indexes[slot];
+		slot = (slot + 1) & (BLURAY_CBOR_STRINGS_SIZE - 1);
+	}
+
+	// Leave free slots so lookups always end. Once the table is full, strings
+	// are still sent, just not remembered.
+	if(table->count >= BLURAY_CBOR_STRINGS_SIZE / 2 || !bluray_cbor_strings_eligible(table->count, len))
+		return -1;
+
+	table->strings[slot] = malloc(len + 1);
+	if(table->strings[slot] == NULL)
+		return -1;
+
+	memcpy(table->strings[slot], str, len);
+	table->strings[slot][len] = '\0';
+	table->indexes[slot] = table->count;
+	table->count++;
+
+	return -1;
+
+}
@@ -0,0 +1,61 @@
+#ifndef BLURAY_INFO_CBOR_H
+#define BLURAY_INFO_CBOR_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+/**
+ * CBOR (RFC 8949) encoding helpers for the JSON writer
+ *
+ * Repeated strings (keys, languages, codec names) are sent once and then
+ * referenced by their index, using the stringref extension: the root item is
+ * wrapped in tag 256, and a reference is tag 25 followed by the index.
+ * See http://cbor.schmorp.de/stringref
+ */
+
+// Major types
+#define BLURAY_CBOR_UINT 0
+#define BLURAY_CBOR_NINT 1
+#define BLURAY_CBOR_TEXT 3
+#define BLURAY_CBOR_ARRAY 4
+#define BLURAY_CBOR_MAP 5
+#define BLURAY_CBOR_TAG 6
+
+// Simple values
+#define BLURAY_CBOR_FALSE 0xf4
+#define BLURAY_CBOR_TRUE 0xf5
+#define BLURAY_CBOR_BREAK 0xff
+#define BLURAY_CBOR_ARRAY_INDEFINITE 0x9f
+#define BLURAY_CBOR_MAP_INDEFINITE 0xbf
+
+// Tags
+#define BLURAY_CBOR_TAG_DECIMAL_FRACTION 4
+#define BLURAY_CBOR_TAG_STRINGREF 25
+#define BLURAY_CBOR_TAG_STRINGREF_NAMESPACE 256
+#define BLURAY_CBOR_TAG_SELF_DESCRIBE 55799
+
+// Longest encoded head: initial byte plus a 64-bit argument
+#define BLURAY_CBOR_HEAD_MAX 9
+
+// Number of strings remembered per namespace, has to be a power of two
+#define BLURAY_CBOR_STRINGS_SIZE 4096
+
+struct bluray_cbor_strings {
+	uint32_t count;
+	char *strings[BLURAY_CBOR_STRINGS_SIZE];
+	uint32_t indexes[BLURAY_CBOR_STRINGS_SIZE];
+};
+
+size_t bluray_cbor_head(uint8_t *dest, uint8_t major, uint64_t value);
+
+struct bluray_cbor_strings *bluray_cbor_strings_init(void);
+
+void bluray_cbor_strings_reset(struct bluray_cbor_strings *table);
+
+void bluray_cbor_strings_free(struct bluray_cbor_strings *table);
+
+int64_t bluray_cbor_strings_lookup(struct bluray_cbor_strings *table, const char *str, size_t len);
+
+#endif
@@ -4,11 +4,10 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include "libbluray/bluray.h"
+#include "bluray_open.h"
 
-uint64_t bluray_chapter_first_position(struct bluray *bd, const uint32_t title_ix, const uint32_t chapter_ix);
+int bluray_chapter_range(const struct bluray_title *bluray_title, const uint32_t chapter_ix, uint64_t *first_position, uint64_t *last_position);
 
-uint64_t bluray_chapter_last_position(struct bluray *bd, const uint32_t title_ix, const uint32_t chapter_ix);
-
-uint64_t bluray_chapter_size(struct bluray *bd, const uint32_t title_ix, const uint32_t chapter_ix);
+uint64_t bluray_chapter_size(const struct bluray_title *bluray_title, const uint32_t chapter_ix);
 
 #endif
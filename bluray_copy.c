@@ -14,6 +14,11 @@
 #include "bluray_device.h"
 #include "bluray_open.h"
 #include "bluray_time.h"
+#include "bluray_chapter.h"
+#include "bluray_cache.h"
+#include "bluray_bdmv.h"
+#include "bluray_aacs.h"
+#include "bluray_ts.h"
 #include "bluray_copy.h"
 
 /**
@@ -59,6 +64,10 @@ int main(int argc, char **argv) {
 	uint8_t arg_angle_number = 1;
 	bool debug = false;
 	const char *key_db_filename = NULL;
+	uint64_t disc_cache_size = 0;
+	bool opt_decrypt = false;
+	uint32_t decrypt_workers = 0;
+	bool opt_check = true;
 
 	// Chapter range selection
 	uint32_t arg_chapter_numbers[2];
@@ -77,6 +86,9 @@ int main(int argc, char **argv) {
 		{ "output", required_argument, NULL, 'o' },
 		{ "playlist", required_argument, NULL, 'p' },
 		{ "title", required_argument, NULL, 't' },
+		{ "disc-cache", required_argument, NULL, 'C' },
+		{ "decrypt", required_argument, NULL, 'D' },
+		{ "no-check", no_argument, NULL, 'N' },
 		{ "debug", no_argument, NULL, 'z' },
 		{ "version", no_argument, NULL, 'Z' },
 		{ 0, 0, 0, 0 }
@@ -115,6 +127,19 @@ int main(int argc, char **argv) {
 				}
 				break;
 
+			case 'C':
+				disc_cache_size = strtoull(optarg, NULL, 10) * 1048576;
+				break;
+
+			case 'D':
+				opt_decrypt = true;
+				decrypt_workers = (uint32_t)strtoul(optarg, NULL, 10);
+				break;
+
+			case 'N':
+				opt_check = false;
+				break;
+
 			case 'k':
 				key_db_filename = optarg;
 				break;
@@ -176,6 +201,9 @@ int main(int argc, char **argv) {
 				printf("Other:\n");
 				printf("  -k, --keydb <filename>   Location to KEYDB.cfg (default: ~/.config/aacs/KEYDB.cfg)\n");
 				printf("  -a, --angle <#>          Video angle (default: 1)\n");
+				printf("      --disc-cache <MBs>   Keep what's read from the disc in a cache this big\n");
+				printf("      --decrypt <#>        Decrypt images and directories in # threads (0: one per CPU)\n");
+				printf("      --no-check           Don't check that the copy is a valid transport stream\n");
 				printf("  -h, --help		   This output\n");
 				printf("      --version		   Version information\n");
 				printf("\n");
@@ -210,7 +238,7 @@ int main(int argc, char **argv) {
 
 	// Open device
 	BLURAY *bd = NULL;
-	bd = bd_open(device_filename, key_db_filename);
+	bd = bluray_disc_open(device_filename, key_db_filename);
 
 	if(bd == NULL) {
 		if(key_db_filename == NULL)
@@ -243,6 +271,15 @@ int main(int argc, char **argv) {
 		return 1;
 	}
 
+	// Disc cache, which is left off if it can't be opened
+	struct bluray_cache disc_cache;
+	char disc_id[BLURAY_INFO_DISC_ID_STRLEN];
+	bluray_cache_init(&disc_cache);
+	if(disc_cache_size && (bluray_disc_id(bd, &bluray_info, disc_id) || bluray_cache_open(&disc_cache, disc_id, disc_cache_size))) {
+		if(debug)
+			fprintf(stderr, "* could not open disc cache\n");
+	}
+
 	uint32_t d_num_titles;
 	d_num_titles = bluray_info.titles;
 
@@ -250,6 +287,7 @@ int main(int argc, char **argv) {
 	main_title_number = bluray_info.main_title + 1;
 
 	struct bluray_title bluray_title;
+	bluray_title.title_info = NULL;
 
 	// Set only the title index at this point, based on input argument.
 	// Create the default output filename if none is given.
@@ -317,6 +355,11 @@ int main(int argc, char **argv) {
 
 	}
 
+	if(bluray_cache_title_size(&disc_cache, &bluray_title, angle_ix)) {
+		bluray_title_size(bd, &bluray_title);
+		bluray_cache_set_title_size(&disc_cache, &bluray_title, angle_ix);
+	}
+
 	// Handle no argument given for last chapter
 	if(arg_chapter_numbers[1] == 0)
 		arg_chapter_numbers[1] = bluray_title.chapters;
@@ -334,6 +377,7 @@ int main(int argc, char **argv) {
 	chapters_range[1] = arg_chapter_numbers[1] - 1;
 
 	// Display disc title
+	bluray_info_disc_name(bd, &bluray_info);
 	if(strlen(bluray_info.disc_name) && d_num_titles) {
 		fprintf(io, "Disc title: %s\n", bluray_info.disc_name);
 	}
@@ -390,7 +434,9 @@ int main(int argc, char **argv) {
 	 * Don't rely on bd_seek, and instead seek to the title or chapter directly.
 	 *
 	 * bd_seek_chapter() jumps and returns its new seek position. The position is the
-	 * offset in bytes from the title (0); for the first chapter, it is probably 768.
+	 * offset in bytes from the title (0), the same as the chapter's offset in the
+	 * title info. The first chapter's mark can be a few packets in, but reading the
+	 * title starts at 0, which is where its range starts.
 	 *
 	 */
 
@@ -435,54 +481,22 @@ int main(int argc, char **argv) {
 
 	}
 
-	// Keep track of chapter ranges, sizes: 0 start sector, 1 stop sector, 2 size
-	// Since there's an offset of the first chapter from the title itself, the
-	// size has to be calculated. When doing seeks or reads though, use position
-	// as the index to see where you're at. No real reason to use the size other than
-	// you'd like to know how big the chapter is.
-
-	// The size for chapter one may be incorrect, because while the title start position
-	// is at 0, the chapter start position will have an offset. To do proper calculation
-	// I'd have to do a read, and check the new positions. It's a bit of a headache, and
-	// I'm not comfortable with it, and I don't want to display the filesize anyway, so
-	// everything here but the first chapter is going to be accurate. Only display the
-	// estimated sizes for debugging.
-
-	// Populate the array
-	uint64_t chapter_size = 0;
-	int64_t chapter_pos = 0;
-	for(chapter_ix = 0; chapter_ix < bluray_title.chapters; chapter_ix++) {
-		chapter_pos = bd_chapter_pos(bd, chapter_ix);
-		bluray_chapters[chapter_ix].range[0] = chapter_pos;
-		if(debug) {
-			fprintf(stderr, "* setting chapter ix %2" PRIu32 " start to %12" PRIi64 "\n", chapter_ix, chapter_pos);
-			fprintf(stderr, "* bluray_chapters ix %2" PRIu32 " range 0: %" PRIi64 "\n", chapter_ix, bluray_chapters[chapter_ix].range[0]);
-		}
-	}
-
-	// Set the final position size using the previous one as its ending point.
-	// For the last chapter, it's simply the title size.
-	// Calculate the chapter size as well.
+	// Chapter byte ranges in the title, from the chapter marks' positions in
+	// the title info, see bluray_chapter_range(). The first chapter starts at
+	// 0, where reading the title starts, and the last one ends at the end of
+	// the title, so the sizes are exact and add up to the title size.
 	uint32_t chapter_number = 1;
+	uint64_t chapter_range[2];
 	for(chapter_ix = 0; chapter_ix < bluray_title.chapters; chapter_ix++) {
 
-		chapter_number = chapter_ix + 1;
-		if(chapter_number == bluray_title.chapters) {
-			chapter_pos = (int64_t)bluray_title.size;
-		} else {
-			chapter_pos = bluray_chapters[chapter_ix + 1].range[0];
-		}
-		bluray_chapters[chapter_ix].range[1] = chapter_pos;
-		if(debug) {
-			fprintf(stderr, "* setting chapter ix %2" PRIu32 " stop to	%12" PRIi64 "\n", chapter_ix, bluray_chapters[chapter_ix].range[1]);
-		}
+		bluray_chapter_range(&bluray_title, chapter_ix, &chapter_range[0], &chapter_range[1]);
+		bluray_chapters[chapter_ix].range[0] = (int64_t)chapter_range[0];
+		bluray_chapters[chapter_ix].range[1] = (int64_t)chapter_range[1];
+		bluray_chapters[chapter_ix].size = chapter_range[1] - chapter_range[0];
+		bluray_chapters[chapter_ix].size_mbs = (uint64_t)(round((double)bluray_chapters[chapter_ix].size / 1048576));
 
-		chapter_size = (uint64_t)(bluray_chapters[chapter_ix].range[1] - bluray_chapters[chapter_ix].range[0]);
-		bluray_chapters[chapter_ix].size = chapter_size;
-		bluray_chapters[chapter_ix].size_mbs = (uint64_t)(round((double)chapter_size / 1048576));
-		if(debug) {
-			fprintf(stderr, "* setting chapter ix %2" PRIu32 " size to	%12" PRIi64 "\n", chapter_ix, bluray_chapters[chapter_ix].size);
-		}
+		if(debug)
+			fprintf(stderr, "* chapter ix %2" PRIu32 " range %12" PRIi64 " to %12" PRIi64 ", size %12" PRIu64 "\n", chapter_ix, bluray_chapters[chapter_ix].range[0], bluray_chapters[chapter_ix].range[1], bluray_chapters[chapter_ix].size);
 
 	}
 
@@ -527,8 +541,72 @@ int main(int argc, char **argv) {
 	// Jump to the first requested chapter
 	// Don't need output variable, just putting here to track it if needed later and
 	// to assign the function output to something to avoid possible compiler warnings.
-	int64_t bd_seek_chapter_retval;
-	bd_seek_chapter_retval = bd_seek_chapter(bd, chapter_ix);
+	int64_t bd_seek_chapter_retval = 0;
+
+	// The position is kept here instead of asking libbluray after each read.
+	// The range ends where the last requested chapter does, and reads are
+	// sized to stop there, and at each chapter on the way, so the current
+	// chapter only changes between reads.
+	uint64_t copy_position = (uint64_t)bluray_chapters[chapter_ix].range[0];
+	uint64_t copy_end = (uint64_t)bluray_chapters[chapters_range[1]].range[1];
+
+	// Decrypting in parallel reads the stream files straight from the image
+	// or directory, so it's only done when the titles are the ones libbluray
+	// has, and the title is the same size. It takes the place of the disc
+	// cache, which is for optical drives. Anything else is read through
+	// libbluray.
+	struct bluray_bdmv bdmv;
+	struct bluray_aacs aacs;
+	struct bluray_aacs_title aacs_title;
+	bool p_bdmv = false;
+	bool p_decrypt = false;
+	const char *decrypt_error = NULL;
+	bluray_aacs_init(&aacs);
+	if(opt_decrypt) {
+		p_bdmv = (bluray_bdmv_open(&bdmv, device_filename) == 0);
+		if(bluray_info.bdplus)
+			decrypt_error = "disc has BD+";
+		else if(!p_bdmv)
+			decrypt_error = "not a disc image or directory";
+		else if(!bluray_bdmv_matches(&bdmv, bd, bluray_info.titles, bluray_info.main_title))
+			decrypt_error = "titles are not the same as libbluray's";
+		else if(bluray_info.aacs && bluray_aacs_keys(&aacs, device_filename, key_db_filename))
+			decrypt_error = "no unit keys or volume unique key in KEYDB";
+		else if(bluray_aacs_title_open(&aacs_title, &aacs, &bdmv, device_filename, bluray_title.ix, angle_ix, (uint64_t)bluray_chapters[chapters_range[0]].range[0], (uint64_t)bluray_chapters[chapters_range[1]].range[1], decrypt_workers))
+			decrypt_error = "could not open stream files";
+		else if(aacs_title.size != bluray_title.size) {
+			decrypt_error = "title size is not the same as libbluray's";
+			bluray_aacs_title_close(&aacs_title);
+		} else {
+			p_decrypt = true;
+		}
+		if(decrypt_error != NULL)
+			fprintf(stderr, "Not decrypting in parallel, %s\n", decrypt_error);
+		else if(debug)
+			fprintf(stderr, "* decrypting in %" PRIu32 " threads, %" PRIu32 " unit keys, AES-NI: %s\n", aacs_title.num_workers, aacs.num_unit_keys, (bluray_aes_ni() ? "yes" : "no"));
+	}
+
+	// Reading through the disc cache only moves libbluray for blocks that
+	// aren't cached yet.
+	struct bluray_cache_title cache_title;
+	bool p_disc_cache = false;
+	if(bluray_cache_enabled(&disc_cache) && !p_decrypt)
+		p_disc_cache = !bluray_cache_title_open(&cache_title, &disc_cache, bd, &bluray_title, angle_ix);
+
+	// Selecting the title already starts reading at 0, where the first
+	// chapter's range starts, so only seek for a later one. If the seek
+	// fails, libbluray is still at the start of the title, so nothing is
+	// copied.
+	bool read_error = false;
+	if(!p_disc_cache && !p_decrypt && chapter_ix > 0) {
+		bd_seek_chapter_retval = bd_seek_chapter(bd, chapter_ix);
+		if(bd_seek_chapter_retval < 0) {
+			read_error = true;
+			fprintf(stderr, "Could not seek to chapter %" PRIu32 "\n", chapter_number);
+		} else {
+			copy_position = (uint64_t)bd_seek_chapter_retval;
+		}
+	}
 
 	if(debug) {
 		printf("* chapters_range[0]: %" PRIu32 "\n", chapters_range[0]);
@@ -536,27 +614,41 @@ int main(int argc, char **argv) {
 		printf("* bd_tell: %" PRIu64 "\n", bd_tell(bd));
 	}
 
+	// Check each packet as it's read, to stop early if the title isn't
+	// decrypted, and count the bad packets in each chapter, see bluray_ts.h
+	struct bluray_ts_check ts_check;
+	bool p_ts_check = false;
+	bool ts_window_checked = false;
+	bool ts_garbage = false;
+	uint64_t chapter_bad_packets[bluray_title.chapters];
+	memset(chapter_bad_packets, 0, sizeof(chapter_bad_packets));
+	if(opt_check)
+		p_ts_check = !bluray_ts_check_init(&ts_check, &bluray_title, copy_position);
+
 	// Display the first chapter
-	// Note that even though the first chapter will have an offset from the beginning
-	// of the title, bd_read() will start from 0, meaning you can't rely on the
-	// chapter positions as absolute definitions of what the filesize will actually be.
-	// For that reason, I used to have filesize in here, but it's not guaranteed to
-	// be accurate, so don't display it.
-	fprintf(io, "	Chapter: %03" PRIu32 ", Start: %s, Length: %s\n", chapter_number, bluray_chapters[chapter_ix].start_time, bluray_chapters[chapter_ix].length);
-
-	// Loop until specifically broken out
+	if(!read_error)
+		fprintf(io, "	Chapter: %03" PRIu32 ", Start: %s, Length: %s\n", chapter_number, bluray_chapters[chapter_ix].start_time, bluray_chapters[chapter_ix].length);
+
+	// Loop until the end of the range, the end of the title, or an error
 	ssize_t write_retval = -1;
-	while(true) {
+	uint64_t read_end = 0;
+	while(!read_error && copy_position < copy_end) {
 
-		// Display chapter information -- have to start on the second chapter, because while jumping
-		// positions, the first chapter position will actually be hit twice.
-		if(bluray_chapters[chapter_ix].range[0] == (int64_t)bd_tell(bd) && chapter_number <= bluray_title.chapters && chapter_ix > chapters_range[0]) {
-			fprintf(io, "\33[2K");
-			fprintf(io, "	Chapter: %03" PRIu32 ", Start: %s, Length: %s\n", chapter_number, bluray_chapters[chapter_ix].start_time, bluray_chapters[chapter_ix].length);
-		}
+		// Read up to the end of the current chapter
+		read_end = (uint64_t)bluray_chapters[chapter_ix].range[1];
+		if(read_end > copy_end)
+			read_end = copy_end;
+		bluray_read[0] = BLURAY_COPY_BUFFER_SIZE;
+		if(read_end - copy_position < (uint64_t)bluray_read[0])
+			bluray_read[0] = (int64_t)(read_end - copy_position);
 
 		// Read from the bluray
-		bluray_read[1] = (int64_t)bd_read(bd, bluray_buffer, (int)bluray_read[0]);
+		if(p_decrypt)
+			bluray_read[1] = bluray_aacs_title_read(&aacs_title, bluray_buffer, (size_t)bluray_read[0]);
+		else if(p_disc_cache)
+			bluray_read[1] = bluray_cache_title_read(&cache_title, copy_position, bluray_buffer, (size_t)bluray_read[0]);
+		else
+			bluray_read[1] = (int64_t)bd_read(bd, bluray_buffer, (int)bluray_read[0]);
 
 		// bd_read will return up to the length required, and stop if it's at the
 		// end of the file. Therefore, your buffer size is going to be the result
@@ -572,10 +664,13 @@ int main(int argc, char **argv) {
 		// Find out what read error occurred
 		if(bluray_read[1] == -1) {
 
+			read_error = true;
 			fprintf(stderr, "\n");
 			fprintf(stderr, "Read error on disc\n");
 
-			if(bd_info->aacs_error_code) {
+			if(p_decrypt)
+				fprintf(stderr, "Could not decrypt, check the unit keys in KEYDB\n");
+			else if(bd_info->aacs_error_code) {
 
 				fprintf(stderr, "Error decoding AACS: ");
 
@@ -627,6 +722,25 @@ int main(int argc, char **argv) {
 		// going to be some multiplication of 1 MB (1048576), and that is chosen based on
 		// human-readability of progress output. A double can also store the max size as well.
 		bluray_read[2] += bluray_read[1];
+		copy_position += (uint64_t)bluray_read[1];
+
+		// Check the packets before they're written, and give up if the start
+		// of the title is mostly bad ones
+		if(p_ts_check) {
+			uint64_t bad_packets = bluray_ts_check(&ts_check, bluray_buffer, (size_t)bluray_read[1]);
+			if(bad_packets && chapter_ix < bluray_title.chapters)
+				chapter_bad_packets[chapter_ix] += bad_packets;
+			if(!ts_window_checked && ts_check.packets * BLURAY_TS_PACKET_SIZE >= BLURAY_TS_WINDOW) {
+				ts_window_checked = true;
+				if(bluray_ts_check_garbage(&ts_check)) {
+					ts_garbage = true;
+					fprintf(stderr, "\n");
+					fprintf(stderr, "The title is not a valid transport stream, %" PRIu64 " of the first %" PRIu64 " packets are bad\n", ts_check.bad_packets, ts_check.packets);
+					fprintf(stderr, "It's probably not decrypted, check the keys in KEYDB, or use --no-check to copy it anyway\n");
+					break;
+				}
+			}
+		}
 
 		// Write to the file
 		bluray_write[0] = bluray_read[1];
@@ -649,35 +763,61 @@ int main(int argc, char **argv) {
 			progress[1]++;
 			progress[2] = (progress[1] / bluray_copy.size_mbs) * 100;
 			if(debug) {
-				fprintf(stderr, "* success: %08" PRIi64 " bytes; total size_mbs read: %06" PRIi64 "; position: %012" PRIu64 ", chapter ix: %03" PRIu32 ", chapter number: %03" PRIu32 "; Progress: %.0lf/%.0lf MBs\r", bluray_read[1], bluray_read[2] / 1048576, bd_tell(bd), bd_get_current_chapter(bd), bd_get_current_chapter(bd) + 1, progress[1], bluray_copy.size_mbs);
+				fprintf(stderr, "* success: %08" PRIi64 " bytes; total size_mbs read: %06" PRIi64 "; position: %012" PRIu64 ", chapter ix: %03" PRIu32 ", chapter number: %03" PRIu32 "; Progress: %.0lf/%.0lf MBs\r", bluray_read[1], bluray_read[2] / 1048576, copy_position, chapter_ix, chapter_number, progress[1], bluray_copy.size_mbs);
 				fflush(stderr);
 			}
 			fprintf(stderr, "Progress: %6.0lf/%.0lf MBs (%.0lf%%)\r", progress[1], bluray_copy.size_mbs, progress[2]);
 			fflush(stderr);
 		}
 
-		// Only use getting current chapter as setting boundary for copying, not the
-		// calculated size or specified end positions. This is intentionally done
-		// to avoid calculation errors.
-		chapter_ix = bd_get_current_chapter(bd);
-		chapter_number = chapter_ix + 1;
-
-		// Stop if we've reached pulling the last of the chapter range
-		// This will only work if the last requested chapter is before the actual last one
-		if(chapter_ix > chapters_range[1]) {
-			break;
+		// Display the next chapter once the read reaches its start, and any
+		// empty ones in between
+		while(copy_position >= (uint64_t)bluray_chapters[chapter_ix].range[1] && chapter_ix < chapters_range[1]) {
+			chapter_ix++;
+			chapter_number = chapter_ix + 1;
+			fprintf(io, "\33[2K");
+			fprintf(io, "	Chapter: %03" PRIu32 ", Start: %s, Length: %s\n", chapter_number, bluray_chapters[chapter_ix].start_time, bluray_chapters[chapter_ix].length);
 		}
 
 	}
 
 	fprintf(io, "\n");
 
+	bool stream_errors = false;
+	if(p_ts_check) {
+		if(debug)
+			fprintf(stderr, "* stream check: %" PRIu64 " packets, sync errors: %" PRIu64 ", timestamp errors: %" PRIu64 ", continuity errors: %" PRIu64 "\n", ts_check.packets, ts_check.sync_errors, ts_check.ats_errors, ts_check.continuity_errors);
+		if(ts_check.bad_packets && !ts_garbage) {
+			stream_errors = true;
+			fprintf(stderr, "Bad packets: %" PRIu64 " of %" PRIu64 ", sync bytes: %" PRIu64 ", timestamps: %" PRIu64 ", continuity counters: %" PRIu64 "\n", ts_check.bad_packets, ts_check.packets, ts_check.sync_errors, ts_check.ats_errors, ts_check.continuity_errors);
+			for(chapter_ix = chapters_range[0]; chapter_ix <= chapters_range[1]; chapter_ix++) {
+				if(chapter_bad_packets[chapter_ix])
+					fprintf(stderr, "	Chapter: %03" PRIu32 ", Bad packets: %" PRIu64 "\n", chapter_ix + 1, chapter_bad_packets[chapter_ix]);
+			}
+		}
+		bluray_ts_check_free(&ts_check);
+	}
+
 	if(debug) {
-		fprintf(stderr, "* current chapter ix: %" PRIu32 "\n", bd_get_current_chapter(bd));
+		fprintf(stderr, "* current chapter ix: %" PRIu32 ", position: %" PRIu64 ", range end: %" PRIu64 "\n", chapter_ix, copy_position, copy_end);
 		fprintf(stderr, "* total bytes read: %" PRIi64 " bytes\n", bluray_read[2]);
 		fprintf(stderr, "* total MBs read: %lf bytes\n", ceil(ceil((double)bluray_read[2]) / 1048576));
 	}
 
+	if(p_disc_cache) {
+		if(debug)
+			fprintf(stderr, "* disc cache hits: %" PRIu64 ", misses: %" PRIu64 "\n", disc_cache.hits, disc_cache.misses);
+		bluray_cache_title_close(&cache_title);
+	}
+	bluray_cache_close(&disc_cache);
+
+	if(p_decrypt)
+		bluray_aacs_title_close(&aacs_title);
+	bluray_aacs_free(&aacs);
+	if(p_bdmv)
+		bluray_bdmv_close(&bdmv);
+
+	bluray_title_free(&bluray_title);
 	bd_close(bd);
 	bd = NULL;
 
@@ -699,6 +839,9 @@ int main(int argc, char **argv) {
 	if(bluray_copy.filename)
 		bluray_copy.filename = NULL;
 
+	if(read_error || ts_garbage || stream_errors)
+		return 1;
+
 	return 0;
 
 }
@@ -4,10 +4,13 @@
 /**
  * For packet size, use the same as libbluray. This makes doing math much
  * simpler when calculating where start and end points of chapters are.
- * Plus, it makes checking for one bad fetch possible, and can skip over bad
- * blocks.
+ *
+ * Reads are a whole number of packets, 32 aligned units of 6144 bytes, and
+ * are cut short at the end of each chapter, so the chapter and the end of
+ * the range are known without asking libbluray.
  */
-#define BLURAY_COPY_BUFFER_SIZE 192
+#define BLURAY_COPY_PACKET_SIZE 192
+#define BLURAY_COPY_BUFFER_SIZE (BLURAY_COPY_PACKET_SIZE * 1024)
 
 struct bluray_copy {
 	char *filename;
@@ -0,0 +1,582 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "bluray_daemon.h"
+#include "bluray_json.h"
+#include "bluray_report.h"
+
+void bluray_daemon_init(struct bluray_daemon *daemon, const char *socket_filename, const char *key_db_filename) {
+
+	daemon->socket_filename = socket_filename;
+	daemon->key_db_filename = key_db_filename;
+	daemon->workers = BLURAY_DAEMON_WORKERS;
+	daemon->max_discs = BLURAY_DAEMON_MAX_DISCS;
+	daemon->idle_timeout = BLURAY_DAEMON_IDLE_TIMEOUT;
+	daemon->client_timeout = BLURAY_DAEMON_CLIENT_TIMEOUT;
+	daemon->max_memory = (size_t)BLURAY_DAEMON_MAX_MEMORY * 1048576;
+	daemon->fd = -1;
+	daemon->discs = NULL;
+	daemon->last_disc = NULL;
+	daemon->open_discs = 0;
+	daemon->memory = 0;
+	daemon->requests = 0;
+	daemon->cache_hits = 0;
+
+}
+
+static void bluray_daemon_disc_free(struct bluray_daemon_disc *disc) {
+
+	struct bluray_daemon_response *response = disc->responses;
+	struct bluray_daemon_response *next = NULL;
+	while(response != NULL) {
+		next = response->next;
+		free(response->request);
+		free(response->data);
+		free(response);
+		response = next;
+	}
+
+	bluray_handle_close(disc->handle);
+	pthread_mutex_destroy(&disc->lock);
+	free(disc->filename);
+	free(disc);
+
+}
+
+/**
+ * Remove a disc from the LRU list. The daemon lock must be held.
+ */
+static void bluray_daemon_unlink(struct bluray_daemon *daemon, struct bluray_daemon_disc *disc) {
+
+	if(disc->prev)
+		disc->prev->next = disc->next;
+	else
+		daemon->discs = disc->next;
+
+	if(disc->next)
+		disc->next->prev = disc->prev;
+	else
+		daemon->last_disc = disc->prev;
+
+	disc->prev = NULL;
+	disc->next = NULL;
+
+}
+
+static void bluray_daemon_push(struct bluray_daemon *daemon, struct bluray_daemon_disc *disc) {
+
+	disc->prev = NULL;
+	disc->next = daemon->discs;
+	if(daemon->discs)
+		daemon->discs->prev = disc;
+	else
+		daemon->last_disc = disc;
+	daemon->discs = disc;
+
+}
+
+/**
+ * Take discs that nobody is using off the list, starting with the least
+ * recently used: the ones that failed to open, have been idle too long, or
+ * are over the disc count and memory limits. The daemon lock must be held.
+ *
+ * Returns a list of the removed discs, to be closed after unlocking.
+ */
+static struct bluray_daemon_disc *bluray_daemon_evict(struct bluray_daemon *daemon, time_t now) {
+
+	struct bluray_daemon_disc *evicted = NULL;
+	struct bluray_daemon_disc *disc = daemon->last_disc;
+	struct bluray_daemon_disc *prev = NULL;
+	bool over_limit = false;
+
+	while(disc != NULL) {
+
+		prev = disc->prev;
+		over_limit = (daemon->open_discs > daemon->max_discs || daemon->memory > daemon->max_memory);
+
+		if(disc->users == 0 && (!disc->opened || over_limit || now - disc->last_used >= (time_t)daemon->idle_timeout)) {
+			bluray_daemon_unlink(daemon, disc);
+			if(disc->opened)
+				daemon->open_discs--;
+			daemon->memory -= disc->memory;
+			disc->next = evicted;
+			evicted = disc;
+		}
+
+		disc = prev;
+
+	}
+
+	return evicted;
+
+}
+
+static void bluray_daemon_close_discs(struct bluray_daemon_disc *disc) {
+
+	struct bluray_daemon_disc *next = NULL;
+	while(disc != NULL) {
+		next = disc->next;
+		bluray_daemon_disc_free(disc);
+		disc = next;
+	}
+
+}
+
+/**
+ * Get a disc from the cache, opening it if needed, and lock it for the caller.
+ * Returns NULL if the disc can't be opened.
+ */
+static struct bluray_daemon_disc *bluray_daemon_acquire(struct bluray_daemon *daemon, const char *filename) {
+
+	struct bluray_daemon_disc *disc = NULL;
+
+	pthread_mutex_lock(&daemon->lock);
+
+	daemon->requests++;
+
+	for(disc = daemon->discs; disc != NULL; disc = disc->next) {
+		if(strcmp(disc->filename, filename) == 0)
+			break;
+	}
+
+	if(disc == NULL) {
+		disc = calloc(1, sizeof(struct bluray_daemon_disc));
+		if(disc == NULL) {
+			pthread_mutex_unlock(&daemon->lock);
+			return NULL;
+		}
+		disc->filename = strdup(filename);
+		if(disc->filename == NULL) {
+			free(disc);
+			pthread_mutex_unlock(&daemon->lock);
+			return NULL;
+		}
+		pthread_mutex_init(&disc->lock, NULL);
+	} else {
+		bluray_daemon_unlink(daemon, disc);
+	}
+
+	bluray_daemon_push(daemon, disc);
+	disc->users++;
+
+	pthread_mutex_unlock(&daemon->lock);
+
+	// Opening is done under the disc lock only, so other discs aren't held up
+	pthread_mutex_lock(&disc->lock);
+
+	if(!disc->opened && disc->handle == NULL) {
+		disc->handle = bluray_handle_open(disc->filename, daemon->key_db_filename);
+		if(disc->handle != NULL) {
+			pthread_mutex_lock(&daemon->lock);
+			disc->opened = true;
+			disc->memory += BLURAY_DAEMON_DISC_COST;
+			daemon->open_discs++;
+			daemon->memory += BLURAY_DAEMON_DISC_COST;
+			pthread_mutex_unlock(&daemon->lock);
+		}
+	}
+
+	return disc;
+
+}
+
+static void bluray_daemon_release(struct bluray_daemon *daemon, struct bluray_daemon_disc *disc) {
+
+	pthread_mutex_unlock(&disc->lock);
+
+	pthread_mutex_lock(&daemon->lock);
+	time_t now = time(NULL);
+	disc->users--;
+	disc->last_used = now;
+	struct bluray_daemon_disc *evicted = bluray_daemon_evict(daemon, now);
+	pthread_mutex_unlock(&daemon->lock);
+
+	bluray_daemon_close_discs(evicted);
+
+}
+
+/**
+ * Keep a response to send again. The disc lock must be held.
+ */
+static void bluray_daemon_cache(struct bluray_daemon *daemon, struct bluray_daemon_disc *disc, const char *request, const char *data, size_t length) {
+
+	struct bluray_daemon_response *response = calloc(1, sizeof(struct bluray_daemon_response));
+	if(response == NULL)
+		return;
+
+	response->request = strdup(request);
+	response->data = malloc(length);
+	if(response->request == NULL || response->data == NULL) {
+		free(response->request);
+		free(response->data);
+		free(response);
+		return;
+	}
+	memcpy(response->data, data, length);
+	response->length = length;
+	response->next = disc->responses;
+	disc->responses = response;
+
+	size_t memory = length + strlen(request) + sizeof(struct bluray_daemon_response);
+
+	pthread_mutex_lock(&daemon->lock);
+	disc->memory += memory;
+	daemon->memory += memory;
+	pthread_mutex_unlock(&daemon->lock);
+
+}
+
+static void bluray_daemon_error_json(struct bluray_json *json, const char *error) {
+
+	bluray_json_object_open(json, NULL);
+	bluray_report_error(json, error);
+	bluray_json_object_close(json);
+
+}
+
+static void bluray_daemon_stats_json(struct bluray_json *json, struct bluray_daemon *daemon) {
+
+	pthread_mutex_lock(&daemon->lock);
+	uint32_t open_discs = daemon->open_discs;
+	size_t memory = daemon->memory;
+	uint64_t requests = daemon->requests;
+	uint64_t cache_hits = daemon->cache_hits;
+	pthread_mutex_unlock(&daemon->lock);
+
+	bluray_json_object_open(json, NULL);
+	bluray_json_uint(json, "open discs", open_discs);
+	bluray_json_uint(json, "memory", memory);
+	bluray_json_uint(json, "requests", requests);
+	bluray_json_uint(json, "cache hits", cache_hits);
+	bluray_json_object_close(json);
+
+}
+
+/**
+ * Answer one request line into json. Disc queries are cached per disc,
+ * keyed by the request without the path.
+ */
+static void bluray_daemon_request(struct bluray_daemon *daemon, struct bluray_json *json, char *line) {
+
+	char *command = line;
+	char *filename = NULL;
+	unsigned long int arg_number = 0;
+	bool title_query = false;
+
+	char *space = strchr(line, ' ');
+	if(space != NULL) {
+		*space = '\0';
+		filename = space + 1;
+	}
+
+	if(strcmp(command, "stats") == 0) {
+		bluray_daemon_stats_json(json, daemon);
+		return;
+	}
+
+	if(strcmp(command, "title") == 0 || strcmp(command, "chapters") == 0) {
+		title_query = true;
+		if(filename == NULL) {
+			bluray_daemon_error_json(json, "missing title number");
+			return;
+		}
+		arg_number = strtoul(filename, &filename, 10);
+		if(arg_number < 1 || arg_number > UINT32_MAX || *filename != ' ') {
+			bluray_daemon_error_json(json, "invalid title number");
+			return;
+		}
+		filename++;
+	} else if(strcmp(command, "disc") != 0) {
+		bluray_daemon_error_json(json, "unknown request");
+		return;
+	}
+
+	if(filename == NULL || *filename == '\0') {
+		bluray_daemon_error_json(json, "missing path");
+		return;
+	}
+
+	char request[32];
+	if(title_query)
+		snprintf(request, sizeof(request), "%s %lu", command, arg_number);
+	else
+		snprintf(request, sizeof(request), "%s", command);
+
+	struct bluray_daemon_disc *disc = bluray_daemon_acquire(daemon, filename);
+	if(disc == NULL) {
+		bluray_daemon_error_json(json, "out of memory");
+		return;
+	}
+
+	if(disc->handle == NULL) {
+		bluray_daemon_error_json(json, "could not open disc");
+		bluray_daemon_release(daemon, disc);
+		return;
+	}
+
+	struct bluray_daemon_response *response = NULL;
+	for(response = disc->responses; response != NULL; response = response->next) {
+		if(strcmp(response->request, request) == 0)
+			break;
+	}
+
+	if(response != NULL) {
+		pthread_mutex_lock(&daemon->lock);
+		daemon->cache_hits++;
+		pthread_mutex_unlock(&daemon->lock);
+		bluray_json_raw(json, response->data, response->length);
+		bluray_daemon_release(daemon, disc);
+		return;
+	}
+
+	int retval = 0;
+	size_t start = json->length;
+
+	uint32_t title_ix = (uint32_t)(arg_number - 1);
+
+	if(strcmp(command, "disc") == 0) {
+		bluray_json_object_open(json, NULL);
+		bluray_report_disc(json, disc->handle);
+		bluray_json_object_close(json);
+	} else if(strcmp(command, "title") == 0) {
+		retval = bluray_report_title(json, disc->handle, title_ix, false);
+	} else if(title_ix < bluray_handle_titles(disc->handle)) {
+		bluray_json_object_open(json, NULL);
+		bluray_json_uint(json, "title", arg_number);
+		bluray_report_chapters(json, disc->handle, title_ix);
+		bluray_json_object_close(json);
+	} else {
+		retval = 1;
+	}
+
+	if(retval)
+		bluray_daemon_error_json(json, "invalid title number");
+	else if(!json->error)
+		bluray_daemon_cache(daemon, disc, request, json->buffer + start, json->length - start);
+
+	bluray_daemon_release(daemon, disc);
+
+}
+
+static int bluray_daemon_write(int fd, const char *buffer, size_t length) {
+
+	ssize_t written = 0;
+
+	while(length > 0) {
+		written = write(fd, buffer, length);
+		if(written < 0 && errno == EINTR)
+			continue;
+		if(written <= 0)
+			return 1;
+		buffer += written;
+		length -= (size_t)written;
+	}
+
+	return 0;
+
+}
+
+/**
+ * Read request lines from a client until it hangs up, or is idle for too long,
+ * either not sending requests or not reading the responses
+ */
+static void bluray_daemon_client(struct bluray_daemon *daemon, int client_fd) {
+
+	struct timeval timeout;
+	timeout.tv_sec = daemon->client_timeout;
+	timeout.tv_usec = 0;
+	setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	FILE *io = fdopen(client_fd, "r");
+	if(io == NULL) {
+		close(client_fd);
+		return;
+	}
+
+	struct bluray_json json;
+	if(bluray_json_init(&json, NULL, BLURAY_JSON_FORMAT_NDJSON)) {
+		bluray_json_free(&json);
+		fclose(io);
+		return;
+	}
+
+	char line[BLURAY_DAEMON_LINE_MAX];
+	size_t length = 0;
+	bool too_long = false;
+
+	while(fgets(line, BLURAY_DAEMON_LINE_MAX, io) != NULL) {
+
+		// A line that doesn't fit is answered once, and the rest of it is
+		// skipped, not read as another request
+		length = strlen(line);
+		too_long = false;
+		if(length && line[length - 1] == '\n') {
+			line[--length] = '\0';
+		} else if(length == BLURAY_DAEMON_LINE_MAX - 1) {
+			too_long = true;
+			while(fgets(line, BLURAY_DAEMON_LINE_MAX, io) != NULL && line[strlen(line) - 1] != '\n')
+				;
+		}
+		if(length && line[length - 1] == '\r')
+			line[--length] = '\0';
+
+		if(length == 0)
+			continue;
+
+		bluray_json_reset(&json);
+		if(too_long)
+			bluray_daemon_error_json(&json, "request too long");
+		else
+			bluray_daemon_request(daemon, &json, line);
+		bluray_json_end(&json);
+
+		if(json.error)
+			break;
+
+		if(bluray_daemon_write(client_fd, json.buffer, json.length))
+			break;
+
+	}
+
+	bluray_json_free(&json);
+	fclose(io);
+
+}
+
+static void *bluray_daemon_worker(void *arg) {
+
+	struct bluray_daemon *daemon = arg;
+	int client_fd = -1;
+
+	while(true) {
+
+		client_fd = accept(daemon->fd, NULL, NULL);
+
+		if(client_fd < 0) {
+			if(errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break;
+		}
+
+		bluray_daemon_client(daemon, client_fd);
+
+	}
+
+	return NULL;
+
+}
+
+/**
+ * Close discs that have been idle for too long
+ */
+static void *bluray_daemon_reaper(void *arg) {
+
+	struct bluray_daemon *daemon = arg;
+	struct bluray_daemon_disc *evicted = NULL;
+	unsigned int interval = daemon->idle_timeout / 2;
+
+	if(interval == 0)
+		interval = 1;
+
+	while(true) {
+
+		sleep(interval);
+
+		pthread_mutex_lock(&daemon->lock);
+		evicted = bluray_daemon_evict(daemon, time(NULL));
+		pthread_mutex_unlock(&daemon->lock);
+
+		bluray_daemon_close_discs(evicted);
+
+	}
+
+	return NULL;
+
+}
+
+/**
+ * Listen on the socket and answer requests until SIGINT or SIGTERM
+ */
+int bluray_daemon_serve(struct bluray_daemon *daemon) {
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(struct sockaddr_un));
+	addr.sun_family = AF_UNIX;
+
+	if(strlen(daemon->socket_filename) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path is too long: %s\n", daemon->socket_filename);
+		return 1;
+	}
+	strcpy(addr.sun_path, daemon->socket_filename);
+
+	// Remove a socket left behind by a previous run, but nothing else
+	struct stat socket_stat;
+	if(lstat(daemon->socket_filename, &socket_stat) == 0 && S_ISSOCK(socket_stat.st_mode))
+		unlink(daemon->socket_filename);
+
+	daemon->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(daemon->fd < 0) {
+		fprintf(stderr, "Could not create socket: %s\n", strerror(errno));
+		return 1;
+	}
+
+	// Anyone who can connect can have the daemon open any disc it can read,
+	// so the socket is created with mode 0600. No threads are running
+	// yet, so changing the umask doesn't affect anything else.
+	mode_t umask_mode = umask(0177);
+	int bind_status = bind(daemon->fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_un));
+	umask(umask_mode);
+
+	if(bind_status || listen(daemon->fd, 64)) {
+		fprintf(stderr, "Could not listen on %s: %s\n", daemon->socket_filename, strerror(errno));
+		close(daemon->fd);
+		return 1;
+	}
+
+	// Handle the signals in this thread only, and ignore clients that hang up
+	// before reading their response
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	pthread_mutex_init(&daemon->lock, NULL);
+
+	pthread_t thread;
+	uint32_t ix = 0;
+	uint32_t workers = 0;
+	for(ix = 0; ix < daemon->workers; ix++) {
+		if(pthread_create(&thread, NULL, bluray_daemon_worker, daemon) == 0) {
+			pthread_detach(thread);
+			workers++;
+		}
+	}
+
+	if(workers == 0 || pthread_create(&thread, NULL, bluray_daemon_reaper, daemon) != 0) {
+		fprintf(stderr, "Could not start worker threads\n");
+		close(daemon->fd);
+		unlink(daemon->socket_filename);
+		return 1;
+	}
+	pthread_detach(thread);
+
+	int signal_number = 0;
+	sigwait(&signals, &signal_number);
+
+	close(daemon->fd);
+	unlink(daemon->socket_filename);
+
+	return 0;
+
+}
@@ -0,0 +1,91 @@
+#ifndef BLURAY_INFO_DAEMON_H
+#define BLURAY_INFO_DAEMON_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include "bluray_handle.h"
+
+/**
+ * bluray_info --serve: answer queries over a Unix socket
+ *
+ * Clients send one request per line and get one line of compact JSON back,
+ * using the same keys as bluray_info --json:
+ *
+ *   disc <path>              disc summary
+ *   title <number> <path>    title with its video, audio and subtitle streams
+ *   chapters <number> <path> chapters of a title
+ *   stats                    open discs and cache usage
+ *
+ * Opened discs are kept in a LRU list, along with the responses already sent
+ * for them, so repeated queries skip bd_open(), KEYDB loading and the playlist
+ * parsing. A disc is closed when it has been idle for idle_timeout seconds, or
+ * when max_discs or max_memory is exceeded, oldest first.
+ *
+ * A pool of worker threads accepts connections. Requests for different discs
+ * run in parallel; requests for the same disc are serialized, since a libbluray
+ * handle can't be shared between threads. A worker stays with its client
+ * until it hangs up, so a client that sends or reads nothing for
+ * client_timeout seconds is dropped, and idle clients can't hold up every
+ * worker.
+ *
+ * The socket is only accessible to the user running the daemon.
+ */
+
+#define BLURAY_DAEMON_WORKERS 4
+#define BLURAY_DAEMON_MAX_DISCS 16
+#define BLURAY_DAEMON_IDLE_TIMEOUT 300
+#define BLURAY_DAEMON_MAX_MEMORY 256
+#define BLURAY_DAEMON_CLIENT_TIMEOUT 30
+
+// libbluray doesn't report how much memory a disc uses, so count each open
+// one as this many bytes, plus the size of its cached responses
+#define BLURAY_DAEMON_DISC_COST 2097152
+
+#define BLURAY_DAEMON_LINE_MAX 8192
+
+struct bluray_daemon_response {
+	char *request;
+	char *data;
+	size_t length;
+	struct bluray_daemon_response *next;
+};
+
+struct bluray_daemon_disc {
+	char *filename;
+	bluray_handle *handle;
+	bool opened;
+	pthread_mutex_t lock;
+	uint32_t users;
+	time_t last_used;
+	size_t memory;
+	struct bluray_daemon_response *responses;
+	struct bluray_daemon_disc *prev;
+	struct bluray_daemon_disc *next;
+};
+
+struct bluray_daemon {
+	const char *socket_filename;
+	const char *key_db_filename;
+	uint32_t workers;
+	uint32_t max_discs;
+	uint32_t idle_timeout;
+	uint32_t client_timeout;
+	size_t max_memory;
+	int fd;
+	pthread_mutex_t lock;
+	struct bluray_daemon_disc *discs;
+	struct bluray_daemon_disc *last_disc;
+	uint32_t open_discs;
+	size_t memory;
+	uint64_t requests;
+	uint64_t cache_hits;
+};
+
+void bluray_daemon_init(struct bluray_daemon *daemon, const char *socket_filename, const char *key_db_filename);
+
+int bluray_daemon_serve(struct bluray_daemon *daemon);
+
+#endif
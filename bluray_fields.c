@@ -0,0 +1,187 @@
+#include "bluray_fields.h"
+
+struct bluray_field {
+	const char *name;
+	uint64_t mask;
+};
+
+static const struct bluray_field bluray_fields[] = {
+	{ "bluray", BLURAY_FIELDS_DISC },
+	{ "bluray.disc_name", BLURAY_FIELD_DISC_NAME },
+	{ "bluray.udf_title", BLURAY_FIELD_UDF_TITLE },
+	{ "bluray.disc_id", BLURAY_FIELD_DISC_ID },
+	{ "bluray.main_title", BLURAY_FIELD_MAIN_TITLE },
+	{ "bluray.main_playlist", BLURAY_FIELD_MAIN_PLAYLIST },
+	{ "bluray.longest_title", BLURAY_FIELD_LONGEST_TITLE },
+	{ "bluray.longest_playlist", BLURAY_FIELD_LONGEST_PLAYLIST },
+	{ "bluray.first_play_supported", BLURAY_FIELD_FIRST_PLAY_SUPPORTED },
+	{ "bluray.top_menu_supported", BLURAY_FIELD_TOP_MENU_SUPPORTED },
+	{ "bluray.provider_data", BLURAY_FIELD_PROVIDER_DATA },
+	{ "bluray.3d_content", BLURAY_FIELD_3D_CONTENT },
+	{ "bluray.initial_mode", BLURAY_FIELD_INITIAL_MODE },
+	{ "bluray.titles", BLURAY_FIELD_TITLES },
+	{ "bluray.bdinfo_titles", BLURAY_FIELD_BDINFO_TITLES },
+	{ "bluray.hdmv_titles", BLURAY_FIELD_HDMV_TITLES },
+	{ "bluray.bdj_titles", BLURAY_FIELD_BDJ_TITLES },
+	{ "bluray.unsupported_titles", BLURAY_FIELD_UNSUPPORTED_TITLES },
+	{ "bluray.aacs", BLURAY_FIELD_AACS },
+	{ "bluray.bdplus", BLURAY_FIELD_BDPLUS },
+	{ "bluray.bd-j", BLURAY_FIELD_BDJ },
+	{ "title", BLURAY_FIELD_TITLE },
+	{ "playlist", BLURAY_FIELD_PLAYLIST },
+	{ "length", BLURAY_FIELD_LENGTH },
+	{ "msecs", BLURAY_FIELD_MSECS },
+	{ "angles", BLURAY_FIELD_ANGLES },
+	{ "filesize", BLURAY_FIELD_FILESIZE },
+	{ "video", BLURAY_FIELDS_VIDEO },
+	{ "video.track", BLURAY_FIELD_VIDEO_TRACK },
+	{ "video.stream", BLURAY_FIELD_VIDEO_STREAM },
+	{ "video.format", BLURAY_FIELD_VIDEO_FORMAT },
+	{ "video.aspect_ratio", BLURAY_FIELD_VIDEO_ASPECT_RATIO },
+	{ "video.framerate", BLURAY_FIELD_VIDEO_FRAMERATE },
+	{ "video.codec", BLURAY_FIELD_VIDEO_CODEC },
+	{ "video.codec_name", BLURAY_FIELD_VIDEO_CODEC_NAME },
+	{ "audio", BLURAY_FIELDS_AUDIO },
+	{ "audio.track", BLURAY_FIELD_AUDIO_TRACK },
+	{ "audio.stream", BLURAY_FIELD_AUDIO_STREAM },
+	{ "audio.language", BLURAY_FIELD_AUDIO_LANGUAGE },
+	{ "audio.codec", BLURAY_FIELD_AUDIO_CODEC },
+	{ "audio.codec_name", BLURAY_FIELD_AUDIO_CODEC_NAME },
+	{ "audio.format", BLURAY_FIELD_AUDIO_FORMAT },
+	{ "audio.rate", BLURAY_FIELD_AUDIO_RATE },
+	{ "subtitles", BLURAY_FIELDS_PGS },
+	{ "subtitles.track", BLURAY_FIELD_PGS_TRACK },
+	{ "subtitles.stream", BLURAY_FIELD_PGS_STREAM },
+	{ "subtitles.language", BLURAY_FIELD_PGS_LANGUAGE },
+	{ "chapters", BLURAY_FIELDS_CHAPTERS },
+	{ "chapters.chapter", BLURAY_FIELD_CHAPTER },
+	{ "chapters.start_time", BLURAY_FIELD_CHAPTER_START_TIME },
+	{ "chapters.length", BLURAY_FIELD_CHAPTER_LENGTH },
+	{ "chapters.start", BLURAY_FIELD_CHAPTER_START },
+	{ "chapters.duration", BLURAY_FIELD_CHAPTER_DURATION },
+	{ "chapters.filesize", BLURAY_FIELD_CHAPTER_FILESIZE },
+	{ NULL, 0 }
+};
+
+/**
+ * Parse a comma-separated list of field names into a bitmask. Returns 1 if a
+ * field name is not recognized, and leaves the previous mask alone.
+ */
+int bluray_fields_parse(uint64_t *fields, const char *str) {
+
+	uint64_t mask = 0;
+	char name[BLURAY_FIELDS_STRLEN];
+	const char *token = str;
+	const char *end = NULL;
+	size_t len = 0;
+	uint32_t ix = 0;
+	bool found = false;
+
+	while(*token != '\0') {
+
+		end = strchr(token, ',');
+		if(end == NULL)
+			end = token + strlen(token);
+
+		len = (size_t)(end - token);
+
+		// Allow empty entries, such as a trailing comma
+		if(len == 0) {
+			token = (*end == ',' ? end + 1 : end);
+			continue;
+		}
+
+		if(len >= BLURAY_FIELDS_STRLEN)
+			return 1;
+
+		memset(name, '\0', BLURAY_FIELDS_STRLEN);
+		memcpy(name, token, len);
+
+		found = false;
+		for(ix = 0; bluray_fields[ix].name != NULL; ix++) {
+			if(strcmp(bluray_fields[ix].name, name) == 0) {
+				mask |= bluray_fields[ix].mask;
+				found = true;
+				break;
+			}
+		}
+
+		if(!found)
+			return 1;
+
+		token = (*end == ',' ? end + 1 : end);
+
+	}
+
+	if(mask == 0)
+		return 1;
+
+	*fields = mask;
+
+	return 0;
+
+}
+
+/**
+ * Write a video stream object, with the selected fields
+ */
+void bluray_fields_video(struct bluray_json *json, uint64_t fields, uint8_t track, const struct bluray_handle_video *video) {
+
+	bluray_json_object_open(json, NULL);
+	if(fields & BLURAY_FIELD_VIDEO_TRACK)
+		bluray_json_uint(json, "track", track);
+	if(fields & BLURAY_FIELD_VIDEO_STREAM)
+		bluray_json_hex(json, "stream", video->pid);
+	if(fields & BLURAY_FIELD_VIDEO_FORMAT)
+		bluray_json_enum(json, "format", video->format, video->format_code);
+	if(fields & BLURAY_FIELD_VIDEO_ASPECT_RATIO)
+		bluray_json_enum(json, "aspect ratio", video->aspect_ratio, video->aspect_ratio_code);
+	if(fields & BLURAY_FIELD_VIDEO_FRAMERATE)
+		bluray_json_fixed(json, "framerate", (uint64_t)(video->framerate * 100 + 0.5), 2);
+	if(fields & BLURAY_FIELD_VIDEO_CODEC)
+		bluray_json_enum(json, "codec", video->codec, video->coding_type);
+	if(fields & BLURAY_FIELD_VIDEO_CODEC_NAME)
+		bluray_json_string(json, "codec name", video->codec_name);
+	bluray_json_object_close(json);
+
+}
+
+/**
+ * Write an audio stream object, with the selected fields
+ */
+void bluray_fields_audio(struct bluray_json *json, uint64_t fields, uint8_t track, const struct bluray_handle_audio *audio) {
+
+	bluray_json_object_open(json, NULL);
+	if(fields & BLURAY_FIELD_AUDIO_TRACK)
+		bluray_json_uint(json, "track", track);
+	if(fields & BLURAY_FIELD_AUDIO_STREAM)
+		bluray_json_hex(json, "stream", audio->pid);
+	if(fields & BLURAY_FIELD_AUDIO_LANGUAGE)
+		bluray_json_string(json, "language", audio->lang);
+	if(fields & BLURAY_FIELD_AUDIO_CODEC)
+		bluray_json_enum(json, "codec", audio->codec, audio->coding_type);
+	if(fields & BLURAY_FIELD_AUDIO_CODEC_NAME)
+		bluray_json_string(json, "codec name", audio->codec_name);
+	if(fields & BLURAY_FIELD_AUDIO_FORMAT)
+		bluray_json_enum(json, "format", audio->format, audio->format_code);
+	if(fields & BLURAY_FIELD_AUDIO_RATE)
+		bluray_json_enum(json, "rate", audio->rate, audio->rate_code);
+	bluray_json_object_close(json);
+
+}
+
+/**
+ * Write a subtitle stream object, with the selected fields
+ */
+void bluray_fields_pgs(struct bluray_json *json, uint64_t fields, uint8_t track, const struct bluray_handle_pgs *pgs) {
+
+	bluray_json_object_open(json, NULL);
+	if(fields & BLURAY_FIELD_PGS_TRACK)
+		bluray_json_uint(json, "track", track);
+	if(fields & BLURAY_FIELD_PGS_STREAM)
+		bluray_json_hex(json, "stream", pgs->pid);
+	if(fields & BLURAY_FIELD_PGS_LANGUAGE)
+		bluray_json_string(json, "language", pgs->lang);
+	bluray_json_object_close(json);
+
+}
@@ -0,0 +1,109 @@
+#ifndef BLURAY_INFO_FIELDS_H
+#define BLURAY_INFO_FIELDS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "bluray_handle.h"
+#include "bluray_json.h"
+
+/**
+ * Field projection for JSON output. Each field that can be displayed has its
+ * own bit, and the fields that are expensive to look up (title and chapter
+ * filesizes, disc name, longest title) are only fetched if they are selected.
+ *
+ * Names used on the command line are the JSON keys, with spaces replaced by
+ * underscores, and prefixed by their section: bluray.disc_name, title,
+ * audio.language, chapters.filesize. Passing only the section name selects
+ * all of its fields.
+ *
+ * The stream objects are written by bluray_fields_video(), _audio() and
+ * _pgs(), for bluray_info and for the daemon and batch reports alike, so
+ * CBOR gets the same enumerated codes from all of them.
+ */
+
+#define BLURAY_FIELDS_STRLEN 32
+
+// Disc
+#define BLURAY_FIELD_DISC_NAME			(UINT64_C(1) << 0)
+#define BLURAY_FIELD_UDF_TITLE			(UINT64_C(1) << 1)
+#define BLURAY_FIELD_DISC_ID			(UINT64_C(1) << 2)
+#define BLURAY_FIELD_MAIN_TITLE			(UINT64_C(1) << 3)
+#define BLURAY_FIELD_MAIN_PLAYLIST		(UINT64_C(1) << 4)
+#define BLURAY_FIELD_LONGEST_TITLE		(UINT64_C(1) << 5)
+#define BLURAY_FIELD_LONGEST_PLAYLIST		(UINT64_C(1) << 6)
+#define BLURAY_FIELD_FIRST_PLAY_SUPPORTED	(UINT64_C(1) << 7)
+#define BLURAY_FIELD_TOP_MENU_SUPPORTED		(UINT64_C(1) << 8)
+#define BLURAY_FIELD_PROVIDER_DATA		(UINT64_C(1) << 9)
+#define BLURAY_FIELD_3D_CONTENT			(UINT64_C(1) << 10)
+#define BLURAY_FIELD_INITIAL_MODE		(UINT64_C(1) << 11)
+#define BLURAY_FIELD_TITLES			(UINT64_C(1) << 12)
+#define BLURAY_FIELD_BDINFO_TITLES		(UINT64_C(1) << 13)
+#define BLURAY_FIELD_HDMV_TITLES		(UINT64_C(1) << 14)
+#define BLURAY_FIELD_BDJ_TITLES			(UINT64_C(1) << 15)
+#define BLURAY_FIELD_UNSUPPORTED_TITLES		(UINT64_C(1) << 16)
+#define BLURAY_FIELD_AACS			(UINT64_C(1) << 17)
+#define BLURAY_FIELD_BDPLUS			(UINT64_C(1) << 18)
+#define BLURAY_FIELD_BDJ			(UINT64_C(1) << 19)
+
+// Titles
+#define BLURAY_FIELD_TITLE			(UINT64_C(1) << 20)
+#define BLURAY_FIELD_PLAYLIST			(UINT64_C(1) << 21)
+#define BLURAY_FIELD_LENGTH			(UINT64_C(1) << 22)
+#define BLURAY_FIELD_MSECS			(UINT64_C(1) << 23)
+#define BLURAY_FIELD_ANGLES			(UINT64_C(1) << 24)
+#define BLURAY_FIELD_FILESIZE			(UINT64_C(1) << 25)
+
+// Video streams
+#define BLURAY_FIELD_VIDEO_TRACK		(UINT64_C(1) << 26)
+#define BLURAY_FIELD_VIDEO_STREAM		(UINT64_C(1) << 27)
+#define BLURAY_FIELD_VIDEO_FORMAT		(UINT64_C(1) << 28)
+#define BLURAY_FIELD_VIDEO_ASPECT_RATIO		(UINT64_C(1) << 29)
+#define BLURAY_FIELD_VIDEO_FRAMERATE		(UINT64_C(1) << 30)
+#define BLURAY_FIELD_VIDEO_CODEC		(UINT64_C(1) << 31)
+#define BLURAY_FIELD_VIDEO_CODEC_NAME		(UINT64_C(1) << 32)
+
+// Audio streams
+#define BLURAY_FIELD_AUDIO_TRACK		(UINT64_C(1) << 33)
+#define BLURAY_FIELD_AUDIO_STREAM		(UINT64_C(1) << 34)
+#define BLURAY_FIELD_AUDIO_LANGUAGE		(UINT64_C(1) << 35)
+#define BLURAY_FIELD_AUDIO_CODEC		(UINT64_C(1) << 36)
+#define BLURAY_FIELD_AUDIO_CODEC_NAME		(UINT64_C(1) << 37)
+#define BLURAY_FIELD_AUDIO_FORMAT		(UINT64_C(1) << 38)
+#define BLURAY_FIELD_AUDIO_RATE			(UINT64_C(1) << 39)
+
+// Subtitles
+#define BLURAY_FIELD_PGS_TRACK			(UINT64_C(1) << 40)
+#define BLURAY_FIELD_PGS_STREAM			(UINT64_C(1) << 41)
+#define BLURAY_FIELD_PGS_LANGUAGE		(UINT64_C(1) << 42)
+
+// Chapters
+#define BLURAY_FIELD_CHAPTER			(UINT64_C(1) << 43)
+#define BLURAY_FIELD_CHAPTER_START_TIME		(UINT64_C(1) << 44)
+#define BLURAY_FIELD_CHAPTER_LENGTH		(UINT64_C(1) << 45)
+#define BLURAY_FIELD_CHAPTER_START		(UINT64_C(1) << 46)
+#define BLURAY_FIELD_CHAPTER_DURATION		(UINT64_C(1) << 47)
+#define BLURAY_FIELD_CHAPTER_FILESIZE		(UINT64_C(1) << 48)
+
+// Sections
+#define BLURAY_FIELDS_DISC		(UINT64_C(0x00000000000fffff))
+#define BLURAY_FIELDS_TITLE		(UINT64_C(0x0000000003f00000))
+#define BLURAY_FIELDS_VIDEO		(UINT64_C(0x00000001fc000000))
+#define BLURAY_FIELDS_AUDIO		(UINT64_C(0x000000fe00000000))
+#define BLURAY_FIELDS_PGS		(UINT64_C(0x0000070000000000))
+#define BLURAY_FIELDS_CHAPTERS		(UINT64_C(0x0001f80000000000))
+#define BLURAY_FIELDS_TITLES		(BLURAY_FIELDS_TITLE | BLURAY_FIELDS_VIDEO | BLURAY_FIELDS_AUDIO | BLURAY_FIELDS_PGS | BLURAY_FIELDS_CHAPTERS)
+#define BLURAY_FIELDS_ALL		(BLURAY_FIELDS_DISC | BLURAY_FIELDS_TITLES)
+
+// Fields that need every title's info to be fetched
+#define BLURAY_FIELDS_LONGEST		(BLURAY_FIELD_MAIN_PLAYLIST | BLURAY_FIELD_LONGEST_TITLE | BLURAY_FIELD_LONGEST_PLAYLIST)
+
+int bluray_fields_parse(uint64_t *fields, const char *str);
+
+void bluray_fields_video(struct bluray_json *json, uint64_t fields, uint8_t track, const struct bluray_handle_video *video);
+
+void bluray_fields_audio(struct bluray_json *json, uint64_t fields, uint8_t track, const struct bluray_handle_audio *audio);
+
+void bluray_fields_pgs(struct bluray_json *json, uint64_t fields, uint8_t track, const struct bluray_handle_pgs *pgs);
+
+#endif
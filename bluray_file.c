@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bluray_file.h"
+
+/**
+ * Build a filename in an XDG base directory, from the environment variable
+ * if it's set, or home_dirname in $HOME if it isn't. The rest of the name is
+ * from the format.
+ */
+int bluray_file_xdg_filename(char *filename, size_t size, const char *xdg_variable, const char *home_dirname, const char *format, ...) {
+
+	const char *xdg_dirname = getenv(xdg_variable);
+	const char *home_dir = getenv("HOME");
+	int length = 0;
+	int format_length = 0;
+	va_list args;
+
+	if(xdg_dirname != NULL && xdg_dirname[0] != '\0')
+		length = snprintf(filename, size, "%s/", xdg_dirname);
+	else if(home_dir != NULL)
+		length = snprintf(filename, size, "%s/%s/", home_dir, home_dirname);
+	else
+		return 1;
+
+	if(length < 0 || length >= (int)size)
+		return 1;
+
+	va_start(args, format);
+	format_length = vsnprintf(filename + length, size - (size_t)length, format, args);
+	va_end(args);
+
+	return (format_length < 0 || format_length >= (int)(size - (size_t)length));
+
+}
+
+/**
+ * Create the directories a file is in
+ */
+int bluray_file_mkdirs(const char *filename) {
+
+	char path[PATH_MAX];
+	char *p = NULL;
+
+	if(snprintf(path, PATH_MAX, "%s", filename) >= PATH_MAX)
+		return 1;
+
+	for(p = strchr(path + 1, '/'); p != NULL; p = strchr(p + 1, '/')) {
+		*p = '\0';
+		if(mkdir(path, 0700) == -1 && errno != EEXIST)
+			return 1;
+		*p = '/';
+	}
+
+	return 0;
+
+}
+
+/**
+ * Open a temporary file to write in place of a file, creating its
+ * directories. tmp_filename gets its name, and is PATH_MAX long. Returns NULL
+ * if it can't be created.
+ */
+FILE *bluray_file_create(const char *filename, char *tmp_filename) {
+
+	FILE *file = NULL;
+	int fd = -1;
+
+	if(bluray_file_mkdirs(filename) || snprintf(tmp_filename, PATH_MAX, "%s.XXXXXX", filename) >= PATH_MAX)
+		return NULL;
+
+	fd = mkstemp(tmp_filename);
+	if(fd == -1)
+		return NULL;
+
+	file = fdopen(fd, "w");
+	if(file == NULL) {
+		close(fd);
+		unlink(tmp_filename);
+		return NULL;
+	}
+
+	return file;
+
+}
+
+/**
+ * Close a file from bluray_file_create() and rename it over the file. If
+ * anything went wrong writing it, it's removed and the file is left as it
+ * was.
+ */
+int bluray_file_replace(FILE *file, const char *tmp_filename, const char *filename) {
+
+	int write_error = ferror(file);
+
+	if(fclose(file) || write_error || rename(tmp_filename, filename)) {
+		unlink(tmp_filename);
+		return 1;
+	}
+
+	return 0;
+
+}
@@ -0,0 +1,30 @@
+#ifndef BLURAY_INFO_FILE_H
+#define BLURAY_INFO_FILE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/**
+ * Files kept between runs
+ *
+ * The KEYDB cache, the disc cache and bluray_player's resume positions live
+ * under the XDG base directories, falling back to their defaults in $HOME:
+ *
+ *   $XDG_CACHE_HOME/bluray_info/... (default ~/.cache)
+ *   $XDG_STATE_HOME/bluray_player/... (default ~/.local/state)
+ *
+ * Directories are created as needed, private to the user. Files that other
+ * programs may read while they're being written are written under a
+ * temporary name in the same directory and renamed over the old one, so
+ * nobody ever reads half of one.
+ */
+
+int bluray_file_xdg_filename(char *filename, size_t size, const char *xdg_variable, const char *home_dirname, const char *format, ...) __attribute__ ((format(printf, 5, 6)));
+
+int bluray_file_mkdirs(const char *filename);
+
+FILE *bluray_file_create(const char *filename, char *tmp_filename);
+
+int bluray_file_replace(FILE *file, const char *tmp_filename, const char *filename);
+
+#endif
@@ -0,0 +1,843 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "bluray_fixture.h"
+#include "bluray_aes.h"
+#include "bluray_sha1.h"
+
+#define BLURAY_FIXTURE_PATH_MAX 4096
+#define BLURAY_FIXTURE_ALIGNED_UNIT 6144
+
+// Times in playlists and clips are in 45 kHz ticks
+#define BLURAY_FIXTURE_TICKS 45000
+
+#define BLURAY_FIXTURE_VIDEO_PID 0x1011
+#define BLURAY_FIXTURE_AUDIO_PID 0x1100
+#define BLURAY_FIXTURE_PGS_PID 0x1200
+
+static const char *bluray_fixture_langs[] = { "eng", "fre", "spa", "ger", "ita", "jpn", "por", "dut" };
+
+// AACS keys for encrypted discs, see bluray_fixture_keydb()
+static const uint8_t bluray_fixture_vuk[BLURAY_AES_BLOCK_SIZE] = { 0x8d, 0x1c, 0x35, 0x52, 0x0e, 0x6a, 0xf7, 0x94, 0x3b, 0xc1, 0x28, 0x7e, 0x50, 0xa9, 0x63, 0x1f };
+static const uint8_t bluray_fixture_unit_key[BLURAY_AES_BLOCK_SIZE] = { 0x2f, 0x71, 0xd8, 0x06, 0x9a, 0x4b, 0xe3, 0x15, 0xc6, 0x80, 0x3d, 0xf2, 0x57, 0x1e, 0xa4, 0x69 };
+static const uint8_t bluray_fixture_aacs_iv[BLURAY_AES_BLOCK_SIZE] = { 0x0b, 0xa0, 0xf8, 0xdd, 0xfe, 0xa6, 0x1f, 0xb3, 0xd8, 0xdf, 0x9f, 0x56, 0x6a, 0x05, 0x0f, 0x78 };
+
+/**
+ * Big-endian output buffer. Sizes and addresses are patched in once the
+ * section they describe has been written.
+ */
+struct bluray_fixture_buffer {
+	uint8_t *data;
+	size_t length;
+	size_t size;
+	bool error;
+};
+
+static void bluray_fixture_put(struct bluray_fixture_buffer *buffer, const void *data, size_t length) {
+
+	if(buffer->error)
+		return;
+
+	if(buffer->length + length > buffer->size) {
+		size_t size = (buffer->size ? buffer->size : 4096);
+		while(buffer->length + length > size)
+			size *= 2;
+		uint8_t *resized = realloc(buffer->data, size);
+		if(resized == NULL) {
+			buffer->error = true;
+			return;
+		}
+		buffer->data = resized;
+		buffer->size = size;
+	}
+
+	memcpy(buffer->data + buffer->length, data, length);
+	buffer->length += length;
+
+}
+
+static void bluray_fixture_u8(struct bluray_fixture_buffer *buffer, uint8_t value) {
+
+	bluray_fixture_put(buffer, &value, 1);
+
+}
+
+static void bluray_fixture_u16(struct bluray_fixture_buffer *buffer, uint16_t value) {
+
+	uint8_t bytes[2] = { (uint8_t)(value >> 8), (uint8_t)value };
+	bluray_fixture_put(buffer, bytes, 2);
+
+}
+
+static void bluray_fixture_u32(struct bluray_fixture_buffer *buffer, uint32_t value) {
+
+	uint8_t bytes[4] = { (uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value };
+	bluray_fixture_put(buffer, bytes, 4);
+
+}
+
+static void bluray_fixture_zero(struct bluray_fixture_buffer *buffer, size_t length) {
+
+	uint8_t zero[128] = { 0 };
+	size_t chunk = 0;
+
+	while(length) {
+		chunk = (length > sizeof(zero) ? sizeof(zero) : length);
+		bluray_fixture_put(buffer, zero, chunk);
+		length -= chunk;
+	}
+
+}
+
+static void bluray_fixture_patch_u16(struct bluray_fixture_buffer *buffer, size_t offset, uint16_t value) {
+
+	if(buffer->error)
+		return;
+
+	buffer->data[offset] = (uint8_t)(value >> 8);
+	buffer->data[offset + 1] = (uint8_t)value;
+
+}
+
+static void bluray_fixture_patch_u32(struct bluray_fixture_buffer *buffer, size_t offset, uint32_t value) {
+
+	if(buffer->error)
+		return;
+
+	buffer->data[offset] = (uint8_t)(value >> 24);
+	buffer->data[offset + 1] = (uint8_t)(value >> 16);
+	buffer->data[offset + 2] = (uint8_t)(value >> 8);
+	buffer->data[offset + 3] = (uint8_t)value;
+
+}
+
+/**
+ * Patch a 32-bit length at offset, covering everything written after it
+ */
+static void bluray_fixture_length_u32(struct bluray_fixture_buffer *buffer, size_t offset) {
+
+	bluray_fixture_patch_u32(buffer, offset, (uint32_t)(buffer->length - offset - 4));
+
+}
+
+static int bluray_fixture_save(struct bluray_fixture_buffer *buffer, const char *filename) {
+
+	if(buffer->error) {
+		fprintf(stderr, "Could not allocate memory for %s\n", filename);
+		return 1;
+	}
+
+	FILE *io = fopen(filename, "wb");
+	if(io == NULL) {
+		fprintf(stderr, "Could not create %s: %s\n", filename, strerror(errno));
+		return 1;
+	}
+
+	size_t written = fwrite(buffer->data, 1, buffer->length, io);
+	if(fclose(io) != 0 || written != buffer->length) {
+		fprintf(stderr, "Could not write %s\n", filename);
+		return 1;
+	}
+
+	buffer->length = 0;
+
+	return 0;
+
+}
+
+static int bluray_fixture_mkdir(const char *dirname) {
+
+	if(mkdir(dirname, 0755) && errno != EEXIST) {
+		fprintf(stderr, "Could not create directory %s: %s\n", dirname, strerror(errno));
+		return 1;
+	}
+
+	return 0;
+
+}
+
+void bluray_fixture_init(struct bluray_fixture *fixture) {
+
+	fixture->playlists = BLURAY_FIXTURE_PLAYLISTS;
+	fixture->clips = 0;
+	fixture->items = 1;
+	fixture->chapters = BLURAY_FIXTURE_CHAPTERS;
+	fixture->streams = BLURAY_FIXTURE_STREAMS;
+	fixture->duplicates = 0;
+	fixture->packets_per_second = BLURAY_FIXTURE_PACKETS_PER_SECOND;
+	fixture->fill = false;
+	fixture->aacs = false;
+
+}
+
+/**
+ * Clip lengths vary from 1 to 20 minutes, so playlists aren't all the same
+ */
+uint32_t bluray_fixture_clip_seconds(uint32_t clip_ix) {
+
+	return 60 + (clip_ix * 131) % 1140;
+
+}
+
+/**
+ * HDMV object reference in index.bdmv, pointing to a movie object
+ */
+static void bluray_fixture_hdmv_object(struct bluray_fixture_buffer *buffer, uint16_t id_ref) {
+
+	bluray_fixture_u16(buffer, 0);
+	bluray_fixture_u16(buffer, id_ref);
+	bluray_fixture_u32(buffer, 0);
+
+}
+
+/**
+ * index.bdmv with first play, top menu and one title, all HDMV movie object 0
+ */
+static void bluray_fixture_index(struct bluray_fixture_buffer *buffer) {
+
+	bluray_fixture_put(buffer, "INDX0200", 8);
+	bluray_fixture_u32(buffer, 40 + 4 + 34);
+	bluray_fixture_u32(buffer, 0);
+	bluray_fixture_zero(buffer, 24);
+
+	// AppInfoBDMV: 2D, no user data
+	bluray_fixture_u32(buffer, 34);
+	bluray_fixture_zero(buffer, 34);
+
+	size_t length_offset = buffer->length;
+	bluray_fixture_u32(buffer, 0);
+
+	// First play and top menu, object type 1 (HDMV)
+	bluray_fixture_u32(buffer, 0x40000000);
+	bluray_fixture_hdmv_object(buffer, 0);
+	bluray_fixture_u32(buffer, 0x40000000);
+	bluray_fixture_hdmv_object(buffer, 0);
+
+	bluray_fixture_u16(buffer, 1);
+	bluray_fixture_u32(buffer, 0x40000000);
+	bluray_fixture_hdmv_object(buffer, 0);
+
+	bluray_fixture_length_u32(buffer, length_offset);
+
+}
+
+/**
+ * MovieObject.bdmv with one object that plays playlist 0
+ */
+static void bluray_fixture_movie_object(struct bluray_fixture_buffer *buffer) {
+
+	bluray_fixture_put(buffer, "MOBJ0200", 8);
+	bluray_fixture_u32(buffer, 0);
+	bluray_fixture_zero(buffer, 28);
+
+	size_t length_offset = buffer->length;
+	bluray_fixture_u32(buffer, 0);
+	bluray_fixture_u32(buffer, 0);
+	bluray_fixture_u16(buffer, 1);
+
+	// resume intention, one command: PLAY_PL 0
+	bluray_fixture_u16(buffer, 0x8000);
+	bluray_fixture_u16(buffer, 1);
+	bluray_fixture_u32(buffer, 0x32800000);
+	bluray_fixture_u32(buffer, 0);
+	bluray_fixture_u32(buffer, 0);
+
+	bluray_fixture_length_u32(buffer, length_offset);
+
+}
+
+/**
+ * STN table entry for a stream in the main clip: stream_entry, then
+ * stream_attributes
+ */
+static void bluray_fixture_stn_stream(struct bluray_fixture_buffer *buffer, uint16_t pid, uint8_t coding_type, uint8_t format_rate, const char *lang) {
+
+	bluray_fixture_u8(buffer, 9);
+	bluray_fixture_u8(buffer, 1);
+	bluray_fixture_u16(buffer, pid);
+	bluray_fixture_zero(buffer, 6);
+
+	bluray_fixture_u8(buffer, 5);
+	bluray_fixture_u8(buffer, coding_type);
+	if(coding_type == 0x90) {
+		bluray_fixture_put(buffer, lang, 3);
+		bluray_fixture_u8(buffer, 0);
+	} else {
+		bluray_fixture_u8(buffer, format_rate);
+		if(lang != NULL)
+			bluray_fixture_put(buffer, lang, 3);
+		else
+			bluray_fixture_zero(buffer, 3);
+	}
+
+}
+
+static void bluray_fixture_stn(struct bluray_fixture_buffer *buffer, uint8_t streams) {
+
+	uint8_t stream_ix = 0;
+	const char *lang = NULL;
+
+	size_t length_offset = buffer->length;
+	bluray_fixture_u16(buffer, 0);
+	bluray_fixture_u16(buffer, 0);
+
+	// video, audio, PG, IG, secondary audio and video, PiP PG, DV
+	bluray_fixture_u8(buffer, 1);
+	bluray_fixture_u8(buffer, streams);
+	bluray_fixture_u8(buffer, streams);
+	bluray_fixture_zero(buffer, 5);
+	bluray_fixture_zero(buffer, 4);
+
+	// H.264, 1080p at 23.976
+	bluray_fixture_stn_stream(buffer, BLURAY_FIXTURE_VIDEO_PID, 0x1b, 0x61, NULL);
+
+	// AC3, multi-channel at 48 kHz
+	for(stream_ix = 0; stream_ix < streams; stream_ix++) {
+		lang = bluray_fixture_langs[stream_ix % 8];
+		bluray_fixture_stn_stream(buffer, BLURAY_FIXTURE_AUDIO_PID + stream_ix, 0x81, 0x61, lang);
+	}
+
+	for(stream_ix = 0; stream_ix < streams; stream_ix++) {
+		lang = bluray_fixture_langs[stream_ix % 8];
+		bluray_fixture_stn_stream(buffer, BLURAY_FIXTURE_PGS_PID + stream_ix, 0x90, 0, lang);
+	}
+
+	bluray_fixture_patch_u16(buffer, length_offset, (uint16_t)(buffer->length - length_offset - 2));
+
+}
+
+/**
+ * A playlist, as a list of clips and the length to play of each one, in ticks
+ */
+static void bluray_fixture_playlist(struct bluray_fixture_buffer *buffer, const uint32_t *clip_ixs, const uint32_t *out_times, uint32_t items, uint32_t chapters, uint8_t streams) {
+
+	uint32_t item_ix = 0;
+	uint32_t chapter_ix = 0;
+	char clip_id[6];
+
+	bluray_fixture_put(buffer, "MPLS0200", 8);
+	bluray_fixture_u32(buffer, 0);
+	bluray_fixture_u32(buffer, 0);
+	bluray_fixture_u32(buffer, 0);
+	bluray_fixture_zero(buffer, 20);
+
+	// AppInfoPlayList: sequential playback
+	bluray_fixture_u32(buffer, 14);
+	bluray_fixture_u8(buffer, 0);
+	bluray_fixture_u8(buffer, 1);
+	bluray_fixture_zero(buffer, 12);
+
+	// PlayList
+	bluray_fixture_patch_u32(buffer, 8, (uint32_t)buffer->length);
+	size_t length_offset = buffer->length;
+	bluray_fixture_u32(buffer, 0);
+	bluray_fixture_u16(buffer, 0);
+	bluray_fixture_u16(buffer, (uint16_t)items);
+	bluray_fixture_u16(buffer, 0);
+
+	uint64_t duration = 0;
+	for(item_ix = 0; item_ix < items; item_ix++) {
+
+		size_t item_offset = buffer->length;
+		bluray_fixture_u16(buffer, 0);
+		snprintf(clip_id, sizeof(clip_id), "%05u", clip_ixs[item_ix] % 100000);
+		bluray_fixture_put(buffer, clip_id, 5);
+		bluray_fixture_put(buffer, "M2TS", 4);
+		// connection condition 1, STC 0
+		bluray_fixture_u16(buffer, 0x0001);
+		bluray_fixture_u8(buffer, 0);
+		bluray_fixture_u32(buffer, 0);
+		bluray_fixture_u32(buffer, out_times[item_ix]);
+		bluray_fixture_zero(buffer, 8);
+		bluray_fixture_u8(buffer, 0);
+		bluray_fixture_u8(buffer, 0);
+		bluray_fixture_u16(buffer, 0);
+		bluray_fixture_stn(buffer, streams);
+		bluray_fixture_patch_u16(buffer, item_offset, (uint16_t)(buffer->length - item_offset - 2));
+
+		duration += out_times[item_ix];
+
+	}
+
+	bluray_fixture_length_u32(buffer, length_offset);
+
+	// PlayListMark: chapters spread over the playlist
+	bluray_fixture_patch_u32(buffer, 12, (uint32_t)buffer->length);
+	length_offset = buffer->length;
+	bluray_fixture_u32(buffer, 0);
+	bluray_fixture_u16(buffer, (uint16_t)chapters);
+
+	uint64_t mark_time = 0;
+	uint64_t item_start = 0;
+	for(chapter_ix = 0; chapter_ix < chapters; chapter_ix++) {
+
+		mark_time = duration * chapter_ix / chapters;
+
+		item_ix = 0;
+		item_start = 0;
+		while(item_ix + 1 < items && item_start + out_times[item_ix] <= mark_time) {
+			item_start += out_times[item_ix];
+			item_ix++;
+		}
+
+		// entry mark
+		bluray_fixture_u8(buffer, 0);
+		bluray_fixture_u8(buffer, 1);
+		bluray_fixture_u16(buffer, (uint16_t)item_ix);
+		bluray_fixture_u32(buffer, (uint32_t)(mark_time - item_start));
+		bluray_fixture_u16(buffer, 0xffff);
+		bluray_fixture_u32(buffer, 0);
+
+	}
+
+	bluray_fixture_length_u32(buffer, length_offset);
+
+}
+
+static void bluray_fixture_clpi_stream(struct bluray_fixture_buffer *buffer, uint16_t pid, uint8_t coding_type, uint8_t format_rate, const char *lang) {
+
+	bluray_fixture_u16(buffer, pid);
+	bluray_fixture_u8(buffer, 5);
+	bluray_fixture_u8(buffer, coding_type);
+	if(coding_type == 0x90) {
+		bluray_fixture_put(buffer, lang, 3);
+		bluray_fixture_u8(buffer, 0);
+	} else if(lang != NULL) {
+		bluray_fixture_u8(buffer, format_rate);
+		bluray_fixture_put(buffer, lang, 3);
+	} else {
+		// 16:9
+		bluray_fixture_u8(buffer, format_rate);
+		bluray_fixture_u8(buffer, 0x30);
+		bluray_fixture_zero(buffer, 2);
+	}
+
+}
+
+/**
+ * Clip info, with an EP map entry every second for the video stream. A new
+ * coarse entry starts whenever the upper bits of the PTS or SPN change.
+ */
+static void bluray_fixture_clip(struct bluray_fixture_buffer *buffer, uint32_t seconds, uint32_t packets_per_second, uint8_t streams) {
+
+	uint32_t packets = seconds * packets_per_second;
+	uint32_t second = 0;
+	uint8_t stream_ix = 0;
+	const char *lang = NULL;
+
+	bluray_fixture_put(buffer, "HDMV0200", 8);
+	bluray_fixture_zero(buffer, 20);
+	bluray_fixture_zero(buffer, 12);
+
+	// ClipInfo: main TS of a movie
+	bluray_fixture_u32(buffer, 176);
+	bluray_fixture_u16(buffer, 0);
+	bluray_fixture_u8(buffer, 1);
+	bluray_fixture_u8(buffer, 1);
+	bluray_fixture_u32(buffer, 0);
+	bluray_fixture_u32(buffer, packets_per_second * 192);
+	bluray_fixture_u32(buffer, packets);
+	bluray_fixture_zero(buffer, 128);
+	bluray_fixture_u16(buffer, 30);
+	bluray_fixture_u8(buffer, 0x80);
+	bluray_fixture_put(buffer, "HDMV", 4);
+	bluray_fixture_zero(buffer, 25);
+
+	// SequenceInfo: one ATC and STC sequence covering the clip
+	bluray_fixture_patch_u32(buffer, 8, (uint32_t)buffer->length);
+	size_t length_offset = buffer->length;
+	bluray_fixture_u32(buffer, 0);
+	bluray_fixture_u8(buffer, 0);
+	bluray_fixture_u8(buffer, 1);
+	bluray_fixture_u32(buffer, 0);
+	bluray_fixture_u8(buffer, 1);
+	bluray_fixture_u8(buffer, 0);
+	bluray_fixture_u16(buffer, BLURAY_FIXTURE_VIDEO_PID - 0x10);
+	bluray_fixture_u32(buffer, 0);
+	bluray_fixture_u32(buffer, 0);
+	bluray_fixture_u32(buffer, seconds * BLURAY_FIXTURE_TICKS);
+	bluray_fixture_length_u32(buffer, length_offset);
+
+	// ProgramInfo
+	bluray_fixture_patch_u32(buffer, 12, (uint32_t)buffer->length);
+	length_offset = buffer->length;
+	bluray_fixture_u32(buffer, 0);
+	bluray_fixture_u8(buffer, 0);
+	bluray_fixture_u8(buffer, 1);
+	bluray_fixture_u32(buffer, 0);
+	bluray_fixture_u16(buffer, 0x0100);
+	bluray_fixture_u8(buffer, 1 + streams * 2);
+	bluray_fixture_u8(buffer, 0);
+	bluray_fixture_clpi_stream(buffer, BLURAY_FIXTURE_VIDEO_PID, 0x1b, 0x61, NULL);
+	for(stream_ix = 0; stream_ix < streams; stream_ix++) {
+		lang = bluray_fixture_langs[stream_ix % 8];
+		bluray_fixture_clpi_stream(buffer, BLURAY_FIXTURE_AUDIO_PID + stream_ix, 0x81, 0x61, lang);
+	}
+	for(stream_ix = 0; stream_ix < streams; stream_ix++) {
+		lang = bluray_fixture_langs[stream_ix % 8];
+		bluray_fixture_clpi_stream(buffer, BLURAY_FIXTURE_PGS_PID + stream_ix, 0x90, 0, lang);
+	}
+	bluray_fixture_length_u32(buffer, length_offset);
+
+	// CPI: EP map, counting coarse entries first
+	uint32_t num_coarse = 0;
+	uint64_t pts = 0;
+	uint32_t spn = 0;
+	uint64_t last_pts = UINT64_MAX;
+	uint32_t last_spn = UINT32_MAX;
+	for(second = 0; second < seconds; second++) {
+		pts = (uint64_t)second * BLURAY_FIXTURE_TICKS * 2;
+		spn = second * packets_per_second;
+		if((pts >> 19) != (last_pts >> 19) || (spn >> 17) != (last_spn >> 17)) {
+			num_coarse++;
+			last_pts = pts;
+			last_spn = spn;
+		}
+	}
+
+	bluray_fixture_patch_u32(buffer, 16, (uint32_t)buffer->length);
+	length_offset = buffer->length;
+	bluray_fixture_u32(buffer, 0);
+	bluray_fixture_u16(buffer, 1);
+
+	bluray_fixture_u8(buffer, 0);
+	bluray_fixture_u8(buffer, 1);
+	bluray_fixture_u16(buffer, BLURAY_FIXTURE_VIDEO_PID);
+	// reserved (10 bits), stream type 1 (4), coarse (16), fine (18)
+	uint64_t counts = ((uint64_t)1 << 34) | ((uint64_t)num_coarse << 18) | seconds;
+	bluray_fixture_u16(buffer, (uint16_t)(counts >> 32));
+	bluray_fixture_u32(buffer, (uint32_t)counts);
+	// stream start address, relative to the EP map
+	bluray_fixture_u32(buffer, 14);
+
+	bluray_fixture_u32(buffer, 4 + num_coarse * 8);
+
+	last_pts = UINT64_MAX;
+	last_spn = UINT32_MAX;
+	for(second = 0; second < seconds; second++) {
+		pts = (uint64_t)second * BLURAY_FIXTURE_TICKS * 2;
+		spn = second * packets_per_second;
+		if((pts >> 19) != (last_pts >> 19) || (spn >> 17) != (last_spn >> 17)) {
+			bluray_fixture_u32(buffer, (second << 14) | (uint32_t)((pts >> 19) & 0x3fff));
+			bluray_fixture_u32(buffer, spn);
+			last_pts = pts;
+			last_spn = spn;
+		}
+	}
+
+	// end position offset 1 for every fine entry
+	for(second = 0; second < seconds; second++) {
+		pts = (uint64_t)second * BLURAY_FIXTURE_TICKS * 2;
+		spn = second * packets_per_second;
+		bluray_fixture_u32(buffer, (1U << 28) | ((uint32_t)((pts >> 9) & 0x7ff) << 17) | (spn & 0x1ffff));
+	}
+
+	bluray_fixture_length_u32(buffer, length_offset);
+
+	// ClipMark
+	bluray_fixture_patch_u32(buffer, 20, (uint32_t)buffer->length);
+	bluray_fixture_u32(buffer, 0);
+
+}
+
+/**
+ * Null packets for a unit of the stream file, numbered from packet_ix. The
+ * arrival timestamps count a 27 MHz clock.
+ */
+static void bluray_fixture_unit(uint8_t *unit, uint32_t clip_ix, uint32_t packet_ix, uint32_t packets_per_second) {
+
+	uint8_t *packet = NULL;
+	uint32_t ats = 0;
+	size_t ix = 0;
+
+	memset(unit, 0xff, BLURAY_FIXTURE_ALIGNED_UNIT);
+	for(ix = 0; ix < BLURAY_FIXTURE_ALIGNED_UNIT; ix += 192, packet_ix++) {
+		packet = unit + ix;
+		ats = (uint32_t)((uint64_t)packet_ix * 27000000 / packets_per_second) & 0x3fffffff;
+		packet[0] = (uint8_t)(ats >> 24);
+		packet[1] = (uint8_t)(ats >> 16);
+		packet[2] = (uint8_t)(ats >> 8);
+		packet[3] = (uint8_t)ats;
+		packet[4] = 0x47;
+		packet[5] = 0x1f;
+		packet[6] = 0xff;
+		packet[7] = 0x10;
+		packet[8] = (uint8_t)(clip_ix >> 24);
+		packet[9] = (uint8_t)(clip_ix >> 16);
+		packet[10] = (uint8_t)(clip_ix >> 8);
+		packet[11] = (uint8_t)clip_ix;
+		packet[12] = (uint8_t)(packet_ix >> 24);
+		packet[13] = (uint8_t)(packet_ix >> 16);
+		packet[14] = (uint8_t)(packet_ix >> 8);
+		packet[15] = (uint8_t)packet_ix;
+	}
+
+}
+
+/**
+ * Encrypt an aligned unit like AACS does, the reverse of
+ * bluray_aacs_decrypt_unit(). The copy permission bits are set in every
+ * packet, and the first 16 bytes, which are left plain, make the key for the
+ * rest with the unit key.
+ */
+static void bluray_fixture_encrypt_unit(const struct bluray_aes *unit_key, uint8_t *unit) {
+
+	struct bluray_aes aes;
+	uint8_t key[BLURAY_AES_BLOCK_SIZE];
+	uint8_t block[BLURAY_AES_BLOCK_SIZE];
+	const uint8_t *previous = bluray_fixture_aacs_iv;
+	size_t offset = 0;
+	size_t ix = 0;
+
+	for(offset = 0; offset < BLURAY_FIXTURE_ALIGNED_UNIT; offset += 192)
+		unit[offset] |= 0xc0;
+
+	bluray_aes_encrypt(unit_key, unit, key);
+	for(ix = 0; ix < BLURAY_AES_BLOCK_SIZE; ix++)
+		key[ix] ^= unit[ix];
+	bluray_aes_init(&aes, key);
+
+	for(offset = BLURAY_AES_BLOCK_SIZE; offset < BLURAY_FIXTURE_ALIGNED_UNIT; offset += BLURAY_AES_BLOCK_SIZE) {
+		for(ix = 0; ix < BLURAY_AES_BLOCK_SIZE; ix++)
+			block[ix] = unit[offset + ix] ^ previous[ix];
+		bluray_aes_encrypt(&aes, block, unit + offset);
+		previous = unit + offset;
+	}
+
+}
+
+/**
+ * The stream file, the clip's packets rounded up to whole aligned units.
+ * Unless it's filled or encrypted, only the first unit is written, and the
+ * file is extended to its size.
+ */
+static int bluray_fixture_stream(const struct bluray_fixture *fixture, const char *filename, uint32_t clip_ix) {
+
+	uint8_t unit[BLURAY_FIXTURE_ALIGNED_UNIT];
+	uint32_t packets = bluray_fixture_clip_seconds(clip_ix) * fixture->packets_per_second;
+	uint32_t units = (packets + BLURAY_FIXTURE_ALIGNED_UNIT / 192 - 1) / (BLURAY_FIXTURE_ALIGNED_UNIT / 192);
+	uint32_t unit_ix = 0;
+	bool fill = (fixture->fill || fixture->aacs);
+	struct bluray_aes unit_key;
+	int retval = 0;
+
+	bluray_aes_init(&unit_key, bluray_fixture_unit_key);
+
+	FILE *io = fopen(filename, "wb");
+	if(io == NULL) {
+		fprintf(stderr, "Could not create %s: %s\n", filename, strerror(errno));
+		return 1;
+	}
+
+	for(unit_ix = 0; retval == 0 && unit_ix < (fill ? units : 1); unit_ix++) {
+		bluray_fixture_unit(unit, clip_ix, unit_ix * (BLURAY_FIXTURE_ALIGNED_UNIT / 192), fixture->packets_per_second);
+		if(fixture->aacs)
+			bluray_fixture_encrypt_unit(&unit_key, unit);
+		if(fwrite(unit, 1, sizeof(unit), io) != sizeof(unit))
+			retval = 1;
+	}
+
+	if(retval == 0 && (fflush(io) != 0 || ftruncate(fileno(io), (off_t)units * BLURAY_FIXTURE_ALIGNED_UNIT) != 0))
+		retval = 1;
+
+	if(fclose(io) != 0)
+		retval = 1;
+
+	if(retval)
+		fprintf(stderr, "Could not write %s\n", filename);
+
+	return retval;
+
+}
+
+/**
+ * AACS/Unit_Key_RO.inf, with the unit key encrypted with the volume unique
+ * key. It starts with where the keys are, which starts with how many there
+ * are, and each key is 48 bytes on from there.
+ */
+static void bluray_fixture_unit_key_file(struct bluray_fixture_buffer *buffer) {
+
+	struct bluray_aes vuk;
+	uint8_t key[BLURAY_AES_BLOCK_SIZE];
+
+	bluray_aes_init(&vuk, bluray_fixture_vuk);
+	bluray_aes_encrypt(&vuk, bluray_fixture_unit_key, key);
+
+	bluray_fixture_u32(buffer, 48);
+	bluray_fixture_zero(buffer, 12);
+	// application type 1 (BD-ROM), one BDMV directory
+	bluray_fixture_u8(buffer, 1);
+	bluray_fixture_u8(buffer, 1);
+	bluray_fixture_zero(buffer, 30);
+	bluray_fixture_u16(buffer, 1);
+	bluray_fixture_zero(buffer, 46);
+	bluray_fixture_put(buffer, key, sizeof(key));
+
+}
+
+/**
+ * Write a KEYDB.cfg with the entry for an encrypted disc: its disc ID, the
+ * SHA-1 of AACS/Unit_Key_RO.inf, and its volume unique key
+ */
+int bluray_fixture_keydb(const char *dirname, const char *filename) {
+
+	char unit_key_filename[BLURAY_FIXTURE_PATH_MAX];
+	uint8_t data[4096];
+	size_t length = 0;
+	struct bluray_sha1 sha1;
+	uint8_t digest[BLURAY_SHA1_LENGTH];
+	size_t ix = 0;
+
+	snprintf(unit_key_filename, sizeof(unit_key_filename), "%s/AACS/Unit_Key_RO.inf", dirname);
+	FILE *io = fopen(unit_key_filename, "rb");
+	if(io == NULL) {
+		fprintf(stderr, "Could not open %s: %s\n", unit_key_filename, strerror(errno));
+		return 1;
+	}
+
+	bluray_sha1_init(&sha1);
+	while((length = fread(data, 1, sizeof(data), io)) > 0)
+		bluray_sha1_update(&sha1, data, length);
+	bluray_sha1_final(&sha1, digest);
+	fclose(io);
+
+	io = fopen(filename, "w");
+	if(io == NULL) {
+		fprintf(stderr, "Could not create %s: %s\n", filename, strerror(errno));
+		return 1;
+	}
+
+	fprintf(io, "0x");
+	for(ix = 0; ix < BLURAY_SHA1_LENGTH; ix++)
+		fprintf(io, "%02X", digest[ix]);
+	fprintf(io, " = bluray_info fixture | V | 0x");
+	for(ix = 0; ix < BLURAY_AES_BLOCK_SIZE; ix++)
+		fprintf(io, "%02X", bluray_fixture_vuk[ix]);
+	fprintf(io, "\n");
+
+	if(fclose(io) != 0) {
+		fprintf(stderr, "Could not write %s\n", filename);
+		return 1;
+	}
+
+	return 0;
+
+}
+
+/**
+ * Write a disc to dirname, which is created if it doesn't exist
+ */
+int bluray_fixture_write(const struct bluray_fixture *fixture, const char *dirname) {
+
+	char filename[BLURAY_FIXTURE_PATH_MAX];
+	uint32_t clips = (fixture->clips ? fixture->clips : fixture->playlists);
+	uint32_t items = (fixture->items ? fixture->items : 1);
+	uint32_t playlist_ix = 0;
+	uint32_t playlists = fixture->playlists + fixture->duplicates;
+	uint32_t clip_ix = 0;
+	uint32_t item_ix = 0;
+	uint32_t trim = 0;
+	int retval = 0;
+
+	if(clips == 0 || playlists > 100000 || clips > 100000 || items > 999 || fixture->chapters > 65535 || fixture->streams > 32 || fixture->packets_per_second == 0 || fixture->packets_per_second > 100000) {
+		fprintf(stderr, "Fixture is out of range\n");
+		return 1;
+	}
+
+	const char *subdirs[] = { "", "/BDMV", "/BDMV/PLAYLIST", "/BDMV/CLIPINF", "/BDMV/STREAM", "/BDMV/META", "/BDMV/META/DL", "/AACS" };
+	size_t subdir_ix = 0;
+	size_t subdirs_length = sizeof(subdirs) / sizeof(subdirs[0]) - (fixture->aacs ? 0 : 1);
+	for(subdir_ix = 0; subdir_ix < subdirs_length; subdir_ix++) {
+		snprintf(filename, sizeof(filename), "%s%s", dirname, subdirs[subdir_ix]);
+		if(bluray_fixture_mkdir(filename))
+			return 1;
+	}
+
+	struct bluray_fixture_buffer buffer = { NULL, 0, 0, false };
+
+	bluray_fixture_index(&buffer);
+	snprintf(filename, sizeof(filename), "%s/BDMV/index.bdmv", dirname);
+	retval = bluray_fixture_save(&buffer, filename);
+
+	if(retval == 0) {
+		bluray_fixture_movie_object(&buffer);
+		snprintf(filename, sizeof(filename), "%s/BDMV/MovieObject.bdmv", dirname);
+		retval = bluray_fixture_save(&buffer, filename);
+	}
+
+	if(retval == 0 && fixture->aacs) {
+		bluray_fixture_unit_key_file(&buffer);
+		snprintf(filename, sizeof(filename), "%s/AACS/Unit_Key_RO.inf", dirname);
+		retval = bluray_fixture_save(&buffer, filename);
+	}
+
+	if(retval == 0) {
+		snprintf(filename, sizeof(filename), "%s/BDMV/META/DL/bdmt_eng.xml", dirname);
+		FILE *io = fopen(filename, "w");
+		if(io == NULL) {
+			fprintf(stderr, "Could not create %s: %s\n", filename, strerror(errno));
+			retval = 1;
+		} else {
+			fprintf(io, "<?xml version=\"1.0\" encoding=\"utf-8\" ?>\n");
+			fprintf(io, "<disclib xmlns=\"urn:BDA:bdmv;disclib\" xmlns:di=\"urn:BDA:bdmv;discinfo\">\n");
+			fprintf(io, "<di:discinfo><di:title><di:name>bluray_info fixture, %" PRIu32 " playlists</di:name></di:title><di:language>eng</di:language></di:discinfo>\n", playlists);
+			fprintf(io, "</disclib>\n");
+			if(fclose(io) != 0)
+				retval = 1;
+		}
+	}
+
+	for(clip_ix = 0; retval == 0 && clip_ix < clips; clip_ix++) {
+		bluray_fixture_clip(&buffer, bluray_fixture_clip_seconds(clip_ix), fixture->packets_per_second, fixture->streams);
+		snprintf(filename, sizeof(filename), "%s/BDMV/CLIPINF/%05" PRIu32 ".clpi", dirname, clip_ix);
+		retval = bluray_fixture_save(&buffer, filename);
+		if(retval == 0) {
+			snprintf(filename, sizeof(filename), "%s/BDMV/STREAM/%05" PRIu32 ".m2ts", dirname, clip_ix);
+			retval = bluray_fixture_stream(fixture, filename, clip_ix);
+		}
+	}
+
+	uint32_t *clip_ixs = calloc(items, sizeof(uint32_t));
+	uint32_t *out_times = calloc(items, sizeof(uint32_t));
+	if(clip_ixs == NULL || out_times == NULL)
+		retval = 1;
+
+	for(playlist_ix = 0; retval == 0 && playlist_ix < playlists; playlist_ix++) {
+
+		for(item_ix = 0; item_ix < items; item_ix++) {
+
+			// Near-duplicates play the first playlist's clips in another order
+			if(playlist_ix < fixture->playlists)
+				clip_ix = (playlist_ix * items + item_ix) % clips;
+			else
+				clip_ix = ((item_ix + playlist_ix - fixture->playlists + 1) % items) % clips;
+
+			clip_ixs[item_ix] = clip_ix;
+			out_times[item_ix] = bluray_fixture_clip_seconds(clip_ix) * BLURAY_FIXTURE_TICKS;
+
+		}
+
+		// and stop a few seconds early
+		if(playlist_ix >= fixture->playlists) {
+			trim = (playlist_ix - fixture->playlists) % 50 + 1;
+			out_times[items - 1] -= trim * BLURAY_FIXTURE_TICKS;
+		}
+
+		bluray_fixture_playlist(&buffer, clip_ixs, out_times, items, fixture->chapters, fixture->streams);
+		snprintf(filename, sizeof(filename), "%s/BDMV/PLAYLIST/%05" PRIu32 ".mpls", dirname, playlist_ix);
+		retval = bluray_fixture_save(&buffer, filename);
+
+	}
+
+	free(clip_ixs);
+	free(out_times);
+	free(buffer.data);
+
+	return retval;
+
+}
@@ -0,0 +1,66 @@
+#ifndef BLURAY_INFO_FIXTURE_H
+#define BLURAY_INFO_FIXTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Synthetic Blu-ray disc generator, for benchmarks
+ *
+ * Writes an unencrypted BDMV tree that libbluray can open: index.bdmv,
+ * MovieObject.bdmv, one MPLS per playlist, and one CLPI and M2TS per clip.
+ *
+ * Each clip has one H.264 video stream, plus streams audio and subtitle
+ * streams, and an EP map with an entry every second, so chapter positions and
+ * title sizes resolve like they would on a real disc. The M2TS files are whole
+ * aligned units, like on a disc, so where a clip's packets end doesn't line up
+ * with a unit. They start with one aligned unit of null packets and are
+ * extended to their full size without writing the rest, so on most
+ * filesystems they take no space.
+ *
+ * With fill set, every packet is written instead: null packets with arrival
+ * timestamps going up, and the clip and packet number in the payload, so any
+ * part of a title read back can be checked byte for byte. Fewer packets per
+ * second keep the files small.
+ *
+ * With aacs set, the streams are filled and every aligned unit is encrypted
+ * like AACS does, with one unit key, which is in AACS/Unit_Key_RO.inf
+ * encrypted with a volume unique key. bluray_fixture_keydb() writes a
+ * KEYDB.cfg with the disc's entry, so libaacs or bluray_copy --decrypt can
+ * decrypt it. Decrypted, it's the same as the disc written without aacs.
+ *
+ * Playlist N plays items clips, starting at clip N * items, with chapters
+ * marks spread evenly over it. Near-duplicates are copies of the first
+ * playlist with the items rotated and the end trimmed by a few seconds, like
+ * the decoy playlists on obfuscated discs; libbluray doesn't filter them out.
+ */
+
+#define BLURAY_FIXTURE_PLAYLISTS 10
+#define BLURAY_FIXTURE_CHAPTERS 12
+#define BLURAY_FIXTURE_STREAMS 2
+
+// Source packets per second of video, about 15 Mbps
+#define BLURAY_FIXTURE_PACKETS_PER_SECOND 10000
+
+struct bluray_fixture {
+	uint32_t playlists;
+	uint32_t clips;
+	uint32_t items;
+	uint32_t chapters;
+	uint8_t streams;
+	uint32_t duplicates;
+	uint32_t packets_per_second;
+	bool fill;
+	bool aacs;
+};
+
+void bluray_fixture_init(struct bluray_fixture *fixture);
+
+uint32_t bluray_fixture_clip_seconds(uint32_t clip_ix);
+
+int bluray_fixture_write(const struct bluray_fixture *fixture, const char *dirname);
+
+int bluray_fixture_keydb(const char *dirname, const char *filename);
+
+#endif
@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bluray_handle.h"
+#include "bluray_open.h"
+#include "bluray_time.h"
+#include "bluray_chapter.h"
+#include "bluray_video.h"
+#include "bluray_audio.h"
+#include "bluray_pgs.h"
+
+/**
+ * Read size for bluray_handle_copy(), in aligned units (32 packets of 192 bytes)
+ */
+#define BLURAY_HANDLE_COPY_BUFFER_SIZE (6144 * 32)
+
+struct bluray_handle {
+	BLURAY *bd;
+	struct bluray_info bluray_info;
+	bool disc_name;
+	struct bluray_title bluray_title;
+	bool title_loaded;
+	struct bluray_handle_disc disc;
+	struct bluray_handle_title title;
+	struct bluray_handle_video video;
+	struct bluray_handle_audio audio;
+	struct bluray_handle_pgs pgs;
+	struct bluray_handle_chapter chapter;
+};
+
+/**
+ * Make title_ix the current title, reusing its info if it already is
+ */
+static int bluray_handle_load_title(bluray_handle *handle, uint32_t title_ix) {
+
+	if(title_ix >= handle->bluray_info.titles)
+		return 1;
+
+	if(handle->title_loaded && handle->bluray_title.ix == title_ix)
+		return 0;
+
+	handle->title_loaded = false;
+
+	if(bluray_title_init(handle->bd, &handle->bluray_title, title_ix, 0))
+		return 1;
+
+	handle->title_loaded = true;
+
+	return 0;
+
+}
+
+bluray_handle *bluray_handle_open(const char *device_filename, const char *key_db_filename) {
+
+	bluray_handle *handle = calloc(1, sizeof(bluray_handle));
+	if(handle == NULL)
+		return NULL;
+
+	handle->bd = bluray_disc_open(device_filename, key_db_filename);
+	if(handle->bd == NULL) {
+		free(handle);
+		return NULL;
+	}
+
+	if(bluray_info_init(handle->bd, &handle->bluray_info)) {
+		bd_close(handle->bd);
+		free(handle);
+		return NULL;
+	}
+
+	return handle;
+
+}
+
+void bluray_handle_close(bluray_handle *handle) {
+
+	if(handle == NULL)
+		return;
+
+	bluray_title_free(&handle->bluray_title);
+	bd_close(handle->bd);
+	free(handle);
+
+}
+
+const struct bluray_handle_disc *bluray_handle_disc(bluray_handle *handle) {
+
+	// Reading the disc name parses the metadata files, do it once
+	if(!handle->disc_name) {
+		bluray_info_disc_name(handle->bd, &handle->bluray_info);
+		handle->disc_name = true;
+	}
+
+	struct bluray_handle_disc *disc = &handle->disc;
+	struct bluray_info *bluray_info = &handle->bluray_info;
+
+	memset(disc, 0, sizeof(struct bluray_handle_disc));
+	snprintf(disc->disc_name, sizeof(disc->disc_name), "%s", bluray_info->disc_name);
+	snprintf(disc->udf_volume_id, sizeof(disc->udf_volume_id), "%s", bluray_info->udf_volume_id);
+	snprintf(disc->disc_id, sizeof(disc->disc_id), "%s", bluray_info->disc_id);
+	disc->titles = bluray_info->titles;
+	disc->main_title = bluray_info->main_title;
+	disc->aacs = bluray_info->aacs;
+	disc->bdplus = bluray_info->bdplus;
+	disc->bdj = bluray_info->bdj;
+	disc->content_exist_3D = bluray_info->content_exist_3D;
+
+	return disc;
+
+}
+
+uint32_t bluray_handle_titles(bluray_handle *handle) {
+
+	return handle->bluray_info.titles;
+
+}
+
+const struct bluray_handle_title *bluray_handle_title(bluray_handle *handle, uint32_t title_ix) {
+
+	if(bluray_handle_load_title(handle, title_ix))
+		return NULL;
+
+	struct bluray_handle_title *title = &handle->title;
+	struct bluray_title *bluray_title = &handle->bluray_title;
+
+	memset(title, 0, sizeof(struct bluray_handle_title));
+	title->ix = bluray_title->ix;
+	title->playlist = bluray_title->playlist;
+	title->duration = bluray_title->duration;
+	snprintf(title->length, sizeof(title->length), "%s", bluray_title->length);
+	title->chapters = bluray_title->chapters;
+	title->clips = bluray_title->clips;
+	title->angles = bluray_title->angles;
+	title->video_streams = bluray_title->video_streams;
+	title->audio_streams = bluray_title->audio_streams;
+	title->pg_streams = bluray_title->pg_streams;
+
+	return title;
+
+}
+
+/**
+ * libbluray opens every clip in the title to get its size, so this is kept
+ * separate from bluray_handle_title()
+ */
+uint64_t bluray_handle_title_size(bluray_handle *handle, uint32_t title_ix) {
+
+	if(bluray_handle_load_title(handle, title_ix))
+		return 0;
+
+	// The title has to be selected, which another call may have changed
+	if(bd_select_title(handle->bd, title_ix) == 0)
+		return 0;
+
+	bluray_title_size(handle->bd, &handle->bluray_title);
+
+	return handle->bluray_title.size;
+
+}
+
+const struct bluray_handle_video *bluray_handle_video(bluray_handle *handle, uint32_t title_ix, uint8_t stream_ix) {
+
+	if(bluray_handle_load_title(handle, title_ix))
+		return NULL;
+
+	if(stream_ix >= handle->bluray_title.video_streams)
+		return NULL;
+
+	struct bluray_handle_video *video = &handle->video;
+	bluray_video_stream(video, &handle->bluray_title.clip_info[0].video_streams[stream_ix]);
+
+	return video;
+
+}
+
+const struct bluray_handle_audio *bluray_handle_audio(bluray_handle *handle, uint32_t title_ix, uint8_t stream_ix) {
+
+	if(bluray_handle_load_title(handle, title_ix))
+		return NULL;
+
+	if(stream_ix >= handle->bluray_title.audio_streams)
+		return NULL;
+
+	struct bluray_handle_audio *audio = &handle->audio;
+	bluray_audio_stream(audio, &handle->bluray_title.clip_info[0].audio_streams[stream_ix]);
+
+	return audio;
+
+}
+
+const struct bluray_handle_pgs *bluray_handle_pgs(bluray_handle *handle, uint32_t title_ix, uint8_t stream_ix) {
+
+	if(bluray_handle_load_title(handle, title_ix))
+		return NULL;
+
+	if(stream_ix >= handle->bluray_title.pg_streams)
+		return NULL;
+
+	struct bluray_handle_pgs *pgs = &handle->pgs;
+	bluray_pgs_stream(pgs, &handle->bluray_title.clip_info[0].pg_streams[stream_ix]);
+
+	return pgs;
+
+}
+
+const struct bluray_handle_chapter *bluray_handle_chapter(bluray_handle *handle, uint32_t title_ix, uint32_t chapter_ix) {
+
+	if(bluray_handle_load_title(handle, title_ix))
+		return NULL;
+
+	if(chapter_ix >= handle->bluray_title.chapters)
+		return NULL;
+
+	BLURAY_TITLE_CHAPTER *bd_chapter = &handle->bluray_title.title_chapters[chapter_ix];
+	struct bluray_handle_chapter *chapter = &handle->chapter;
+
+	memset(chapter, 0, sizeof(struct bluray_handle_chapter));
+	chapter->ix = chapter_ix;
+	chapter->start = bd_chapter->start;
+	chapter->duration = bd_chapter->duration;
+	bluray_duration_length(chapter->start_time, bd_chapter->start);
+	bluray_duration_length(chapter->length, bd_chapter->duration);
+
+	return chapter;
+
+}
+
+/**
+ * Copy a chapter range of a title, passing each block read to write_cb.
+ *
+ * Starting at the first chapter includes the title's leading packets, the
+ * same as bluray_copy.
+ */
+int bluray_handle_copy(bluray_handle *handle, uint32_t title_ix, uint8_t angle_ix, uint32_t first_chapter_ix, uint32_t last_chapter_ix, bluray_handle_write_cb write_cb, void *user_data) {
+
+	if(bluray_handle_load_title(handle, title_ix))
+		return BLURAY_HANDLE_ERROR_TITLE;
+
+	uint32_t chapters = handle->bluray_title.chapters;
+	if(first_chapter_ix > last_chapter_ix || last_chapter_ix >= chapters)
+		return BLURAY_HANDLE_ERROR_RANGE;
+
+	if(angle_ix >= handle->bluray_title.angles)
+		return BLURAY_HANDLE_ERROR_ANGLE;
+
+	BLURAY *bd = handle->bd;
+
+	if(bd_select_title(bd, title_ix) == 0)
+		return BLURAY_HANDLE_ERROR_TITLE;
+
+	if(bd_select_angle(bd, angle_ix) == 0)
+		return BLURAY_HANDLE_ERROR_ANGLE;
+
+	// The loaded title info is for the first angle, and another angle can use
+	// different clips, which moves the chapters
+	uint64_t start = 0;
+	uint64_t end = 0;
+	struct bluray_title angle_title;
+	angle_title.title_info = NULL;
+	if(angle_ix == 0) {
+		bluray_chapter_range(&handle->bluray_title, last_chapter_ix, &start, &end);
+	} else {
+		if(bluray_title_init(bd, &angle_title, title_ix, angle_ix))
+			return BLURAY_HANDLE_ERROR_ANGLE;
+		bluray_chapter_range(&angle_title, last_chapter_ix, &start, &end);
+		bluray_title_free(&angle_title);
+	}
+
+	uint64_t position = 0;
+	int64_t seek_position = 0;
+	if(first_chapter_ix) {
+		seek_position = bd_seek_chapter(bd, first_chapter_ix);
+		if(seek_position < 0)
+			return BLURAY_HANDLE_ERROR_READ;
+		position = (uint64_t)seek_position;
+	}
+
+	uint8_t *buffer = malloc(BLURAY_HANDLE_COPY_BUFFER_SIZE);
+	if(buffer == NULL)
+		return BLURAY_HANDLE_ERROR_READ;
+
+	int retval = BLURAY_HANDLE_OK;
+	uint64_t remaining = 0;
+	int length = 0;
+	int bytes_read = 0;
+
+	while(position < end) {
+
+		remaining = end - position;
+		length = (remaining < BLURAY_HANDLE_COPY_BUFFER_SIZE ? (int)remaining : BLURAY_HANDLE_COPY_BUFFER_SIZE);
+
+		bytes_read = bd_read(bd, buffer, length);
+
+		if(bytes_read == 0)
+			break;
+
+		if(bytes_read < 0) {
+			retval = BLURAY_HANDLE_ERROR_READ;
+			break;
+		}
+
+		if(write_cb(buffer, (size_t)bytes_read, user_data)) {
+			retval = BLURAY_HANDLE_ERROR_CALLBACK;
+			break;
+		}
+
+		position += (uint64_t)bytes_read;
+
+	}
+
+	free(buffer);
+
+	return retval;
+
+}
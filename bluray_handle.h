@@ -0,0 +1,140 @@
+#ifndef BLURAY_HANDLE_H
+#define BLURAY_HANDLE_H
+
+/**
+ * libbluray_info - query and copy Blu-ray titles in-process
+ *
+ * This is the public interface of libbluray_info. It is self-contained: it
+ * does not include libbluray headers or the package's config.h, so callers
+ * only need this file and -lbluray_info.
+ *
+ * A handle wraps one open disc. The structs returned by the getters are owned
+ * by the handle and stay valid until the next call that takes the same handle,
+ * or until it is closed. New fields are only ever appended to them, so
+ * existing callers keep working across minor library versions.
+ *
+ * A handle must not be used from more than one thread at a time. Separate
+ * handles can be used concurrently.
+ *
+ * Title, stream and chapter indexes start at 0, like libbluray's.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BLURAY_HANDLE_API_VERSION 1
+
+#define BLURAY_HANDLE_OK 0
+#define BLURAY_HANDLE_ERROR_OPEN 1
+#define BLURAY_HANDLE_ERROR_TITLE 2
+#define BLURAY_HANDLE_ERROR_ANGLE 3
+#define BLURAY_HANDLE_ERROR_RANGE 4
+#define BLURAY_HANDLE_ERROR_READ 5
+#define BLURAY_HANDLE_ERROR_CALLBACK 6
+
+typedef struct bluray_handle bluray_handle;
+
+struct bluray_handle_disc {
+	char disc_name[256];
+	char udf_volume_id[33];
+	char disc_id[41];
+	uint32_t titles;
+	uint32_t main_title;
+	bool aacs;
+	bool bdplus;
+	bool bdj;
+	bool content_exist_3D;
+};
+
+struct bluray_handle_title {
+	uint32_t ix;
+	uint32_t playlist;
+	uint64_t duration;
+	char length[13];
+	uint32_t chapters;
+	uint32_t clips;
+	uint8_t angles;
+	uint8_t video_streams;
+	uint8_t audio_streams;
+	uint8_t pg_streams;
+};
+
+struct bluray_handle_video {
+	uint16_t pid;
+	uint8_t coding_type;
+	char codec[8];
+	char codec_name[8];
+	char format[8];
+	double framerate;
+	char aspect_ratio[8];
+	// libbluray's codes for the format, frame rate and aspect ratio
+	uint8_t format_code;
+	uint8_t rate_code;
+	uint8_t aspect_ratio_code;
+};
+
+struct bluray_handle_audio {
+	uint16_t pid;
+	uint8_t coding_type;
+	char lang[4];
+	char codec[16];
+	char codec_name[32];
+	char format[16];
+	char rate[16];
+	bool secondary;
+	// libbluray's codes for the format and rate
+	uint8_t format_code;
+	uint8_t rate_code;
+};
+
+struct bluray_handle_pgs {
+	uint16_t pid;
+	char lang[4];
+};
+
+struct bluray_handle_chapter {
+	uint32_t ix;
+	uint64_t start;
+	uint64_t duration;
+	char start_time[13];
+	char length[13];
+};
+
+/**
+ * Called with each block read by bluray_handle_copy(). Return 0 to continue,
+ * or anything else to stop the copy.
+ */
+typedef int (*bluray_handle_write_cb)(const uint8_t *buffer, size_t length, void *user_data);
+
+bluray_handle *bluray_handle_open(const char *device_filename, const char *key_db_filename);
+
+void bluray_handle_close(bluray_handle *handle);
+
+const struct bluray_handle_disc *bluray_handle_disc(bluray_handle *handle);
+
+uint32_t bluray_handle_titles(bluray_handle *handle);
+
+const struct bluray_handle_title *bluray_handle_title(bluray_handle *handle, uint32_t title_ix);
+
+uint64_t bluray_handle_title_size(bluray_handle *handle, uint32_t title_ix);
+
+const struct bluray_handle_video *bluray_handle_video(bluray_handle *handle, uint32_t title_ix, uint8_t stream_ix);
+
+const struct bluray_handle_audio *bluray_handle_audio(bluray_handle *handle, uint32_t title_ix, uint8_t stream_ix);
+
+const struct bluray_handle_pgs *bluray_handle_pgs(bluray_handle *handle, uint32_t title_ix, uint8_t stream_ix);
+
+const struct bluray_handle_chapter *bluray_handle_chapter(bluray_handle *handle, uint32_t title_ix, uint32_t chapter_ix);
+
+int bluray_handle_copy(bluray_handle *handle, uint32_t title_ix, uint8_t angle_ix, uint32_t first_chapter_ix, uint32_t last_chapter_ix, bluray_handle_write_cb write_cb, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -16,6 +16,15 @@
 #include "bluray_video.h"
 #include "bluray_pgs.h"
 #include "bluray_time.h"
+#include "bluray_fields.h"
+#include "bluray_json.h"
+#include "bluray_daemon.h"
+#include "bluray_batch.h"
+#include "bluray_watch.h"
+#include "bluray_trace.h"
+#include "bluray_bdmv.h"
+#include "bluray_where.h"
+#include "bluray_cache.h"
 
 /**
  *   _     _                           _        __
@@ -43,6 +52,8 @@ int main(int argc, char **argv) {
 	// Parse options and arguments
 	bool p_bluray_info = true;
 	bool p_bluray_json = false;
+	bool p_bluray_ndjson = false;
+	uint8_t json_format = BLURAY_JSON_FORMAT_JSON;
 	bool p_bluray_xchap = false;
 	bool d_title_number = false;
 	uint32_t arg_title_number = 0;
@@ -58,16 +69,40 @@ int main(int argc, char **argv) {
 	uint32_t d_min_minutes = 0;
 	uint32_t d_min_audio_streams = 0;
 	uint32_t d_min_pg_streams = 0;
+	struct bluray_where where;
+	bluray_where_init(&where);
+	char where_str[32];
 	bool invalid_opt = false;
+	uint64_t d_fields = BLURAY_FIELDS_ALL;
 	const char *key_db_filename = NULL;
+	const char *daemon_socket_filename = NULL;
+	const char *batch_source = NULL;
+	const char *watch_dirname = NULL;
+	const char *index_filename = NULL;
+	unsigned long int arg_jobs = 0;
+	unsigned long int arg_batch_timeout = 0;
+	const char *trace_filename = NULL;
+	bool p_timings = false;
+	bool p_libbluray = false;
+	bool p_fingerprint = false;
+	uint64_t disc_cache_size = 0;
+	uint64_t trace_start = 0;
+	struct bluray_daemon bluray_daemon;
+	bluray_daemon_init(&bluray_daemon, NULL, NULL);
 	int g_opt = 0;
 	int g_ix = 0;
 	struct option p_long_opts[] = {
 		{ "audio", no_argument, NULL, 'a' },
+		{ "batch", required_argument, NULL, 'b' },
+		{ "jobs", required_argument, NULL, 'P' },
+		{ "batch-timeout", required_argument, NULL, 'T' },
+		{ "watch", required_argument, NULL, 'w' },
+		{ "index", required_argument, NULL, 'X' },
 		{ "chapters", no_argument, NULL, 'c' },
 		{ "xchap", no_argument, NULL, 'g' },
 		{ "help", no_argument, NULL, 'h' },
 		{ "json", no_argument, NULL, 'j' },
+		{ "ndjson", no_argument, NULL, 'J' },
 		{ "keydb", required_argument, NULL, 'k' },
 		{ "main", no_argument, NULL, 'm' },
 		{ "playlist", required_argument, NULL, 'p' },
@@ -77,12 +112,26 @@ int main(int argc, char **argv) {
 		{ "all", no_argument, NULL, 'x' },
 		{ "has-audio", no_argument, NULL, 'A' },
 		{ "seconds", required_argument, NULL, 'E' },
+		{ "fields", required_argument, NULL, 'F' },
+		{ "format", required_argument, NULL, 'f' },
 		{ "minutes", required_argument, NULL, 'M' },
 		{ "has-subtitles", no_argument, NULL, 'S' },
+		{ "serve", required_argument, NULL, 'D' },
+		{ "workers", required_argument, NULL, 'W' },
+		{ "max-discs", required_argument, NULL, 'N' },
+		{ "idle-timeout", required_argument, NULL, 'I' },
+		{ "client-timeout", required_argument, NULL, 'U' },
+		{ "max-memory", required_argument, NULL, 'B' },
+		{ "trace", required_argument, NULL, 'R' },
+		{ "timings", no_argument, NULL, 'K' },
+		{ "libbluray", no_argument, NULL, 'L' },
+		{ "fingerprint", no_argument, NULL, 'G' },
+		{ "disc-cache", required_argument, NULL, 'C' },
+		{ "where", required_argument, NULL, 'Q' },
 		{ "version", no_argument, NULL, 'Z' },
 		{ 0, 0, 0, 0 }
 	};
-	while((g_opt = getopt_long(argc, argv, "acghjk:mp:st:vxAE:M:SZ", p_long_opts, &g_ix)) != -1) {
+	while((g_opt = getopt_long(argc, argv, "ab:cD:f:ghjJk:mp:st:vw:xAE:F:M:SZ", p_long_opts, &g_ix)) != -1) {
 
 		switch(g_opt) {
 
@@ -94,15 +143,55 @@ int main(int argc, char **argv) {
 				d_min_audio_streams = 1;
 				break;
 
+			case 'b':
+				batch_source = optarg;
+				break;
+
+			case 'B':
+				arg_number = strtoul(optarg, NULL, 10);
+				bluray_daemon.max_memory = (size_t)arg_number * 1048576;
+				break;
+
 			case 'c':
 				d_chapters = true;
 				break;
 
+			case 'D':
+				daemon_socket_filename = optarg;
+				break;
+
 			case 'E':
 				arg_number = strtoul(optarg, NULL, 10);
 				d_min_seconds = (uint32_t)arg_number;
 				break;
 
+			case 'f':
+				if(strcmp(optarg, "json") == 0) {
+					json_format = BLURAY_JSON_FORMAT_JSON;
+					p_bluray_ndjson = false;
+				} else if(strcmp(optarg, "ndjson") == 0) {
+					json_format = BLURAY_JSON_FORMAT_NDJSON;
+					p_bluray_ndjson = true;
+				} else if(strcmp(optarg, "cbor") == 0) {
+					json_format = BLURAY_JSON_FORMAT_CBOR;
+					p_bluray_ndjson = false;
+				} else {
+					fprintf(stderr, "Invalid format: %s, choose json, ndjson or cbor\n", optarg);
+					return 1;
+				}
+				p_bluray_info = false;
+				p_bluray_json = true;
+				break;
+
+			case 'F':
+				if(bluray_fields_parse(&d_fields, optarg)) {
+					fprintf(stderr, "Invalid field list: %s\n", optarg);
+					return 1;
+				}
+				p_bluray_info = false;
+				p_bluray_json = true;
+				break;
+
 			case 'g':
 				p_bluray_info = false;
 				p_bluray_xchap = true;
@@ -111,15 +200,43 @@ int main(int argc, char **argv) {
 			case 'H':
 				break;
 
+			case 'I':
+				arg_number = strtoul(optarg, NULL, 10);
+				bluray_daemon.idle_timeout = (uint32_t)arg_number;
+				break;
+
 			case 'j':
 				p_bluray_info = false;
 				p_bluray_json = true;
 				break;
 
+			case 'J':
+				p_bluray_info = false;
+				p_bluray_json = true;
+				p_bluray_ndjson = true;
+				json_format = BLURAY_JSON_FORMAT_NDJSON;
+				break;
+
 			case 'k':
 				key_db_filename = optarg;
 				break;
 
+			case 'G':
+				p_fingerprint = true;
+				break;
+
+			case 'C':
+				disc_cache_size = strtoull(optarg, NULL, 10) * 1048576;
+				break;
+
+			case 'K':
+				p_timings = true;
+				break;
+
+			case 'L':
+				p_libbluray = true;
+				break;
+
 			case 'm':
 				d_title_number = false;
 				d_playlist_number = false;
@@ -131,6 +248,16 @@ int main(int argc, char **argv) {
 				d_min_minutes = (uint32_t)arg_number;
 				break;
 
+			case 'N':
+				arg_number = strtoul(optarg, NULL, 10);
+				if(arg_number > 0)
+					bluray_daemon.max_discs = (uint32_t)arg_number;
+				break;
+
+			case 'P':
+				arg_jobs = strtoul(optarg, NULL, 10);
+				break;
+
 			case 'p':
 				d_title_number = false;
 				d_playlist_number = true;
@@ -139,6 +266,17 @@ int main(int argc, char **argv) {
 				arg_playlist_number = (uint32_t)arg_number;
 				break;
 
+			case 'Q':
+				if(bluray_where_and(&where, optarg)) {
+					fprintf(stderr, "Invalid --where expression, %s at position %zu: %s\n", where.error, where.error_offset + 1, optarg);
+					return 1;
+				}
+				break;
+
+			case 'R':
+				trace_filename = optarg;
+				break;
+
 			case 's':
 				d_subtitles = true;
 				break;
@@ -158,10 +296,34 @@ int main(int argc, char **argv) {
 					arg_title_number = (uint32_t)arg_number;
 				break;
 
+			case 'T':
+				arg_batch_timeout = strtoul(optarg, NULL, 10);
+				break;
+
+			case 'U':
+				arg_number = strtoul(optarg, NULL, 10);
+				if(arg_number > 0)
+					bluray_daemon.client_timeout = (uint32_t)arg_number;
+				break;
+
 			case 'v':
 				d_video = true;
 				break;
 
+			case 'W':
+				arg_number = strtoul(optarg, NULL, 10);
+				if(arg_number > 0)
+					bluray_daemon.workers = (uint32_t)arg_number;
+				break;
+
+			case 'w':
+				watch_dirname = optarg;
+				break;
+
+			case 'X':
+				index_filename = optarg;
+				break;
+
 			case 'x':
 				d_video = true;
 				d_audio = true;
@@ -185,6 +347,9 @@ int main(int argc, char **argv) {
 				printf("  -t, --title <number>     Limit to selected title\n");
 				printf("  -p, --playlist <number>  Limit to selected playlist\n");
 				printf("  -j, --json               Display format as JSON\n");
+				printf("  -J, --ndjson             Display format as NDJSON, one title per line\n");
+				printf("  -f, --format <format>    Display format: json, ndjson or cbor\n");
+				printf("  -F, --fields <list>      Limit JSON to fields (title,playlist,audio.language,...)\n");
 				printf("\n");
 				printf("Extra information:\n");
 				printf("  -v, --video              Display video streams\n");
@@ -198,10 +363,31 @@ int main(int argc, char **argv) {
 				printf("  -S, --has-subtitles      Title has subtitles\n");
 				printf("  -E, --seconds <number>   Title has minimum number of seconds\n");
 				printf("  -M, --minutes <number>   Title has minimum number of minutes\n");
+				printf("      --where <expression> Title matches expression (minutes>=60 && audio.language==eng)\n");
+				printf("\n");
+				printf("Batch:\n");
+				printf("  -b, --batch <dir|file>   Scan every disc in a directory or list file, as NDJSON\n");
+				printf("      --jobs <number>      Number of discs to scan at once (default: number of CPUs)\n");
+				printf("      --batch-timeout <sec> Give up on a disc after this many seconds (default: %u)\n", BLURAY_BATCH_TIMEOUT);
+				printf("  -w, --watch <dir>        Keep an index of the discs in a directory up to date\n");
+				printf("      --index <filename>   Index file for --watch (default: <dir>/%s)\n", BLURAY_WATCH_INDEX_FILENAME);
+				printf("\n");
+				printf("Daemon:\n");
+				printf("  -D, --serve <socket>     Answer queries on a Unix socket instead of displaying a disc\n");
+				printf("      --workers <number>   Number of worker threads (default: %u)\n", BLURAY_DAEMON_WORKERS);
+				printf("      --max-discs <number> Maximum number of discs kept open (default: %u)\n", BLURAY_DAEMON_MAX_DISCS);
+				printf("      --idle-timeout <sec> Close discs idle for this many seconds (default: %u)\n", BLURAY_DAEMON_IDLE_TIMEOUT);
+				printf("      --client-timeout <sec> Hang up on clients idle for this many seconds (default: %u)\n", BLURAY_DAEMON_CLIENT_TIMEOUT);
+				printf("      --max-memory <MBs>   Memory budget for open discs (default: %u)\n", BLURAY_DAEMON_MAX_MEMORY);
 				printf("\n");
 				printf("Other:\n");
 				printf("  -g, --xchap		   Display title's chapter format for mkvmerge\n");
 				printf("  -k, --keydb <filename>   Location to KEYDB.cfg (default: ~/.config/aacs/KEYDB.cfg)\n");
+				printf("      --trace <filename>   Write the time spent in libbluray calls as a Chrome trace\n");
+				printf("      --timings            Display a summary of the time spent in libbluray calls\n");
+				printf("      --libbluray          Get titles from libbluray instead of reading the playlists\n");
+				printf("      --fingerprint        Display a hash of the disc's playlists and clip info, and exit\n");
+				printf("      --disc-cache <MBs>   Keep title sizes in a cache this big, shared with the other programs\n");
 				printf("  -h, --help		   This output\n");
 				printf("      --version		   Version information\n");
 				printf("\n");
@@ -218,6 +404,53 @@ int main(int argc, char **argv) {
 
 	}
 
+	if(watch_dirname != NULL) {
+		struct bluray_watch bluray_watch;
+		bluray_watch_init(&bluray_watch, watch_dirname, key_db_filename);
+		bluray_watch.index_filename = index_filename;
+		bluray_watch.jobs = (uint32_t)arg_jobs;
+		if(arg_batch_timeout)
+			bluray_watch.timeout = (uint32_t)arg_batch_timeout;
+		return bluray_watch_run(&bluray_watch);
+	}
+
+	if(daemon_socket_filename != NULL) {
+		bluray_daemon.socket_filename = daemon_socket_filename;
+		bluray_daemon.key_db_filename = key_db_filename;
+		return bluray_daemon_serve(&bluray_daemon);
+	}
+
+	if(batch_source != NULL) {
+		struct bluray_batch bluray_batch;
+		bluray_batch_init(&bluray_batch, key_db_filename);
+		if(arg_jobs)
+			bluray_batch.jobs = (uint32_t)arg_jobs;
+		if(arg_batch_timeout)
+			bluray_batch.timeout = (uint32_t)arg_batch_timeout;
+		retval = bluray_batch_find(&bluray_batch, batch_source);
+		if(retval == 0)
+			retval = bluray_batch_run(&bluray_batch, stdout);
+		bluray_batch_free(&bluray_batch);
+		return retval;
+	}
+
+	// The options to narrow results are filters like any other
+	if(d_min_seconds) {
+		snprintf(where_str, sizeof(where_str), "seconds>=%" PRIu32, d_min_seconds);
+		bluray_where_and(&where, where_str);
+	}
+	if(d_min_minutes) {
+		snprintf(where_str, sizeof(where_str), "minutes>=%" PRIu32, d_min_minutes);
+		bluray_where_and(&where, where_str);
+	}
+	if(d_min_audio_streams)
+		bluray_where_and(&where, "audio>=1");
+	if(d_min_pg_streams)
+		bluray_where_and(&where, "subtitles>=1");
+
+	// Titles are only filtered when they're displayed
+	bool p_where = ((p_bluray_info || p_bluray_json) && where.root >= 0);
+
 	const char *device_filename = NULL;
 
 	if(argv[optind])
@@ -225,9 +458,38 @@ int main(int argc, char **argv) {
 	else
 		device_filename = DEFAULT_BLURAY_DEVICE;
 
-	// Open device
+	if(trace_filename != NULL || p_timings)
+		bluray_trace_enable();
+
+	// The fingerprint only reads the navigation files, libbluray isn't needed
+	if(p_fingerprint) {
+		uint8_t digest[BLURAY_SHA256_LENGTH];
+		uint8_t digest_ix = 0;
+		trace_start = bluray_trace_begin();
+		retval = bluray_bdmv_fingerprint(device_filename, digest);
+		bluray_trace_end("bdmv_fingerprint", trace_start, BLURAY_TRACE_NONE, BLURAY_TRACE_NONE);
+		if(retval) {
+			fprintf(stderr, "Could not read the playlists and clip info in %s, only disc directories and images can be fingerprinted\n", device_filename);
+		} else {
+			for(digest_ix = 0; digest_ix < BLURAY_SHA256_LENGTH; digest_ix++)
+				printf("%02x", digest[digest_ix]);
+			printf("\n");
+		}
+		if(trace_filename != NULL && bluray_trace_write(trace_filename))
+			retval = 1;
+		if(p_timings)
+			bluray_trace_timings(stderr);
+		bluray_trace_free();
+		return retval;
+	}
+
+	// Everything up to the first title is recorded as the "disc" span, which
+	// is most of the time before anything is displayed
+	uint64_t disc_trace_start = bluray_trace_begin();
+
+	// Open device, which is also where libaacs and libbdplus are initialized
 	BLURAY *bd = NULL;
-	bd = bd_open(device_filename, key_db_filename);
+	bd = bluray_disc_open(device_filename, key_db_filename);
 
 	if(bd == NULL) {
 		if(key_db_filename == NULL)
@@ -246,6 +508,13 @@ int main(int argc, char **argv) {
 		return 1;
 	}
 
+	// Disc cache, which is left off if it can't be opened
+	struct bluray_cache disc_cache;
+	char disc_id[BLURAY_INFO_DISC_ID_STRLEN];
+	bluray_cache_init(&disc_cache);
+	if(disc_cache_size && bluray_disc_id(bd, &bluray_info, disc_id) == 0)
+		bluray_cache_open(&disc_cache, disc_id, disc_cache_size);
+
 	uint32_t d_num_titles = 0;
 	d_num_titles = bluray_info.titles;
 
@@ -284,6 +553,10 @@ int main(int argc, char **argv) {
 	uint32_t main_title_number;
 	main_title_number = bluray_info.main_title + 1;
 
+	// Only parse the metadata XML if the disc name is going to be displayed
+	if(p_bluray_info || (p_bluray_json && (d_fields & BLURAY_FIELD_DISC_NAME)))
+		bluray_info_disc_name(bd, &bluray_info);
+
 	if(p_bluray_info) {
 		printf("Disc title: '%s', Volume name: '%s', Main title: %03" PRIu32 ", AACS: %s, BD-J: %s, BD+: %s\n", bluray_info.disc_name, bluray_info.udf_volume_id, main_title_number, (bluray_info.aacs ? "yes" : "no"), (bluray_info.bdj ? "yes" : "no"), (bluray_info.bdplus ? "yes": "no"));
 	}
@@ -291,59 +564,128 @@ int main(int argc, char **argv) {
 	uint32_t ix = 0;
 	uint8_t angle_ix = 0;
 
+	// Read the titles straight from the playlists and clip info when the disc
+	// is a directory or an image, as long as the title list is the same one
+	// libbluray has, so the title numbers match
+	struct bluray_bdmv bdmv;
+	bool native = false;
+	if(!p_libbluray) {
+		trace_start = bluray_trace_begin();
+		native = (bluray_bdmv_open(&bdmv, device_filename) == 0);
+		bluray_trace_end("bdmv_open", trace_start, BLURAY_TRACE_NONE, BLURAY_TRACE_NONE);
+		if(native && !bluray_bdmv_matches(&bdmv, bd, bluray_info.titles, bluray_info.main_title)) {
+			bluray_bdmv_close(&bdmv);
+			native = false;
+		}
+	}
+
+	bluray_trace_end("disc", disc_trace_start, BLURAY_TRACE_NONE, BLURAY_TRACE_NONE);
+
+	// NDJSON output has one record per line: the disc, followed by each title
+	struct bluray_json json;
 	if(p_bluray_json) {
+		retval = bluray_json_init(&json, stdout, json_format);
+		if(retval) {
+			fprintf(stderr, "Could not allocate JSON output buffer\n");
+			return 1;
+		}
+	}
+
+	if(p_bluray_json && !p_bluray_ndjson)
+		bluray_json_object_open(&json, NULL);
+
+	if(p_bluray_json && (d_fields & BLURAY_FIELDS_DISC)) {
 
-		// Find the longest title
+		// Find the longest title, which needs the info for every title
 		uint64_t max_duration = 0;
 		uint32_t main_playlist = 0;
 		uint32_t longest_title_number = 1;
 		uint32_t longest_playlist = 0;
+		uint64_t title_duration = 0;
+		uint32_t title_playlist = 0;
 		BLURAY_TITLE_INFO *bd_title = NULL;
-		for(ix = 0; ix < bluray_info.titles; ix++) {
+		for(ix = 0; (d_fields & BLURAY_FIELDS_LONGEST) && ix < bluray_info.titles; ix++) {
 
-			bd_title = bd_get_title_info(bd, ix, angle_ix);
+			if(native) {
+				title_duration = bdmv.titles[ix].duration;
+				title_playlist = bdmv.titles[ix].playlist;
+			} else {
+
+				trace_start = bluray_trace_begin();
+				bd_title = bd_get_title_info(bd, ix, angle_ix);
+				bluray_trace_end("bd_get_title_info", trace_start, ix, BLURAY_TRACE_NONE);
+
+				if(bd_title == NULL) {
+					continue;
+				}
+
+				title_duration = bd_title->duration;
+				title_playlist = bd_title->playlist;
+
+				bd_free_title_info(bd_title);
+				bd_title = NULL;
 
-			if(bd_title == NULL) {
-				continue;
 			}
 
-			if(bd_title->idx == bluray_info.main_title)
-				main_playlist = bd_title->playlist;
+			if(ix == bluray_info.main_title)
+				main_playlist = title_playlist;
 
-			if(bd_title->duration > max_duration) {
+			if(title_duration > max_duration) {
 				longest_title_number = ix + 1;
-				longest_playlist = bd_title->playlist;
-				max_duration = bd_title->duration;
+				longest_playlist = title_playlist;
+				max_duration = title_duration;
 			}
 
-			bd_free_title_info(bd_title);
-			bd_title = NULL;
-
 		}
 
-		printf("{\n");
-		printf(" \"bluray\": {\n");
-		printf("  \"disc name\": \"%s\",\n", bluray_info.disc_name);
-		printf("  \"udf title\": \"%s\",\n", bluray_info.udf_volume_id);
-		printf("  \"disc id\": \"%s\",\n", bluray_info.disc_id);
-		printf("  \"main title\": %" PRIu32 ",\n", main_title_number);
-		printf("  \"main playlist\": %" PRIu32 ",\n", main_playlist);
-		printf("  \"longest title\": %" PRIu32 ",\n", longest_title_number);
-		printf("  \"longest playlist\": %" PRIu32 ",\n", longest_playlist);
-		printf("  \"first play supported\": %s,\n", (bluray_info.first_play_supported ? "true" : "false"));
-		printf("  \"top menu supported\": %s,\n", (bluray_info.top_menu_supported ? "true" : "false"));
-		printf("  \"provider data\": \"%s\",\n", bluray_info.provider_data);
-		printf("  \"3D content\": %s,\n", (bluray_info.content_exist_3D ? "true" : "false"));
-		printf("  \"initial mode\": \"%s\",\n", bluray_info.initial_output_mode_preference);
-		printf("  \"titles\": %" PRIu32 ",\n", bluray_info.titles);
-		printf("  \"bdinfo titles\": %" PRIu32 ",\n", bluray_info.disc_num_titles);
-		printf("  \"hdmv titles\": %" PRIu32 ",\n", bluray_info.hdmv_titles);
-		printf("  \"bdj titles\": %" PRIu32 ",\n", bluray_info.bdj_titles);
-		printf("  \"unsupported titles\": %" PRIu32 ",\n", bluray_info.unsupported_titles);
-		printf("  \"aacs\": %s,\n", (bluray_info.aacs ? "true" : "false"));
-		printf("  \"bdplus\": %s,\n", (bluray_info.bdplus ? "true" : "false"));
-		printf("  \"bd-j\": %s\n", (bluray_info.bdj ? "true" : "false"));
-		printf(" },\n");
+		if(p_bluray_ndjson)
+			bluray_json_object_open(&json, NULL);
+		bluray_json_object_open(&json, "bluray");
+		if(d_fields & BLURAY_FIELD_DISC_NAME)
+			bluray_json_string(&json, "disc name", bluray_info.disc_name);
+		if(d_fields & BLURAY_FIELD_UDF_TITLE)
+			bluray_json_string(&json, "udf title", bluray_info.udf_volume_id);
+		if(d_fields & BLURAY_FIELD_DISC_ID)
+			bluray_json_string(&json, "disc id", bluray_info.disc_id);
+		if(d_fields & BLURAY_FIELD_MAIN_TITLE)
+			bluray_json_uint(&json, "main title", main_title_number);
+		if(d_fields & BLURAY_FIELD_MAIN_PLAYLIST)
+			bluray_json_uint(&json, "main playlist", main_playlist);
+		if(d_fields & BLURAY_FIELD_LONGEST_TITLE)
+			bluray_json_uint(&json, "longest title", longest_title_number);
+		if(d_fields & BLURAY_FIELD_LONGEST_PLAYLIST)
+			bluray_json_uint(&json, "longest playlist", longest_playlist);
+		if(d_fields & BLURAY_FIELD_FIRST_PLAY_SUPPORTED)
+			bluray_json_bool(&json, "first play supported", bluray_info.first_play_supported);
+		if(d_fields & BLURAY_FIELD_TOP_MENU_SUPPORTED)
+			bluray_json_bool(&json, "top menu supported", bluray_info.top_menu_supported);
+		if(d_fields & BLURAY_FIELD_PROVIDER_DATA)
+			bluray_json_string(&json, "provider data", bluray_info.provider_data);
+		if(d_fields & BLURAY_FIELD_3D_CONTENT)
+			bluray_json_bool(&json, "3D content", bluray_info.content_exist_3D);
+		if(d_fields & BLURAY_FIELD_INITIAL_MODE)
+			bluray_json_string(&json, "initial mode", bluray_info.initial_output_mode_preference);
+		if(d_fields & BLURAY_FIELD_TITLES)
+			bluray_json_uint(&json, "titles", bluray_info.titles);
+		if(d_fields & BLURAY_FIELD_BDINFO_TITLES)
+			bluray_json_uint(&json, "bdinfo titles", bluray_info.disc_num_titles);
+		if(d_fields & BLURAY_FIELD_HDMV_TITLES)
+			bluray_json_uint(&json, "hdmv titles", bluray_info.hdmv_titles);
+		if(d_fields & BLURAY_FIELD_BDJ_TITLES)
+			bluray_json_uint(&json, "bdj titles", bluray_info.bdj_titles);
+		if(d_fields & BLURAY_FIELD_UNSUPPORTED_TITLES)
+			bluray_json_uint(&json, "unsupported titles", bluray_info.unsupported_titles);
+		if(d_fields & BLURAY_FIELD_AACS)
+			bluray_json_bool(&json, "aacs", bluray_info.aacs);
+		if(d_fields & BLURAY_FIELD_BDPLUS)
+			bluray_json_bool(&json, "bdplus", bluray_info.bdplus);
+		if(d_fields & BLURAY_FIELD_BDJ)
+			bluray_json_bool(&json, "bd-j", bluray_info.bdj);
+		bluray_json_object_close(&json);
+		if(p_bluray_ndjson) {
+			bluray_json_object_close(&json);
+			bluray_json_end(&json);
+		}
 
 	}
 
@@ -351,9 +693,10 @@ int main(int argc, char **argv) {
 	BLURAY_TITLE_CHAPTER *bd_chapter = NULL;
 
 	struct bluray_title bluray_title;
-	struct bluray_video bluray_video;
-	struct bluray_audio bluray_audio;
-	struct bluray_pgs bluray_pgs;
+	bluray_title.title_info = NULL;
+	struct bluray_handle_video bluray_video;
+	struct bluray_handle_audio bluray_audio;
+	struct bluray_handle_pgs bluray_pgs;
 	struct bluray_chapter bluray_chapter;
 	bluray_chapter.duration = 0;
 	strcpy(bluray_chapter.length, "00:00:00.000");
@@ -362,8 +705,11 @@ int main(int argc, char **argv) {
 
 	uint32_t bluray_highest_playlist = 0;
 
-	if(p_bluray_json)
-		printf(" \"titles\": [\n");
+	// Leave out the titles completely if none of their fields are requested
+	bool p_bluray_json_titles = (p_bluray_json && (d_fields & BLURAY_FIELDS_TITLES));
+
+	if(p_bluray_json_titles && !p_bluray_ndjson)
+		bluray_json_array_open(&json, "titles");
 
 	uint8_t video_stream_ix = 0;
 	uint8_t video_stream_number = 1;
@@ -375,11 +721,31 @@ int main(int argc, char **argv) {
 	uint32_t chapter_number = 1;
 	uint64_t chapter_start = 0;
 	uint32_t d_title_counter = 0;
+	struct bluray_where_title where_title;
 	angle_ix = 0;
 
-	for(ix = d_first_ix; d_title_counter < d_num_titles; ix++, d_title_counter++) {
+	for(ix = d_first_ix; d_title_counter < d_num_titles && (p_bluray_info || p_bluray_xchap || p_bluray_json_titles); ix++, d_title_counter++) {
+
+		trace_start = bluray_trace_begin();
+
+		// Filter in stages, and skip the title as soon as it can't match, before
+		// doing any more expensive lookups. The native title list has the
+		// playlist and duration of every title already.
+		where_title.number = ix + 1;
+		where_title.list = native;
+		where_title.playlist = (native ? bdmv.titles[ix].playlist : 0);
+		where_title.duration = (native ? bdmv.titles[ix].duration : 0);
+		where_title.title_info = NULL;
+		where_title.size_known = false;
+		where_title.size = 0;
+		if(p_where && bluray_where_eval(&where, &where_title) == BLURAY_WHERE_FALSE)
+			continue;
 
-		retval = bluray_title_init(bd, &bluray_title, ix, angle_ix);
+		// The title doesn't need to be selected for its info, only for its size
+		if(native)
+			retval = bluray_bdmv_title_init(&bdmv, &bluray_title, ix, angle_ix);
+		else
+			retval = bluray_title_info_init(bd, &bluray_title, ix, angle_ix);
 
 		// Skip if there was a problem getting it
 		if(retval)
@@ -387,12 +753,28 @@ int main(int argc, char **argv) {
 
 		bluray_highest_playlist = ((bluray_title.playlist > bluray_highest_playlist) ? bluray_title.playlist : bluray_highest_playlist);
 
-		if(p_bluray_info) {
+		where_title.title_info = bluray_title.title_info;
+		if(p_where && bluray_where_eval(&where, &where_title) == BLURAY_WHERE_FALSE)
+			continue;
 
-			if(!(bluray_title.seconds >= d_min_seconds && bluray_title.minutes >= d_min_minutes && bluray_title.audio_streams >= d_min_audio_streams && bluray_title.pg_streams >= d_min_pg_streams)) {
-				bd_stream = NULL;
+		// Chapter start times are relative to the title
+		chapter_start = 0;
+
+		// Getting the title size requires libbluray to select the title and open
+		// all its clips, skip it if not needed, or if the disc cache has it
+		if(!native && (p_bluray_info || (p_bluray_json && (d_fields & BLURAY_FIELD_FILESIZE)) || (p_where && (where.stages & BLURAY_WHERE_STAGE_SIZE))) && bluray_cache_title_size(&disc_cache, &bluray_title, angle_ix)) {
+			if(bd_select_title(bd, ix) == 0)
 				continue;
-			}
+			bluray_title_size(bd, &bluray_title);
+			bluray_cache_set_title_size(&disc_cache, &bluray_title, angle_ix);
+		}
+
+		where_title.size_known = true;
+		where_title.size = bluray_title.size;
+		if(p_where && bluray_where_eval(&where, &where_title) != BLURAY_WHERE_TRUE)
+			continue;
+
+		if(p_bluray_info) {
 
 			printf("Title: %03" PRIu32 ", Playlist: %04" PRIu32 ", Length: %s, Chapters: %03"PRIu32 ", Video streams: %02" PRIu8 ", Audio streams: %02" PRIu8 ", Subtitles: %02" PRIu8 ", Angles: %02" PRIu8 ", Filesize: %05.0lf MBs\n", bluray_title.number, bluray_title.playlist, bluray_title.length, bluray_title.chapters, bluray_title.video_streams, bluray_title.audio_streams, bluray_title.pg_streams, bluray_title.angles, bluray_title.size_mbs);
 
@@ -400,26 +782,27 @@ int main(int argc, char **argv) {
 
 		if(p_bluray_json) {
 
-			if(!(bluray_title.seconds >= d_min_seconds && bluray_title.minutes >= d_min_minutes && bluray_title.audio_streams >= d_min_audio_streams && bluray_title.pg_streams >= d_min_pg_streams)) {
-				bd_stream = NULL;
-				continue;
-			}
-
-			printf("  {\n");
-			printf("   \"title\": %u,\n", bluray_title.number);
-			printf("   \"playlist\": %" PRIu32 ",\n", bluray_title.playlist);
-			printf("   \"length\": \"%s\",\n", bluray_title.length);
-			printf("   \"msecs\": %" PRIu64 ",\n", bluray_title.duration / 900);
-			printf("   \"angles\": %" PRIu8 ",\n", bluray_title.angles);
-			printf("   \"filesize\": %" PRIu64 ",\n", bluray_title.size);
+			bluray_json_object_open(&json, NULL);
+			if(d_fields & BLURAY_FIELD_TITLE)
+				bluray_json_uint(&json, "title", bluray_title.number);
+			if(d_fields & BLURAY_FIELD_PLAYLIST)
+				bluray_json_uint(&json, "playlist", bluray_title.playlist);
+			if(d_fields & BLURAY_FIELD_LENGTH)
+				bluray_json_string(&json, "length", bluray_title.length);
+			if(d_fields & BLURAY_FIELD_MSECS)
+				bluray_json_uint(&json, "msecs", bluray_title.duration / 900);
+			if(d_fields & BLURAY_FIELD_ANGLES)
+				bluray_json_uint(&json, "angles", bluray_title.angles);
+			if(d_fields & BLURAY_FIELD_FILESIZE)
+				bluray_json_uint(&json, "filesize", bluray_title.size);
 
 		}
 
 		// Blu-ray video streams
-		if((p_bluray_info && d_video) || p_bluray_json) {
+		if((p_bluray_info && d_video) || (p_bluray_json && (d_fields & BLURAY_FIELDS_VIDEO))) {
 
 			if(p_bluray_json)
-				printf("   \"video\": [\n");
+				bluray_json_array_open(&json, "video");
 
 			for(video_stream_ix = 0; video_stream_ix < bluray_title.video_streams; video_stream_ix++) {
 
@@ -430,45 +813,29 @@ int main(int argc, char **argv) {
 				if(bd_stream == NULL)
 					continue;
 
-				bluray_video_codec(bluray_video.codec, bd_stream->coding_type);
-				bluray_video_codec_name(bluray_video.codec_name, bd_stream->coding_type);
-				bluray_video_format(bluray_video.format, bd_stream->format);
-				bluray_video.framerate = bluray_video_framerate(bd_stream->rate);
-				bluray_video_aspect_ratio(bluray_video.aspect_ratio, bd_stream->aspect);
+				bluray_video_stream(&bluray_video, bd_stream);
 
 				if(p_bluray_info && d_video) {
 					printf("	Video: %02u, Format: %s, Aspect ratio: %s, FPS: %.02f, Codec: %s\n", video_stream_number, bluray_video.format, bluray_video.aspect_ratio, bluray_video.framerate, bluray_video.codec);
 				}
 
-				if(p_bluray_json) {
-					printf("    {\n");
-					printf("     \"track\": %" PRIu8 ",\n", video_stream_number);
-					printf("     \"stream\": \"0x%x\",\n", bd_stream->pid);
-					printf("     \"format\": \"%s\",\n", bluray_video.format);
-					printf("     \"aspect ratio\": \"%s\",\n", bluray_video.aspect_ratio);
-					printf("     \"framerate\": %.02f,\n", bluray_video.framerate);
-					printf("     \"codec\": \"%s\",\n", bluray_video.codec);
-					printf("     \"codec name\": \"%s\"\n", bluray_video.codec_name);
-					if(video_stream_number < bluray_title.video_streams)
-						printf("    },\n");
-					else
-						printf("    }\n");
-				}
+				if(p_bluray_json)
+					bluray_fields_video(&json, d_fields, video_stream_number, &bluray_video);
 
 			}
 
 			bd_stream = NULL;
 
 			if(p_bluray_json)
-				printf("   ],\n");
+				bluray_json_array_close(&json);
 
 		}
 
 		// Blu-ray audio streams
-		if((p_bluray_info && d_audio) || p_bluray_json) {
+		if((p_bluray_info && d_audio) || (p_bluray_json && (d_fields & BLURAY_FIELDS_AUDIO))) {
 
 			if(p_bluray_json)
-				printf("   \"audio\": [\n");
+				bluray_json_array_open(&json, "audio");
 
 			for(audio_stream_ix = 0; audio_stream_ix < bluray_title.audio_streams; audio_stream_ix++) {
 
@@ -479,45 +846,29 @@ int main(int argc, char **argv) {
 				if(bd_stream == NULL)
 					continue;
 
-				bluray_audio_lang(bluray_audio.lang, bd_stream->lang);
-				bluray_audio_codec(bluray_audio.codec, bd_stream->coding_type);
-				bluray_audio_codec_name(bluray_audio.codec_name, bd_stream->coding_type);
-				bluray_audio_format(bluray_audio.format, bd_stream->format);
-				bluray_audio_rate(bluray_audio.rate, bd_stream->rate);
+				bluray_audio_stream(&bluray_audio, bd_stream);
 
 				if(p_bluray_info && d_audio) {
 					printf("	Audio: %02" PRIu8 ", Language: %s, Codec: %s, Format: %s, Rate: %s\n", audio_stream_number, bluray_audio.lang, bluray_audio.codec, bluray_audio.format, bluray_audio.rate);
 				}
 
-				if(p_bluray_json) {
-					printf("    {\n");
-					printf("     \"track\": %" PRIu8 ",\n", audio_stream_number);
-					printf("     \"stream\": \"0x%x\",\n", bd_stream->pid);
-					printf("     \"language\": \"%s\",\n", bluray_audio.lang);
-					printf("     \"codec\": \"%s\",\n", bluray_audio.codec);
-					printf("     \"codec name\": \"%s\",\n", bluray_audio.codec_name);
-					printf("     \"format\": \"%s\",\n", bluray_audio.format);
-					printf("     \"rate\": \"%s\"\n", bluray_audio.rate);
-					if(audio_stream_number < bluray_title.audio_streams)
-						printf("    },\n");
-					else
-						printf("    }\n");
-				}
+				if(p_bluray_json)
+					bluray_fields_audio(&json, d_fields, audio_stream_number, &bluray_audio);
 
 			}
 
 			bd_stream = NULL;
 
 			if(p_bluray_json)
-				printf("   ],\n");
+				bluray_json_array_close(&json);
 
 		}
 
 		// Blu-ray PGS streams
-		if((p_bluray_info && d_subtitles) || p_bluray_json) {
+		if((p_bluray_info && d_subtitles) || (p_bluray_json && (d_fields & BLURAY_FIELDS_PGS))) {
 
 			if(p_bluray_json)
-				printf("   \"subtitles\": [\n");
+				bluray_json_array_open(&json, "subtitles");
 
 			for(pg_stream_ix = 0; pg_stream_ix < bluray_title.pg_streams; pg_stream_ix++) {
 
@@ -525,40 +876,32 @@ int main(int argc, char **argv) {
 				// bd_stream = &bd_title->clips[0].pg_streams[pg_stream_ix];
 				bd_stream = &bluray_title.clip_info[0].pg_streams[pg_stream_ix];
 
-				bluray_pgs_lang(bluray_pgs.lang, bd_stream->lang);
-
 				if(bd_stream == NULL)
 					continue;
 
+				bluray_pgs_stream(&bluray_pgs, bd_stream);
+
 				if(p_bluray_info && d_subtitles) {
 					printf("	Subtitle: %02" PRIu8 ", Language: %s\n", pg_stream_number, bluray_pgs.lang);
 				}
 
-				if(p_bluray_json) {
-					printf("    {\n");
-					printf("     \"track\": %" PRIu8 ",\n", pg_stream_number);
-					printf("     \"stream\": \"0x%x\",\n", bd_stream->pid);
-					printf("     \"language\": \"%s\"\n", bluray_pgs.lang);
-					if(pg_stream_number < bluray_title.pg_streams)
-						printf("    },\n");
-					else
-						printf("    }\n");
-				}
+				if(p_bluray_json)
+					bluray_fields_pgs(&json, d_fields, pg_stream_number, &bluray_pgs);
 
 			}
 
 			bd_stream = NULL;
 
 			if(p_bluray_json)
-				printf("   ],\n");
+				bluray_json_array_close(&json);
 
 		}
 
 		// Blu-ray chapters
-		if((p_bluray_info && d_chapters) || p_bluray_json || p_bluray_xchap) {
+		if((p_bluray_info && d_chapters) || (p_bluray_json && (d_fields & BLURAY_FIELDS_CHAPTERS)) || p_bluray_xchap) {
 
 			if(p_bluray_json)
-				printf("   \"chapters\": [\n");
+				bluray_json_array_open(&json, "chapters");
 
 			for(chapter_ix = 0; chapter_ix < bluray_title.chapters; chapter_ix++) {
 
@@ -573,24 +916,29 @@ int main(int argc, char **argv) {
 				bluray_chapter.duration = bd_chapter->duration;
 				bluray_duration_length(bluray_chapter.length, bluray_chapter.duration);
 				bluray_duration_length(bluray_chapter.start_time, bluray_chapter.start);
-				bluray_chapter.size = bluray_chapter_size(bd, bluray_title.number - 1, chapter_ix);
+
+				if(p_bluray_json && (d_fields & BLURAY_FIELD_CHAPTER_FILESIZE))
+					bluray_chapter.size = bluray_chapter_size(&bluray_title, chapter_ix);
 
 				if(p_bluray_info && d_chapters) {
 					printf("	Chapter: %03" PRIu32 ", Start: %s, Length: %s\n", chapter_number, bluray_chapter.start_time, bluray_chapter.length);
 				}
 
 				if(p_bluray_json) {
-					printf("    {\n");
-					printf("     \"chapter\": %" PRIu32 ",\n", chapter_number);
-					printf("     \"start time\": \"%s\",\n", bluray_chapter.start_time);
-					printf("     \"length\": \"%s\",\n", bluray_chapter.length);
-					printf("     \"start\": %" PRIu64 ",\n", bluray_chapter.start / 900);
-					printf("     \"duration\": %" PRIu64 ",\n", bd_chapter->duration / 900);
-					printf("     \"filesize\": %" PRIu64 "\n", bluray_chapter.size);
-					if(chapter_number < bluray_title.chapters)
-						printf("    },\n");
-					else
-						printf("    }\n");
+					bluray_json_object_open(&json, NULL);
+					if(d_fields & BLURAY_FIELD_CHAPTER)
+						bluray_json_uint(&json, "chapter", chapter_number);
+					if(d_fields & BLURAY_FIELD_CHAPTER_START_TIME)
+						bluray_json_string(&json, "start time", bluray_chapter.start_time);
+					if(d_fields & BLURAY_FIELD_CHAPTER_LENGTH)
+						bluray_json_string(&json, "length", bluray_chapter.length);
+					if(d_fields & BLURAY_FIELD_CHAPTER_START)
+						bluray_json_uint(&json, "start", bluray_chapter.start / 900);
+					if(d_fields & BLURAY_FIELD_CHAPTER_DURATION)
+						bluray_json_uint(&json, "duration", bd_chapter->duration / 900);
+					if(d_fields & BLURAY_FIELD_CHAPTER_FILESIZE)
+						bluray_json_uint(&json, "filesize", bluray_chapter.size);
+					bluray_json_object_close(&json);
 				}
 
 				if(p_bluray_xchap && ix == d_first_ix) {
@@ -605,27 +953,61 @@ int main(int argc, char **argv) {
 			bd_chapter = NULL;
 
 			if(p_bluray_json)
-				printf("   ]\n");
+				bluray_json_array_close(&json);
 
 		}
 
-		if(p_bluray_json) {
-			if(d_title_counter + 1 < d_num_titles)
-				printf("  },\n");
-			else
-				printf("  }\n");
-		}
+		if(p_bluray_json)
+			bluray_json_object_close(&json);
+
+		if(p_bluray_ndjson)
+			bluray_json_end(&json);
+
+		bluray_trace_end("title", trace_start, ix, BLURAY_TRACE_NONE);
 
 	}
 
+	if(p_bluray_json_titles && !p_bluray_ndjson)
+		bluray_json_array_close(&json);
+
+	if(p_bluray_json && !p_bluray_ndjson) {
+		bluray_json_object_close(&json);
+		bluray_json_end(&json);
+	}
+
+	// A short write leaves the document cut off, see bluray_json_flush()
+	bool json_error = false;
 	if(p_bluray_json) {
-		printf(" ]\n");
-		printf("}\n");
+		bluray_json_flush(&json);
+		json_error = json.error;
+		bluray_json_free(&json);
 	}
 
+	bluray_title_free(&bluray_title);
+
+	if(native)
+		bluray_bdmv_close(&bdmv);
+
+	bluray_cache_close(&disc_cache);
+
 	bd_close(bd);
 	bd = NULL;
 
-	return 0;
+	retval = 0;
+
+	if(json_error) {
+		fprintf(stderr, "Could not write output\n");
+		retval = 1;
+	}
+
+	if(trace_filename != NULL && bluray_trace_write(trace_filename))
+		retval = 1;
+
+	if(p_timings)
+		bluray_trace_timings(stderr);
+
+	bluray_trace_free();
+
+	return retval;
 
 }
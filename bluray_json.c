@@ -0,0 +1,492 @@
+#include "bluray_json.h"
+
+/**
+ * Make room for len more bytes in the buffer
+ */
+static bool bluray_json_reserve(struct bluray_json *json, size_t len) {
+
+	if(json->error)
+		return false;
+
+	if(json->length + len <= json->size)
+		return true;
+
+	size_t size = json->size;
+	while(json->length + len > size)
+		size *= 2;
+
+	char *buffer = NULL;
+	buffer = realloc(json->buffer, size);
+	if(buffer == NULL) {
+		json->error = true;
+		return false;
+	}
+
+	json->buffer = buffer;
+	json->size = size;
+
+	return true;
+
+}
+
+static void bluray_json_append(struct bluray_json *json, const char *str, size_t len) {
+
+	if(!bluray_json_reserve(json, len))
+		return;
+
+	memcpy(json->buffer + json->length, str, len);
+	json->length += len;
+
+}
+
+static void bluray_json_char(struct bluray_json *json, char c) {
+
+	if(!bluray_json_reserve(json, 1))
+		return;
+
+	json->buffer[json->length] = c;
+	json->length++;
+
+}
+
+static void bluray_json_cbor_head(struct bluray_json *json, uint8_t major, uint64_t value) {
+
+	if(!bluray_json_reserve(json, BLURAY_CBOR_HEAD_MAX))
+		return;
+
+	json->length += bluray_cbor_head((uint8_t *)json->buffer + json->length, major, value);
+
+}
+
+/**
+ * Write a CBOR text string, or a reference to it if it's been sent already
+ */
+static void bluray_json_cbor_text(struct bluray_json *json, const char *str) {
+
+	size_t len = strlen(str);
+	int64_t index = -1;
+
+	if(json->strings != NULL)
+		index = bluray_cbor_strings_lookup(json->strings, str, len);
+
+	if(index >= 0) {
+		bluray_json_cbor_head(json, BLURAY_CBOR_TAG, BLURAY_CBOR_TAG_STRINGREF);
+		bluray_json_cbor_head(json, BLURAY_CBOR_UINT, (uint64_t)index);
+		return;
+	}
+
+	bluray_json_cbor_head(json, BLURAY_CBOR_TEXT, len);
+	bluray_json_append(json, str, len);
+
+}
+
+static void bluray_json_quoted(struct bluray_json *json, const char *str) {
+
+	const char *hex = "0123456789abcdef";
+	const unsigned char *c = (const unsigned char *)str;
+	char escape[6] = { '\\', 'u', '0', '0', '0', '0' };
+
+	bluray_json_char(json, '"');
+
+	for(; *c != '\0'; c++) {
+
+		switch(*c) {
+
+			case '"':
+				bluray_json_append(json, "\\\"", 2);
+				break;
+
+			case '\\':
+				bluray_json_append(json, "\\\\", 2);
+				break;
+
+			case '\n':
+				bluray_json_append(json, "\\n", 2);
+				break;
+
+			case '\r':
+				bluray_json_append(json, "\\r", 2);
+				break;
+
+			case '\t':
+				bluray_json_append(json, "\\t", 2);
+				break;
+
+			default:
+				if(*c < 0x20) {
+					escape[4] = hex[*c >> 4];
+					escape[5] = hex[*c & 0x0f];
+					bluray_json_append(json, escape, 6);
+				} else {
+					bluray_json_char(json, (char)*c);
+				}
+				break;
+
+		}
+
+	}
+
+	bluray_json_char(json, '"');
+
+}
+
+/**
+ * Write an unsigned integer, zero-padded to a minimum number of digits
+ */
+static void bluray_json_digits(struct bluray_json *json, uint64_t value, uint8_t min_digits) {
+
+	// UINT64_MAX is 20 digits
+	char digits[20];
+	uint8_t ix = 20;
+
+	do {
+		ix--;
+		digits[ix] = (char)('0' + (value % 10));
+		value /= 10;
+	} while((value || (20 - ix) < min_digits) && ix > 0);
+
+	bluray_json_append(json, digits + ix, (size_t)(20 - ix));
+
+}
+
+/**
+ * Start a new value: add the separator, indentation and key, if there is one
+ */
+static void bluray_json_key(struct bluray_json *json, const char *key) {
+
+	uint8_t ix = 0;
+
+	if(json->format == BLURAY_JSON_FORMAT_CBOR) {
+		if(key != NULL)
+			bluray_json_cbor_text(json, key);
+		return;
+	}
+
+	if(json->depth) {
+
+		if(json->first[json->depth - 1] == false)
+			bluray_json_char(json, ',');
+		json->first[json->depth - 1] = false;
+
+		if(!json->compact) {
+			bluray_json_char(json, '\n');
+			for(ix = 0; ix < json->depth; ix++)
+				bluray_json_char(json, ' ');
+		}
+
+	}
+
+	if(key == NULL)
+		return;
+
+	bluray_json_quoted(json, key);
+
+	if(json->compact)
+		bluray_json_char(json, ':');
+	else
+		bluray_json_append(json, ": ", 2);
+
+}
+
+static void bluray_json_open(struct bluray_json *json, const char *key, char c) {
+
+	// Each top-level CBOR item is self-described, and has its own string table
+	if(json->format == BLURAY_JSON_FORMAT_CBOR && json->depth == 0) {
+		bluray_json_cbor_head(json, BLURAY_CBOR_TAG, BLURAY_CBOR_TAG_SELF_DESCRIBE);
+		bluray_json_cbor_head(json, BLURAY_CBOR_TAG, BLURAY_CBOR_TAG_STRINGREF_NAMESPACE);
+		if(json->strings != NULL)
+			bluray_cbor_strings_reset(json->strings);
+	}
+
+	bluray_json_key(json, key);
+
+	if(json->format == BLURAY_JSON_FORMAT_CBOR)
+		bluray_json_char(json, (char)(c == '{' ? BLURAY_CBOR_MAP_INDEFINITE : BLURAY_CBOR_ARRAY_INDEFINITE));
+	else
+		bluray_json_char(json, c);
+
+	if(json->depth == BLURAY_JSON_DEPTH_MAX) {
+		json->error = true;
+		return;
+	}
+
+	json->first[json->depth] = true;
+	json->depth++;
+
+}
+
+static void bluray_json_close(struct bluray_json *json, char c) {
+
+	uint8_t ix = 0;
+
+	if(json->depth == 0) {
+		json->error = true;
+		return;
+	}
+
+	json->depth--;
+
+	if(json->format == BLURAY_JSON_FORMAT_CBOR) {
+		bluray_json_char(json, (char)BLURAY_CBOR_BREAK);
+	} else {
+		if(!json->compact) {
+			bluray_json_char(json, '\n');
+			for(ix = 0; ix < json->depth; ix++)
+				bluray_json_char(json, ' ');
+		}
+		bluray_json_char(json, c);
+	}
+
+	// A document can be written out part way through; an NDJSON record is
+	// kept whole, so it's never cut off in the stream
+	if((json->depth == 0 || json->format != BLURAY_JSON_FORMAT_NDJSON) && json->length >= BLURAY_JSON_FLUSH_SIZE)
+		bluray_json_flush(json);
+
+}
+
+/**
+ * Initialize a writer. If io is NULL, the output is kept in the buffer and
+ * never flushed, so the caller can use it directly.
+ */
+int bluray_json_init(struct bluray_json *json, FILE *io, uint8_t format) {
+
+	json->io = io;
+	json->length = 0;
+	json->size = BLURAY_JSON_BUFFER_SIZE;
+	json->format = format;
+	json->compact = (format != BLURAY_JSON_FORMAT_JSON);
+	json->error = false;
+	json->depth = 0;
+	memset(json->first, true, sizeof(json->first));
+	json->strings = NULL;
+
+	json->buffer = malloc(json->size);
+	if(json->buffer == NULL) {
+		json->error = true;
+		return 1;
+	}
+
+	if(format == BLURAY_JSON_FORMAT_CBOR) {
+		json->strings = bluray_cbor_strings_init();
+		if(json->strings == NULL) {
+			json->error = true;
+			return 1;
+		}
+	}
+
+	return 0;
+
+}
+
+void bluray_json_free(struct bluray_json *json) {
+
+	free(json->buffer);
+	json->buffer = NULL;
+	bluray_cbor_strings_free(json->strings);
+	json->strings = NULL;
+	json->length = 0;
+	json->size = 0;
+
+}
+
+/**
+ * Discard the buffered output and start a new document
+ */
+void bluray_json_reset(struct bluray_json *json) {
+
+	json->length = 0;
+	json->error = false;
+	json->depth = 0;
+	memset(json->first, true, sizeof(json->first));
+
+}
+
+/**
+ * Write out the buffer
+ */
+int bluray_json_flush(struct bluray_json *json) {
+
+	if(json->io == NULL || json->length == 0)
+		return 0;
+
+	size_t length = json->length;
+	size_t written = 0;
+	written = fwrite(json->buffer, 1, length, json->io);
+	json->length = 0;
+
+	// A short write leaves a record cut off in the stream
+	if(written != length || fflush(json->io) != 0) {
+		json->error = true;
+		return 1;
+	}
+
+	return 0;
+
+}
+
+void bluray_json_object_open(struct bluray_json *json, const char *key) {
+
+	bluray_json_open(json, key, '{');
+
+}
+
+void bluray_json_object_close(struct bluray_json *json) {
+
+	bluray_json_close(json, '}');
+
+}
+
+void bluray_json_array_open(struct bluray_json *json, const char *key) {
+
+	bluray_json_open(json, key, '[');
+
+}
+
+void bluray_json_array_close(struct bluray_json *json) {
+
+	bluray_json_close(json, ']');
+
+}
+
+void bluray_json_string(struct bluray_json *json, const char *key, const char *value) {
+
+	bluray_json_key(json, key);
+
+	if(json->format == BLURAY_JSON_FORMAT_CBOR)
+		bluray_json_cbor_text(json, value);
+	else
+		bluray_json_quoted(json, value);
+
+}
+
+void bluray_json_uint(struct bluray_json *json, const char *key, uint64_t value) {
+
+	bluray_json_key(json, key);
+
+	if(json->format == BLURAY_JSON_FORMAT_CBOR)
+		bluray_json_cbor_head(json, BLURAY_CBOR_UINT, value);
+	else
+		bluray_json_digits(json, value, 1);
+
+}
+
+/**
+ * Write a fixed-point number, value is scaled by 10^decimals. For example,
+ * 2397 with 2 decimals is 23.97
+ *
+ * CBOR has an exact type for it, a decimal fraction: [ -decimals, value ]
+ */
+void bluray_json_fixed(struct bluray_json *json, const char *key, uint64_t value, uint8_t decimals) {
+
+	uint64_t scale = 1;
+	uint8_t ix = 0;
+
+	for(ix = 0; ix < decimals; ix++)
+		scale *= 10;
+
+	bluray_json_key(json, key);
+
+	if(json->format == BLURAY_JSON_FORMAT_CBOR) {
+		bluray_json_cbor_head(json, BLURAY_CBOR_TAG, BLURAY_CBOR_TAG_DECIMAL_FRACTION);
+		bluray_json_cbor_head(json, BLURAY_CBOR_ARRAY, 2);
+		if(decimals)
+			bluray_json_cbor_head(json, BLURAY_CBOR_NINT, decimals - 1);
+		else
+			bluray_json_cbor_head(json, BLURAY_CBOR_UINT, 0);
+		bluray_json_cbor_head(json, BLURAY_CBOR_UINT, value);
+		return;
+	}
+
+	bluray_json_digits(json, value / scale, 1);
+
+	if(decimals == 0)
+		return;
+
+	bluray_json_char(json, '.');
+	bluray_json_digits(json, value % scale, decimals);
+
+}
+
+/**
+ * Write a number as a hexadecimal string, such as stream PIDs: "0x1011"
+ *
+ * CBOR gets the plain number
+ */
+void bluray_json_hex(struct bluray_json *json, const char *key, uint64_t value) {
+
+	const char *hex = "0123456789abcdef";
+	char digits[16];
+	uint8_t ix = 16;
+
+	bluray_json_key(json, key);
+
+	if(json->format == BLURAY_JSON_FORMAT_CBOR) {
+		bluray_json_cbor_head(json, BLURAY_CBOR_UINT, value);
+		return;
+	}
+
+	do {
+		ix--;
+		digits[ix] = hex[value & 0x0f];
+		value >>= 4;
+	} while(value && ix > 0);
+
+	bluray_json_append(json, "\"0x", 3);
+	bluray_json_append(json, digits + ix, (size_t)(16 - ix));
+	bluray_json_char(json, '"');
+
+}
+
+void bluray_json_bool(struct bluray_json *json, const char *key, bool value) {
+
+	bluray_json_key(json, key);
+
+	if(json->format == BLURAY_JSON_FORMAT_CBOR)
+		bluray_json_char(json, (char)(value ? BLURAY_CBOR_TRUE : BLURAY_CBOR_FALSE));
+	else if(value)
+		bluray_json_append(json, "true", 4);
+	else
+		bluray_json_append(json, "false", 5);
+
+}
+
+/**
+ * Write an enumerated value: its name as a string, or for CBOR, its code
+ */
+void bluray_json_enum(struct bluray_json *json, const char *key, const char *value, uint64_t code) {
+
+	if(json->format == BLURAY_JSON_FORMAT_CBOR)
+		bluray_json_uint(json, key, code);
+	else
+		bluray_json_string(json, key, value);
+
+}
+
+/**
+ * Append a complete top-level value that was written earlier, such as a
+ * cached record. It has to be in the same format as the writer.
+ */
+void bluray_json_raw(struct bluray_json *json, const char *data, size_t length) {
+
+	bluray_json_append(json, data, length);
+
+}
+
+/**
+ * Finish a top-level record with a newline. In compact mode, each record is
+ * one line and is written out immediately.
+ */
+int bluray_json_end(struct bluray_json *json) {
+
+	if(json->format != BLURAY_JSON_FORMAT_CBOR)
+		bluray_json_char(json, '\n');
+
+	if(json->compact || json->length >= BLURAY_JSON_FLUSH_SIZE)
+		bluray_json_flush(json);
+
+	if(json->error)
+		return 1;
+
+	return 0;
+
+}
@@ -0,0 +1,81 @@
+#ifndef BLURAY_INFO_JSON_H
+#define BLURAY_INFO_JSON_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "bluray_cbor.h"
+
+/**
+ * Streaming JSON writer
+ *
+ * Everything is appended to one output buffer, which is written out once it
+ * passes BLURAY_JSON_FLUSH_SIZE at the end of an object or array, so a
+ * document of any size only takes that much memory. NDJSON records (one per
+ * line) are only written out whole, at the end of each one. Commas and indentation are tracked by the
+ * writer, so values can be skipped without worrying about separators.
+ *
+ * Strings are escaped, and numbers are formatted by hand so the output
+ * never depends on the locale.
+ *
+ * The same calls can also write CBOR, a binary encoding of the same data
+ * model. Enumerated values (codecs, formats, rates) are written as their
+ * libbluray codes instead of names, and repeated strings are only sent once.
+ */
+
+#define BLURAY_JSON_FORMAT_JSON 0
+#define BLURAY_JSON_FORMAT_NDJSON 1
+#define BLURAY_JSON_FORMAT_CBOR 2
+
+#define BLURAY_JSON_BUFFER_SIZE 65536
+#define BLURAY_JSON_FLUSH_SIZE 61440
+#define BLURAY_JSON_DEPTH_MAX 16
+
+struct bluray_json {
+	FILE *io;
+	char *buffer;
+	size_t length;
+	size_t size;
+	uint8_t format;
+	bool compact;
+	bool error;
+	uint8_t depth;
+	bool first[BLURAY_JSON_DEPTH_MAX];
+	struct bluray_cbor_strings *strings;
+};
+
+int bluray_json_init(struct bluray_json *json, FILE *io, uint8_t format);
+
+void bluray_json_free(struct bluray_json *json);
+
+void bluray_json_reset(struct bluray_json *json);
+
+int bluray_json_flush(struct bluray_json *json);
+
+void bluray_json_object_open(struct bluray_json *json, const char *key);
+
+void bluray_json_object_close(struct bluray_json *json);
+
+void bluray_json_array_open(struct bluray_json *json, const char *key);
+
+void bluray_json_array_close(struct bluray_json *json);
+
+void bluray_json_string(struct bluray_json *json, const char *key, const char *value);
+
+void bluray_json_uint(struct bluray_json *json, const char *key, uint64_t value);
+
+void bluray_json_fixed(struct bluray_json *json, const char *key, uint64_t value, uint8_t decimals);
+
+void bluray_json_hex(struct bluray_json *json, const char *key, uint64_t value);
+
+void bluray_json_bool(struct bluray_json *json, const char *key, bool value);
+
+void bluray_json_enum(struct bluray_json *json, const char *key, const char *value, uint64_t code);
+
+void bluray_json_raw(struct bluray_json *json, const char *data, size_t length);
+
+int bluray_json_end(struct bluray_json *json);
+
+#endif
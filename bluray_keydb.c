@@ -0,0 +1,426 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bluray_keydb.h"
+#include "bluray_file.h"
+#include "bluray_sha1.h"
+#include "bluray_udf.h"
+
+static const char *bluray_keydb_unit_key_files[] = { "AACS/Unit_Key_RO.inf", "AACS/DUPLICATE/Unit_Key_RO.inf" };
+
+static void bluray_keydb_hex(char *disc_id, const uint8_t digest[BLURAY_SHA1_LENGTH]) {
+
+	uint8_t ix = 0;
+	for(ix = 0; ix < BLURAY_SHA1_LENGTH; ix++)
+		sprintf(disc_id + 2 * ix, "%02X", digest[ix]);
+
+}
+
+static int bluray_keydb_unit_key_dir(const char *dirname, uint8_t **data, size_t *length) {
+
+	char path[PATH_MAX];
+	struct stat st;
+	uint8_t *buffer = NULL;
+	FILE *file = NULL;
+	uint8_t ix = 0;
+
+	for(ix = 0; ix < 2 && file == NULL; ix++) {
+		if(snprintf(path, PATH_MAX, "%s/%s", dirname, bluray_keydb_unit_key_files[ix]) >= PATH_MAX)
+			return 1;
+		file = fopen(path, "rb");
+	}
+
+	if(file == NULL)
+		return 1;
+
+	if(fstat(fileno(file), &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		fclose(file);
+		return 1;
+	}
+
+	buffer = malloc((size_t)st.st_size);
+	if(buffer == NULL || fread(buffer, 1, (size_t)st.st_size, file) != (size_t)st.st_size) {
+		free(buffer);
+		fclose(file);
+		return 1;
+	}
+
+	fclose(file);
+
+	*data = buffer;
+	*length = (size_t)st.st_size;
+
+	return 0;
+
+}
+
+static int bluray_keydb_unit_key_image(const char *filename, size_t size, uint8_t **data, size_t *length) {
+
+	int fd = open(filename, O_RDONLY);
+	if(fd == -1)
+		return 1;
+
+	void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+		return 1;
+
+	struct bluray_udf udf;
+	const uint8_t *file_data = NULL;
+	size_t file_length = 0;
+	uint8_t *copy = NULL;
+	int retval = 1;
+	uint8_t ix = 0;
+
+	if(bluray_udf_open(&udf, map, size) == 0) {
+
+		for(ix = 0; ix < 2 && retval; ix++)
+			retval = bluray_udf_file(&udf, bluray_keydb_unit_key_files[ix], &file_data, &file_length, &copy);
+
+		// Keep a copy, since the image is unmapped
+		if(retval == 0 && copy == NULL) {
+			copy = malloc(file_length ? file_length : 1);
+			if(copy == NULL)
+				retval = 1;
+			else
+				memcpy(copy, file_data, file_length);
+		}
+
+		if(retval == 0) {
+			*data = copy;
+			*length = file_length;
+		}
+
+		bluray_udf_close(&udf);
+
+	}
+
+	munmap(map, size);
+
+	return retval;
+
+}
+
+/**
+ * Read AACS/Unit_Key_RO.inf, or its duplicate, from a disc directory or image.
+ * The data is to be freed afterwards.
+ */
+int bluray_keydb_unit_key_file(const char *device_filename, uint8_t **data, size_t *length) {
+
+	struct stat st;
+	if(stat(device_filename, &st) == -1)
+		return 1;
+
+	if(S_ISDIR(st.st_mode))
+		return bluray_keydb_unit_key_dir(device_filename, data, length);
+
+	if(S_ISREG(st.st_mode) && st.st_size > 0)
+		return bluray_keydb_unit_key_image(device_filename, (size_t)st.st_size, data, length);
+
+	return 1;
+
+}
+
+/**
+ * Get the AACS disc ID of a disc directory or image, without opening it in
+ * libbluray. Fails for anything else, and for discs without AACS.
+ */
+int bluray_keydb_disc_id(const char *device_filename, char *disc_id) {
+
+	uint8_t *data = NULL;
+	size_t length = 0;
+	uint8_t digest[BLURAY_SHA1_LENGTH];
+	struct bluray_sha1 sha1;
+
+	if(bluray_keydb_unit_key_file(device_filename, &data, &length))
+		return 1;
+
+	bluray_sha1_init(&sha1);
+	bluray_sha1_update(&sha1, data, length);
+	bluray_sha1_final(&sha1, digest);
+	bluray_keydb_hex(disc_id, digest);
+
+	free(data);
+
+	return 0;
+
+}
+
+/**
+ * Get the KEYDB.cfg libaacs reads, either the one given or the first one in
+ * its config directories
+ */
+int bluray_keydb_filename(char *filename, size_t size, const char *key_db_filename) {
+
+	if(key_db_filename != NULL) {
+		if(snprintf(filename, size, "%s", key_db_filename) >= (int)size)
+			return 1;
+		return access(filename, R_OK);
+	}
+
+	const char *config_home = getenv("XDG_CONFIG_HOME");
+	const char *home_dir = getenv("HOME");
+
+	if(config_home != NULL && config_home[0] != '\0') {
+		if(snprintf(filename, size, "%s/aacs/KEYDB.cfg", config_home) < (int)size && access(filename, R_OK) == 0)
+			return 0;
+	} else if(home_dir != NULL) {
+		if(snprintf(filename, size, "%s/.config/aacs/KEYDB.cfg", home_dir) < (int)size && access(filename, R_OK) == 0)
+			return 0;
+	}
+
+	if(snprintf(filename, size, "/etc/xdg/aacs/KEYDB.cfg") < (int)size && access(filename, R_OK) == 0)
+		return 0;
+
+	return 1;
+
+}
+
+int bluray_keydb_cache_filename(char *filename, size_t size, const char *disc_id) {
+
+	return bluray_file_xdg_filename(filename, size, "XDG_CACHE_HOME", ".cache", "bluray_info/keydb/%s.cfg", disc_id);
+
+}
+
+/**
+ * Check for a cache file, and that it was written after the KEYDB, which may
+ * have had the disc's keys changed since
+ */
+int bluray_keydb_cached(const char *cache_filename, const char *key_db_filename) {
+
+	struct stat cache_st;
+	struct stat key_db_st;
+
+	if(stat(cache_filename, &cache_st) == -1 || !S_ISREG(cache_st.st_mode))
+		return BLURAY_KEYDB_STALE;
+
+	if(stat(key_db_filename, &key_db_st) == -1 || cache_st.st_mtime <= key_db_st.st_mtime)
+		return BLURAY_KEYDB_STALE;
+
+	if(cache_st.st_size == 0)
+		return BLURAY_KEYDB_NO_ENTRY;
+
+	return BLURAY_KEYDB_ENTRY;
+
+}
+
+/**
+ * Disc entries are one line each, starting with the disc ID:
+ *
+ *   0x<disc id> = <title> | D | <date> | M | <media key> | I | <volume id>
+ *     | V | <volume unique key> | U | <unit keys> ; <comment>
+ */
+static bool bluray_keydb_disc_entry(const char *line, const char *disc_id) {
+
+	while(*line == ' ' || *line == '\t')
+		line++;
+
+	if(line[0] != '0' || (line[1] != 'x' && line[1] != 'X'))
+		return false;
+	line += 2;
+
+	if(strncasecmp(line, disc_id, BLURAY_KEYDB_DISC_ID_STRLEN - 1))
+		return false;
+
+	return !isxdigit((unsigned char)line[BLURAY_KEYDB_DISC_ID_STRLEN - 1]);
+
+}
+
+static bool bluray_keydb_has_keys(const char *line) {
+
+	const char *p = line;
+
+	// Look for a | V | or | U | field
+	while((p = strchr(p, '|')) != NULL) {
+		p++;
+		while(*p == ' ' || *p == '\t')
+			p++;
+		if(*p != 'V' && *p != 'U')
+			continue;
+		p++;
+		while(*p == ' ' || *p == '\t')
+			p++;
+		if(*p == '|')
+			return true;
+	}
+
+	return false;
+
+}
+
+/**
+ * Parse a key, 0x and 32 hex digits, ending at a field separator
+ */
+static int bluray_keydb_key(const char *p, uint8_t key[BLURAY_KEYDB_KEY_LENGTH]) {
+
+	char hex[3] = { 0, 0, 0 };
+	uint8_t ix = 0;
+
+	while(*p == ' ' || *p == '\t')
+		p++;
+
+	if(p[0] != '0' || (p[1] != 'x' && p[1] != 'X'))
+		return 1;
+	p += 2;
+
+	for(ix = 0; ix < BLURAY_KEYDB_KEY_LENGTH; ix++) {
+		if(!isxdigit((unsigned char)p[0]) || !isxdigit((unsigned char)p[1]))
+			return 1;
+		hex[0] = p[0];
+		hex[1] = p[1];
+		key[ix] = (uint8_t)strtoul(hex, NULL, 16);
+		p += 2;
+	}
+
+	while(*p == ' ' || *p == '\t')
+		p++;
+
+	return !(*p == '|' || *p == ';' || *p == '\0' || *p == '\n' || *p == '\r');
+
+}
+
+/**
+ * Get the volume unique key and unit keys from a disc's entry. Unit keys are
+ * numbered, and listed one per field after the U field:
+ *
+ *   | U | 1-0x<unit key> | 2-0x<unit key>
+ */
+static void bluray_keydb_parse_keys(const char *line, struct bluray_keydb_keys *keys) {
+
+	const char *p = line;
+	const char *field = NULL;
+	const char *comment = strchr(line, ';');
+	char type = '\0';
+
+	while((p = strchr(p, '|')) != NULL) {
+
+		p++;
+		field = p;
+		while(*field == ' ' || *field == '\t')
+			field++;
+
+		// The comment is the end of the entry
+		if(comment != NULL && field > comment)
+			break;
+
+		// A field naming what comes after it
+		if(isalpha((unsigned char)field[0]) && (field[1] == ' ' || field[1] == '\t' || field[1] == '|')) {
+			type = field[0];
+			continue;
+		}
+
+		if(type == 'V' && !keys->vuk_found) {
+			keys->vuk_found = (bluray_keydb_key(field, keys->vuk) == 0);
+		} else if(type == 'U' && keys->num_unit_keys < BLURAY_KEYDB_UNIT_KEYS) {
+			while(isdigit((unsigned char)*field))
+				field++;
+			if(*field == '-' && bluray_keydb_key(field + 1, keys->unit_keys[keys->num_unit_keys]) == 0)
+				keys->num_unit_keys++;
+		}
+
+	}
+
+}
+
+/**
+ * Look up a disc's keys in a KEYDB, or its cache file. Fails if it has no
+ * entry, or one without a volume unique key or unit keys.
+ */
+int bluray_keydb_disc_keys(const char *filename, const char *disc_id, struct bluray_keydb_keys *keys) {
+
+	memset(keys, 0, sizeof(struct bluray_keydb_keys));
+
+	FILE *key_db = fopen(filename, "r");
+	if(key_db == NULL)
+		return 1;
+
+	char *line = NULL;
+	size_t line_size = 0;
+	bool found = false;
+
+	while(!found && getline(&line, &line_size, key_db) != -1)
+		found = bluray_keydb_disc_entry(line, disc_id);
+
+	fclose(key_db);
+
+	if(found)
+		bluray_keydb_parse_keys(line, keys);
+
+	free(line);
+
+	return !(keys->vuk_found || keys->num_unit_keys);
+
+}
+
+/**
+ * Copy the disc's entry from the KEYDB to its cache file, or leave it empty if
+ * the KEYDB doesn't have one with keys. The file is written under a temporary
+ * name and then renamed, so another program opening the same disc never reads
+ * half of it.
+ */
+int bluray_keydb_cache(const char *key_db_filename, const char *disc_id, const char *cache_filename) {
+
+	FILE *key_db = fopen(key_db_filename, "r");
+	if(key_db == NULL)
+		return 1;
+
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t length = 0;
+	bool found = false;
+
+	while(!found && (length = getline(&line, &line_size, key_db)) != -1)
+		found = bluray_keydb_disc_entry(line, disc_id);
+
+	fclose(key_db);
+
+	// Leave the file empty if there's nothing to cache
+	if(!found || !bluray_keydb_has_keys(line))
+		length = 0;
+
+	while(length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+		length--;
+
+	char tmp_filename[PATH_MAX];
+	FILE *cache = bluray_file_create(cache_filename, tmp_filename);
+	int retval = 1;
+
+	if(cache != NULL) {
+		if(length)
+			fprintf(cache, "%.*s\n", (int)length, line);
+		retval = bluray_file_replace(cache, tmp_filename, cache_filename);
+	}
+
+	free(line);
+
+	return retval;
+
+}
+
+/**
+ * Empty a disc's cache file, for when its entry didn't open the disc, so it
+ * isn't used again. It's replaced the same way it's written, or removed if it
+ * can't be. Returns 1 if the old entry is still there.
+ */
+int bluray_keydb_uncache(const char *cache_filename) {
+
+	char tmp_filename[PATH_MAX];
+	FILE *cache = bluray_file_create(cache_filename, tmp_filename);
+
+	if(cache != NULL && bluray_file_replace(cache, tmp_filename, cache_filename) == 0)
+		return 0;
+
+	if(unlink(cache_filename) == 0 || errno == ENOENT)
+		return 0;
+
+	return 1;
+
+}
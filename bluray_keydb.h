@@ -0,0 +1,66 @@
+#ifndef BLURAY_INFO_KEYDB_H
+#define BLURAY_INFO_KEYDB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Per-disc KEYDB cache
+ *
+ * libaacs parses the whole KEYDB.cfg each time a disc is opened, and a
+ * community one is tens of MBs. Once a disc has been opened with it, the
+ * disc's entry is copied to a file of its own, named after the disc ID, which
+ * is passed to libaacs instead on later opens:
+ *
+ *   $XDG_CACHE_HOME/bluray_info/keydb/<disc id>.cfg (default ~/.cache)
+ *
+ * The disc ID is the one libaacs uses, the SHA-1 of AACS/Unit_Key_RO.inf, so
+ * it can be read from a disc directory or image before opening it. Devices
+ * always use the full KEYDB. Only entries with a volume unique key or unit
+ * keys are cached, since the others need the processing keys and host
+ * certificate from the full file. For other discs an empty file is cached,
+ * so the KEYDB isn't searched again. Cache files that aren't newer than the
+ * KEYDB aren't used.
+ *
+ * bluray_keydb_disc_keys() reads the keys from an entry, for bluray_copy
+ * --decrypt, which decrypts the stream files itself.
+ */
+
+#define BLURAY_KEYDB_DISC_ID_STRLEN 41
+
+#define BLURAY_KEYDB_KEY_LENGTH 16
+#define BLURAY_KEYDB_UNIT_KEYS 32
+
+// Cache lookups
+#define BLURAY_KEYDB_STALE 0
+#define BLURAY_KEYDB_ENTRY 1
+#define BLURAY_KEYDB_NO_ENTRY 2
+
+/**
+ * A disc's keys, for decrypting it without libaacs (see bluray_aacs)
+ */
+struct bluray_keydb_keys {
+	bool vuk_found;
+	uint8_t vuk[BLURAY_KEYDB_KEY_LENGTH];
+	uint8_t unit_keys[BLURAY_KEYDB_UNIT_KEYS][BLURAY_KEYDB_KEY_LENGTH];
+	uint32_t num_unit_keys;
+};
+
+int bluray_keydb_unit_key_file(const char *device_filename, uint8_t **data, size_t *length);
+
+int bluray_keydb_disc_id(const char *device_filename, char *disc_id);
+
+int bluray_keydb_filename(char *filename, size_t size, const char *key_db_filename);
+
+int bluray_keydb_cache_filename(char *filename, size_t size, const char *disc_id);
+
+int bluray_keydb_cached(const char *cache_filename, const char *key_db_filename);
+
+int bluray_keydb_cache(const char *key_db_filename, const char *disc_id, const char *cache_filename);
+
+int bluray_keydb_uncache(const char *cache_filename);
+
+int bluray_keydb_disc_keys(const char *filename, const char *disc_id, struct bluray_keydb_keys *keys);
+
+#endif
@@ -0,0 +1,685 @@
+#include <stdlib.h>
+#include <string.h>
+#include "bluray_mpls.h"
+
+/**
+ * Big-endian reader over a buffer. Reading past the end sets the error flag
+ * and returns zeros, so it only has to be checked once at the end.
+ */
+struct bluray_mpls_reader {
+	const uint8_t *data;
+	size_t length;
+	size_t offset;
+	bool error;
+};
+
+static bool bluray_mpls_has(struct bluray_mpls_reader *reader, size_t length) {
+
+	if(reader->error || reader->offset > reader->length || reader->length - reader->offset < length) {
+		reader->error = true;
+		return false;
+	}
+
+	return true;
+
+}
+
+static void bluray_mpls_seek(struct bluray_mpls_reader *reader, size_t offset) {
+
+	if(offset > reader->length)
+		reader->error = true;
+	else
+		reader->offset = offset;
+
+}
+
+static void bluray_mpls_skip(struct bluray_mpls_reader *reader, size_t length) {
+
+	if(bluray_mpls_has(reader, length))
+		reader->offset += length;
+
+}
+
+static uint8_t bluray_mpls_u8(struct bluray_mpls_reader *reader) {
+
+	if(!bluray_mpls_has(reader, 1))
+		return 0;
+
+	return reader->data[reader->offset++];
+
+}
+
+static uint16_t bluray_mpls_u16(struct bluray_mpls_reader *reader) {
+
+	if(!bluray_mpls_has(reader, 2))
+		return 0;
+
+	const uint8_t *p = reader->data + reader->offset;
+	reader->offset += 2;
+
+	return (uint16_t)(p[0] << 8 | p[1]);
+
+}
+
+static uint32_t bluray_mpls_u32(struct bluray_mpls_reader *reader) {
+
+	if(!bluray_mpls_has(reader, 4))
+		return 0;
+
+	const uint8_t *p = reader->data + reader->offset;
+	reader->offset += 4;
+
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
+
+}
+
+static void bluray_mpls_chars(struct bluray_mpls_reader *reader, char *str, size_t length) {
+
+	memset(str, '\0', length + 1);
+
+	if(!bluray_mpls_has(reader, length))
+		return;
+
+	memcpy(str, reader->data + reader->offset, length);
+	reader->offset += length;
+
+}
+
+/**
+ * Check the type indicator and version, which is the same for both file types
+ */
+static bool bluray_mpls_header(const uint8_t *data, size_t length, const char *type_indicator) {
+
+	if(length < 40 || memcmp(data, type_indicator, 4) != 0)
+		return false;
+
+	return (memcmp(data + 4, "0100", 4) == 0 || memcmp(data + 4, "0200", 4) == 0 || memcmp(data + 4, "0300", 4) == 0);
+
+}
+
+/**
+ * One stream of a stream number table: the entry saying where it is, then its
+ * attributes
+ */
+static void bluray_mpls_stream(struct bluray_mpls_reader *reader, struct bluray_mpls_stream *stream) {
+
+	uint8_t length = bluray_mpls_u8(reader);
+	size_t offset = reader->offset;
+
+	stream->stream_type = bluray_mpls_u8(reader);
+	switch(stream->stream_type) {
+		case 1:
+			stream->pid = bluray_mpls_u16(reader);
+			break;
+		case 2:
+		case 4:
+			stream->subpath_id = bluray_mpls_u8(reader);
+			bluray_mpls_skip(reader, 1);
+			stream->pid = bluray_mpls_u16(reader);
+			break;
+		case 3:
+			stream->subpath_id = bluray_mpls_u8(reader);
+			stream->pid = bluray_mpls_u16(reader);
+			break;
+	}
+
+	bluray_mpls_seek(reader, offset + length);
+
+	length = bluray_mpls_u8(reader);
+	offset = reader->offset;
+
+	uint8_t format_rate = 0;
+	stream->coding_type = bluray_mpls_u8(reader);
+	switch(stream->coding_type) {
+		// Video
+		case 0x01:
+		case 0x02:
+		case 0x1b:
+		case 0x20:
+		case 0x24:
+		case 0xea:
+			format_rate = bluray_mpls_u8(reader);
+			stream->format = format_rate >> 4;
+			stream->rate = format_rate & 0x0f;
+			break;
+		// Audio
+		case 0x03:
+		case 0x04:
+		case 0x80:
+		case 0x81:
+		case 0x82:
+		case 0x83:
+		case 0x84:
+		case 0x85:
+		case 0x86:
+		case 0xa1:
+		case 0xa2:
+			format_rate = bluray_mpls_u8(reader);
+			stream->format = format_rate >> 4;
+			stream->rate = format_rate & 0x0f;
+			bluray_mpls_chars(reader, stream->lang, 3);
+			break;
+		// Presentation and interactive graphics
+		case 0x90:
+		case 0x91:
+			bluray_mpls_chars(reader, stream->lang, 3);
+			break;
+		// Text subtitles
+		case 0x92:
+			stream->char_code = bluray_mpls_u8(reader);
+			bluray_mpls_chars(reader, stream->lang, 3);
+			break;
+	}
+
+	bluray_mpls_seek(reader, offset + length);
+
+}
+
+/**
+ * Skip the list of stream references that follows secondary streams, which
+ * is padded to an even length
+ */
+static void bluray_mpls_skip_refs(struct bluray_mpls_reader *reader) {
+
+	uint8_t num_refs = bluray_mpls_u8(reader);
+	bluray_mpls_skip(reader, 1 + num_refs + (num_refs % 2));
+
+}
+
+/**
+ * Stream number table of a play item. Picture-in-picture subtitles are listed
+ * with the rest of the presentation graphics streams, like libbluray does.
+ */
+static int bluray_mpls_stn(struct bluray_mpls_reader *reader, struct bluray_mpls_item *item) {
+
+	uint16_t length = bluray_mpls_u16(reader);
+	size_t offset = reader->offset;
+
+	bluray_mpls_skip(reader, 2);
+	item->num_video = bluray_mpls_u8(reader);
+	item->num_audio = bluray_mpls_u8(reader);
+	uint8_t num_pg = bluray_mpls_u8(reader);
+	item->num_ig = bluray_mpls_u8(reader);
+	item->num_secondary_audio = bluray_mpls_u8(reader);
+	item->num_secondary_video = bluray_mpls_u8(reader);
+	uint8_t num_pip_pg = bluray_mpls_u8(reader);
+	bluray_mpls_skip(reader, 5);
+
+	if(num_pg + num_pip_pg > UINT8_MAX)
+		return 1;
+	item->num_pg = (uint8_t)(num_pg + num_pip_pg);
+
+	size_t num_streams = (size_t)item->num_video + item->num_audio + item->num_pg + item->num_ig + item->num_secondary_audio + item->num_secondary_video;
+	if(num_streams) {
+		item->streams = calloc(num_streams, sizeof(struct bluray_mpls_stream));
+		if(item->streams == NULL)
+			return 1;
+	}
+
+	struct bluray_mpls_stream *stream = item->streams;
+	uint8_t ix = 0;
+
+	item->video = stream;
+	for(ix = 0; ix < item->num_video; ix++)
+		bluray_mpls_stream(reader, stream++);
+
+	item->audio = stream;
+	for(ix = 0; ix < item->num_audio; ix++)
+		bluray_mpls_stream(reader, stream++);
+
+	item->pg = stream;
+	for(ix = 0; ix < item->num_pg; ix++)
+		bluray_mpls_stream(reader, stream++);
+
+	item->ig = stream;
+	for(ix = 0; ix < item->num_ig; ix++)
+		bluray_mpls_stream(reader, stream++);
+
+	item->secondary_audio = stream;
+	for(ix = 0; ix < item->num_secondary_audio; ix++) {
+		bluray_mpls_stream(reader, stream++);
+		bluray_mpls_skip_refs(reader);
+	}
+
+	item->secondary_video = stream;
+	for(ix = 0; ix < item->num_secondary_video; ix++) {
+		bluray_mpls_stream(reader, stream++);
+		bluray_mpls_skip_refs(reader);
+		bluray_mpls_skip_refs(reader);
+	}
+
+	bluray_mpls_seek(reader, offset + length);
+
+	return 0;
+
+}
+
+static int bluray_mpls_item(struct bluray_mpls_reader *reader, struct bluray_mpls_item *item) {
+
+	uint16_t length = bluray_mpls_u16(reader);
+	size_t offset = reader->offset;
+
+	struct bluray_mpls_clip clip;
+	bluray_mpls_chars(reader, clip.clip_id, 5);
+	bluray_mpls_chars(reader, clip.codec_id, 4);
+
+	uint16_t flags = bluray_mpls_u16(reader);
+	item->multi_angle = (flags & 0x10 ? true : false);
+	item->connection_condition = flags & 0x0f;
+	clip.stc_id = bluray_mpls_u8(reader);
+	item->in_time = bluray_mpls_u32(reader);
+	item->out_time = bluray_mpls_u32(reader);
+	bluray_mpls_skip(reader, 9);
+	item->still_mode = bluray_mpls_u8(reader);
+	item->still_time = bluray_mpls_u16(reader);
+	if(item->still_mode != 1)
+		item->still_time = 0;
+
+	item->angle_count = 1;
+	if(item->multi_angle) {
+		item->angle_count = bluray_mpls_u8(reader);
+		if(item->angle_count < 1)
+			item->angle_count = 1;
+		bluray_mpls_skip(reader, 1);
+	}
+
+	item->clips = calloc(item->angle_count, sizeof(struct bluray_mpls_clip));
+	if(item->clips == NULL)
+		return 1;
+
+	item->clips[0] = clip;
+
+	uint8_t angle_ix = 0;
+	for(angle_ix = 1; angle_ix < item->angle_count; angle_ix++) {
+		bluray_mpls_chars(reader, item->clips[angle_ix].clip_id, 5);
+		bluray_mpls_chars(reader, item->clips[angle_ix].codec_id, 4);
+		item->clips[angle_ix].stc_id = bluray_mpls_u8(reader);
+	}
+
+	if(bluray_mpls_stn(reader, item))
+		return 1;
+
+	bluray_mpls_seek(reader, offset + length);
+
+	return 0;
+
+}
+
+/**
+ * Parse a playlist file
+ */
+int bluray_mpls_parse(struct bluray_mpls *mpls, const uint8_t *data, size_t length) {
+
+	memset(mpls, 0, sizeof(struct bluray_mpls));
+
+	if(!bluray_mpls_header(data, length, "MPLS"))
+		return 1;
+
+	struct bluray_mpls_reader reader = { data, length, 8, false };
+	uint32_t list_offset = bluray_mpls_u32(&reader);
+	uint32_t mark_offset = bluray_mpls_u32(&reader);
+
+	// AppInfoPlayList flags, after the user operation mask
+	bluray_mpls_seek(&reader, 56);
+	mpls->mvc_base_view_r_flag = (bluray_mpls_u8(&reader) & 0x10 ? true : false);
+
+	bluray_mpls_seek(&reader, list_offset);
+	bluray_mpls_skip(&reader, 6);
+	mpls->num_items = bluray_mpls_u16(&reader);
+	mpls->num_sub_paths = bluray_mpls_u16(&reader);
+
+	if(reader.error)
+		return 1;
+
+	uint16_t ix = 0;
+	if(mpls->num_items) {
+		mpls->items = calloc(mpls->num_items, sizeof(struct bluray_mpls_item));
+		if(mpls->items == NULL)
+			return 1;
+	}
+
+	for(ix = 0; ix < mpls->num_items && !reader.error; ix++) {
+		if(bluray_mpls_item(&reader, &mpls->items[ix])) {
+			bluray_mpls_free(mpls);
+			return 1;
+		}
+	}
+
+	bluray_mpls_seek(&reader, mark_offset);
+	bluray_mpls_skip(&reader, 4);
+	mpls->num_marks = bluray_mpls_u16(&reader);
+
+	if(mpls->num_marks && !reader.error) {
+		mpls->marks = calloc(mpls->num_marks, sizeof(struct bluray_mpls_mark));
+		if(mpls->marks == NULL) {
+			bluray_mpls_free(mpls);
+			return 1;
+		}
+	}
+
+	for(ix = 0; ix < mpls->num_marks && !reader.error; ix++) {
+		bluray_mpls_skip(&reader, 1);
+		mpls->marks[ix].mark_type = bluray_mpls_u8(&reader);
+		mpls->marks[ix].item_ref = bluray_mpls_u16(&reader);
+		mpls->marks[ix].time = bluray_mpls_u32(&reader);
+		bluray_mpls_skip(&reader, 2);
+		mpls->marks[ix].duration = bluray_mpls_u32(&reader);
+	}
+
+	if(reader.error) {
+		bluray_mpls_free(mpls);
+		return 1;
+	}
+
+	return 0;
+
+}
+
+void bluray_mpls_free(struct bluray_mpls *mpls) {
+
+	uint16_t ix = 0;
+	for(ix = 0; mpls->items != NULL && ix < mpls->num_items; ix++) {
+		free(mpls->items[ix].clips);
+		free(mpls->items[ix].streams);
+	}
+
+	free(mpls->items);
+	free(mpls->marks);
+	mpls->items = NULL;
+	mpls->marks = NULL;
+	mpls->num_items = 0;
+	mpls->num_marks = 0;
+
+}
+
+/**
+ * Sequence info: where each STC sequence starts, numbered across all of the
+ * ATC sequences
+ */
+static int bluray_clpi_sequences(struct bluray_mpls_reader *reader, struct bluray_clpi *clpi) {
+
+	bluray_mpls_skip(reader, 5);
+	uint8_t num_atc = bluray_mpls_u8(reader);
+
+	uint8_t atc_ix = 0;
+	uint8_t stc_ix = 0;
+	uint8_t num_stc = 0;
+	uint32_t *stc_spn = NULL;
+
+	for(atc_ix = 0; atc_ix < num_atc && !reader->error; atc_ix++) {
+
+		bluray_mpls_skip(reader, 4);
+		num_stc = bluray_mpls_u8(reader);
+		bluray_mpls_skip(reader, 1);
+
+		if(num_stc == 0)
+			continue;
+
+		stc_spn = realloc(clpi->stc_spn, (clpi->num_stc + num_stc) * sizeof(uint32_t));
+		if(stc_spn == NULL)
+			return 1;
+		clpi->stc_spn = stc_spn;
+
+		for(stc_ix = 0; stc_ix < num_stc; stc_ix++) {
+			bluray_mpls_skip(reader, 2);
+			clpi->stc_spn[clpi->num_stc++] = bluray_mpls_u32(reader);
+			bluray_mpls_skip(reader, 8);
+		}
+
+	}
+
+	return 0;
+
+}
+
+/**
+ * Program info: the aspect ratio of each video stream, which the playlist
+ * doesn't have
+ */
+static int bluray_clpi_programs(struct bluray_mpls_reader *reader, struct bluray_clpi *clpi) {
+
+	bluray_mpls_skip(reader, 5);
+	uint8_t num_programs = bluray_mpls_u8(reader);
+
+	uint8_t program_ix = 0;
+	uint8_t stream_ix = 0;
+	uint8_t num_streams = 0;
+	uint8_t length = 0;
+	size_t offset = 0;
+	struct bluray_clpi_stream *streams = NULL;
+	struct bluray_clpi_stream *stream = NULL;
+
+	for(program_ix = 0; program_ix < num_programs && !reader->error; program_ix++) {
+
+		bluray_mpls_skip(reader, 6);
+		num_streams = bluray_mpls_u8(reader);
+		bluray_mpls_skip(reader, 1);
+
+		if(num_streams == 0)
+			continue;
+
+		streams = realloc(clpi->streams, (clpi->num_streams + num_streams) * sizeof(struct bluray_clpi_stream));
+		if(streams == NULL)
+			return 1;
+		clpi->streams = streams;
+
+		for(stream_ix = 0; stream_ix < num_streams; stream_ix++) {
+
+			stream = &clpi->streams[clpi->num_streams++];
+			stream->pid = bluray_mpls_u16(reader);
+			stream->aspect = 0;
+
+			length = bluray_mpls_u8(reader);
+			offset = reader->offset;
+
+			switch(bluray_mpls_u8(reader)) {
+				case 0x01:
+				case 0x02:
+				case 0x1b:
+				case 0x20:
+				case 0x24:
+				case 0xea:
+					bluray_mpls_skip(reader, 1);
+					stream->aspect = bluray_mpls_u8(reader) >> 4;
+					break;
+			}
+
+			bluray_mpls_seek(reader, offset + length);
+
+		}
+
+	}
+
+	return 0;
+
+}
+
+/**
+ * The EP map of the first stream, which is the video. libbluray only uses that
+ * one to look up packets as well.
+ */
+static int bluray_clpi_ep_map(struct bluray_mpls_reader *reader, struct bluray_clpi *clpi) {
+
+	uint32_t length = bluray_mpls_u32(reader);
+	if(length == 0)
+		return 0;
+
+	// CPI type 1 is an EP map
+	if((bluray_mpls_u16(reader) & 0x0f) != 1)
+		return 0;
+
+	size_t ep_map_offset = reader->offset;
+	bluray_mpls_skip(reader, 1);
+	if(bluray_mpls_u8(reader) == 0)
+		return 0;
+
+	bluray_mpls_skip(reader, 2);
+	uint32_t counts = bluray_mpls_u32(reader);
+	uint32_t num_coarse = (counts >> 2) & 0xffff;
+	uint32_t num_fine = (counts & 0x03) << 16 | bluray_mpls_u16(reader);
+	size_t map_offset = ep_map_offset + bluray_mpls_u32(reader);
+
+	bluray_mpls_seek(reader, map_offset);
+	size_t fine_offset = map_offset + bluray_mpls_u32(reader);
+
+	if(reader->error || num_coarse == 0 || num_fine == 0)
+		return 0;
+
+	clpi->coarse = calloc(num_coarse, sizeof(struct bluray_clpi_coarse));
+	clpi->fine = calloc(num_fine, sizeof(struct bluray_clpi_fine));
+	if(clpi->coarse == NULL || clpi->fine == NULL)
+		return 1;
+
+	uint32_t ix = 0;
+	uint32_t value = 0;
+	for(ix = 0; ix < num_coarse; ix++) {
+		value = bluray_mpls_u32(reader);
+		clpi->coarse[ix].ref_ep_fine_id = value >> 14;
+		clpi->coarse[ix].pts_ep = value & 0x3fff;
+		clpi->coarse[ix].spn_ep = bluray_mpls_u32(reader);
+		if(clpi->coarse[ix].ref_ep_fine_id >= num_fine)
+			return 1;
+	}
+
+	bluray_mpls_seek(reader, fine_offset);
+	for(ix = 0; ix < num_fine; ix++) {
+		value = bluray_mpls_u32(reader);
+		clpi->fine[ix].pts_ep = (value >> 17) & 0x07ff;
+		clpi->fine[ix].spn_ep = value & 0x1ffff;
+	}
+
+	clpi->num_coarse = num_coarse;
+	clpi->num_fine = num_fine;
+
+	return 0;
+
+}
+
+/**
+ * Parse a clip info file
+ */
+int bluray_clpi_parse(struct bluray_clpi *clpi, const uint8_t *data, size_t length) {
+
+	memset(clpi, 0, sizeof(struct bluray_clpi));
+
+	if(!bluray_mpls_header(data, length, "HDMV"))
+		return 1;
+
+	struct bluray_mpls_reader reader = { data, length, 8, false };
+	uint32_t sequence_offset = bluray_mpls_u32(&reader);
+	uint32_t program_offset = bluray_mpls_u32(&reader);
+	uint32_t cpi_offset = bluray_mpls_u32(&reader);
+
+	bluray_mpls_seek(&reader, 56);
+	clpi->num_source_packets = bluray_mpls_u32(&reader);
+
+	bluray_mpls_seek(&reader, sequence_offset);
+	if(bluray_clpi_sequences(&reader, clpi)) {
+		bluray_clpi_free(clpi);
+		return 1;
+	}
+
+	bluray_mpls_seek(&reader, program_offset);
+	if(bluray_clpi_programs(&reader, clpi)) {
+		bluray_clpi_free(clpi);
+		return 1;
+	}
+
+	bluray_mpls_seek(&reader, cpi_offset);
+	if(bluray_clpi_ep_map(&reader, clpi) || reader.error) {
+		bluray_clpi_free(clpi);
+		return 1;
+	}
+
+	return 0;
+
+}
+
+void bluray_clpi_free(struct bluray_clpi *clpi) {
+
+	free(clpi->stc_spn);
+	free(clpi->streams);
+	free(clpi->coarse);
+	free(clpi->fine);
+	memset(clpi, 0, sizeof(struct bluray_clpi));
+
+}
+
+/**
+ * Look up the source packet for a presentation time in the EP map, the same
+ * way libbluray's clpi_lookup_spn() does, so that positions match up. With
+ * before set, it's the entry point at or before the time, otherwise the one
+ * after it.
+ */
+uint32_t bluray_clpi_spn(const struct bluray_clpi *clpi, uint32_t time, bool before, uint8_t stc_id) {
+
+	if(clpi->num_coarse == 0)
+		return (before ? 0 : clpi->num_source_packets);
+
+	const struct bluray_clpi_coarse *coarse = clpi->coarse;
+	const struct bluray_clpi_fine *fine = clpi->fine;
+	uint32_t stc_spn = (stc_id < clpi->num_stc ? clpi->stc_spn[stc_id] : 0);
+	uint32_t ix = 0;
+	uint32_t fine_ix = 0;
+	uint32_t start = 0;
+	uint32_t end = 0;
+	uint64_t coarse_pts = 0;
+
+	// Start searching at the STC sequence
+	for(ix = 0; ix < clpi->num_coarse; ix++) {
+		if((coarse[ix].spn_ep & ~0x1ffffU) + fine[coarse[ix].ref_ep_fine_id].spn_ep >= stc_spn)
+			break;
+	}
+
+	if(ix == clpi->num_coarse)
+		return 0;
+
+	start = ix;
+	for(ix = start; ix < clpi->num_coarse; ix++) {
+		coarse_pts = (uint64_t)(coarse[ix].pts_ep & ~0x01) << 18;
+		if(coarse_pts + ((uint64_t)fine[coarse[ix].ref_ep_fine_id].pts_ep << 8) > time)
+			break;
+	}
+
+	// Before the first entry point
+	if(ix == start)
+		return 0;
+
+	ix--;
+	coarse_pts = (uint64_t)(coarse[ix].pts_ep & ~0x01) << 18;
+	start = coarse[ix].ref_ep_fine_id;
+	end = (ix + 1 < clpi->num_coarse ? coarse[ix + 1].ref_ep_fine_id : clpi->num_fine);
+
+	for(fine_ix = start; fine_ix < end; fine_ix++) {
+		if(coarse_pts + ((uint64_t)fine[fine_ix].pts_ep << 8) > time)
+			break;
+	}
+
+	if(before && fine_ix > start)
+		fine_ix--;
+
+	if(fine_ix >= end) {
+		ix++;
+		if(ix >= clpi->num_coarse)
+			return clpi->num_source_packets;
+		fine_ix = coarse[ix].ref_ep_fine_id;
+	}
+
+	return (coarse[ix].spn_ep & ~0x1ffffU) + fine[fine_ix].spn_ep;
+
+}
+
+/**
+ * Aspect ratio of a video stream, or 0 if it's not in the clip
+ */
+uint8_t bluray_clpi_aspect(const struct bluray_clpi *clpi, uint16_t pid) {
+
+	uint32_t ix = 0;
+	for(ix = 0; ix < clpi->num_streams; ix++) {
+		if(clpi->streams[ix].pid == pid)
+			return clpi->streams[ix].aspect;
+	}
+
+	return 0;
+
+}
@@ -0,0 +1,120 @@
+#ifndef BLURAY_INFO_MPLS_H
+#define BLURAY_INFO_MPLS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Read-only parser for playlists (BDMV/PLAYLIST/NNNNN.mpls) and clip info
+ * (BDMV/CLIPINF/NNNNN.clpi)
+ *
+ * Only the parts that describe a title are read: play items with their
+ * stream tables, marks, the clip's sequences, stream attributes, and the EP
+ * map of its first stream. Sub paths and extension data are skipped. Times
+ * are in 45 kHz ticks, like on the disc.
+ *
+ * The parsers work on a buffer that is only read while parsing, so it can be
+ * a mapping of the file that is released straight after.
+ */
+
+#define BLURAY_MPLS_MARK_ENTRY 1
+
+struct bluray_mpls_stream {
+	uint8_t stream_type;
+	uint8_t subpath_id;
+	uint16_t pid;
+	uint8_t coding_type;
+	uint8_t format;
+	uint8_t rate;
+	uint8_t char_code;
+	char lang[4];
+};
+
+struct bluray_mpls_clip {
+	char clip_id[6];
+	char codec_id[5];
+	uint8_t stc_id;
+};
+
+struct bluray_mpls_item {
+	struct bluray_mpls_clip *clips;
+	uint8_t angle_count;
+	bool multi_angle;
+	uint8_t connection_condition;
+	uint32_t in_time;
+	uint32_t out_time;
+	uint8_t still_mode;
+	uint16_t still_time;
+	uint8_t num_video;
+	uint8_t num_audio;
+	uint8_t num_pg;
+	uint8_t num_ig;
+	uint8_t num_secondary_audio;
+	uint8_t num_secondary_video;
+	struct bluray_mpls_stream *streams;
+	struct bluray_mpls_stream *video;
+	struct bluray_mpls_stream *audio;
+	struct bluray_mpls_stream *pg;
+	struct bluray_mpls_stream *ig;
+	struct bluray_mpls_stream *secondary_audio;
+	struct bluray_mpls_stream *secondary_video;
+};
+
+struct bluray_mpls_mark {
+	uint8_t mark_type;
+	uint16_t item_ref;
+	uint32_t time;
+	uint32_t duration;
+};
+
+struct bluray_mpls {
+	bool mvc_base_view_r_flag;
+	uint16_t num_items;
+	uint16_t num_sub_paths;
+	uint16_t num_marks;
+	struct bluray_mpls_item *items;
+	struct bluray_mpls_mark *marks;
+};
+
+struct bluray_clpi_stream {
+	uint16_t pid;
+	uint8_t aspect;
+};
+
+struct bluray_clpi_coarse {
+	uint32_t ref_ep_fine_id;
+	uint16_t pts_ep;
+	uint32_t spn_ep;
+};
+
+struct bluray_clpi_fine {
+	uint16_t pts_ep;
+	uint32_t spn_ep;
+};
+
+struct bluray_clpi {
+	uint32_t num_source_packets;
+	uint32_t num_stc;
+	uint32_t *stc_spn;
+	uint32_t num_streams;
+	struct bluray_clpi_stream *streams;
+	uint32_t num_coarse;
+	uint32_t num_fine;
+	struct bluray_clpi_coarse *coarse;
+	struct bluray_clpi_fine *fine;
+};
+
+int bluray_mpls_parse(struct bluray_mpls *mpls, const uint8_t *data, size_t length);
+
+void bluray_mpls_free(struct bluray_mpls *mpls);
+
+int bluray_clpi_parse(struct bluray_clpi *clpi, const uint8_t *data, size_t length);
+
+void bluray_clpi_free(struct bluray_clpi *clpi);
+
+uint32_t bluray_clpi_spn(const struct bluray_clpi *clpi, uint32_t time, bool before, uint8_t stc_id);
+
+uint8_t bluray_clpi_aspect(const struct bluray_clpi *clpi, uint16_t pid);
+
+#endif
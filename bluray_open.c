@@ -1,5 +1,113 @@
+#include <stdlib.h>
+#include <limits.h>
 #include "bluray_open.h"
+#include "bluray_keydb.h"
 #include "bluray_time.h"
+#include "bluray_trace.h"
+#include "bluray_sha1.h"
+
+static struct bluray *bluray_disc_init(const char *device_filename, const char *key_db_filename) {
+
+	uint64_t trace_start = bluray_trace_begin();
+	struct bluray *bd = NULL;
+	bd = bd_init();
+	if(bd == NULL)
+		return NULL;
+
+	bd_set_player_setting(bd, BLURAY_PLAYER_SETTING_PERSISTENT_STORAGE, 0);
+
+	int retval = bd_open_disc(bd, device_filename, key_db_filename);
+	bluray_trace_end("bd_open_disc", trace_start, BLURAY_TRACE_NONE, BLURAY_TRACE_NONE);
+
+	if(retval == 0) {
+		bd_close(bd);
+		return NULL;
+	}
+
+	return bd;
+
+}
+
+/**
+ * Open a disc for reading its titles, which is all these programs do with it
+ *
+ * bd_open() sets up the disc as a player would. This opens it with player
+ * settings that leave out what only playing menus needs: BD-J's persistent
+ * storage is disabled, so nothing is read from or created in the cache
+ * directories for it. The metadata XML isn't parsed until
+ * bluray_info_disc_name() asks for it, and libbluray only loads libaacs and
+ * libbdplus when the disc has AACS or BD+ files.
+ *
+ * When libaacs is loaded, it's given the disc's own entry from the KEYDB
+ * cache if there is one (see bluray_keydb.h), instead of the whole KEYDB.
+ * After opening a disc with the whole KEYDB, its entry is cached. If the
+ * cached entry doesn't open the disc, the whole KEYDB is used instead.
+ */
+struct bluray *bluray_disc_open(const char *device_filename, const char *key_db_filename) {
+
+	char disc_id[BLURAY_KEYDB_DISC_ID_STRLEN];
+	char full_key_db_filename[PATH_MAX];
+	char cache_filename[PATH_MAX];
+	bool keydb = false;
+	int cached = BLURAY_KEYDB_STALE;
+
+	uint64_t trace_start = bluray_trace_begin();
+	if(bluray_keydb_disc_id(device_filename, disc_id) == 0 && bluray_keydb_filename(full_key_db_filename, PATH_MAX, key_db_filename) == 0 && bluray_keydb_cache_filename(cache_filename, PATH_MAX, disc_id) == 0) {
+		keydb = true;
+		cached = bluray_keydb_cached(cache_filename, full_key_db_filename);
+	}
+	bluray_trace_end("keydb_lookup", trace_start, BLURAY_TRACE_NONE, BLURAY_TRACE_NONE);
+
+	struct bluray *bd = NULL;
+	const BLURAY_DISC_INFO *bd_disc_info = NULL;
+
+	if(cached == BLURAY_KEYDB_ENTRY) {
+
+		bd = bluray_disc_init(device_filename, cache_filename);
+
+		if(bd != NULL) {
+			bd_disc_info = bd_get_disc_info(bd);
+			if(bd_disc_info == NULL || !bd_disc_info->aacs_detected || bd_disc_info->aacs_handled)
+				return bd;
+
+			// The cached keys aren't enough on their own, so stop using them.
+			// If the cache file can't be changed, it can't be written again
+			// either.
+			bd_close(bd);
+			if(bluray_keydb_uncache(cache_filename))
+				keydb = false;
+		}
+
+		// Try the whole KEYDB again, and cache the entry again if it works,
+		// so one failed open doesn't turn off the cache for the disc
+		cached = BLURAY_KEYDB_STALE;
+
+	}
+
+	// Without a usable entry, libaacs needs the whole KEYDB anyway
+	bd = bluray_disc_init(device_filename, key_db_filename);
+	if(bd == NULL || !keydb || cached == BLURAY_KEYDB_NO_ENTRY)
+		return bd;
+
+	// Only cache the entry for the disc libaacs opened
+	char bd_disc_id[BLURAY_KEYDB_DISC_ID_STRLEN];
+	uint32_t ix = 0;
+	bd_disc_info = bd_get_disc_info(bd);
+	if(bd_disc_info == NULL || !bd_disc_info->libaacs_detected || !bd_disc_info->aacs_handled)
+		return bd;
+
+	for(ix = 0; ix < 20; ix++)
+		sprintf(bd_disc_id + 2 * ix, "%02X", bd_disc_info->disc_id[ix]);
+
+	if(strcmp(bd_disc_id, disc_id) == 0) {
+		trace_start = bluray_trace_begin();
+		bluray_keydb_cache(full_key_db_filename, disc_id, cache_filename);
+		bluray_trace_end("keydb_cache", trace_start, BLURAY_TRACE_NONE, BLURAY_TRACE_NONE);
+	}
+
+	return bd;
+
+}
 
 /**
  * Get main Blu-ray metadata from disc
@@ -7,19 +115,18 @@
 int bluray_info_init(struct bluray *bd, struct bluray_info *bluray_info) {
 
 	// Get main disc information
+	uint64_t trace_start = bluray_trace_begin();
 	const BLURAY_DISC_INFO *bd_disc_info = NULL;
 	bd_disc_info = bd_get_disc_info(bd);
+	bluray_trace_end("bd_get_disc_info", trace_start, BLURAY_TRACE_NONE, BLURAY_TRACE_NONE);
 
 	// Quit if couldn't open disc
 	if(bd_disc_info == NULL)
 		return 1;
 
-	// Set Blu-ray disc name
+	// The disc name is parsed from the metadata XML files, which is only done
+	// when it's requested by bluray_info_disc_name()
 	memset(bluray_info->disc_name, '\0', BLURAY_INFO_DISC_NAME_STRLEN);
-	const struct meta_dl *bd_meta = NULL;
-	bd_meta = bd_get_meta(bd);
-	if(bd_meta != NULL)
-		strncpy(bluray_info->disc_name, bd_meta->di_name, BLURAY_INFO_DISC_NAME_STRLEN - 1);
 
 	// Use the UDF volume name as disc title; will only work if input file
 	// is an image or disc.
@@ -51,10 +158,14 @@ int bluray_info_init(struct bluray *bd, struct bluray_info *bluray_info) {
 	// libbluray indexes titles starting at 0, but for human-readable, bluray_info
 	// starts at 1. Playlists start at 0, because they are indexed as such on the
 	// filesystem.
+	trace_start = bluray_trace_begin();
 	bluray_info->titles = bd_get_titles(bd, TITLES_RELEVANT, 0);
+	bluray_trace_end("bd_get_titles", trace_start, BLURAY_TRACE_NONE, BLURAY_TRACE_NONE);
 	bluray_info->main_title = 0;
 
+	trace_start = bluray_trace_begin();
 	int bd_main_title = bd_get_main_title(bd);
+	bluray_trace_end("bd_get_main_title", trace_start, BLURAY_TRACE_NONE, BLURAY_TRACE_NONE);
 	if(bd_main_title == -1)
 		return 1;
 	bluray_info->main_title = (uint32_t)bd_main_title;
@@ -80,11 +191,76 @@ int bluray_info_init(struct bluray *bd, struct bluray_info *bluray_info) {
 }
 
 /**
- * Initialize and populate a bluray_title struct
+ * Set the Blu-ray disc name from its metadata (META/DL/bdmt_*.xml)
  */
-int bluray_title_init(struct bluray *bd, struct bluray_title *bluray_title, uint32_t title_ix, uint8_t angle_ix) {
+void bluray_info_disc_name(struct bluray *bd, struct bluray_info *bluray_info) {
+
+	memset(bluray_info->disc_name, '\0', BLURAY_INFO_DISC_NAME_STRLEN);
+
+	uint64_t trace_start = bluray_trace_begin();
+	const struct meta_dl *bd_meta = NULL;
+	bd_meta = bd_get_meta(bd);
+	bluray_trace_end("bd_get_meta", trace_start, BLURAY_TRACE_NONE, BLURAY_TRACE_NONE);
+	if(bd_meta != NULL && bd_meta->di_name != NULL)
+		strncpy(bluray_info->disc_name, bd_meta->di_name, BLURAY_INFO_DISC_NAME_STRLEN - 1);
+
+}
+
+static void bluray_disc_id_hash(struct bluray *bd, struct bluray_sha1 *sha1, const char *path) {
+
+	void *data = NULL;
+	int64_t size = 0;
+
+	if(bd_read_file(bd, path, &data, &size) == 0 || data == NULL)
+		return;
+
+	bluray_sha1_update(sha1, (const uint8_t *)path, strlen(path) + 1);
+	bluray_sha1_update(sha1, data, (size_t)size);
+	free(data);
+
+}
+
+/**
+ * Get an ID for the disc, which is the same every time it's opened, whether
+ * from a drive, an image or a directory. It's the AACS disc ID when libaacs
+ * has it, the same as bluray_info displays. Other discs get the SHA-1 of
+ * their UDF volume ID, index.bdmv and MovieObject.bdmv instead.
+ */
+int bluray_disc_id(struct bluray *bd, const struct bluray_info *bluray_info, char *disc_id) {
+
+	if(strlen(bluray_info->disc_id)) {
+		snprintf(disc_id, BLURAY_INFO_DISC_ID_STRLEN, "%s", bluray_info->disc_id);
+		return 0;
+	}
+
+	struct bluray_sha1 sha1;
+	uint8_t digest[BLURAY_SHA1_LENGTH];
+	uint8_t ix = 0;
+
+	bluray_sha1_init(&sha1);
+	bluray_sha1_update(&sha1, (const uint8_t *)bluray_info->udf_volume_id, strlen(bluray_info->udf_volume_id) + 1);
+	bluray_disc_id_hash(bd, &sha1, "BDMV/index.bdmv");
+	bluray_disc_id_hash(bd, &sha1, "BDMV/MovieObject.bdmv");
+
+	// Nothing to tell it apart from any other disc
+	if(sha1.length == strlen(bluray_info->udf_volume_id) + 1)
+		return 1;
+
+	bluray_sha1_final(&sha1, digest);
+	for(ix = 0; ix < BLURAY_SHA1_LENGTH; ix++)
+		sprintf(disc_id + 2 * ix, "%02X", digest[ix]);
+
+	return 0;
+
+}
+
+/**
+ * Release the previous title, and initialize the struct to safe values
+ */
+void bluray_title_reset(struct bluray_title *bluray_title, uint32_t title_ix) {
+
+	bluray_title_free(bluray_title);
 
-	// Initialize to safe values
 	bluray_title->ix = title_ix;
 	bluray_title->number = title_ix + 1;
 	bluray_title->playlist = 0;
@@ -101,6 +277,23 @@ int bluray_title_init(struct bluray *bd, struct bluray_title *bluray_title, uint
 	bluray_title->pg_streams = 0;
 	strcpy(bluray_title->length, "00:00:00.000");
 
+}
+
+/**
+ * Initialize and populate a bluray_title struct, and select the title and
+ * angle for playback
+ *
+ * The title size is not set here, see bluray_title_size()
+ *
+ * The struct keeps libbluray's title info, which clip_info and title_chapters
+ * point into, until it's released with bluray_title_free() or the struct is
+ * initialized with another title, so a loop over titles only holds one.
+ * title_info must be NULL the first time a struct is initialized.
+ */
+int bluray_title_init(struct bluray *bd, struct bluray_title *bluray_title, uint32_t title_ix, uint8_t angle_ix) {
+
+	bluray_title_reset(bluray_title, title_ix);
+
 	int retval = 0;
 
 	// Quit if couldn't open title
@@ -114,19 +307,47 @@ int bluray_title_init(struct bluray *bd, struct bluray_title *bluray_title, uint
 		return 2;
 
 	// Quit if couldn't get title info
+	if(bluray_title_info_init(bd, bluray_title, title_ix, angle_ix))
+		return 3;
+
+	return 0;
+
+}
+
+/**
+ * Initialize and populate a bluray_title struct without selecting the title.
+ * Selecting a title opens its first clip for playback, which displaying it
+ * doesn't need. Select it before calling bluray_title_size().
+ */
+int bluray_title_info_init(struct bluray *bd, struct bluray_title *bluray_title, uint32_t title_ix, uint8_t angle_ix) {
+
+	bluray_title_reset(bluray_title, title_ix);
+
+	uint64_t trace_start = bluray_trace_begin();
 	BLURAY_TITLE_INFO *bd_title = NULL;
 	bd_title = bd_get_title_info(bd, title_ix, angle_ix);
+	bluray_trace_end("bd_get_title_info", trace_start, title_ix, BLURAY_TRACE_NONE);
 	if(bd_title == NULL)
-		return 3;
+		return 1;
+
+	bluray_title_populate(bluray_title, bd_title, bd_free_title_info);
+
+	return 0;
+
+}
+
+/**
+ * Populate a bluray_title from title info, which it takes ownership of.
+ * title_info_free is what releases it, for title info that doesn't come from
+ * libbluray.
+ */
+void bluray_title_populate(struct bluray_title *bluray_title, BLURAY_TITLE_INFO *bd_title, void (*title_info_free)(BLURAY_TITLE_INFO *title_info)) {
 
-	// Populate data
 	bluray_title->playlist = bd_title->playlist;
 	bluray_title->duration = bd_title->duration;
 	bluray_title->seconds = bluray_duration_seconds(bluray_title->duration);
 	bluray_title->minutes = bluray_duration_minutes(bluray_title->duration);
 	bluray_duration_length(bluray_title->length, bluray_title->duration);
-	bluray_title->size = bd_get_title_size(bd);
-	bluray_title->size_mbs = ceil((double)bluray_title->size / 1048576);
 	bluray_title->chapters = bd_title->chapter_count;
 	bluray_title->clips = bd_title->clip_count;
 	bluray_title->angles = bd_title->angle_count;
@@ -136,9 +357,60 @@ int bluray_title_init(struct bluray *bd, struct bluray_title *bluray_title, uint
 		bluray_title->pg_streams = bd_title->clips[0].pg_stream_count;
 	}
 
+	bluray_title->title_info = bd_title;
+	bluray_title->title_info_free = title_info_free;
 	bluray_title->clip_info = bd_title->clips;
 	bluray_title->title_chapters = bd_title->chapters;
 
-	return 0;
+}
+
+void bluray_title_free(struct bluray_title *bluray_title) {
+
+	if(bluray_title->title_info != NULL)
+		bluray_title->title_info_free(bluray_title->title_info);
+
+	bluray_title->title_info = NULL;
+	bluray_title->clip_info = NULL;
+	bluray_title->title_chapters = NULL;
+
+}
+
+/**
+ * Set the title's filesize. libbluray has to open all of the title's clips to
+ * calculate it, so only call it when needed. The title must already be selected,
+ * which bluray_title_init() does.
+ */
+void bluray_title_size(struct bluray *bd, struct bluray_title *bluray_title) {
+
+	uint64_t trace_start = bluray_trace_begin();
+	bluray_title->size = bd_get_title_size(bd);
+	bluray_trace_end("bd_get_title_size", trace_start, bluray_title->ix, BLURAY_TRACE_NONE);
+	bluray_title->size_mbs = ceil((double)bluray_title->size / 1048576);
+
+}
+
+/**
+ * Seek the selected title to a byte position. bd_seek() only goes to the
+ * start of the aligned unit (6144 bytes, 32 packets) the position is in,
+ * counted from the start of the clip, so read up to the position from there.
+ * Returns the position, or -1 if it can't get there.
+ */
+int64_t bluray_title_seek(struct bluray *bd, uint64_t position) {
+
+	unsigned char buffer[6144];
+	int64_t disc_position = bd_seek(bd, position);
+	int retval = 0;
+
+	if(disc_position < 0 || (uint64_t)disc_position > position)
+		return -1;
+
+	while((uint64_t)disc_position < position) {
+		retval = bd_read(bd, buffer, (int)(position - (uint64_t)disc_position < sizeof(buffer) ? position - (uint64_t)disc_position : sizeof(buffer)));
+		if(retval <= 0)
+			return -1;
+		disc_position += retval;
+	}
+
+	return disc_position;
 
 }
@@ -54,6 +54,8 @@ struct bluray_title {
 	uint8_t audio_streams;
 	uint8_t pg_streams;
 	char length[BLURAY_INFO_TIME_STRLEN];
+	BLURAY_TITLE_INFO *title_info;
+	void (*title_info_free)(BLURAY_TITLE_INFO *title_info);
 	BLURAY_CLIP_INFO *clip_info;
 	BLURAY_TITLE_CHAPTER *title_chapters;
 };
@@ -68,8 +70,26 @@ struct bluray_chapter {
 	uint64_t size_mbs;
 };
 
+struct bluray *bluray_disc_open(const char *device_filename, const char *key_db_filename);
+
 int bluray_info_init(struct bluray *bd, struct bluray_info *bluray_info);
 
+void bluray_info_disc_name(struct bluray *bd, struct bluray_info *bluray_info);
+
+int bluray_disc_id(struct bluray *bd, const struct bluray_info *bluray_info, char *disc_id);
+
+void bluray_title_reset(struct bluray_title *bluray_title, uint32_t title_ix);
+
 int bluray_title_init(struct bluray *bd, struct bluray_title *bluray_title, uint32_t title_ix, uint8_t angle_ix);
 
+int bluray_title_info_init(struct bluray *bd, struct bluray_title *bluray_title, uint32_t title_ix, uint8_t angle_ix);
+
+void bluray_title_populate(struct bluray_title *bluray_title, BLURAY_TITLE_INFO *bd_title, void (*title_info_free)(BLURAY_TITLE_INFO *title_info));
+
+void bluray_title_free(struct bluray_title *bluray_title);
+
+void bluray_title_size(struct bluray *bd, struct bluray_title *bluray_title);
+
+int64_t bluray_title_seek(struct bluray *bd, uint64_t position);
+
 #endif
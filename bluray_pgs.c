@@ -6,3 +6,11 @@ void bluray_pgs_lang(char *str, uint8_t lang[BLURAY_PGS_LANG_STRLEN]) {
 	memcpy(str, lang, BLURAY_PGS_LANG_STRLEN - 1);
 
 }
+
+void bluray_pgs_stream(struct bluray_handle_pgs *pgs, const BLURAY_STREAM_INFO *bd_stream) {
+
+	memset(pgs, 0, sizeof(struct bluray_handle_pgs));
+	pgs->pid = bd_stream->pid;
+	bluray_pgs_lang(pgs->lang, (uint8_t *)bd_stream->lang);
+
+}
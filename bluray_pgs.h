@@ -4,6 +4,7 @@
 
 #include <string.h>
 #include "libbluray/bluray.h"
+#include "bluray_handle.h"
 
 struct bluray_pgs {
 	char lang[BLURAY_PGS_LANG_STRLEN];
@@ -11,4 +12,6 @@ struct bluray_pgs {
 
 void bluray_pgs_lang(char *str, uint8_t lang[BLURAY_PGS_LANG_STRLEN]);
 
+void bluray_pgs_stream(struct bluray_handle_pgs *pgs, const BLURAY_STREAM_INFO *bd_stream);
+
 #endif
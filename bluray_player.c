@@ -14,6 +14,12 @@
 #include "bluray_open.h"
 #include "bluray_time.h"
 #include "bluray_player.h"
+#include "bluray_chapter.h"
+#include "bluray_stream.h"
+#include "bluray_resume.h"
+#include "bluray_cache.h"
+#include "bluray_trace.h"
+#include "bluray_telemetry.h"
 #include <mpv/client.h>
 
 /**
@@ -57,6 +63,28 @@ int main(int argc, char **argv) {
 	uint32_t main_title_number = 1;
 	const char *key_db_filename = NULL;
 	const char *home_dir = getenv("HOME");
+	bool p_timings = false;
+	const char *telemetry_filename = NULL;
+	uint64_t telemetry_interval = BLURAY_TELEMETRY_INTERVAL;
+	uint64_t underruns = 0;
+	uint64_t buffered_seeks = 0;
+	uint64_t seeks = 0;
+	bool opt_resume = true;
+	bool resume = false;
+	bool p_disc_id = false;
+	char disc_id[BLURAY_INFO_DISC_ID_STRLEN];
+	uint64_t disc_cache_size = 0;
+	char resume_filename[PATH_MAX];
+	uint64_t resume_ticks = 0;
+	uint64_t stream_ticks = 0;
+	uint64_t stream_end_ticks = 0;
+	int64_t resume_next = 0;
+	double playback_time = 0;
+	char resume_length[BLURAY_INFO_TIME_STRLEN];
+	uint64_t first_position = 0;
+	uint64_t last_position = 0;
+	uint64_t chapter_position = 0;
+	uint8_t track = 0;
 	int retval = 0;
 
 	struct bluray_player bluray_player;
@@ -71,8 +99,6 @@ int main(int argc, char **argv) {
 	bluray_playback.deinterlace = false;
 	memset(bluray_playback.audio_lang, '\0', BLURAY_PLAYER_LANG_STRLEN);
 	memset(bluray_playback.subtitles_lang, '\0', BLURAY_PLAYER_LANG_STRLEN);
-	memset(bluray_playback.chapter_start, '\0', BLURAY_PLAYER_CHAPTER_STRLEN);
-	memset(bluray_playback.chapter_end, '\0', BLURAY_PLAYER_CHAPTER_STRLEN);
 
 	char *token = NULL;
 	int g_opt = 0;
@@ -82,14 +108,19 @@ int main(int argc, char **argv) {
 		{ "aid", required_argument, NULL, 'A' },
 		{ "chapters", required_argument, NULL, 'c' },
 		{ "deinterlace", no_argument, NULL, 'd' },
+		{ "disc-cache", required_argument, NULL, 'C' },
 		{ "fullscreen", no_argument, NULL, 'f' },
 		{ "help", no_argument, NULL, 'h' },
 		{ "keydb", required_argument, NULL, 'k' },
 		{ "main", no_argument, NULL, 'm' },
+		{ "no-resume", no_argument, NULL, 'R' },
 		{ "playlist", required_argument, NULL, 'p' },
 		{ "slang", required_argument, NULL, 's' },
 		{ "sid", required_argument, NULL, 'S' },
 		{ "title", required_argument, NULL, 't' },
+		{ "telemetry", required_argument, NULL, 'T' },
+		{ "telemetry-interval", required_argument, NULL, 'I' },
+		{ "timings", no_argument, NULL, 'K' },
 		{ "version", no_argument, NULL, 'Z' },
 		{ 0, 0, 0, 0 }
 	};
@@ -176,14 +207,34 @@ int main(int argc, char **argv) {
 				bluray_playback.fullscreen = true;
 				break;
 
+			case 'I':
+				arg_number = strtoul(optarg, NULL, 10);
+				if(arg_number < 100)
+					telemetry_interval = 100;
+				else
+					telemetry_interval = (uint64_t)arg_number;
+				break;
+
 			case 'k':
 				key_db_filename = optarg;
 				break;
 
+			case 'K':
+				p_timings = true;
+				break;
+
 			case 'm':
 				opt_main_title = true;
 				break;
 
+			case 'R':
+				opt_resume = false;
+				break;
+
+			case 'C':
+				disc_cache_size = strtoull(optarg, NULL, 10) * 1048576;
+				break;
+
 			case 'p':
 				opt_playlist_number = true;
 				arg_number = strtoul(optarg, NULL, 10);
@@ -199,6 +250,10 @@ int main(int argc, char **argv) {
 					arg_title_number = (uint32_t)arg_number;
 				break;
 
+			case 'T':
+				telemetry_filename = optarg;
+				break;
+
 			case 's':
 				strncpy(bluray_playback.subtitles_lang, optarg, BLURAY_PLAYER_LANG_STRLEN - 1);
 				break;
@@ -244,9 +299,14 @@ int main(int argc, char **argv) {
 				printf("Playback:\n");
 				printf("  -f, --fullscreen	   Display fullscreen\n");
 				printf("  -d, --deinterlace	   Deinterlace video\n");
+				printf("      --no-resume          Start from the beginning, and don't save where playback stops\n");
 				printf("\n");
 				printf("Other:\n");
 				printf("  -k, --keydb <filename>   Location to KEYDB.cfg (default: ~/.config/aacs/KEYDB.cfg)\n");
+				printf("      --disc-cache <MBs>   Keep what's read from the disc in a cache this big\n");
+				printf("      --timings            Display the time spent opening the disc and until the first frame\n");
+				printf("      --telemetry <file>   Append playback samples and a summary to file, as NDJSON\n");
+				printf("      --telemetry-interval <ms>  Time between samples (default: %u)\n", BLURAY_TELEMETRY_INTERVAL);
 				printf("  -h, --help		   This output\n");
 				printf("      --version		   Version information\n");
 				printf("\n");
@@ -281,9 +341,21 @@ int main(int argc, char **argv) {
 		device_filename = DEFAULT_BLURAY_DEVICE;
 	}
 
-	// Open device
+	// Time to first frame is measured from here, before opening the disc
+	if(p_timings)
+		bluray_trace_enable();
+	uint64_t first_frame_start = bluray_trace_begin();
+
+	struct bluray_telemetry bluray_telemetry;
+	bluray_telemetry.io = NULL;
+	if(telemetry_filename != NULL && bluray_telemetry_open(&bluray_telemetry, telemetry_filename, telemetry_interval)) {
+		fprintf(stderr, "Could not open telemetry file %s\n", telemetry_filename);
+		return 1;
+	}
+
+	// Open device. The disc stays open for playback.
 	BLURAY *bd = NULL;
-	bd = bd_open(device_filename, key_db_filename);
+	bd = bluray_disc_open(device_filename, key_db_filename);
 
 	if(bd == NULL) {
 		if(key_db_filename == NULL)
@@ -313,6 +385,7 @@ int main(int argc, char **argv) {
 	main_title_number = bluray_info.main_title + 1;
 
 	struct bluray_title bluray_title;
+	bluray_title.title_info = NULL;
 
 	// Select title passed as an argument
 	if(opt_title_number) {
@@ -351,6 +424,16 @@ int main(int argc, char **argv) {
 		}
 	}
 
+	// The disc ID names both the file to resume from and the disc cache
+	if(opt_resume || disc_cache_size)
+		p_disc_id = (bluray_disc_id(bd, &bluray_info, disc_id) == 0);
+
+	// Disc cache, which is left off if it can't be opened
+	struct bluray_cache disc_cache;
+	bluray_cache_init(&disc_cache);
+	if(disc_cache_size && p_disc_id)
+		bluray_cache_open(&disc_cache, disc_id, disc_cache_size);
+
 	// Init bluray_title struct
 	uint8_t angle_ix = 0;
 	retval = bluray_title_init(bd, &bluray_title, bluray_title.ix, angle_ix);
@@ -360,31 +443,67 @@ int main(int argc, char **argv) {
 		return 1;
 	}
 
+	if(bluray_cache_title_size(&disc_cache, &bluray_title, angle_ix)) {
+		bluray_title_size(bd, &bluray_title);
+		bluray_cache_set_title_size(&disc_cache, &bluray_title, angle_ix);
+	}
+
 	// Silently check and fix chapter boundaries for playback
 	if(arg_last_chapter > 0 && arg_last_chapter > bluray_title.chapters)
 		arg_last_chapter = bluray_title.chapters;
 	if(arg_last_chapter > 0 && arg_first_chapter > arg_last_chapter)
 		arg_first_chapter = arg_last_chapter;
 
-	// When choosing a chapter range, mpv will add 1 to the last one requested
-	// For example, to play just chapter 3, send playback of 3-4
-	memset(bluray_playback.chapter_start, '\0', BLURAY_PLAYER_CHAPTER_STRLEN);
-	snprintf(bluray_playback.chapter_start, BLURAY_PLAYER_CHAPTER_STRLEN, "#%" PRIu32, arg_first_chapter);
-	memset(bluray_playback.chapter_end, '\0', BLURAY_PLAYER_CHAPTER_STRLEN);
-	snprintf(bluray_playback.chapter_end, BLURAY_PLAYER_CHAPTER_STRLEN, "#%" PRIu32, arg_last_chapter + 1);
+	// Stream just the bytes of a chapter range, from the start of the first
+	// chapter to the end of the last one
+	if(arg_first_chapter > bluray_title.chapters)
+		arg_first_chapter = bluray_title.chapters;
+	first_position = 0;
+	last_position = bluray_title.size;
+	if(opt_chapter_start && arg_first_chapter > 0)
+		bluray_chapter_range(&bluray_title, arg_first_chapter - 1, &first_position, &chapter_position);
+	if(opt_chapter_end && arg_last_chapter > 0)
+		bluray_chapter_range(&bluray_title, arg_last_chapter - 1, &chapter_position, &last_position);
+	if(last_position > bluray_title.size)
+		last_position = bluray_title.size;
+
+	// Title times the stream starts and ends at
+	stream_ticks = 0;
+	stream_end_ticks = bluray_title.duration;
+	if(opt_chapter_start && arg_first_chapter > 0)
+		stream_ticks = bluray_title.title_chapters[arg_first_chapter - 1].start;
+	if(opt_chapter_end && arg_last_chapter > 0)
+		stream_end_ticks = bluray_title.title_chapters[arg_last_chapter - 1].start + bluray_title.title_chapters[arg_last_chapter - 1].duration;
+
+	// Resume where playback last stopped, unless chapters were asked for
+	memset(resume_filename, '\0', PATH_MAX);
+	if(opt_resume && p_disc_id && bluray_resume_filename(resume_filename, PATH_MAX, disc_id) == 0)
+		resume = true;
+	if(resume && !opt_chapter_start && !opt_chapter_end && bluray_resume_load(resume_filename, bluray_title.playlist, &resume_ticks) == 0 && resume_ticks >= BLURAY_RESUME_MARGIN && resume_ticks + BLURAY_RESUME_MARGIN < bluray_title.duration) {
+		first_position = bluray_resume_position(&bluray_title, resume_ticks);
+		stream_ticks = resume_ticks;
+	} else {
+		resume_ticks = 0;
+	}
 
-	// MPV zero-indexes title numbers
 	bluray_playback.title = bluray_title.ix;
 
+	bluray_info_disc_name(bd, &bluray_info);
 	if(strlen(bluray_info.disc_name))
 		printf("Disc title: %s\n", bluray_info.disc_name);
 
 	// libmpv doesn't support Blu-ray angle selection (as of latest stable, 0.29.1)
 	printf("Title: %03" PRIu32 ", Playlist: %04" PRIu32 ", Length: %s, Chapters: %02" PRIu32 ", Video streams: %02" PRIu8 ", Audio streams: %02" PRIu8 ", Subtitles: %02" PRIu8 ", Angles: %02" PRIu8 ", Filesize: %05.0lf MBs\n", bluray_title.number, bluray_title.playlist, bluray_title.length, bluray_title.chapters, bluray_title.video_streams, bluray_title.audio_streams, bluray_title.pg_streams, bluray_title.angles, bluray_title.size_mbs);
 
-	// Finished with libbluray
-	bd_close(bd);
-	bd = NULL;
+	// Play the title from this libbluray session instead of mpv opening the
+	// disc again. When resuming, start reading there while mpv starts up.
+	struct bluray_stream bluray_stream;
+	struct bluray_cache_title cache_title;
+	bluray_stream_init(&bluray_stream, bd, &bluray_title, angle_ix, first_position, last_position);
+	if(bluray_cache_enabled(&disc_cache) && bluray_cache_title_open(&cache_title, &disc_cache, bd, &bluray_title, angle_ix) == 0)
+		bluray_stream.cache_title = &cache_title;
+	if(resume_ticks)
+		bluray_stream_prefetch(&bluray_stream, NULL, 0);
 
 	// Note that the order and location of setting mpv configuration is important,
 	// especially if you want to override mpv.conf in ~/.config/bluray_player/
@@ -410,8 +529,16 @@ int main(int argc, char **argv) {
 		return 1;
 	}
 
+	retval = mpv_stream_cb_add_ro(bluray_mpv, BLURAY_STREAM_PROTOCOL, &bluray_stream, bluray_stream_open);
+	if(retval) {
+		fprintf(stderr, "Could not add MPV stream protocol %s: %s\n", BLURAY_STREAM_PROTOCOL, mpv_error_string(retval));
+		return 1;
+	}
+
+	bluray_telemetry_start(&bluray_telemetry, bluray_mpv, bluray_title.number, bluray_title.playlist);
+
 	// Playback options and default configuration
-	mpv_set_option_string(bluray_mpv, "bluray-device", device_filename);
+	mpv_set_option_string(bluray_mpv, "demuxer-lavf-format", "mpegts");
 	mpv_set_option_string(bluray_mpv, "terminal", "yes");
 	mpv_set_option_string(bluray_mpv, "term-osd-bar", "yes");
 	mpv_set_option_string(bluray_mpv, "input-default-bindings", "yes");
@@ -420,23 +547,34 @@ int main(int argc, char **argv) {
 		mpv_set_option_string(bluray_mpv, "fullscreen", NULL);
 	if(bluray_playback.deinterlace)
 		mpv_set_option_string(bluray_mpv, "deinterlace", "yes");
-	if(opt_chapter_start && arg_first_chapter > 0)
-		mpv_set_option_string(bluray_mpv, "start", bluray_playback.chapter_start);
-	if(opt_chapter_end && arg_last_chapter > 0)
-		mpv_set_option_string(bluray_mpv, "end", bluray_playback.chapter_end);
 
-	// mpv zero-indexes titles
+	// The title number is only there to name it, the title is already selected
 	char bluray_mpv_args[BLURAY_PLAYER_TITLE_STRLEN];
 	memset(bluray_mpv_args, '\0', BLURAY_PLAYER_TITLE_STRLEN);
-	snprintf(bluray_mpv_args, BLURAY_PLAYER_TITLE_STRLEN, "bd://%" PRIu32, bluray_playback.title);
+	snprintf(bluray_mpv_args, BLURAY_PLAYER_TITLE_STRLEN, "%s://%" PRIu32, BLURAY_STREAM_PROTOCOL, bluray_playback.title + 1);
 
-	// MPV uses zero-indexing for titles, bluray_info uses one instead
 	const char *bluray_mpv_commands[] = {
 		"loadfile",
 		bluray_mpv_args,
 		NULL
 	};
 
+	// The chapter table only gets close to the time to resume from, so get it
+	// from the stream itself once the start of it has been read
+	if(resume_ticks) {
+		uint64_t trace_start = bluray_trace_begin();
+		uint8_t *prefetch = malloc(BLURAY_RESUME_PREFETCH_SIZE);
+		size_t prefetch_length = 0;
+		if(prefetch != NULL) {
+			prefetch_length = bluray_stream_prefetch(&bluray_stream, prefetch, BLURAY_RESUME_PREFETCH_SIZE);
+			bluray_resume_time(&bluray_title, first_position, prefetch, prefetch_length, &stream_ticks);
+			free(prefetch);
+		}
+		bluray_trace_end("resume_prefetch", trace_start, bluray_title.ix, BLURAY_TRACE_NONE);
+		bluray_duration_length(resume_length, stream_ticks);
+		printf("Resuming at %s\n", resume_length);
+	}
+
 	retval = mpv_command(bluray_mpv, bluray_mpv_commands);
 	if(retval) {
 		fprintf(stderr, "Could not send MPV arguments: %s; using defaults\n", bluray_mpv_args);
@@ -451,10 +589,22 @@ int main(int argc, char **argv) {
 	// Set playback languages in order of language code, then stream IDs
 	// When selecting a lanugage with --alang or --slang, it will choose the first of
 	// any streams with that language. Setting --aid, or --sid will choose the specific one.
-	if(strlen(bluray_playback.audio_lang) > 0)
-		retval = mpv_set_option_string(bluray_mpv, "alang", bluray_playback.audio_lang);
-	if(strlen(bluray_playback.subtitles_lang) > 0)
-		mpv_set_option_string(bluray_mpv, "slang", bluray_playback.subtitles_lang);
+	// The languages are in the playlist, not the stream, so they are looked up
+	// here and passed as track numbers.
+	if(strlen(bluray_playback.audio_lang) > 0 && bluray_title.clips) {
+		track = bluray_stream_track(bluray_title.clip_info[0].audio_streams, bluray_title.clip_info[0].audio_stream_count, bluray_playback.audio_lang);
+		if(track) {
+			snprintf(stream_id, 4, "%" PRIu8, track);
+			retval = mpv_set_option_string(bluray_mpv, "aid", stream_id);
+		}
+	}
+	if(strlen(bluray_playback.subtitles_lang) > 0 && bluray_title.clips) {
+		track = bluray_stream_track(bluray_title.clip_info[0].pg_streams, bluray_title.clip_info[0].pg_stream_count, bluray_playback.subtitles_lang);
+		if(track) {
+			snprintf(stream_id, 4, "%" PRIu8, track);
+			retval = mpv_set_option_string(bluray_mpv, "sid", stream_id);
+		}
+	}
 
 	// I vaguely recall seeing a Blu-ray with two video streams before
 	if(opt_video_stream) {
@@ -474,15 +624,44 @@ int main(int argc, char **argv) {
 	}
 
 	mpv_event *bluray_mpv_event = NULL;
+	double timeout = -1;
 	struct mpv_event_log_message *bluray_mpv_log_message = NULL;
 
 	while(true) {
 
-		bluray_mpv_event = mpv_wait_event(bluray_mpv, -1);
+		// Wake up when the next telemetry sample is due, if there's one, and
+		// at least every second to keep the time to resume from
+		timeout = bluray_telemetry_timeout(&bluray_telemetry);
+		if(resume && (timeout < 0 || timeout > 1))
+			timeout = 1;
+		bluray_mpv_event = mpv_wait_event(bluray_mpv, timeout);
+
+		// Playback time is gone once the file ends, so it's kept as it goes
+		if(resume && mpv_get_time_us(bluray_mpv) >= resume_next) {
+			if(mpv_get_property(bluray_mpv, "playback-time", MPV_FORMAT_DOUBLE, &playback_time) == 0 && playback_time >= 0)
+				resume_ticks = stream_ticks + (uint64_t)(playback_time * 90000);
+			resume_next = mpv_get_time_us(bluray_mpv) + 1000000;
+		}
+
+		if(bluray_mpv_event->event_id == MPV_EVENT_END_FILE && ((mpv_event_end_file *)bluray_mpv_event->data)->reason == MPV_END_FILE_REASON_EOF)
+			resume_ticks = stream_end_ticks;
 
 		if(bluray_mpv_event->event_id == MPV_EVENT_SHUTDOWN || bluray_mpv_event->event_id == MPV_EVENT_END_FILE)
 			break;
 
+		bluray_telemetry_event(&bluray_telemetry, bluray_mpv_event);
+		if(bluray_telemetry.io != NULL) {
+			bluray_stream_counters(&bluray_stream, &underruns, NULL, NULL);
+			bluray_telemetry_sample(&bluray_telemetry, bluray_mpv, underruns);
+		}
+
+		// Playback restarts after loading, and after every seek
+		if(bluray_mpv_event->event_id == MPV_EVENT_PLAYBACK_RESTART && first_frame_start) {
+			bluray_trace_end("first_frame", first_frame_start, bluray_title.ix, BLURAY_TRACE_NONE);
+			fprintf(stderr, "Time to first frame: %.0f ms\n", (double)(bluray_trace_begin() - first_frame_start) / 1000000.0);
+			first_frame_start = 0;
+		}
+
 		if(bluray_mpv_event->event_id == MPV_EVENT_LOG_MESSAGE) {
 			bluray_mpv_log_message = (struct mpv_event_log_message *)bluray_mpv_event->data;
 			printf("mpv [%s]: %s", bluray_mpv_log_message->level, bluray_mpv_log_message->text);
@@ -490,7 +669,38 @@ int main(int argc, char **argv) {
 
 	}
 
+	// Start from the beginning next time if it played to, or stopped near, the end
+	if(resume && resume_ticks) {
+		if(resume_ticks < BLURAY_RESUME_MARGIN || resume_ticks + BLURAY_RESUME_MARGIN >= bluray_title.duration)
+			resume_ticks = 0;
+		bluray_resume_save(resume_filename, bluray_title.playlist, resume_ticks);
+	}
+
+	bluray_stream_counters(&bluray_stream, &underruns, &buffered_seeks, &seeks);
+	bluray_telemetry_close(&bluray_telemetry, bluray_mpv, underruns, seeks);
+
 	mpv_terminate_destroy(bluray_mpv);
+	bluray_stream_counters(&bluray_stream, &underruns, &buffered_seeks, &seeks);
+	bluray_stream_free(&bluray_stream);
+
+	if(p_timings)
+		fprintf(stderr, "Read-ahead: %zu MBs, underruns: %" PRIu64 ", seeks: %" PRIu64 " in the buffer, %" PRIu64 " on the disc\n", bluray_stream.buffer_size / 1048576, underruns, buffered_seeks, seeks);
+
+	if(bluray_stream.cache_title != NULL) {
+		if(p_timings)
+			fprintf(stderr, "Disc cache: %" PRIu64 " blocks from the cache, %" PRIu64 " from the disc\n", disc_cache.hits, disc_cache.misses);
+		bluray_cache_title_close(&cache_title);
+	}
+	bluray_cache_close(&disc_cache);
+
+	// Finished with libbluray
+	bluray_title_free(&bluray_title);
+	bd_close(bd);
+	bd = NULL;
+
+	if(p_timings)
+		bluray_trace_timings(stderr);
+	bluray_trace_free();
 
 	return 0;
 
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <string.h>
+#include "bluray_report.h"
+#include "bluray_fields.h"
+
+/**
+ * Set the identity used to key disc records: the AACS disc ID, or the path if
+ * the disc has none or couldn't be opened
+ */
+void bluray_report_id(char *id, bluray_handle *handle, const char *path) {
+
+	const struct bluray_handle_disc *disc = NULL;
+	if(handle != NULL)
+		disc = bluray_handle_disc(handle);
+
+	if(disc != NULL && strlen(disc->disc_id))
+		snprintf(id, BLURAY_REPORT_ID_STRLEN, "%s", disc->disc_id);
+	else
+		snprintf(id, BLURAY_REPORT_ID_STRLEN, "%s", path);
+
+}
+
+/**
+ * Write the "bluray" object into the current object
+ */
+void bluray_report_disc(struct bluray_json *json, bluray_handle *handle) {
+
+	const struct bluray_handle_disc *disc = bluray_handle_disc(handle);
+
+	bluray_json_object_open(json, "bluray");
+	bluray_json_string(json, "disc name", disc->disc_name);
+	bluray_json_string(json, "udf title", disc->udf_volume_id);
+	bluray_json_string(json, "disc id", disc->disc_id);
+	bluray_json_uint(json, "main title", disc->main_title + 1);
+	bluray_json_uint(json, "titles", disc->titles);
+	bluray_json_bool(json, "3D content", disc->content_exist_3D);
+	bluray_json_bool(json, "aacs", disc->aacs);
+	bluray_json_bool(json, "bdplus", disc->bdplus);
+	bluray_json_bool(json, "bd-j", disc->bdj);
+	bluray_json_object_close(json);
+
+}
+
+/**
+ * Write a title object with its streams, and optionally its chapters.
+ * Returns 1 without writing anything if the title doesn't exist.
+ */
+int bluray_report_title(struct bluray_json *json, bluray_handle *handle, uint32_t title_ix, bool chapters) {
+
+	const struct bluray_handle_title *title = bluray_handle_title(handle, title_ix);
+	if(title == NULL)
+		return 1;
+
+	uint8_t stream_ix = 0;
+	const struct bluray_handle_video *video = NULL;
+	const struct bluray_handle_audio *audio = NULL;
+	const struct bluray_handle_pgs *pgs = NULL;
+
+	bluray_json_object_open(json, NULL);
+	bluray_json_uint(json, "title", title->ix + 1);
+	bluray_json_uint(json, "playlist", title->playlist);
+	bluray_json_string(json, "length", title->length);
+	bluray_json_uint(json, "msecs", title->duration / 900);
+	bluray_json_uint(json, "angles", title->angles);
+	bluray_json_uint(json, "filesize", bluray_handle_title_size(handle, title_ix));
+
+	bluray_json_array_open(json, "video");
+	for(stream_ix = 0; stream_ix < title->video_streams; stream_ix++) {
+		video = bluray_handle_video(handle, title_ix, stream_ix);
+		if(video == NULL)
+			continue;
+		bluray_fields_video(json, BLURAY_FIELDS_VIDEO, stream_ix + 1, video);
+	}
+	bluray_json_array_close(json);
+
+	bluray_json_array_open(json, "audio");
+	for(stream_ix = 0; stream_ix < title->audio_streams; stream_ix++) {
+		audio = bluray_handle_audio(handle, title_ix, stream_ix);
+		if(audio == NULL)
+			continue;
+		bluray_fields_audio(json, BLURAY_FIELDS_AUDIO, stream_ix + 1, audio);
+	}
+	bluray_json_array_close(json);
+
+	bluray_json_array_open(json, "subtitles");
+	for(stream_ix = 0; stream_ix < title->pg_streams; stream_ix++) {
+		pgs = bluray_handle_pgs(handle, title_ix, stream_ix);
+		if(pgs == NULL)
+			continue;
+		bluray_fields_pgs(json, BLURAY_FIELDS_PGS, stream_ix + 1, pgs);
+	}
+	bluray_json_array_close(json);
+
+	if(chapters)
+		bluray_report_chapters(json, handle, title_ix);
+
+	bluray_json_object_close(json);
+
+	return 0;
+
+}
+
+/**
+ * Write the "chapters" array of a title into the current object
+ */
+void bluray_report_chapters(struct bluray_json *json, bluray_handle *handle, uint32_t title_ix) {
+
+	const struct bluray_handle_title *title = bluray_handle_title(handle, title_ix);
+	uint32_t chapters = (title == NULL ? 0 : title->chapters);
+	uint32_t chapter_ix = 0;
+	const struct bluray_handle_chapter *chapter = NULL;
+
+	bluray_json_array_open(json, "chapters");
+	for(chapter_ix = 0; chapter_ix < chapters; chapter_ix++) {
+		chapter = bluray_handle_chapter(handle, title_ix, chapter_ix);
+		if(chapter == NULL)
+			continue;
+		bluray_json_object_open(json, NULL);
+		bluray_json_uint(json, "chapter", chapter_ix + 1);
+		bluray_json_string(json, "start time", chapter->start_time);
+		bluray_json_string(json, "length", chapter->length);
+		bluray_json_uint(json, "start", chapter->start / 900);
+		bluray_json_uint(json, "duration", chapter->duration / 900);
+		bluray_json_object_close(json);
+	}
+	bluray_json_array_close(json);
+
+}
+
+void bluray_report_error(struct bluray_json *json, const char *error) {
+
+	bluray_json_string(json, "error", error);
+
+}
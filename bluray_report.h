@@ -0,0 +1,28 @@
+#ifndef BLURAY_INFO_REPORT_H
+#define BLURAY_INFO_REPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "bluray_handle.h"
+#include "bluray_json.h"
+
+/**
+ * Write a disc's information through the JSON writer, with the same keys as
+ * bluray_info --json, from an open bluray_handle. Used by the daemon and the
+ * batch scanner.
+ */
+
+// Long enough for a path or a disc ID
+#define BLURAY_REPORT_ID_STRLEN 4096
+
+void bluray_report_id(char *id, bluray_handle *handle, const char *path);
+
+void bluray_report_disc(struct bluray_json *json, bluray_handle *handle);
+
+int bluray_report_title(struct bluray_json *json, bluray_handle *handle, uint32_t title_ix, bool chapters);
+
+void bluray_report_chapters(struct bluray_json *json, bluray_handle *handle, uint32_t title_ix);
+
+void bluray_report_error(struct bluray_json *json, const char *error);
+
+#endif
@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <limits.h>
+#include "bluray_resume.h"
+#include "bluray_file.h"
+#include "bluray_chapter.h"
+
+#define BLURAY_RESUME_PTS_MASK ((UINT64_C(1) << 33) - 1)
+
+int bluray_resume_filename(char *filename, size_t size, const char *disc_id) {
+
+	return bluray_file_xdg_filename(filename, size, "XDG_STATE_HOME", ".local/state", "bluray_player/resume/%s", disc_id);
+
+}
+
+/**
+ * Get the saved time for a playlist. Returns 1 if there isn't one.
+ */
+int bluray_resume_load(const char *filename, uint32_t playlist, uint64_t *ticks) {
+
+	FILE *file = fopen(filename, "r");
+	if(file == NULL)
+		return 1;
+
+	uint32_t line_playlist = 0;
+	uint64_t line_ticks = 0;
+	char line[64];
+	int retval = 1;
+
+	while(retval && fgets(line, sizeof(line), file) != NULL) {
+		if(sscanf(line, "%" SCNu32 " %" SCNu64, &line_playlist, &line_ticks) == 2 && line_playlist == playlist) {
+			*ticks = line_ticks;
+			retval = 0;
+		}
+	}
+
+	fclose(file);
+
+	return retval;
+
+}
+
+/**
+ * Save the time for a playlist, keeping the other playlists' times. A time
+ * of 0 removes it. The file is written under a temporary name and renamed.
+ */
+int bluray_resume_save(const char *filename, uint32_t playlist, uint64_t ticks) {
+
+	char tmp_filename[PATH_MAX];
+	char line[64];
+	uint32_t line_playlist = 0;
+	uint64_t line_ticks = 0;
+	FILE *file = NULL;
+	FILE *tmp_file = bluray_file_create(filename, tmp_filename);
+
+	if(tmp_file == NULL)
+		return 1;
+
+	file = fopen(filename, "r");
+	if(file != NULL) {
+		while(fgets(line, sizeof(line), file) != NULL) {
+			if(sscanf(line, "%" SCNu32 " %" SCNu64, &line_playlist, &line_ticks) == 2 && line_playlist != playlist)
+				fprintf(tmp_file, "%" PRIu32 " %" PRIu64 "\n", line_playlist, line_ticks);
+		}
+		fclose(file);
+	}
+
+	if(ticks)
+		fprintf(tmp_file, "%" PRIu32 " %" PRIu64 "\n", playlist, ticks);
+
+	return bluray_file_replace(tmp_file, tmp_filename, filename);
+
+}
+
+/**
+ * Get the byte position in a title to resume a time from, at the start of an
+ * aligned unit, which libbluray reads in and always starts with a packet
+ */
+uint64_t bluray_resume_position(const struct bluray_title *bluray_title, uint64_t ticks) {
+
+	uint64_t first_position = 0;
+	uint64_t last_position = bluray_title->size;
+	uint64_t start = 0;
+	uint64_t duration = bluray_title->duration;
+	uint64_t position = 0;
+	uint32_t chapter_ix = 0;
+
+	for(chapter_ix = 0; chapter_ix < bluray_title->chapters; chapter_ix++) {
+		if(chapter_ix + 1 < bluray_title->chapters && bluray_title->title_chapters[chapter_ix + 1].start <= ticks)
+			continue;
+		start = bluray_title->title_chapters[chapter_ix].start;
+		duration = bluray_title->title_chapters[chapter_ix].duration;
+		bluray_chapter_range(bluray_title, chapter_ix, &first_position, &last_position);
+		break;
+	}
+
+	if(last_position > bluray_title->size)
+		last_position = bluray_title->size;
+	if(first_position > last_position)
+		first_position = last_position;
+
+	position = first_position;
+	if(duration && ticks > start)
+		position += (uint64_t)((double)(last_position - first_position) * (double)(ticks - start) / (double)duration);
+
+	if(position > last_position)
+		position = last_position;
+
+	return position / 6144 * 6144;
+
+}
+
+/**
+ * Get the title time of the first video timestamp in data read from a
+ * position in the title. Timestamps are in the clip's own time, which starts
+ * at its in time. Returns 1 if there isn't one.
+ */
+int bluray_resume_time(const struct bluray_title *bluray_title, uint64_t position, const uint8_t *data, size_t length, uint64_t *ticks) {
+
+	const BLURAY_CLIP_INFO *clip_info = NULL;
+	uint64_t clip_last_position = 0;
+	uint64_t pts = 0;
+	uint32_t clip_ix = 0;
+	size_t offset = 0;
+	size_t payload = 0;
+	uint16_t pid = 0;
+	const uint8_t *packet = NULL;
+	const uint8_t *pes = NULL;
+
+	for(offset = 0; offset + 192 <= length; offset += 192) {
+
+		// Find the clip each packet is in, since data can cross into the next one
+		while(clip_info == NULL || position + offset >= clip_last_position) {
+			if(clip_info != NULL)
+				clip_ix++;
+			if(clip_ix >= bluray_title->clips)
+				return 1;
+			clip_info = &bluray_title->clip_info[clip_ix];
+			clip_last_position += (uint64_t)clip_info->pkt_count * 192;
+		}
+
+		if(clip_info->video_stream_count == 0)
+			continue;
+
+		// Source packets are a 4 byte header, and a transport packet
+		packet = data + offset + 4;
+		if(packet[0] != 0x47)
+			return 1;
+
+		// Only the start of a PES packet has a timestamp
+		pid = (uint16_t)(((packet[1] & 0x1f) << 8) | packet[2]);
+		if(pid != clip_info->video_streams[0].pid || !(packet[1] & 0x40) || !(packet[3] & 0x10))
+			continue;
+
+		payload = 4;
+		if(packet[3] & 0x20)
+			payload += 1 + packet[4];
+		if(payload + 14 > 188)
+			continue;
+
+		pes = packet + payload;
+		if(pes[0] != 0 || pes[1] != 0 || pes[2] != 1 || !(pes[7] & 0x80))
+			continue;
+
+		pts = ((uint64_t)(pes[9] & 0x0e) << 29) | ((uint64_t)pes[10] << 22) | ((uint64_t)(pes[11] & 0xfe) << 14) | ((uint64_t)pes[12] << 7) | (pes[13] >> 1);
+
+		// Frames from just before the clip's in time are skipped
+		pts = (pts - clip_info->in_time) & BLURAY_RESUME_PTS_MASK;
+		if(clip_info->start_time + pts > bluray_title->duration)
+			continue;
+
+		*ticks = clip_info->start_time + pts;
+
+		return 0;
+
+	}
+
+	return 1;
+
+}
@@ -0,0 +1,46 @@
+#ifndef BLURAY_PLAYER_RESUME_H
+#define BLURAY_PLAYER_RESUME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "libbluray/bluray.h"
+#include "bluray_open.h"
+
+/**
+ * Resume positions, per disc and playlist
+ *
+ * When bluray_player quits in the middle of a title, the time it stopped at
+ * is saved in a file for the disc:
+ *
+ *   $XDG_STATE_HOME/bluray_player/resume/<disc id> (default ~/.local/state)
+ *
+ * with one line per playlist, its number and the time in 90kHz ticks. The
+ * disc ID is from bluray_disc_id().
+ *
+ * To resume, the time is turned into a byte position in the title through
+ * the chapter table: the chapter it's in, and as far into the chapter's
+ * bytes as it is into the chapter's duration. The title is streamed to mpv
+ * from there, so mpv doesn't seek at all. Since that's only as close as the
+ * chapter's bitrate is even, the time is taken again from the first video
+ * timestamp at that position, once it has been read, and playback times are
+ * counted from that.
+ */
+
+// Don't bother resuming this close to either end of a title, in ticks
+#define BLURAY_RESUME_MARGIN (10 * 90000)
+
+// How much of the stream to look for the first video timestamp in
+#define BLURAY_RESUME_PREFETCH_SIZE (1024 * 1024)
+
+int bluray_resume_filename(char *filename, size_t size, const char *disc_id);
+
+int bluray_resume_load(const char *filename, uint32_t playlist, uint64_t *ticks);
+
+int bluray_resume_save(const char *filename, uint32_t playlist, uint64_t ticks);
+
+uint64_t bluray_resume_position(const struct bluray_title *bluray_title, uint64_t ticks);
+
+int bluray_resume_time(const struct bluray_title *bluray_title, uint64_t position, const uint8_t *data, size_t length, uint64_t *ticks);
+
+#endif
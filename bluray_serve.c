@@ -0,0 +1,1056 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "libbluray/bluray.h"
+#include "bluray_device.h"
+#include "bluray_open.h"
+#include "bluray_chapter.h"
+#include "bluray_serve.h"
+
+/**
+ *   _     _
+ *  | |__ | |_   _ _ __ __ _ _   _     ___  ___ _ ____   _____
+ *  | '_ \| | | | | '__/ _` | | | |   / __|/ _ \ '__\ \ / / _ \
+ *  | |_) | | |_| | | | (_| | |_| |   \__ \  __/ |   \ V /  __/
+ *  |_.__/|_|\__,_|_|  \__,_|\__, |___|___/\___|_|    \_/ \___|
+ *                           |___/_____|
+ *
+ * stream titles from a disc over HTTP using libbluray
+ *
+ * If your Blu-ray is encrypted, you'll need libaacs as well as a modern
+ * KEYDB.cfg file to access them.
+ *
+ * More information at https://dvds.beandog.org/
+ *
+ * Have fun :)
+ *
+ */
+
+static int bluray_serve_cache_init(struct bluray_serve *serve) {
+
+	serve->max_blocks = (uint32_t)(serve->cache_size / BLURAY_SERVE_BLOCK_SIZE);
+	if(serve->max_blocks < BLURAY_SERVE_READ_AHEAD)
+		serve->max_blocks = BLURAY_SERVE_READ_AHEAD;
+
+	serve->hash_size = serve->max_blocks * 2 + 1;
+	serve->hash = calloc(serve->hash_size, sizeof(struct bluray_serve_block *));
+	if(serve->hash == NULL)
+		return 1;
+
+	serve->blocks = NULL;
+	serve->last_block = NULL;
+	serve->cached_blocks = 0;
+	serve->cache_hits = 0;
+	serve->cache_misses = 0;
+	serve->seeks = 0;
+
+	return 0;
+
+}
+
+static uint32_t bluray_serve_hash(struct bluray_serve *serve, uint32_t title_ix, uint64_t block) {
+
+	return (uint32_t)((block * 2654435761u + title_ix * 40503u) % serve->hash_size);
+
+}
+
+/**
+ * Find a block in the cache, and move it to the front of the LRU list. The
+ * cache lock must be held.
+ */
+static struct bluray_serve_block *bluray_serve_lookup(struct bluray_serve *serve, uint32_t title_ix, uint64_t block) {
+
+	struct bluray_serve_block *cached = serve->hash[bluray_serve_hash(serve, title_ix, block)];
+
+	while(cached != NULL && (cached->title_ix != title_ix || cached->block != block))
+		cached = cached->hash_next;
+
+	if(cached == NULL || cached == serve->blocks)
+		return cached;
+
+	cached->prev->next = cached->next;
+	if(cached->next)
+		cached->next->prev = cached->prev;
+	else
+		serve->last_block = cached->prev;
+
+	cached->prev = NULL;
+	cached->next = serve->blocks;
+	serve->blocks->prev = cached;
+	serve->blocks = cached;
+
+	return cached;
+
+}
+
+/**
+ * Add a block to the cache, dropping the least recently used one if it's
+ * full. The cache lock must be held, and the block must not be cached yet.
+ */
+static void bluray_serve_insert(struct bluray_serve *serve, struct bluray_serve_block *cached) {
+
+	struct bluray_serve_block *evicted = NULL;
+	struct bluray_serve_block **hash_prev = NULL;
+	uint32_t hash = 0;
+
+	if(serve->cached_blocks >= serve->max_blocks && serve->last_block != NULL) {
+
+		evicted = serve->last_block;
+		serve->last_block = evicted->prev;
+		if(serve->last_block)
+			serve->last_block->next = NULL;
+		else
+			serve->blocks = NULL;
+
+		hash_prev = &serve->hash[bluray_serve_hash(serve, evicted->title_ix, evicted->block)];
+		while(*hash_prev != evicted)
+			hash_prev = &(*hash_prev)->hash_next;
+		*hash_prev = evicted->hash_next;
+
+		free(evicted->data);
+		free(evicted);
+		serve->cached_blocks--;
+
+	}
+
+	hash = bluray_serve_hash(serve, cached->title_ix, cached->block);
+	cached->hash_next = serve->hash[hash];
+	serve->hash[hash] = cached;
+
+	cached->prev = NULL;
+	cached->next = serve->blocks;
+	if(serve->blocks)
+		serve->blocks->prev = cached;
+	else
+		serve->last_block = cached;
+	serve->blocks = cached;
+	serve->cached_blocks++;
+
+}
+
+/**
+ * Select a title to read, unless it's already selected. Selecting it starts
+ * reading it at 0. The disc lock must be held.
+ */
+static int bluray_serve_select(struct bluray_serve *serve, uint32_t title_ix) {
+
+	if(serve->title_ix == title_ix)
+		return 0;
+
+	serve->title_ix = UINT32_MAX;
+
+	if(bd_select_title(serve->bd, title_ix) == 0 || bd_select_angle(serve->bd, 0) == 0)
+		return 1;
+
+	serve->title_ix = title_ix;
+	serve->position = 0;
+
+	return 0;
+
+}
+
+/**
+ * Get a title's size, which libbluray only knows once the title is selected,
+ * so it's looked up the first time a title is requested. The disc lock must
+ * be held.
+ */
+static int bluray_serve_title_size(struct bluray_serve *serve, uint32_t title_ix, uint64_t *size) {
+
+	struct bluray_serve_title *title = &serve->titles[title_ix];
+
+	if(!title->sized) {
+		if(bluray_cache_title_size(&serve->disc_cache, &title->bluray_title, 0)) {
+			if(bluray_serve_select(serve, title_ix))
+				return 1;
+			bluray_title_size(serve->bd, &title->bluray_title);
+			bluray_cache_set_title_size(&serve->disc_cache, &title->bluray_title, 0);
+		}
+		title->sized = true;
+	}
+
+	*size = title->bluray_title.size;
+
+	return 0;
+
+}
+
+/**
+ * Move libbluray to the start of a block. The disc lock must be held.
+ *
+ * The title is only seeked when the block isn't where the last read stopped,
+ * which it is for clients reading in order. The start of the title is
+ * selected again instead, see bluray_copy.c.
+ */
+static int bluray_serve_seek(struct bluray_serve *serve, uint32_t title_ix, uint64_t position) {
+
+	if(bluray_serve_select(serve, title_ix))
+		return 1;
+
+	if(serve->position == position)
+		return 0;
+
+	serve->seeks++;
+	if(position == 0) {
+		serve->title_ix = UINT32_MAX;
+		if(bluray_serve_select(serve, title_ix))
+			return 1;
+	} else if(bluray_title_seek(serve->bd, position) < 0) {
+		serve->title_ix = UINT32_MAX;
+		return 1;
+	} else {
+		serve->position = position;
+	}
+
+	return 0;
+
+}
+
+/**
+ * Read a block from the disc cache, or else from the disc. The disc lock
+ * must be held. Returns NULL unless the whole block could be read.
+ */
+static struct bluray_serve_block *bluray_serve_read_block(struct bluray_serve *serve, uint32_t title_ix, uint64_t block, uint64_t title_size) {
+
+	uint32_t playlist = serve->titles[title_ix].bluray_title.playlist;
+	uint64_t position = block * BLURAY_SERVE_BLOCK_SIZE;
+	uint64_t length = title_size - position;
+	int bytes_read = 0;
+
+	if(length > BLURAY_SERVE_BLOCK_SIZE)
+		length = BLURAY_SERVE_BLOCK_SIZE;
+
+	struct bluray_serve_block *cached = calloc(1, sizeof(struct bluray_serve_block));
+	if(cached == NULL)
+		return NULL;
+
+	// A whole block, which is what the disc cache reads into
+	cached->title_ix = title_ix;
+	cached->block = block;
+	cached->data = malloc(BLURAY_SERVE_BLOCK_SIZE);
+	if(cached->data == NULL) {
+		free(cached);
+		return NULL;
+	}
+
+	if(bluray_cache_read_block(&serve->disc_cache, playlist, 0, block, cached->data, &cached->length) == 0 && cached->length == length)
+		return cached;
+	cached->length = 0;
+
+	if(bluray_serve_seek(serve, title_ix, position)) {
+		free(cached->data);
+		free(cached);
+		return NULL;
+	}
+
+	while(cached->length < length) {
+		bytes_read = bd_read(serve->bd, cached->data + cached->length, (int)(length - cached->length));
+		if(bytes_read <= 0)
+			break;
+		cached->length += (size_t)bytes_read;
+		serve->position += (uint64_t)bytes_read;
+	}
+
+	if(serve->debug && cached->length < length)
+		fprintf(stderr, "* title ix %" PRIu32 " block %" PRIu64 ": read %zu of %" PRIu64 " bytes\n", title_ix, block, cached->length, length);
+
+	// Start from a known position next time. A short block isn't kept, in
+	// memory or on disk, or the rest of it could never be read again
+	if(cached->length < length) {
+		serve->title_ix = UINT32_MAX;
+		free(cached->data);
+		free(cached);
+		return NULL;
+	}
+
+	bluray_cache_write_block(&serve->disc_cache, playlist, 0, block, cached->data, cached->length);
+
+	return cached;
+
+}
+
+/**
+ * Copy data from a position in a title, up to the end of the block it's in.
+ * Returns the number of bytes copied, or 0 if it couldn't be read.
+ *
+ * Only one client reads from the disc at a time. Clients that missed the same
+ * block wait for the first one, and then find it cached. Reading a block also
+ * reads the next ones, until one that's already cached.
+ */
+static size_t bluray_serve_read(struct bluray_serve *serve, uint32_t title_ix, uint64_t title_size, uint64_t position, uint8_t *buffer, size_t length) {
+
+	uint64_t block = position / BLURAY_SERVE_BLOCK_SIZE;
+	size_t offset = (size_t)(position % BLURAY_SERVE_BLOCK_SIZE);
+	size_t copied = 0;
+	uint64_t ix = 0;
+	bool found = false;
+	struct bluray_serve_block *cached = NULL;
+
+	pthread_mutex_lock(&serve->cache_lock);
+	cached = bluray_serve_lookup(serve, title_ix, block);
+	if(cached != NULL) {
+		serve->cache_hits++;
+		if(offset < cached->length) {
+			copied = cached->length - offset;
+			if(copied > length)
+				copied = length;
+			memcpy(buffer, cached->data + offset, copied);
+		}
+		pthread_mutex_unlock(&serve->cache_lock);
+		return copied;
+	}
+	pthread_mutex_unlock(&serve->cache_lock);
+
+	pthread_mutex_lock(&serve->disc_lock);
+
+	for(ix = block; ix < block + BLURAY_SERVE_READ_AHEAD && ix * BLURAY_SERVE_BLOCK_SIZE < title_size; ix++) {
+
+		pthread_mutex_lock(&serve->cache_lock);
+		cached = bluray_serve_lookup(serve, title_ix, ix);
+		found = (cached != NULL);
+		if(found && ix == block) {
+			serve->cache_hits++;
+			if(offset < cached->length) {
+				copied = cached->length - offset;
+				if(copied > length)
+					copied = length;
+				memcpy(buffer, cached->data + offset, copied);
+			}
+		}
+		pthread_mutex_unlock(&serve->cache_lock);
+
+		if(found)
+			break;
+
+		cached = bluray_serve_read_block(serve, title_ix, ix, title_size);
+		if(cached == NULL)
+			break;
+
+		pthread_mutex_lock(&serve->cache_lock);
+		if(ix == block) {
+			serve->cache_misses++;
+			if(offset < cached->length) {
+				copied = cached->length - offset;
+				if(copied > length)
+					copied = length;
+				memcpy(buffer, cached->data + offset, copied);
+			}
+		}
+		bluray_serve_insert(serve, cached);
+		pthread_mutex_unlock(&serve->cache_lock);
+
+	}
+
+	pthread_mutex_unlock(&serve->disc_lock);
+
+	return copied;
+
+}
+
+static int bluray_serve_write(int fd, const char *buffer, size_t length) {
+
+	ssize_t written = 0;
+
+	while(length > 0) {
+		written = write(fd, buffer, length);
+		if(written < 0 && errno == EINTR)
+			continue;
+		if(written <= 0)
+			return 1;
+		buffer += written;
+		length -= (size_t)written;
+	}
+
+	return 0;
+
+}
+
+/**
+ * Send a response's status line and headers. content_range is the value of
+ * the Content-Range header, if there is one.
+ */
+static int bluray_serve_headers(int fd, int status, const char *reason, const char *content_type, uint64_t content_length, const char *content_range, bool keep_alive) {
+
+	char headers[512];
+	int length = 0;
+
+	length = snprintf(headers, sizeof(headers), "HTTP/1.1 %d %s\r\nServer: bluray_serve/%s\r\nContent-Type: %s\r\nContent-Length: %" PRIu64 "\r\nAccept-Ranges: bytes\r\n%s%s%sConnection: %s\r\n\r\n", status, reason, PACKAGE_VERSION, content_type, content_length, content_range ? "Content-Range: " : "", content_range ? content_range : "", content_range ? "\r\n" : "", keep_alive ? "keep-alive" : "close");
+
+	if(length < 0 || length >= (int)sizeof(headers))
+		return 1;
+
+	return bluray_serve_write(fd, headers, (size_t)length);
+
+}
+
+static bool bluray_serve_error(int fd, int status, const char *reason, const char *content_range, bool head, bool keep_alive) {
+
+	char body[64];
+	snprintf(body, sizeof(body), "%d %s\n", status, reason);
+
+	if(bluray_serve_headers(fd, status, reason, "text/plain", strlen(body), content_range, keep_alive))
+		return false;
+
+	if(!head && bluray_serve_write(fd, body, strlen(body)))
+		return false;
+
+	return keep_alive;
+
+}
+
+/**
+ * Parse a number followed by a suffix, which has to be the rest of the string
+ */
+static bool bluray_serve_number(const char *str, const char *suffix, uint32_t *number) {
+
+	char *end = NULL;
+	unsigned long value = 0;
+
+	if(!isdigit((unsigned char)str[0]))
+		return false;
+
+	errno = 0;
+	value = strtoul(str, &end, 10);
+	if(errno || value > UINT32_MAX || strcmp(end, suffix))
+		return false;
+
+	*number = (uint32_t)value;
+
+	return true;
+
+}
+
+/**
+ * Parse a Range header for a file of a length. Returns 0 to send all of it,
+ * 1 to send from first to last, inclusive, and 2 if the range is past the end.
+ * Ranges that can't be parsed, and requests for more than one range, get all
+ * of it, which HTTP allows.
+ */
+static int bluray_serve_range(const char *value, uint64_t length, uint64_t *first, uint64_t *last) {
+
+	char *end = NULL;
+	uint64_t number = 0;
+
+	if(value == NULL || strncasecmp(value, "bytes=", 6) || strchr(value, ','))
+		return 0;
+	value += 6;
+
+	// Suffix range, the last bytes
+	if(value[0] == '-') {
+		if(!isdigit((unsigned char)value[1]))
+			return 0;
+		number = strtoull(value + 1, &end, 10);
+		if(*end != '\0')
+			return 0;
+		if(number == 0 || length == 0)
+			return 2;
+		*first = (number < length ? length - number : 0);
+		*last = length - 1;
+		return 1;
+	}
+
+	if(!isdigit((unsigned char)value[0]))
+		return 0;
+	*first = strtoull(value, &end, 10);
+	if(*end != '-')
+		return 0;
+	value = end + 1;
+
+	*last = UINT64_MAX;
+	if(isdigit((unsigned char)value[0])) {
+		*last = strtoull(value, &end, 10);
+		value = end;
+	}
+	if(*value != '\0' || *last < *first)
+		return 0;
+
+	if(*first >= length)
+		return 2;
+	if(*last >= length)
+		*last = length - 1;
+
+	return 1;
+
+}
+
+static bool bluray_serve_index(struct bluray_serve *serve, int fd, bool head, bool keep_alive) {
+
+	struct bluray_title *bluray_title = NULL;
+	size_t size = 128 * ((size_t)serve->bluray_info.titles + 1);
+	size_t length = 0;
+	uint32_t title_ix = 0;
+	bool retval = false;
+
+	char *body = malloc(size);
+	if(body == NULL)
+		return bluray_serve_error(fd, 500, "Internal Server Error", NULL, head, false);
+
+	if(strlen(serve->bluray_info.disc_name))
+		length += (size_t)snprintf(body + length, size - length, "Disc title: %.64s\n", serve->bluray_info.disc_name);
+
+	for(title_ix = 0; title_ix < serve->bluray_info.titles; title_ix++) {
+		bluray_title = &serve->titles[title_ix].bluray_title;
+		length += (size_t)snprintf(body + length, size - length, "/title/%" PRIu32 ".m2ts playlist %" PRIu32 ", length %s, chapters %" PRIu32 "%s\n", bluray_title->number, bluray_title->playlist, bluray_title->length, bluray_title->chapters, title_ix == serve->bluray_info.main_title ? " (main)" : "");
+		if(length >= size)
+			length = size - 1;
+	}
+
+	if(bluray_serve_headers(fd, 200, "OK", "text/plain", length, NULL, keep_alive) == 0 && (head || bluray_serve_write(fd, body, length) == 0))
+		retval = keep_alive;
+
+	free(body);
+
+	return retval;
+
+}
+
+/**
+ * Send a title, or the chapters and the byte range requested of it
+ */
+static bool bluray_serve_title(struct bluray_serve *serve, int fd, uint32_t title_ix, const char *query, const char *range, bool head, bool keep_alive, uint8_t *buffer) {
+
+	struct bluray_title *bluray_title = &serve->titles[title_ix].bluray_title;
+	uint64_t title_size = 0;
+	uint64_t first_position = 0;
+	uint64_t last_position = 0;
+	uint64_t chapter_position = 0;
+	uint32_t chapter_numbers[2];
+	char *end = NULL;
+	int retval = 0;
+
+	// Chapter range
+	chapter_numbers[0] = 1;
+	chapter_numbers[1] = bluray_title->chapters;
+	if(query != NULL) {
+		if(strncmp(query, "chapters=", 9) || !isdigit((unsigned char)query[9]))
+			return bluray_serve_error(fd, 400, "Bad Request", NULL, head, keep_alive);
+		chapter_numbers[0] = (uint32_t)strtoul(query + 9, &end, 10);
+		if(*end == '\0')
+			chapter_numbers[1] = chapter_numbers[0];
+		else if(*end == '-' && isdigit((unsigned char)end[1]))
+			chapter_numbers[1] = (uint32_t)strtoul(end + 1, &end, 10);
+		else if(*end == '-')
+			end++;
+		if(*end != '\0' || chapter_numbers[0] == 0 || chapter_numbers[0] > chapter_numbers[1] || chapter_numbers[1] > bluray_title->chapters)
+			return bluray_serve_error(fd, 404, "Not Found", NULL, head, keep_alive);
+	}
+
+	pthread_mutex_lock(&serve->disc_lock);
+	retval = bluray_serve_title_size(serve, title_ix, &title_size);
+	pthread_mutex_unlock(&serve->disc_lock);
+
+	if(retval || title_size == 0)
+		return bluray_serve_error(fd, 500, "Internal Server Error", NULL, head, false);
+
+	last_position = title_size;
+	if(query != NULL) {
+		bluray_chapter_range(bluray_title, chapter_numbers[0] - 1, &first_position, &chapter_position);
+		bluray_chapter_range(bluray_title, chapter_numbers[1] - 1, &chapter_position, &last_position);
+		if(last_position > title_size)
+			last_position = title_size;
+		if(first_position > last_position)
+			first_position = last_position;
+	}
+
+	// Byte range, in the chapters
+	uint64_t length = last_position - first_position;
+	uint64_t range_first = 0;
+	uint64_t range_last = 0;
+	char content_range[96];
+
+	retval = bluray_serve_range(range, length, &range_first, &range_last);
+
+	if(retval == 2) {
+		snprintf(content_range, sizeof(content_range), "bytes */%" PRIu64, length);
+		return bluray_serve_error(fd, 416, "Range Not Satisfiable", content_range, head, keep_alive);
+	}
+
+	if(retval == 1) {
+		snprintf(content_range, sizeof(content_range), "bytes %" PRIu64 "-%" PRIu64 "/%" PRIu64, range_first, range_last, length);
+		if(bluray_serve_headers(fd, 206, "Partial Content", "video/MP2T", range_last - range_first + 1, content_range, keep_alive))
+			return false;
+		first_position += range_first;
+		last_position = first_position + (range_last - range_first + 1);
+	} else {
+		if(bluray_serve_headers(fd, 200, "OK", "video/MP2T", length, NULL, keep_alive))
+			return false;
+	}
+
+	if(head)
+		return keep_alive;
+
+	// Once the headers are sent, the only way to report an error is to hang up
+	uint64_t position = first_position;
+	size_t copied = 0;
+
+	while(position < last_position) {
+
+		copied = bluray_serve_read(serve, title_ix, title_size, position, buffer, BLURAY_SERVE_BLOCK_SIZE);
+		if(copied == 0)
+			return false;
+		if(copied > last_position - position)
+			copied = (size_t)(last_position - position);
+
+		if(bluray_serve_write(fd, (const char *)buffer, copied))
+			return false;
+
+		position += copied;
+
+	}
+
+	return keep_alive;
+
+}
+
+/**
+ * Answer a request. Returns whether to keep the connection open for another.
+ */
+static bool bluray_serve_request(struct bluray_serve *serve, int fd, char *request, uint8_t *buffer) {
+
+	char *method = NULL;
+	char *target = NULL;
+	char *version = NULL;
+	char *query = NULL;
+	char *line = NULL;
+	char *next_line = NULL;
+	char *value = NULL;
+	const char *range = NULL;
+	bool keep_alive = false;
+	bool head = false;
+	uint32_t number = 0;
+	uint32_t title_ix = 0;
+
+	next_line = strstr(request, "\r\n");
+	*next_line = '\0';
+	next_line += 2;
+
+	method = request;
+	target = strchr(method, ' ');
+	if(target == NULL)
+		return bluray_serve_error(fd, 400, "Bad Request", NULL, false, false);
+	*target++ = '\0';
+	version = strchr(target, ' ');
+	if(version == NULL)
+		return bluray_serve_error(fd, 400, "Bad Request", NULL, false, false);
+	*version++ = '\0';
+
+	// HTTP/1.1 connections stay open unless the client closes them, and
+	// HTTP/1.0 ones only if the client asks
+	keep_alive = (strcmp(version, "HTTP/1.1") == 0);
+
+	// Headers
+	while(*next_line != '\0' && strncmp(next_line, "\r\n", 2)) {
+		line = next_line;
+		next_line = strstr(line, "\r\n");
+		*next_line = '\0';
+		next_line += 2;
+		value = strchr(line, ':');
+		if(value == NULL)
+			continue;
+		*value++ = '\0';
+		while(*value == ' ' || *value == '\t')
+			value++;
+		if(strcasecmp(line, "Range") == 0)
+			range = value;
+		else if(strcasecmp(line, "Connection") == 0 && strcasecmp(value, "close") == 0)
+			keep_alive = false;
+		else if(strcasecmp(line, "Connection") == 0 && strcasecmp(value, "keep-alive") == 0)
+			keep_alive = true;
+	}
+
+	if(serve->debug)
+		fprintf(stderr, "* %s %s%s%s\n", method, target, range ? " range " : "", range ? range : "");
+
+	head = (strcmp(method, "HEAD") == 0);
+	if(!head && strcmp(method, "GET"))
+		return bluray_serve_error(fd, 405, "Method Not Allowed", NULL, false, keep_alive);
+
+	query = strchr(target, '?');
+	if(query != NULL)
+		*query++ = '\0';
+
+	if(strcmp(target, "/") == 0)
+		return bluray_serve_index(serve, fd, head, keep_alive);
+
+	if(strcmp(target, "/main.m2ts") == 0 && serve->bluray_info.titles)
+		return bluray_serve_title(serve, fd, serve->bluray_info.main_title, query, range, head, keep_alive, buffer);
+
+	if(strncmp(target, "/title/", 7) == 0 && bluray_serve_number(target + 7, ".m2ts", &number) && number > 0 && number <= serve->bluray_info.titles)
+		return bluray_serve_title(serve, fd, number - 1, query, range, head, keep_alive, buffer);
+
+	if(strncmp(target, "/playlist/", 10) == 0 && bluray_serve_number(target + 10, ".m2ts", &number)) {
+		for(title_ix = 0; title_ix < serve->bluray_info.titles; title_ix++) {
+			if(serve->titles[title_ix].bluray_title.title_info != NULL && serve->titles[title_ix].bluray_title.playlist == number)
+				return bluray_serve_title(serve, fd, title_ix, query, range, head, keep_alive, buffer);
+		}
+	}
+
+	return bluray_serve_error(fd, 404, "Not Found", NULL, head, keep_alive);
+
+}
+
+/**
+ * Read requests from a client until it hangs up, or is idle for too long,
+ * either not sending requests or not reading the responses
+ */
+static void bluray_serve_client(struct bluray_serve *serve, int client_fd) {
+
+	char request[BLURAY_SERVE_REQUEST_MAX + 1];
+	size_t length = 0;
+	size_t request_length = 0;
+	ssize_t received = 0;
+	char *headers_end = NULL;
+	bool keep_alive = true;
+
+	struct timeval timeout;
+	timeout.tv_sec = BLURAY_SERVE_TIMEOUT;
+	timeout.tv_usec = 0;
+	setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	uint8_t *buffer = malloc(BLURAY_SERVE_BLOCK_SIZE);
+	if(buffer == NULL) {
+		close(client_fd);
+		return;
+	}
+
+	while(keep_alive) {
+
+		request[length] = '\0';
+		headers_end = strstr(request, "\r\n\r\n");
+
+		if(headers_end == NULL) {
+			if(length == BLURAY_SERVE_REQUEST_MAX) {
+				bluray_serve_error(client_fd, 431, "Request Header Fields Too Large", NULL, false, false);
+				break;
+			}
+			received = recv(client_fd, request + length, BLURAY_SERVE_REQUEST_MAX - length, 0);
+			if(received < 0 && errno == EINTR)
+				continue;
+			if(received <= 0)
+				break;
+			length += (size_t)received;
+			continue;
+		}
+
+		// Requests don't have a body, so the next one starts after the headers
+		request_length = (size_t)(headers_end - request) + 4;
+		headers_end[2] = '\0';
+		keep_alive = bluray_serve_request(serve, client_fd, request, buffer);
+
+		memmove(request, request + request_length, length - request_length);
+		length -= request_length;
+
+	}
+
+	free(buffer);
+	close(client_fd);
+
+}
+
+static void *bluray_serve_worker(void *arg) {
+
+	struct bluray_serve *serve = arg;
+	int client_fd = -1;
+
+	while(true) {
+
+		client_fd = accept(serve->fd, NULL, NULL);
+
+		if(client_fd < 0) {
+			if(errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break;
+		}
+
+		bluray_serve_client(serve, client_fd);
+
+	}
+
+	return NULL;
+
+}
+
+/**
+ * Listen on the address and port, and print where. Port 0 picks a free one.
+ */
+static int bluray_serve_listen(struct bluray_serve *serve) {
+
+	struct addrinfo hints;
+	struct addrinfo *addrinfo = NULL;
+	struct sockaddr_storage addr;
+	socklen_t addr_length = sizeof(addr);
+	char port[6];
+	char host[NI_MAXHOST];
+	int optval = 1;
+	int retval = 0;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST | AI_NUMERICSERV;
+	snprintf(port, sizeof(port), "%" PRIu16, serve->port);
+
+	retval = getaddrinfo(serve->address, port, &hints, &addrinfo);
+	if(retval) {
+		fprintf(stderr, "Could not use address %s: %s\n", serve->address, gai_strerror(retval));
+		return 1;
+	}
+
+	serve->fd = socket(addrinfo->ai_family, addrinfo->ai_socktype, addrinfo->ai_protocol);
+	if(serve->fd < 0) {
+		fprintf(stderr, "Could not create socket: %s\n", strerror(errno));
+		freeaddrinfo(addrinfo);
+		return 1;
+	}
+
+	setsockopt(serve->fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+
+	if(bind(serve->fd, addrinfo->ai_addr, addrinfo->ai_addrlen) || listen(serve->fd, 64) || getsockname(serve->fd, (struct sockaddr *)&addr, &addr_length)) {
+		fprintf(stderr, "Could not listen on %s port %" PRIu16 ": %s\n", serve->address, serve->port, strerror(errno));
+		close(serve->fd);
+		freeaddrinfo(addrinfo);
+		return 1;
+	}
+
+	freeaddrinfo(addrinfo);
+
+	if(getnameinfo((struct sockaddr *)&addr, addr_length, host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) == 0) {
+		if(strchr(host, ':'))
+			printf("Serving at http://[%s]:%s/\n", host, port);
+		else
+			printf("Serving at http://%s:%s/\n", host, port);
+		fflush(stdout);
+	}
+
+	return 0;
+
+}
+
+int main(int argc, char **argv) {
+
+	struct bluray_serve serve;
+	serve.address = BLURAY_SERVE_ADDRESS;
+	serve.port = BLURAY_SERVE_PORT;
+	serve.workers = BLURAY_SERVE_WORKERS;
+	serve.cache_size = (size_t)BLURAY_SERVE_CACHE_SIZE * 1048576;
+	serve.fd = -1;
+	serve.debug = false;
+	serve.title_ix = UINT32_MAX;
+	serve.position = 0;
+
+	// Parse options and arguments
+	bool invalid_opt = false;
+	unsigned long int arg_number = 0;
+	const char *key_db_filename = NULL;
+	uint64_t disc_cache_size = 0;
+	char disc_id[BLURAY_INFO_DISC_ID_STRLEN];
+
+	int g_opt = 0;
+	int g_ix = 0;
+	struct option p_long_opts[] = {
+		{ "address", required_argument, NULL, 'a' },
+		{ "cache", required_argument, NULL, 'c' },
+		{ "disc-cache", required_argument, NULL, 'C' },
+		{ "help", no_argument, NULL, 'h' },
+		{ "keydb", required_argument, NULL, 'k' },
+		{ "port", required_argument, NULL, 'p' },
+		{ "workers", required_argument, NULL, 'w' },
+		{ "debug", no_argument, NULL, 'z' },
+		{ "version", no_argument, NULL, 'Z' },
+		{ 0, 0, 0, 0 }
+	};
+	while((g_opt = getopt_long(argc, argv, "a:c:hk:p:w:zZ", p_long_opts, &g_ix)) != -1) {
+
+		switch(g_opt) {
+
+			case 'a':
+				serve.address = optarg;
+				break;
+
+			case 'c':
+				arg_number = strtoul(optarg, NULL, 10);
+				serve.cache_size = (size_t)arg_number * 1048576;
+				break;
+
+			case 'C':
+				disc_cache_size = strtoull(optarg, NULL, 10) * 1048576;
+				break;
+
+			case 'k':
+				key_db_filename = optarg;
+				break;
+
+			case 'p':
+				arg_number = strtoul(optarg, NULL, 10);
+				if(arg_number > UINT16_MAX) {
+					fprintf(stderr, "Port must be between 0 and %u\n", UINT16_MAX);
+					return 1;
+				}
+				serve.port = (uint16_t)arg_number;
+				break;
+
+			case 'w':
+				arg_number = strtoul(optarg, NULL, 10);
+				if(arg_number < 1)
+					arg_number = 1;
+				if(arg_number > 256)
+					arg_number = 256;
+				serve.workers = (uint32_t)arg_number;
+				break;
+
+			case 'z':
+				serve.debug = true;
+				break;
+
+			case 'Z':
+				printf("bluray_serve %s\n", PACKAGE_VERSION);
+				return 0;
+
+			case '?':
+				invalid_opt = true;
+			case 'h':
+				printf("bluray_serve - stream Blu-ray titles and playlists over HTTP\n");
+				printf("\n");
+				printf("Usage: bluray_serve [path] [options]\n");
+				printf("\n");
+				printf("Options:\n");
+				printf("  -a, --address <address>  Listen on address (default: %s)\n", BLURAY_SERVE_ADDRESS);
+				printf("  -p, --port <#>           Listen on port, 0 for any free one (default: %u)\n", BLURAY_SERVE_PORT);
+				printf("  -w, --workers <#>        Number of clients served at once (default: %u)\n", BLURAY_SERVE_WORKERS);
+				printf("  -c, --cache <MBs>        Size of the block cache (default: %u)\n", BLURAY_SERVE_CACHE_SIZE);
+				printf("      --disc-cache <MBs>   Also keep blocks on disk, in a cache this big\n");
+				printf("\n");
+				printf("Other:\n");
+				printf("  -k, --keydb <filename>   Location to KEYDB.cfg (default: ~/.config/aacs/KEYDB.cfg)\n");
+				printf("  -h, --help		   This output\n");
+				printf("      --version		   Version information\n");
+				printf("\n");
+				printf("Blu-ray path can be a device, a filename, or directory; default is %s\n", DEFAULT_BLURAY_DEVICE);
+				if(invalid_opt)
+					return 1;
+				return 0;
+
+			case 0:
+			default:
+				break;
+
+		}
+
+	}
+
+	const char *device_filename = NULL;
+
+	if(argv[optind]) {
+		device_filename = argv[optind];
+	} else {
+		device_filename = DEFAULT_BLURAY_DEVICE;
+	}
+
+	// Open device
+	serve.bd = bluray_disc_open(device_filename, key_db_filename);
+
+	if(serve.bd == NULL) {
+		if(key_db_filename == NULL)
+			fprintf(stderr, "Could not open device %s\n", device_filename);
+		else
+			fprintf(stderr, "Could not open device %s and key_db file %s\n", device_filename, key_db_filename);
+		return 1;
+	}
+
+	if(bluray_info_init(serve.bd, &serve.bluray_info)) {
+		fprintf(stderr, "Could not get Blu-ray disc info\n");
+		bd_close(serve.bd);
+		return 1;
+	}
+
+	bluray_info_disc_name(serve.bd, &serve.bluray_info);
+
+	// Disc cache, which is left off if it can't be opened
+	bluray_cache_init(&serve.disc_cache);
+	if(disc_cache_size && (bluray_disc_id(serve.bd, &serve.bluray_info, disc_id) || bluray_cache_open(&serve.disc_cache, disc_id, disc_cache_size)) && serve.debug)
+		fprintf(stderr, "* could not open disc cache\n");
+
+	// Get each title's info, for its chapters and playlist number. Sizes are
+	// looked up once a title is requested, since libbluray has to select it.
+	serve.titles = calloc((size_t)serve.bluray_info.titles + 1, sizeof(struct bluray_serve_title));
+	if(serve.titles == NULL || bluray_serve_cache_init(&serve)) {
+		fprintf(stderr, "Could not allocate memory\n");
+		bd_close(serve.bd);
+		return 1;
+	}
+
+	uint32_t title_ix = 0;
+	for(title_ix = 0; title_ix < serve.bluray_info.titles; title_ix++) {
+		serve.titles[title_ix].bluray_title.title_info = NULL;
+		if(bluray_title_info_init(serve.bd, &serve.titles[title_ix].bluray_title, title_ix, 0) && serve.debug)
+			fprintf(stderr, "* could not get title info %" PRIu32 "\n", title_ix + 1);
+	}
+
+	if(bluray_serve_listen(&serve)) {
+		bd_close(serve.bd);
+		return 1;
+	}
+
+	// Handle the signals in this thread only, and ignore clients that hang up
+	// in the middle of a response
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	pthread_mutex_init(&serve.disc_lock, NULL);
+	pthread_mutex_init(&serve.cache_lock, NULL);
+
+	pthread_t thread;
+	uint32_t ix = 0;
+	uint32_t workers = 0;
+	for(ix = 0; ix < serve.workers; ix++) {
+		if(pthread_create(&thread, NULL, bluray_serve_worker, &serve) == 0) {
+			pthread_detach(thread);
+			workers++;
+		}
+	}
+
+	if(workers == 0) {
+		fprintf(stderr, "Could not start worker threads\n");
+		close(serve.fd);
+		bd_close(serve.bd);
+		return 1;
+	}
+
+	int signal_number = 0;
+	sigwait(&signals, &signal_number);
+
+	close(serve.fd);
+
+	// Workers can still be reading, so the disc is left open. The disc cache
+	// is closed to save its index, and they go on without it.
+	pthread_mutex_lock(&serve.disc_lock);
+	if(serve.debug) {
+		pthread_mutex_lock(&serve.cache_lock);
+		fprintf(stderr, "* cache hits %" PRIu64 ", misses %" PRIu64 ", disc seeks %" PRIu64 "\n", serve.cache_hits, serve.cache_misses, serve.seeks);
+		if(bluray_cache_enabled(&serve.disc_cache))
+			fprintf(stderr, "* disc cache hits %" PRIu64 ", misses %" PRIu64 "\n", serve.disc_cache.hits, serve.disc_cache.misses);
+		pthread_mutex_unlock(&serve.cache_lock);
+	}
+	bluray_cache_close(&serve.disc_cache);
+	pthread_mutex_unlock(&serve.disc_lock);
+
+	return 0;
+
+}
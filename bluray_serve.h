@@ -0,0 +1,100 @@
+#ifndef BLURAY_SERVE_H
+#define BLURAY_SERVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "libbluray/bluray.h"
+#include "bluray_open.h"
+#include "bluray_cache.h"
+
+/**
+ * bluray_serve: stream titles over HTTP
+ *
+ * Each title and playlist of one disc is a virtual .m2ts file, the same bytes
+ * bluray_copy would write:
+ *
+ *   GET /                               list of titles
+ *   GET /title/<number>.m2ts            title
+ *   GET /playlist/<number>.m2ts         playlist
+ *   GET /main.m2ts                      main title
+ *   GET /title/<number>.m2ts?chapters=<first>[-<last>]
+ *
+ * Range requests are answered with the byte range, so players can seek. The
+ * title is seeked to an offset with bluray_title_seek(), and a chapter range
+ * starts at its first chapter's offset in the chapter table.
+ *
+ * There is only one libbluray handle, since a disc can only be read in one
+ * place at a time. What's read goes in a block cache shared by all clients,
+ * so clients streaming the same part of a title, or a client seeking back,
+ * don't make the drive seek. Blocks are a number of aligned units, which is
+ * what libbluray reads and decrypts, and a miss reads a few blocks ahead,
+ * since clients mostly read in order. With --disc-cache, blocks that aren't
+ * in memory are looked for in the disc cache before reading the disc, and
+ * what's read from the disc is kept there as well.
+ *
+ * A pool of worker threads accepts connections, one client at a time each.
+ */
+
+#define BLURAY_SERVE_ADDRESS "127.0.0.1"
+#define BLURAY_SERVE_PORT 8080
+#define BLURAY_SERVE_WORKERS 8
+#define BLURAY_SERVE_CACHE_SIZE 64
+
+// The same as the disc cache's, so each block is one of its blocks
+#define BLURAY_SERVE_BLOCK_SIZE BLURAY_CACHE_BLOCK_SIZE
+#define BLURAY_SERVE_READ_AHEAD 4
+
+#define BLURAY_SERVE_REQUEST_MAX 8192
+
+// Seconds to keep an idle connection open, for the next request, or to wait
+// for a client to read a response
+#define BLURAY_SERVE_TIMEOUT 30
+
+struct bluray_serve_block {
+	uint32_t title_ix;
+	uint64_t block;
+	uint8_t *data;
+	size_t length;
+	struct bluray_serve_block *hash_next;
+	struct bluray_serve_block *prev;
+	struct bluray_serve_block *next;
+};
+
+struct bluray_serve_title {
+	struct bluray_title bluray_title;
+	bool sized;
+};
+
+struct bluray_serve {
+	const char *address;
+	uint16_t port;
+	uint32_t workers;
+	size_t cache_size;
+	int fd;
+	bool debug;
+
+	// The disc, and the title that is selected and where it's read from
+	BLURAY *bd;
+	struct bluray_info bluray_info;
+	struct bluray_serve_title *titles;
+	uint32_t title_ix;
+	uint64_t position;
+	struct bluray_cache disc_cache;
+	pthread_mutex_t disc_lock;
+
+	// Cached blocks, in a hash table and in a LRU list
+	struct bluray_serve_block **hash;
+	uint32_t hash_size;
+	struct bluray_serve_block *blocks;
+	struct bluray_serve_block *last_block;
+	uint32_t cached_blocks;
+	uint32_t max_blocks;
+	pthread_mutex_t cache_lock;
+	uint64_t cache_hits;
+	uint64_t cache_misses;
+	uint64_t seeks;
+};
+
+#endif
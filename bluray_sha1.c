@@ -0,0 +1,113 @@
+#include <string.h>
+#include "bluray_sha1.h"
+
+#define BLURAY_SHA1_ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void bluray_sha1_block(struct bluray_sha1 *sha1, const uint8_t *block) {
+
+	uint32_t w[80];
+	uint32_t s[5];
+	uint32_t f = 0;
+	uint32_t k = 0;
+	uint32_t t = 0;
+	uint8_t ix = 0;
+
+	for(ix = 0; ix < 16; ix++)
+		w[ix] = ((uint32_t)block[ix * 4] << 24) | ((uint32_t)block[ix * 4 + 1] << 16) | ((uint32_t)block[ix * 4 + 2] << 8) | block[ix * 4 + 3];
+
+	for(ix = 16; ix < 80; ix++)
+		w[ix] = BLURAY_SHA1_ROTL(w[ix - 3] ^ w[ix - 8] ^ w[ix - 14] ^ w[ix - 16], 1);
+
+	memcpy(s, sha1->state, sizeof(s));
+
+	for(ix = 0; ix < 80; ix++) {
+		if(ix < 20) {
+			f = (s[1] & s[2]) | (~s[1] & s[3]);
+			k = 0x5a827999;
+		} else if(ix < 40) {
+			f = s[1] ^ s[2] ^ s[3];
+			k = 0x6ed9eba1;
+		} else if(ix < 60) {
+			f = (s[1] & s[2]) | (s[1] & s[3]) | (s[2] & s[3]);
+			k = 0x8f1bbcdc;
+		} else {
+			f = s[1] ^ s[2] ^ s[3];
+			k = 0xca62c1d6;
+		}
+		t = BLURAY_SHA1_ROTL(s[0], 5) + f + s[4] + k + w[ix];
+		s[4] = s[3];
+		s[3] = s[2];
+		s[2] = BLURAY_SHA1_ROTL(s[1], 30);
+		s[1] = s[0];
+		s[0] = t;
+	}
+
+	for(ix = 0; ix < 5; ix++)
+		sha1->state[ix] += s[ix];
+
+}
+
+void bluray_sha1_init(struct bluray_sha1 *sha1) {
+
+	sha1->state[0] = 0x67452301;
+	sha1->state[1] = 0xefcdab89;
+	sha1->state[2] = 0x98badcfe;
+	sha1->state[3] = 0x10325476;
+	sha1->state[4] = 0xc3d2e1f0;
+	sha1->length = 0;
+	sha1->block_length = 0;
+
+}
+
+void bluray_sha1_update(struct bluray_sha1 *sha1, const uint8_t *data, size_t length) {
+
+	size_t n = 0;
+
+	sha1->length += length;
+
+	if(sha1->block_length) {
+		n = 64 - sha1->block_length;
+		if(n > length)
+			n = length;
+		memcpy(sha1->block + sha1->block_length, data, n);
+		sha1->block_length += n;
+		data += n;
+		length -= n;
+		if(sha1->block_length < 64)
+			return;
+		bluray_sha1_block(sha1, sha1->block);
+		sha1->block_length = 0;
+	}
+
+	while(length >= 64) {
+		bluray_sha1_block(sha1, data);
+		data += 64;
+		length -= 64;
+	}
+
+	memcpy(sha1->block, data, length);
+	sha1->block_length = length;
+
+}
+
+void bluray_sha1_final(struct bluray_sha1 *sha1, uint8_t digest[BLURAY_SHA1_LENGTH]) {
+
+	uint64_t bits = sha1->length * 8;
+	uint8_t ix = 0;
+
+	sha1->block[sha1->block_length++] = 0x80;
+	if(sha1->block_length > 56) {
+		memset(sha1->block + sha1->block_length, 0, 64 - sha1->block_length);
+		bluray_sha1_block(sha1, sha1->block);
+		sha1->block_length = 0;
+	}
+
+	memset(sha1->block + sha1->block_length, 0, 56 - sha1->block_length);
+	for(ix = 0; ix < 8; ix++)
+		sha1->block[63 - ix] = (uint8_t)(bits >> (8 * ix));
+	bluray_sha1_block(sha1, sha1->block);
+
+	for(ix = 0; ix < BLURAY_SHA1_LENGTH; ix++)
+		digest[ix] = (uint8_t)(sha1->state[ix / 4] >> (24 - 8 * (ix % 4)));
+
+}
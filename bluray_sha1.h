@@ -0,0 +1,27 @@
+#ifndef BLURAY_INFO_SHA1_H
+#define BLURAY_INFO_SHA1_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * SHA-1 (FIPS 180-4), for AACS disc IDs, which are the SHA-1 of
+ * AACS/Unit_Key_RO.inf
+ */
+
+#define BLURAY_SHA1_LENGTH 20
+
+struct bluray_sha1 {
+	uint32_t state[5];
+	uint64_t length;
+	uint8_t block[64];
+	size_t block_length;
+};
+
+void bluray_sha1_init(struct bluray_sha1 *sha1);
+
+void bluray_sha1_update(struct bluray_sha1 *sha1, const uint8_t *data, size_t length);
+
+void bluray_sha1_final(struct bluray_sha1 *sha1, uint8_t digest[BLURAY_SHA1_LENGTH]);
+
+#endif
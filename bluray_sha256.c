@@ -0,0 +1,115 @@
+#include <string.h>
+#include "bluray_sha256.h"
+
+static const uint32_t bluray_sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define BLURAY_SHA256_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void bluray_sha256_block(struct bluray_sha256 *sha256, const uint8_t *block) {
+
+	uint32_t w[64];
+	uint32_t s[8];
+	uint32_t t1 = 0;
+	uint32_t t2 = 0;
+	uint8_t ix = 0;
+
+	for(ix = 0; ix < 16; ix++)
+		w[ix] = ((uint32_t)block[ix * 4] << 24) | ((uint32_t)block[ix * 4 + 1] << 16) | ((uint32_t)block[ix * 4 + 2] << 8) | block[ix * 4 + 3];
+
+	for(ix = 16; ix < 64; ix++)
+		w[ix] = (BLURAY_SHA256_ROTR(w[ix - 2], 17) ^ BLURAY_SHA256_ROTR(w[ix - 2], 19) ^ (w[ix - 2] >> 10)) + w[ix - 7] + (BLURAY_SHA256_ROTR(w[ix - 15], 7) ^ BLURAY_SHA256_ROTR(w[ix - 15], 18) ^ (w[ix - 15] >> 3)) + w[ix - 16];
+
+	memcpy(s, sha256->state, sizeof(s));
+
+	for(ix = 0; ix < 64; ix++) {
+		t1 = s[7] + (BLURAY_SHA256_ROTR(s[4], 6) ^ BLURAY_SHA256_ROTR(s[4], 11) ^ BLURAY_SHA256_ROTR(s[4], 25)) + ((s[4] & s[5]) ^ (~s[4] & s[6])) + bluray_sha256_k[ix] + w[ix];
+		t2 = (BLURAY_SHA256_ROTR(s[0], 2) ^ BLURAY_SHA256_ROTR(s[0], 13) ^ BLURAY_SHA256_ROTR(s[0], 22)) + ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+		s[7] = s[6];
+		s[6] = s[5];
+		s[5] = s[4];
+		s[4] = s[3] + t1;
+		s[3] = s[2];
+		s[2] = s[1];
+		s[1] = s[0];
+		s[0] = t1 + t2;
+	}
+
+	for(ix = 0; ix < 8; ix++)
+		sha256->state[ix] += s[ix];
+
+}
+
+void bluray_sha256_init(struct bluray_sha256 *sha256) {
+
+	static const uint32_t h[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	memcpy(sha256->state, h, sizeof(h));
+	sha256->length = 0;
+	sha256->block_length = 0;
+
+}
+
+void bluray_sha256_update(struct bluray_sha256 *sha256, const uint8_t *data, size_t length) {
+
+	size_t n = 0;
+
+	sha256->length += length;
+
+	// Top up a partial block first, then hash whole blocks straight from data
+	if(sha256->block_length) {
+		n = 64 - sha256->block_length;
+		if(n > length)
+			n = length;
+		memcpy(sha256->block + sha256->block_length, data, n);
+		sha256->block_length += n;
+		data += n;
+		length -= n;
+		if(sha256->block_length < 64)
+			return;
+		bluray_sha256_block(sha256, sha256->block);
+		sha256->block_length = 0;
+	}
+
+	while(length >= 64) {
+		bluray_sha256_block(sha256, data);
+		data += 64;
+		length -= 64;
+	}
+
+	memcpy(sha256->block, data, length);
+	sha256->block_length = length;
+
+}
+
+void bluray_sha256_final(struct bluray_sha256 *sha256, uint8_t digest[BLURAY_SHA256_LENGTH]) {
+
+	uint64_t bits = sha256->length * 8;
+	uint8_t ix = 0;
+
+	sha256->block[sha256->block_length++] = 0x80;
+	if(sha256->block_length > 56) {
+		memset(sha256->block + sha256->block_length, 0, 64 - sha256->block_length);
+		bluray_sha256_block(sha256, sha256->block);
+		sha256->block_length = 0;
+	}
+
+	memset(sha256->block + sha256->block_length, 0, 56 - sha256->block_length);
+	for(ix = 0; ix < 8; ix++)
+		sha256->block[63 - ix] = (uint8_t)(bits >> (8 * ix));
+	bluray_sha256_block(sha256, sha256->block);
+
+	for(ix = 0; ix < 32; ix++)
+		digest[ix] = (uint8_t)(sha256->state[ix / 4] >> (24 - 8 * (ix % 4)));
+
+}
@@ -0,0 +1,29 @@
+#ifndef BLURAY_INFO_SHA256_H
+#define BLURAY_INFO_SHA256_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * SHA-256 (FIPS 180-4), for disc fingerprints
+ *
+ * Only a few MBs are ever hashed, so this is the plain reference algorithm,
+ * which saves depending on a crypto library for it.
+ */
+
+#define BLURAY_SHA256_LENGTH 32
+
+struct bluray_sha256 {
+	uint32_t state[8];
+	uint64_t length;
+	uint8_t block[64];
+	size_t block_length;
+};
+
+void bluray_sha256_init(struct bluray_sha256 *sha256);
+
+void bluray_sha256_update(struct bluray_sha256 *sha256, const uint8_t *data, size_t length);
+
+void bluray_sha256_final(struct bluray_sha256 *sha256, uint8_t digest[BLURAY_SHA256_LENGTH]);
+
+#endif
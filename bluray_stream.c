@@ -0,0 +1,383 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "bluray_stream.h"
+
+/**
+ * Set up the stream for a range of a title, sizing the read-ahead buffer from
+ * the title's average bitrate. Nothing is allocated until mpv opens it.
+ */
+void bluray_stream_init(struct bluray_stream *stream, struct bluray *bd, const struct bluray_title *bluray_title, uint8_t angle, uint64_t first_position, uint64_t last_position) {
+
+	memset(stream, 0, sizeof(struct bluray_stream));
+
+	stream->bd = bd;
+	stream->title_ix = bluray_title->ix;
+	stream->angle = angle;
+	stream->first_position = first_position;
+	stream->last_position = (last_position < first_position ? first_position : last_position);
+
+	uint64_t buffer_size = BLURAY_STREAM_MAX_BUFFER;
+	if(bluray_title->duration)
+		buffer_size = bluray_title->size * BLURAY_STREAM_SECONDS * 90000 / bluray_title->duration;
+
+	if(buffer_size < BLURAY_STREAM_MIN_BUFFER)
+		buffer_size = BLURAY_STREAM_MIN_BUFFER;
+	if(buffer_size > BLURAY_STREAM_MAX_BUFFER)
+		buffer_size = BLURAY_STREAM_MAX_BUFFER;
+
+	// There's no use in a buffer bigger than the stream
+	if(buffer_size > stream->last_position - stream->first_position)
+		buffer_size = stream->last_position - stream->first_position;
+
+	// Keep it in whole aligned units, same as libbluray reads
+	buffer_size = (buffer_size + 6143) / 6144 * 6144;
+	if(buffer_size == 0)
+		buffer_size = 6144;
+
+	stream->buffer_size = (size_t)buffer_size;
+
+	// The lock outlives each open, so the counters can be read at any time
+	pthread_mutex_init(&stream->mutex, NULL);
+	pthread_cond_init(&stream->cond, NULL);
+
+}
+
+void bluray_stream_free(struct bluray_stream *stream) {
+
+	pthread_cond_destroy(&stream->cond);
+	pthread_mutex_destroy(&stream->mutex);
+
+}
+
+/**
+ * Get the counters while mpv is playing. Any of them can be NULL.
+ */
+void bluray_stream_counters(struct bluray_stream *stream, uint64_t *underruns, uint64_t *buffered_seeks, uint64_t *seeks) {
+
+	pthread_mutex_lock(&stream->mutex);
+
+	if(underruns != NULL)
+		*underruns = stream->underruns;
+	if(buffered_seeks != NULL)
+		*buffered_seeks = stream->buffered_seeks;
+	if(seeks != NULL)
+		*seeks = stream->seeks;
+
+	pthread_mutex_unlock(&stream->mutex);
+
+}
+
+static void *bluray_stream_reader(void *arg) {
+
+	struct bluray_stream *stream = arg;
+	uint64_t size = stream->last_position - stream->first_position;
+	uint64_t keep = stream->buffer_size / 4;
+	uint64_t generation = 0;
+	uint64_t end = 0;
+	uint64_t used = 0;
+	uint64_t disc_position = UINT64_MAX;
+	size_t offset = 0;
+	size_t length = 0;
+	int retval = 0;
+
+	pthread_mutex_lock(&stream->mutex);
+
+	while(!stream->quit) {
+
+		// Make room by letting go of what mpv read long enough ago
+		if(stream->position - stream->buffer_start > keep)
+			stream->buffer_start = stream->position - keep;
+
+		if(stream->buffer_end == size)
+			stream->eof = true;
+
+		used = stream->buffer_end - stream->buffer_start;
+		if(stream->eof || stream->error || used == stream->buffer_size) {
+			pthread_cond_wait(&stream->cond, &stream->mutex);
+			continue;
+		}
+
+		generation = stream->generation;
+		end = stream->buffer_end;
+		offset = (size_t)(end % stream->buffer_size);
+		length = stream->buffer_size - (size_t)used;
+		if(length > stream->buffer_size - offset)
+			length = stream->buffer_size - offset;
+		if(length > BLURAY_STREAM_READ_SIZE)
+			length = BLURAY_STREAM_READ_SIZE;
+		if(length > size - end)
+			length = (size_t)(size - end);
+
+		// mpv only reads what's between the start and the end of the buffer,
+		// so the part after the end can be filled without holding the lock
+		pthread_mutex_unlock(&stream->mutex);
+
+		// Only seek the disc when it's not already there. The disc cache keeps
+		// track of that itself. The start of the title is selected again
+		// instead of seeked to, see bluray_copy.c.
+		retval = 0;
+		if(stream->cache_title != NULL) {
+			retval = (int)bluray_cache_title_read(stream->cache_title, stream->first_position + end, stream->buffer + offset, length);
+		} else {
+			if(disc_position != end && stream->first_position + end == 0) {
+				if(bd_select_title(stream->bd, stream->title_ix) == 0 || bd_select_angle(stream->bd, stream->angle) == 0)
+					retval = -1;
+			} else if(disc_position != end && bluray_title_seek(stream->bd, stream->first_position + end) < 0) {
+				retval = -1;
+			}
+			if(retval == 0)
+				retval = bd_read(stream->bd, stream->buffer + offset, (int)length);
+			disc_position = (retval > 0 ? end + (uint64_t)retval : UINT64_MAX);
+		}
+
+		pthread_mutex_lock(&stream->mutex);
+
+		// Throw it away if mpv seeked somewhere else in the meantime
+		if(generation != stream->generation)
+			continue;
+
+		if(retval < 0)
+			stream->error = true;
+		else if(retval == 0)
+			stream->eof = true;
+		else
+			stream->buffer_end += (uint64_t)retval;
+
+		pthread_cond_broadcast(&stream->cond);
+
+	}
+
+	pthread_mutex_unlock(&stream->mutex);
+
+	return NULL;
+
+}
+
+static int64_t bluray_stream_read(void *cookie, char *buf, uint64_t nbytes) {
+
+	struct bluray_stream *stream = cookie;
+	size_t offset = 0;
+	uint64_t length = 0;
+
+	pthread_mutex_lock(&stream->mutex);
+
+	if(stream->position == stream->buffer_end && !stream->eof && !stream->error && !stream->cancel && !stream->filling)
+		stream->underruns++;
+
+	while(stream->position == stream->buffer_end && !stream->eof && !stream->error && !stream->cancel)
+		pthread_cond_wait(&stream->cond, &stream->mutex);
+
+	if(stream->cancel || (stream->position == stream->buffer_end && stream->error)) {
+		pthread_mutex_unlock(&stream->mutex);
+		return -1;
+	}
+
+	offset = (size_t)(stream->position % stream->buffer_size);
+	length = stream->buffer_end - stream->position;
+	if(length > nbytes)
+		length = nbytes;
+	if(length > stream->buffer_size - offset)
+		length = stream->buffer_size - offset;
+
+	memcpy(buf, stream->buffer + offset, (size_t)length);
+	stream->position += length;
+	if(length)
+		stream->filling = false;
+
+	pthread_cond_broadcast(&stream->cond);
+	pthread_mutex_unlock(&stream->mutex);
+
+	return (int64_t)length;
+
+}
+
+/**
+ * Seeking anywhere that's still in the buffer just moves mpv's position in
+ * it. Anywhere else starts reading ahead again from there.
+ */
+static int64_t bluray_stream_seek(void *cookie, int64_t offset) {
+
+	struct bluray_stream *stream = cookie;
+
+	if(offset < 0 || (uint64_t)offset > stream->last_position - stream->first_position)
+		return MPV_ERROR_GENERIC;
+
+	pthread_mutex_lock(&stream->mutex);
+
+	if((uint64_t)offset >= stream->buffer_start && (uint64_t)offset <= stream->buffer_end) {
+		stream->buffered_seeks++;
+	} else {
+		stream->seeks++;
+		stream->generation++;
+		stream->buffer_start = (uint64_t)offset;
+		stream->buffer_end = (uint64_t)offset;
+		stream->eof = false;
+		stream->error = false;
+		stream->filling = true;
+	}
+
+	stream->position = (uint64_t)offset;
+
+	pthread_cond_broadcast(&stream->cond);
+	pthread_mutex_unlock(&stream->mutex);
+
+	return offset;
+
+}
+
+static int64_t bluray_stream_size(void *cookie) {
+
+	struct bluray_stream *stream = cookie;
+
+	return (int64_t)(stream->last_position - stream->first_position);
+
+}
+
+/**
+ * Stop the reader and free the buffer. The disc stays open for bluray_player
+ * to close once mpv is done.
+ */
+static void bluray_stream_close(void *cookie) {
+
+	struct bluray_stream *stream = cookie;
+
+	if(!stream->running)
+		return;
+
+	pthread_mutex_lock(&stream->mutex);
+	stream->quit = true;
+	pthread_cond_broadcast(&stream->cond);
+	pthread_mutex_unlock(&stream->mutex);
+
+	pthread_join(stream->thread, NULL);
+	free(stream->buffer);
+	stream->buffer = NULL;
+	stream->running = false;
+
+}
+
+/**
+ * Wake up a read that's waiting on the disc, when mpv gives up on it
+ */
+static void bluray_stream_cancel(void *cookie) {
+
+	struct bluray_stream *stream = cookie;
+
+	pthread_mutex_lock(&stream->mutex);
+	stream->cancel = true;
+	pthread_cond_broadcast(&stream->cond);
+	pthread_mutex_unlock(&stream->mutex);
+
+}
+
+static int bluray_stream_start(struct bluray_stream *stream) {
+
+	stream->buffer = malloc(stream->buffer_size);
+	if(stream->buffer == NULL)
+		return 1;
+
+	pthread_mutex_lock(&stream->mutex);
+	stream->quit = false;
+	stream->cancel = false;
+	stream->eof = false;
+	stream->error = false;
+	stream->filling = true;
+	stream->buffer_start = 0;
+	stream->buffer_end = 0;
+	stream->position = 0;
+	pthread_mutex_unlock(&stream->mutex);
+
+	if(pthread_create(&stream->thread, NULL, bluray_stream_reader, stream)) {
+		free(stream->buffer);
+		stream->buffer = NULL;
+		return 1;
+	}
+
+	stream->running = true;
+
+	return 0;
+
+}
+
+/**
+ * Start reading ahead before mpv opens the stream, and wait for the start of
+ * it to be read, copying it to data. Returns how much was copied, which is
+ * less at the end of the stream or on a read error.
+ */
+size_t bluray_stream_prefetch(struct bluray_stream *stream, uint8_t *data, size_t length) {
+
+	if(!stream->running && bluray_stream_start(stream))
+		return 0;
+
+	if(length > stream->buffer_size)
+		length = stream->buffer_size;
+
+	pthread_mutex_lock(&stream->mutex);
+
+	while(stream->buffer_end < length && !stream->eof && !stream->error)
+		pthread_cond_wait(&stream->cond, &stream->mutex);
+
+	if(length > stream->buffer_end)
+		length = (size_t)stream->buffer_end;
+	if(length)
+		memcpy(data, stream->buffer, length);
+
+	pthread_mutex_unlock(&stream->mutex);
+
+	return length;
+
+}
+
+/**
+ * Open the stream from the start, and start reading ahead, unless it already
+ * has been. mpv can open it more than once, closing it in between.
+ */
+int bluray_stream_open(void *user_data, char *uri, mpv_stream_cb_info *info) {
+
+	(void)uri;
+
+	struct bluray_stream *stream = user_data;
+
+	if(!stream->running && bluray_stream_start(stream))
+		return MPV_ERROR_LOADING_FAILED;
+
+	info->cookie = stream;
+	info->read_fn = bluray_stream_read;
+	info->seek_fn = bluray_stream_seek;
+	info->size_fn = bluray_stream_size;
+	info->close_fn = bluray_stream_close;
+	info->cancel_fn = bluray_stream_cancel;
+
+	return 0;
+
+}
+
+/**
+ * Get the mpv track number (starting at 1) of the first stream in a language,
+ * or 0 if there isn't one. mpv numbers tracks in the order of the PMT, which
+ * lists streams by PID, while the playlist may list them in another order.
+ */
+uint8_t bluray_stream_track(const BLURAY_STREAM_INFO *streams, uint8_t num_streams, const char *lang) {
+
+	uint8_t ix = 0;
+	uint8_t stream_ix = 0;
+	uint8_t track = 0;
+
+	for(ix = 0; ix < num_streams; ix++) {
+		if(strncmp((const char *)streams[ix].lang, lang, 3) == 0)
+			break;
+	}
+
+	if(ix == num_streams)
+		return 0;
+
+	track = 1;
+	for(stream_ix = 0; stream_ix < num_streams; stream_ix++) {
+		if(streams[stream_ix].pid < streams[ix].pid)
+			track++;
+	}
+
+	return track;
+
+}
@@ -0,0 +1,85 @@
+#ifndef BLURAY_PLAYER_STREAM_H
+#define BLURAY_PLAYER_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "libbluray/bluray.h"
+#include "bluray_open.h"
+#include "bluray_cache.h"
+#include <mpv/client.h>
+#include <mpv/stream_cb.h>
+
+/**
+ * A title read through libbluray, played by mpv as a custom protocol
+ *
+ * bluray_player already has the disc open and the title selected to display
+ * it, so instead of closing it and having mpv open the disc again through
+ * bd://, which on an optical drive means spinning it up and setting up AACS a
+ * second time, mpv reads the title from the same session, as bluray://.
+ *
+ * mpv gets the title's transport stream, without the playlist around it, so
+ * what it would have read from the playlist is passed as options instead:
+ * languages as track numbers. A chapter range is streamed as just that range
+ * of the title, from the chapter marks' positions, so playback starts at the
+ * first chapter without mpv reading the start of the title and seeking.
+ *
+ * Reading is done ahead of mpv by a thread of its own, into a ring buffer
+ * sized to hold BLURAY_STREAM_SECONDS of the title at its average bitrate.
+ * The last quarter of the buffer that mpv has already read is kept, so
+ * seeking back a little, or anywhere that's already been read ahead, doesn't
+ * read the disc again. Reads that have to wait for the disc are counted as
+ * underruns, not counting the first one after opening or a seek. Reading
+ * ahead can also be started before mpv is, with bluray_stream_prefetch().
+ *
+ * With the disc cache, cache_title is set after bluray_stream_init(), and the
+ * title is read through it instead of from libbluray directly.
+ */
+
+#define BLURAY_STREAM_PROTOCOL "bluray"
+#define BLURAY_STREAM_SECONDS 30
+#define BLURAY_STREAM_MIN_BUFFER (16 * 1024 * 1024)
+#define BLURAY_STREAM_MAX_BUFFER (256 * 1024 * 1024)
+#define BLURAY_STREAM_READ_SIZE (32 * 6144)
+
+struct bluray_stream {
+	struct bluray *bd;
+	struct bluray_cache_title *cache_title;
+	uint32_t title_ix;
+	uint8_t angle;
+	uint64_t first_position;
+	uint64_t last_position;
+	size_t buffer_size;
+	uint8_t *buffer;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool running;
+	bool quit;
+	bool cancel;
+	bool eof;
+	bool error;
+	bool filling;
+	uint64_t generation;
+	uint64_t buffer_start;
+	uint64_t buffer_end;
+	uint64_t position;
+	uint64_t underruns;
+	uint64_t buffered_seeks;
+	uint64_t seeks;
+};
+
+void bluray_stream_init(struct bluray_stream *stream, struct bluray *bd, const struct bluray_title *bluray_title, uint8_t angle, uint64_t first_position, uint64_t last_position);
+
+void bluray_stream_free(struct bluray_stream *stream);
+
+void bluray_stream_counters(struct bluray_stream *stream, uint64_t *underruns, uint64_t *buffered_seeks, uint64_t *seeks);
+
+size_t bluray_stream_prefetch(struct bluray_stream *stream, uint8_t *data, size_t length);
+
+int bluray_stream_open(void *user_data, char *uri, mpv_stream_cb_info *info);
+
+uint8_t bluray_stream_track(const BLURAY_STREAM_INFO *streams, uint8_t num_streams, const char *lang);
+
+#endif
@@ -0,0 +1,209 @@
+#include <string.h>
+#include <time.h>
+#include "bluray_telemetry.h"
+
+static uint64_t bluray_telemetry_clock(void) {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+
+}
+
+// Durations are written in seconds, to the millisecond
+static void bluray_telemetry_seconds(struct bluray_json *json, const char *key, double seconds) {
+
+	if(seconds < 0)
+		seconds = 0;
+
+	bluray_json_fixed(json, key, (uint64_t)(seconds * 1000 + 0.5), 3);
+
+}
+
+static void bluray_telemetry_record(struct bluray_telemetry *telemetry, const char *event, uint64_t now) {
+
+	bluray_json_object_open(&telemetry->json, NULL);
+	bluray_json_string(&telemetry->json, "event", event);
+	bluray_json_fixed(&telemetry->json, "time", now - telemetry->epoch, 3);
+
+}
+
+/**
+ * Open the file to append to, and start the clock. Time to first frame is
+ * measured from here, so open it before the disc.
+ */
+int bluray_telemetry_open(struct bluray_telemetry *telemetry, const char *filename, uint64_t interval) {
+
+	telemetry->epoch = bluray_telemetry_clock();
+	telemetry->interval = (interval ? interval : BLURAY_TELEMETRY_INTERVAL);
+	telemetry->next_sample = telemetry->epoch + telemetry->interval;
+	telemetry->first_frame = 0;
+	telemetry->samples = 0;
+	telemetry->rebuffers = 0;
+	telemetry->buffering = false;
+	telemetry->frame_drops = 0;
+	telemetry->cache_duration_min = -1;
+	telemetry->cache_duration_max = -1;
+
+	telemetry->io = fopen(filename, "a");
+	if(telemetry->io == NULL)
+		return 1;
+
+	if(bluray_json_init(&telemetry->json, telemetry->io, BLURAY_JSON_FORMAT_NDJSON)) {
+		bluray_json_free(&telemetry->json);
+		fclose(telemetry->io);
+		telemetry->io = NULL;
+		return 1;
+	}
+
+	return 0;
+
+}
+
+void bluray_telemetry_start(struct bluray_telemetry *telemetry, mpv_handle *mpv, uint32_t title, uint32_t playlist) {
+
+	if(telemetry->io == NULL)
+		return;
+
+	mpv_observe_property(mpv, 0, "paused-for-cache", MPV_FORMAT_FLAG);
+
+	bluray_telemetry_record(telemetry, "start", bluray_telemetry_clock());
+	bluray_json_uint(&telemetry->json, "started", (uint64_t)time(NULL));
+	bluray_json_uint(&telemetry->json, "title", title);
+	bluray_json_uint(&telemetry->json, "playlist", playlist);
+	bluray_json_object_close(&telemetry->json);
+	bluray_json_end(&telemetry->json);
+
+}
+
+/**
+ * Look at each event from mpv for the first frame and for rebuffering. This
+ * doesn't write anything other than the first frame record.
+ */
+void bluray_telemetry_event(struct bluray_telemetry *telemetry, mpv_event *event) {
+
+	if(telemetry->io == NULL)
+		return;
+
+	uint64_t now = 0;
+	mpv_event_property *property = NULL;
+
+	// Playback restarts after loading, and after every seek
+	if(event->event_id == MPV_EVENT_PLAYBACK_RESTART && telemetry->first_frame == 0) {
+		now = bluray_telemetry_clock();
+		telemetry->first_frame = now - telemetry->epoch;
+		bluray_telemetry_record(telemetry, "first_frame", now);
+		bluray_json_object_close(&telemetry->json);
+		bluray_json_end(&telemetry->json);
+	}
+
+	if(event->event_id == MPV_EVENT_PROPERTY_CHANGE) {
+		property = (mpv_event_property *)event->data;
+		if(property->format == MPV_FORMAT_FLAG && strcmp(property->name, "paused-for-cache") == 0) {
+			if(*(int *)property->data && !telemetry->buffering)
+				telemetry->rebuffers++;
+			telemetry->buffering = *(int *)property->data;
+		}
+	}
+
+}
+
+/**
+ * How long the event loop can wait for mpv before the next sample is due, in
+ * seconds, or -1 to wait for as long as it takes
+ */
+double bluray_telemetry_timeout(struct bluray_telemetry *telemetry) {
+
+	if(telemetry->io == NULL)
+		return -1;
+
+	uint64_t now = bluray_telemetry_clock();
+	if(now >= telemetry->next_sample)
+		return 0;
+
+	return (double)(telemetry->next_sample - now) / 1000.0;
+
+}
+
+/**
+ * Write a sample if one is due. Properties mpv can't give yet, such as the
+ * cache before the file is loaded, are left out.
+ */
+void bluray_telemetry_sample(struct bluray_telemetry *telemetry, mpv_handle *mpv, uint64_t underruns) {
+
+	if(telemetry->io == NULL)
+		return;
+
+	uint64_t now = bluray_telemetry_clock();
+	if(now < telemetry->next_sample)
+		return;
+
+	// Skip ahead if the loop was held up, instead of catching up all at once
+	telemetry->next_sample += telemetry->interval;
+	if(telemetry->next_sample <= now)
+		telemetry->next_sample = now + telemetry->interval;
+
+	double playback_time = 0;
+	double cache_duration = 0;
+	int64_t cache_buffering = 0;
+
+	bluray_telemetry_record(telemetry, "sample", now);
+
+	if(mpv_get_property(mpv, "playback-time", MPV_FORMAT_DOUBLE, &playback_time) == 0)
+		bluray_telemetry_seconds(&telemetry->json, "position", playback_time);
+
+	if(mpv_get_property(mpv, "frame-drop-count", MPV_FORMAT_INT64, &telemetry->frame_drops) == 0)
+		bluray_json_uint(&telemetry->json, "frame_drops", (uint64_t)telemetry->frame_drops);
+
+	if(mpv_get_property(mpv, "demuxer-cache-duration", MPV_FORMAT_DOUBLE, &cache_duration) == 0) {
+		bluray_telemetry_seconds(&telemetry->json, "cache_duration", cache_duration);
+		if(telemetry->cache_duration_min < 0 || cache_duration < telemetry->cache_duration_min)
+			telemetry->cache_duration_min = cache_duration;
+		if(cache_duration > telemetry->cache_duration_max)
+			telemetry->cache_duration_max = cache_duration;
+	}
+
+	if(mpv_get_property(mpv, "cache-buffering-state", MPV_FORMAT_INT64, &cache_buffering) == 0)
+		bluray_json_uint(&telemetry->json, "cache_buffering", (uint64_t)cache_buffering);
+
+	bluray_json_bool(&telemetry->json, "buffering", telemetry->buffering);
+	bluray_json_uint(&telemetry->json, "underruns", underruns);
+	bluray_json_object_close(&telemetry->json);
+	bluray_json_end(&telemetry->json);
+
+	telemetry->samples++;
+
+}
+
+/**
+ * Write the summary, with the counts from the stream as well, and close the
+ * file. Call it before mpv is destroyed, to get its final frame drops.
+ */
+void bluray_telemetry_close(struct bluray_telemetry *telemetry, mpv_handle *mpv, uint64_t underruns, uint64_t seeks) {
+
+	if(telemetry->io == NULL)
+		return;
+
+	mpv_get_property(mpv, "frame-drop-count", MPV_FORMAT_INT64, &telemetry->frame_drops);
+
+	bluray_telemetry_record(telemetry, "summary", bluray_telemetry_clock());
+	if(telemetry->first_frame)
+		bluray_json_fixed(&telemetry->json, "first_frame", telemetry->first_frame, 3);
+	bluray_json_uint(&telemetry->json, "samples", telemetry->samples);
+	bluray_json_uint(&telemetry->json, "frame_drops", (uint64_t)telemetry->frame_drops);
+	bluray_json_uint(&telemetry->json, "rebuffers", telemetry->rebuffers);
+	bluray_json_uint(&telemetry->json, "underruns", underruns);
+	bluray_json_uint(&telemetry->json, "seeks", seeks);
+	if(telemetry->cache_duration_min >= 0) {
+		bluray_telemetry_seconds(&telemetry->json, "cache_duration_min", telemetry->cache_duration_min);
+		bluray_telemetry_seconds(&telemetry->json, "cache_duration_max", telemetry->cache_duration_max);
+	}
+	bluray_json_object_close(&telemetry->json);
+	bluray_json_end(&telemetry->json);
+
+	bluray_json_free(&telemetry->json);
+	fclose(telemetry->io);
+	telemetry->io = NULL;
+
+}
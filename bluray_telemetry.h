@@ -0,0 +1,55 @@
+#ifndef BLURAY_PLAYER_TELEMETRY_H
+#define BLURAY_PLAYER_TELEMETRY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <mpv/client.h>
+#include "bluray_json.h"
+
+/**
+ * Playback telemetry, as NDJSON
+ *
+ * Each playback appends records to a file, one per line: a "start" record
+ * with the title, a "first_frame" record with the time from starting until
+ * the first frame was shown, a "sample" record every interval, and a
+ * "summary" record when playback ends.
+ *
+ * Samples are rate limited: mpv's properties are only read when a sample is
+ * due, not observed, so the player's event loop doesn't wake up on every
+ * cache update. Frame drops are a running count in mpv, so nothing is lost
+ * between samples. The one property that is observed is paused-for-cache,
+ * which only changes when mpv stops and starts playing again to wait for the
+ * cache, so that each time it does is counted as a rebuffer.
+ */
+
+#define BLURAY_TELEMETRY_INTERVAL 5000
+
+struct bluray_telemetry {
+	FILE *io;
+	struct bluray_json json;
+	uint64_t epoch;
+	uint64_t interval;
+	uint64_t next_sample;
+	uint64_t first_frame;
+	uint64_t samples;
+	uint64_t rebuffers;
+	bool buffering;
+	int64_t frame_drops;
+	double cache_duration_min;
+	double cache_duration_max;
+};
+
+int bluray_telemetry_open(struct bluray_telemetry *telemetry, const char *filename, uint64_t interval);
+
+void bluray_telemetry_start(struct bluray_telemetry *telemetry, mpv_handle *mpv, uint32_t title, uint32_t playlist);
+
+void bluray_telemetry_event(struct bluray_telemetry *telemetry, mpv_event *event);
+
+double bluray_telemetry_timeout(struct bluray_telemetry *telemetry);
+
+void bluray_telemetry_sample(struct bluray_telemetry *telemetry, mpv_handle *mpv, uint64_t underruns);
+
+void bluray_telemetry_close(struct bluray_telemetry *telemetry, mpv_handle *mpv, uint64_t underruns, uint64_t seeks);
+
+#endif
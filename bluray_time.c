@@ -51,13 +51,13 @@ uint64_t bluray_chapter_duration(struct bluray *bd, uint32_t title_ix, uint32_t
 	uint32_t chapter_number;
 	chapter_number = chapter_ix + 1;
 
-	if(chapter_number > bluray_title_info->chapter_count)
-		return 0;
+	uint64_t duration = 0;
+	if(chapter_number <= bluray_title_info->chapter_count)
+		duration = bluray_title_info->chapters[chapter_ix].duration;
 
-	struct bd_chapter *bd_chapter = NULL;
-	bd_chapter = &bluray_title_info->chapters[chapter_ix];
+	bd_free_title_info(bluray_title_info);
 
-	return bd_chapter->duration;
+	return duration;
 
 }
 
@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "bluray_trace.h"
+
+#define BLURAY_TRACE_SPANS 1024
+#define BLURAY_TRACE_TIMINGS_MAX 32
+
+struct bluray_trace bluray_trace = { false, 0, NULL, 0, 0 };
+
+static uint64_t bluray_trace_clock(void) {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+
+}
+
+/**
+ * Start recording spans, with times relative to now
+ */
+void bluray_trace_enable(void) {
+
+	bluray_trace.enabled = true;
+	bluray_trace.epoch = bluray_trace_clock();
+
+}
+
+void bluray_trace_free(void) {
+
+	free(bluray_trace.spans);
+	bluray_trace.spans = NULL;
+	bluray_trace.num_spans = 0;
+	bluray_trace.size = 0;
+	bluray_trace.enabled = false;
+
+}
+
+uint64_t bluray_trace_begin(void) {
+
+	if(!bluray_trace.enabled)
+		return 0;
+
+	return bluray_trace_clock();
+
+}
+
+/**
+ * Record a span from start until now. name must be a string literal, it isn't
+ * copied.
+ */
+void bluray_trace_end(const char *name, uint64_t start, uint32_t title_ix, uint32_t chapter_ix) {
+
+	if(!bluray_trace.enabled)
+		return;
+
+	uint64_t end = bluray_trace_clock();
+
+	if(bluray_trace.num_spans == bluray_trace.size) {
+		size_t size = (bluray_trace.size ? bluray_trace.size * 2 : BLURAY_TRACE_SPANS);
+		struct bluray_trace_span *spans = realloc(bluray_trace.spans, size * sizeof(struct bluray_trace_span));
+		if(spans == NULL)
+			return;
+		bluray_trace.spans = spans;
+		bluray_trace.size = size;
+	}
+
+	struct bluray_trace_span *span = &bluray_trace.spans[bluray_trace.num_spans];
+	span->name = name;
+	span->title_ix = title_ix;
+	span->chapter_ix = chapter_ix;
+	span->start = start - bluray_trace.epoch;
+	span->duration = end - start;
+	bluray_trace.num_spans++;
+
+}
+
+/**
+ * Write the spans as Chrome trace-event JSON, using complete ("X") events.
+ * Times are in microseconds. Span names are literals that don't need escaping.
+ */
+int bluray_trace_write(const char *filename) {
+
+	FILE *io = fopen(filename, "w");
+	if(io == NULL) {
+		fprintf(stderr, "Could not open trace file %s\n", filename);
+		return 1;
+	}
+
+	unsigned long pid = (unsigned long)getpid();
+	size_t ix = 0;
+	struct bluray_trace_span *span = NULL;
+
+	fprintf(io, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for(ix = 0; ix < bluray_trace.num_spans; ix++) {
+		span = &bluray_trace.spans[ix];
+		fprintf(io, "{\"name\":\"%s\",\"cat\":\"libbluray\",\"ph\":\"X\",\"ts\":%" PRIu64 ".%03" PRIu64 ",\"dur\":%" PRIu64 ".%03" PRIu64 ",\"pid\":%lu,\"tid\":%lu,\"args\":{", span->name, span->start / 1000, span->start % 1000, span->duration / 1000, span->duration % 1000, pid, pid);
+		if(span->title_ix != BLURAY_TRACE_NONE)
+			fprintf(io, "\"title\":%" PRIu32, span->title_ix + 1);
+		if(span->title_ix != BLURAY_TRACE_NONE && span->chapter_ix != BLURAY_TRACE_NONE)
+			fprintf(io, ",");
+		if(span->chapter_ix != BLURAY_TRACE_NONE)
+			fprintf(io, "\"chapter\":%" PRIu32, span->chapter_ix + 1);
+		fprintf(io, "}}%s\n", (ix + 1 < bluray_trace.num_spans ? "," : ""));
+	}
+	fprintf(io, "]}\n");
+
+	if(fclose(io) != 0) {
+		fprintf(stderr, "Could not write trace file %s\n", filename);
+		return 1;
+	}
+
+	return 0;
+
+}
+
+/**
+ * Display the number of calls, and total, mean and max time of each span name,
+ * in the order they were first called
+ */
+void bluray_trace_timings(FILE *io) {
+
+	struct {
+		const char *name;
+		uint64_t calls;
+		uint64_t total;
+		uint64_t max;
+	} timings[BLURAY_TRACE_TIMINGS_MAX];
+	size_t num_timings = 0;
+	size_t ix = 0;
+	size_t timing_ix = 0;
+	struct bluray_trace_span *span = NULL;
+
+	for(ix = 0; ix < bluray_trace.num_spans; ix++) {
+
+		span = &bluray_trace.spans[ix];
+
+		for(timing_ix = 0; timing_ix < num_timings; timing_ix++) {
+			if(strcmp(timings[timing_ix].name, span->name) == 0)
+				break;
+		}
+
+		if(timing_ix == num_timings) {
+			if(num_timings == BLURAY_TRACE_TIMINGS_MAX)
+				continue;
+			timings[timing_ix].name = span->name;
+			timings[timing_ix].calls = 0;
+			timings[timing_ix].total = 0;
+			timings[timing_ix].max = 0;
+			num_timings++;
+		}
+
+		timings[timing_ix].calls++;
+		timings[timing_ix].total += span->duration;
+		if(span->duration > timings[timing_ix].max)
+			timings[timing_ix].max = span->duration;
+
+	}
+
+	fprintf(io, "%-20s %8s %12s %12s %12s\n", "Call", "Calls", "Total ms", "Mean ms", "Max ms");
+	for(timing_ix = 0; timing_ix < num_timings; timing_ix++) {
+		fprintf(io, "%-20s %8" PRIu64 " %12.3f %12.3f %12.3f\n", timings[timing_ix].name, timings[timing_ix].calls, (double)timings[timing_ix].total / 1000000, (double)timings[timing_ix].total / timings[timing_ix].calls / 1000000, (double)timings[timing_ix].max / 1000000);
+	}
+
+}
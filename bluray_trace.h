@@ -0,0 +1,55 @@
+#ifndef BLURAY_INFO_TRACE_H
+#define BLURAY_INFO_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Timing spans around libbluray calls
+ *
+ * Each call site takes a start time with bluray_trace_begin() and records the
+ * span with bluray_trace_end(), passing the title and chapter it was for (or
+ * BLURAY_TRACE_NONE). While tracing is disabled both return straight away,
+ * without reading the clock.
+ *
+ * The spans can be written as Chrome trace-event JSON, which can be loaded in
+ * Perfetto (ui.perfetto.dev) or chrome://tracing, or summed up per call.
+ *
+ * The span list isn't locked, so only enable it in single threaded programs.
+ */
+
+#define BLURAY_TRACE_NONE UINT32_MAX
+
+struct bluray_trace_span {
+	const char *name;
+	uint32_t title_ix;
+	uint32_t chapter_ix;
+	uint64_t start;
+	uint64_t duration;
+};
+
+struct bluray_trace {
+	bool enabled;
+	uint64_t epoch;
+	struct bluray_trace_span *spans;
+	size_t num_spans;
+	size_t size;
+};
+
+extern struct bluray_trace bluray_trace;
+
+void bluray_trace_enable(void);
+
+void bluray_trace_free(void);
+
+uint64_t bluray_trace_begin(void);
+
+void bluray_trace_end(const char *name, uint64_t start, uint32_t title_ix, uint32_t chapter_ix);
+
+int bluray_trace_write(const char *filename);
+
+void bluray_trace_timings(FILE *io);
+
+#endif
@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <string.h>
+#include "bluray_ts.h"
+
+// The arrival timestamp is the low 30 bits of the packet's extra header, and
+// counts a 27 MHz clock, so it wraps around about every 40 seconds.
+#define BLURAY_TS_ATS_MASK 0x3fffffff
+#define BLURAY_TS_ATS_HALF 0x20000000
+
+#define BLURAY_TS_NULL_PID 0x1fff
+#define BLURAY_TS_NO_COUNTER 0xff
+
+static void bluray_ts_check_reset(struct bluray_ts_check *ts_check) {
+
+	memset(ts_check->continuity, BLURAY_TS_NO_COUNTER, sizeof(ts_check->continuity));
+	ts_check->ats = 0;
+	ts_check->ats_valid = false;
+
+}
+
+/**
+ * Check one source packet, returning true if it's bad. A packet is bad once,
+ * for the first thing wrong with it, and one without a sync byte isn't looked
+ * at any further, since there's nothing else in it to trust.
+ */
+static bool bluray_ts_check_packet(struct bluray_ts_check *ts_check, const uint8_t *packet) {
+
+	if(packet[4] != 0x47) {
+		ts_check->sync_errors++;
+		return true;
+	}
+
+	bool bad = false;
+
+	uint32_t ats = (((uint32_t)packet[0] << 24) | ((uint32_t)packet[1] << 16) | ((uint32_t)packet[2] << 8) | packet[3]) & BLURAY_TS_ATS_MASK;
+	if(ts_check->ats_valid && ((ats - ts_check->ats) & BLURAY_TS_ATS_MASK) >= BLURAY_TS_ATS_HALF) {
+		ts_check->ats_errors++;
+		bad = true;
+	}
+	ts_check->ats = ats;
+	ts_check->ats_valid = true;
+
+	uint16_t pid = (uint16_t)(((packet[5] & 0x1f) << 8) | packet[6]);
+	if(pid == BLURAY_TS_NULL_PID)
+		return bad;
+
+	// The counter only goes up for packets with a payload, and may be
+	// repeated once for a duplicate packet. An adaptation field can say the
+	// counter starts over.
+	uint8_t adaptation_field_control = (packet[7] >> 4) & 0x03;
+	uint8_t counter = packet[7] & 0x0f;
+	uint8_t last_counter = ts_check->continuity[pid];
+	bool discontinuity = (adaptation_field_control & 0x02) && packet[8] > 0 && (packet[9] & 0x80);
+
+	if(last_counter != BLURAY_TS_NO_COUNTER && !discontinuity) {
+		if(adaptation_field_control & 0x01) {
+			if(counter != last_counter && counter != ((last_counter + 1) & 0x0f)) {
+				ts_check->continuity_errors++;
+				bad = true;
+			}
+		} else if(counter != last_counter) {
+			ts_check->continuity_errors++;
+			bad = true;
+		}
+	}
+	ts_check->continuity[pid] = counter;
+
+	return bad;
+
+}
+
+/**
+ * Start checking a title at a position, which is where a chapter range
+ * starts, so it's at the start of a packet.
+ */
+int bluray_ts_check_init(struct bluray_ts_check *ts_check, const struct bluray_title *bluray_title, uint64_t position) {
+
+	memset(ts_check, 0, sizeof(struct bluray_ts_check));
+	bluray_ts_check_reset(ts_check);
+	ts_check->position = position;
+
+	if(bluray_title->clips == 0)
+		return 0;
+
+	ts_check->clip_starts = calloc(bluray_title->clips, sizeof(uint64_t));
+	if(ts_check->clip_starts == NULL)
+		return 1;
+
+	uint64_t clip_start = 0;
+	uint32_t clip_ix = 0;
+	for(clip_ix = 0; clip_ix < bluray_title->clips; clip_ix++) {
+		ts_check->clip_starts[clip_ix] = clip_start;
+		clip_start += (uint64_t)bluray_title->clip_info[clip_ix].pkt_count * BLURAY_TS_PACKET_SIZE;
+	}
+	ts_check->num_clips = bluray_title->clips;
+
+	// Start in the clip the position is in
+	while(ts_check->clip_ix + 1 < ts_check->num_clips && ts_check->clip_starts[ts_check->clip_ix + 1] <= position)
+		ts_check->clip_ix++;
+
+	return 0;
+
+}
+
+/**
+ * Check the next part of the title, returning the number of bad packets in
+ * it. A packet split between two calls is checked once the rest of it
+ * arrives.
+ */
+uint64_t bluray_ts_check(struct bluray_ts_check *ts_check, const uint8_t *buffer, size_t length) {
+
+	uint64_t bad_packets = 0;
+	size_t offset = 0;
+
+	while(offset < length) {
+
+		const uint8_t *packet = buffer + offset;
+		size_t packet_length = BLURAY_TS_PACKET_SIZE;
+
+		if(ts_check->partial_length || length - offset < BLURAY_TS_PACKET_SIZE) {
+			packet_length = BLURAY_TS_PACKET_SIZE - ts_check->partial_length;
+			if(packet_length > length - offset)
+				packet_length = length - offset;
+			memcpy(ts_check->partial + ts_check->partial_length, packet, packet_length);
+			ts_check->partial_length += (uint32_t)packet_length;
+			offset += packet_length;
+			if(ts_check->partial_length < BLURAY_TS_PACKET_SIZE)
+				break;
+			packet = ts_check->partial;
+			ts_check->partial_length = 0;
+		} else {
+			offset += packet_length;
+		}
+
+		if(ts_check->clip_ix + 1 < ts_check->num_clips && ts_check->position >= ts_check->clip_starts[ts_check->clip_ix + 1]) {
+			while(ts_check->clip_ix + 1 < ts_check->num_clips && ts_check->position >= ts_check->clip_starts[ts_check->clip_ix + 1])
+				ts_check->clip_ix++;
+			bluray_ts_check_reset(ts_check);
+		}
+
+		if(bluray_ts_check_packet(ts_check, packet))
+			bad_packets++;
+
+		ts_check->packets++;
+		ts_check->position += BLURAY_TS_PACKET_SIZE;
+
+	}
+
+	ts_check->bad_packets += bad_packets;
+
+	return bad_packets;
+
+}
+
+/**
+ * If more than one packet in 16 is bad once the first part of the title is
+ * checked, it's not a decrypted transport stream. A damaged disc loses a few
+ * packets here and there; one that isn't decrypted loses nearly all of them.
+ */
+bool bluray_ts_check_garbage(const struct bluray_ts_check *ts_check) {
+
+	if(ts_check->packets == 0)
+		return false;
+
+	return ts_check->bad_packets * 16 > ts_check->packets;
+
+}
+
+void bluray_ts_check_free(struct bluray_ts_check *ts_check) {
+
+	free(ts_check->clip_starts);
+	ts_check->clip_starts = NULL;
+	ts_check->num_clips = 0;
+
+}
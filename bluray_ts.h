@@ -0,0 +1,57 @@
+#ifndef BLURAY_INFO_TS_H
+#define BLURAY_INFO_TS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bluray_open.h"
+
+/**
+ * Checking a title's transport stream as it's copied
+ *
+ * A title that wasn't decrypted, or was decrypted with the wrong key, still
+ * reads without errors; it's only garbage. Each 192 byte source packet is
+ * checked for what a decrypted stream always has: the sync byte at the start
+ * of the transport packet, an arrival timestamp that doesn't go backwards
+ * (apart from wrapping around), and a continuity counter that goes up by one
+ * for each packet with a payload on the same PID.
+ *
+ * Only the 8 bytes of each packet's headers are looked at, so checking runs
+ * well ahead of reading. Timestamps and counters start over in each clip, so
+ * the clips' positions in the title come from the title info, and their state
+ * is reset where each one starts.
+ */
+
+#define BLURAY_TS_PACKET_SIZE 192
+#define BLURAY_TS_PIDS 8192
+
+// Amount of the title checked before deciding if it's a transport stream
+// at all, 4 MBs
+#define BLURAY_TS_WINDOW (4 * 1048576)
+
+struct bluray_ts_check {
+	uint64_t position;
+	uint64_t *clip_starts;
+	uint32_t num_clips;
+	uint32_t clip_ix;
+	uint8_t continuity[BLURAY_TS_PIDS];
+	uint32_t ats;
+	bool ats_valid;
+	uint8_t partial[BLURAY_TS_PACKET_SIZE];
+	uint32_t partial_length;
+	uint64_t packets;
+	uint64_t bad_packets;
+	uint64_t sync_errors;
+	uint64_t ats_errors;
+	uint64_t continuity_errors;
+};
+
+int bluray_ts_check_init(struct bluray_ts_check *ts_check, const struct bluray_title *bluray_title, uint64_t position);
+
+uint64_t bluray_ts_check(struct bluray_ts_check *ts_check, const uint8_t *buffer, size_t length);
+
+bool bluray_ts_check_garbage(const struct bluray_ts_check *ts_check);
+
+void bluray_ts_check_free(struct bluray_ts_check *ts_check);
+
+#endif
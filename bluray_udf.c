@@ -0,0 +1,711 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "bluray_udf.h"
+
+// Descriptor tag identifiers (ECMA-167 3/7.2.1 and 4/7.2.1)
+#define BLURAY_UDF_TAG_PD 5
+#define BLURAY_UDF_TAG_AVDP 2
+#define BLURAY_UDF_TAG_LVD 6
+#define BLURAY_UDF_TAG_TD 8
+#define BLURAY_UDF_TAG_FSD 256
+#define BLURAY_UDF_TAG_FID 257
+#define BLURAY_UDF_TAG_AED 258
+#define BLURAY_UDF_TAG_IE 259
+#define BLURAY_UDF_TAG_FE 261
+#define BLURAY_UDF_TAG_EFE 266
+
+#define BLURAY_UDF_FILE_TYPE_DIRECTORY 4
+
+#define BLURAY_UDF_FID_DELETED 0x04
+#define BLURAY_UDF_FID_PARENT 0x08
+
+struct bluray_udf_data {
+	struct bluray_udf_extent *extents;
+	size_t num_extents;
+	size_t extents_size;
+	const uint8_t *embedded;
+	uint64_t length;
+	uint8_t file_type;
+};
+
+static uint16_t bluray_udf_u16(const uint8_t *p) {
+
+	return (uint16_t)(p[0] | p[1] << 8);
+
+}
+
+static uint32_t bluray_udf_u32(const uint8_t *p) {
+
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+
+}
+
+static uint64_t bluray_udf_u64(const uint8_t *p) {
+
+	return (uint64_t)bluray_udf_u32(p) | (uint64_t)bluray_udf_u32(p + 4) << 32;
+
+}
+
+/**
+ * Get a sector if it has a descriptor with the tag identifier, or NULL
+ */
+static const uint8_t *bluray_udf_tag(struct bluray_udf *udf, uint32_t sector, uint16_t tag_id) {
+
+	if((uint64_t)(sector + 1ULL) * BLURAY_UDF_SECTOR > udf->size)
+		return NULL;
+
+	const uint8_t *p = udf->data + (uint64_t)sector * BLURAY_UDF_SECTOR;
+
+	if(bluray_udf_u16(p) != tag_id)
+		return NULL;
+
+	return p;
+
+}
+
+/**
+ * Translate a logical block in a partition to a sector in the image. Blocks in
+ * the metadata partition are looked up in the metadata file's extents.
+ */
+static int bluray_udf_map(struct bluray_udf *udf, uint16_t map, uint32_t block, uint32_t *sector) {
+
+	if(map >= udf->num_maps)
+		return 1;
+
+	if(!udf->metadata_map[map]) {
+		*sector = udf->partition_start + block;
+		return 0;
+	}
+
+	size_t ix = 0;
+	uint32_t blocks = 0;
+	for(ix = 0; ix < udf->num_metadata; ix++) {
+		blocks = (udf->metadata[ix].length + BLURAY_UDF_SECTOR - 1) / BLURAY_UDF_SECTOR;
+		if(block < blocks) {
+			*sector = udf->metadata[ix].sector + block;
+			return 0;
+		}
+		block -= blocks;
+	}
+
+	return 1;
+
+}
+
+static int bluray_udf_add_extent(struct bluray_udf_data *data, uint32_t sector, uint32_t length) {
+
+	struct bluray_udf_extent *last = (data->num_extents ? &data->extents[data->num_extents - 1] : NULL);
+
+	// Join up with the previous extent when it carries on from it
+	if(last != NULL && sector != BLURAY_UDF_UNRECORDED && last->sector != BLURAY_UDF_UNRECORDED && last->length % BLURAY_UDF_SECTOR == 0 && last->sector + last->length / BLURAY_UDF_SECTOR == sector) {
+		last->length += length;
+		return 0;
+	}
+
+	if(data->num_extents == data->extents_size) {
+		size_t size = (data->extents_size ? data->extents_size * 2 : 8);
+		struct bluray_udf_extent *extents = realloc(data->extents, size * sizeof(struct bluray_udf_extent));
+		if(extents == NULL)
+			return 1;
+		data->extents = extents;
+		data->extents_size = size;
+	}
+
+	data->extents[data->num_extents].sector = sector;
+	data->extents[data->num_extents].length = length;
+	data->num_extents++;
+
+	return 0;
+
+}
+
+/**
+ * Add an extent of a file, one block at a time when it's in the metadata
+ * partition, since that can be split up on the disc.
+ */
+static int bluray_udf_add_blocks(struct bluray_udf *udf, struct bluray_udf_data *data, uint16_t map, uint32_t block, uint32_t length, uint8_t extent_type) {
+
+	uint32_t sector = 0;
+	uint32_t chunk = 0;
+
+	if(extent_type != 0)
+		return bluray_udf_add_extent(data, BLURAY_UDF_UNRECORDED, length);
+
+	if(map < udf->num_maps && !udf->metadata_map[map]) {
+		if(bluray_udf_map(udf, map, block, &sector))
+			return 1;
+		return bluray_udf_add_extent(data, sector, length);
+	}
+
+	while(length) {
+		if(bluray_udf_map(udf, map, block, &sector))
+			return 1;
+		chunk = (length > BLURAY_UDF_SECTOR ? BLURAY_UDF_SECTOR : length);
+		if(bluray_udf_add_extent(data, sector, chunk))
+			return 1;
+		length -= chunk;
+		block++;
+	}
+
+	return 0;
+
+}
+
+/**
+ * Read a file entry or extended file entry, and collect the extents of its
+ * data.
+ *
+ * Short allocation descriptors are relative to the partition the entry is in.
+ * Directories in a metadata partition have their data there too, but regular
+ * files always have theirs in the physical partition, which is how libudfread
+ * reads them as well.
+ */
+static int bluray_udf_entry(struct bluray_udf *udf, uint16_t map, uint32_t block, struct bluray_udf_data *data) {
+
+	memset(data, 0, sizeof(struct bluray_udf_data));
+
+	uint32_t sector = 0;
+	const uint8_t *p = NULL;
+	uint8_t indirect = 0;
+
+	// Follow indirect entries, used by write-once discs (strategy 4096)
+	for(indirect = 0; indirect < 8; indirect++) {
+		if(bluray_udf_map(udf, map, block, &sector))
+			return 1;
+		p = bluray_udf_tag(udf, sector, BLURAY_UDF_TAG_IE);
+		if(p == NULL)
+			break;
+		block = bluray_udf_u32(p + 40);
+		map = bluray_udf_u16(p + 44);
+	}
+
+	size_t base = 0;
+	uint32_t ea_length = 0;
+	uint32_t ad_length = 0;
+	if((p = bluray_udf_tag(udf, sector, BLURAY_UDF_TAG_FE)) != NULL) {
+		base = 176;
+		ea_length = bluray_udf_u32(p + 168);
+		ad_length = bluray_udf_u32(p + 172);
+	} else if((p = bluray_udf_tag(udf, sector, BLURAY_UDF_TAG_EFE)) != NULL) {
+		base = 216;
+		ea_length = bluray_udf_u32(p + 208);
+		ad_length = bluray_udf_u32(p + 212);
+	} else {
+		return 1;
+	}
+
+	if(ea_length > BLURAY_UDF_SECTOR || ad_length > BLURAY_UDF_SECTOR || base + ea_length + ad_length > BLURAY_UDF_SECTOR)
+		return 1;
+
+	data->file_type = p[27];
+	data->length = bluray_udf_u64(p + 56);
+
+	uint16_t data_map = map;
+	if(data->file_type != BLURAY_UDF_FILE_TYPE_DIRECTORY)
+		data_map = udf->physical_map;
+
+	uint8_t ad_type = bluray_udf_u16(p + 34) & 0x07;
+	const uint8_t *ad = p + base + ea_length;
+	const uint8_t *ad_end = ad + ad_length;
+
+	// Data embedded in the entry itself
+	if(ad_type == 3) {
+		data->embedded = ad;
+		if(data->length > ad_length)
+			data->length = ad_length;
+		return 0;
+	}
+
+	if(ad_type > 1)
+		return 1;
+
+	size_t ad_size = (ad_type == 0 ? 8 : 16);
+	uint32_t extent_length = 0;
+	uint8_t extent_type = 0;
+	uint32_t extent_block = 0;
+	uint16_t extent_map = 0;
+	uint8_t continuations = 0;
+
+	while(ad + ad_size <= ad_end) {
+
+		extent_length = bluray_udf_u32(ad) & 0x3fffffff;
+		extent_type = (uint8_t)(bluray_udf_u32(ad) >> 30);
+		extent_block = bluray_udf_u32(ad + 4);
+		extent_map = (ad_type == 0 ? data_map : bluray_udf_u16(ad + 8));
+		ad += ad_size;
+
+		if(extent_length == 0)
+			break;
+
+		// The rest of the descriptors are in an allocation extent descriptor
+		if(extent_type == 3) {
+			if(continuations++ == 8 || bluray_udf_map(udf, (ad_type == 0 ? map : extent_map), extent_block, &sector))
+				return 1;
+			p = bluray_udf_tag(udf, sector, BLURAY_UDF_TAG_AED);
+			if(p == NULL || bluray_udf_u32(p + 20) > BLURAY_UDF_SECTOR - 24)
+				return 1;
+			ad = p + 24;
+			ad_end = ad + bluray_udf_u32(p + 20);
+			continue;
+		}
+
+		if(ad_type == 1 && data->file_type != BLURAY_UDF_FILE_TYPE_DIRECTORY && extent_map < udf->num_maps && udf->metadata_map[extent_map])
+			extent_map = udf->physical_map;
+
+		if(bluray_udf_add_blocks(udf, data, extent_map, extent_block, extent_length, extent_type))
+			return 1;
+
+	}
+
+	return 0;
+
+}
+
+/**
+ * Get a pointer to a file's data. If it isn't in one piece in the image, it's
+ * copied into a new buffer, which is returned in copy as well.
+ */
+static int bluray_udf_read(struct bluray_udf *udf, struct bluray_udf_data *data, const uint8_t **buffer, size_t *length, uint8_t **copy) {
+
+	*copy = NULL;
+
+	if(data->embedded != NULL) {
+		*buffer = data->embedded;
+		*length = (size_t)data->length;
+		return 0;
+	}
+
+	size_t ix = 0;
+	uint64_t available = 0;
+	for(ix = 0; ix < data->num_extents; ix++) {
+		if(data->extents[ix].sector != BLURAY_UDF_UNRECORDED && (uint64_t)data->extents[ix].sector * BLURAY_UDF_SECTOR + data->extents[ix].length > udf->size)
+			return 1;
+		available += data->extents[ix].length;
+	}
+
+	if(data->length > available || data->length > SIZE_MAX)
+		return 1;
+
+	*length = (size_t)data->length;
+
+	if(data->length == 0) {
+		*buffer = udf->data;
+		return 0;
+	}
+
+	if(data->extents[0].sector != BLURAY_UDF_UNRECORDED && data->extents[0].length >= data->length) {
+		*buffer = udf->data + (uint64_t)data->extents[0].sector * BLURAY_UDF_SECTOR;
+		return 0;
+	}
+
+	uint8_t *p = malloc(*length);
+	if(p == NULL)
+		return 1;
+
+	size_t offset = 0;
+	size_t chunk = 0;
+	for(ix = 0; ix < data->num_extents && offset < *length; ix++) {
+		chunk = data->extents[ix].length;
+		if(chunk > *length - offset)
+			chunk = *length - offset;
+		if(data->extents[ix].sector == BLURAY_UDF_UNRECORDED)
+			memset(p + offset, 0, chunk);
+		else
+			memcpy(p + offset, udf->data + (uint64_t)data->extents[ix].sector * BLURAY_UDF_SECTOR, chunk);
+		offset += chunk;
+	}
+
+	*buffer = p;
+	*copy = p;
+
+	return 0;
+
+}
+
+/**
+ * Decode a file identifier, which is OSTA compressed unicode: 8 or 16 bits per
+ * character, depending on the first byte. Characters outside of ASCII are
+ * replaced, Blu-ray filenames don't have any.
+ */
+static void bluray_udf_name(const uint8_t *p, uint8_t length, char *name) {
+
+	size_t ix = 0;
+	size_t name_ix = 0;
+	uint16_t c = 0;
+	uint8_t step = (p[0] == 16 ? 2 : 1);
+
+	for(ix = 1; ix + step <= length && name_ix < BLURAY_UDF_NAME_MAX - 1; ix += step) {
+		c = (step == 2 ? (uint16_t)(p[ix] << 8 | p[ix + 1]) : p[ix]);
+		name[name_ix++] = (c > 0 && c < 0x80 ? (char)c : '?');
+	}
+
+	name[name_ix] = '\0';
+
+}
+
+/**
+ * Parse the file identifier descriptor at offset in a directory. Returns the
+ * offset of the next one, or 0 at the end or if it's invalid.
+ */
+static size_t bluray_udf_fid(const uint8_t *dir, size_t length, size_t offset, char *name, uint8_t *characteristics, uint16_t *map, uint32_t *block) {
+
+	if(offset + 38 > length)
+		return 0;
+
+	const uint8_t *p = dir + offset;
+
+	if(bluray_udf_u16(p) != BLURAY_UDF_TAG_FID)
+		return 0;
+
+	uint8_t name_length = p[19];
+	uint16_t iu_length = bluray_udf_u16(p + 36);
+	size_t fid_length = (38 + (size_t)iu_length + name_length + 3) & ~(size_t)3;
+
+	if(offset + 38 + iu_length + name_length > length)
+		return 0;
+
+	*characteristics = p[18];
+	*block = bluray_udf_u32(p + 24);
+	*map = bluray_udf_u16(p + 28);
+
+	if(name_length)
+		bluray_udf_name(p + 38 + iu_length, name_length, name);
+	else
+		name[0] = '\0';
+
+	return offset + fid_length;
+
+}
+
+/**
+ * Find the entry for a path, relative to the root directory
+ */
+static int bluray_udf_lookup(struct bluray_udf *udf, const char *path, uint16_t *map, uint32_t *block) {
+
+	*map = udf->root_map;
+	*block = udf->root_block;
+
+	struct bluray_udf_data data;
+	const uint8_t *dir = NULL;
+	size_t dir_length = 0;
+	uint8_t *copy = NULL;
+	size_t offset = 0;
+	size_t next = 0;
+	size_t component_length = 0;
+	char name[BLURAY_UDF_NAME_MAX];
+	uint8_t characteristics = 0;
+	uint16_t entry_map = 0;
+	uint32_t entry_block = 0;
+	bool found = false;
+
+	while(*path) {
+
+		while(*path == '/')
+			path++;
+		if(*path == '\0')
+			break;
+
+		component_length = strcspn(path, "/");
+
+		if(bluray_udf_entry(udf, *map, *block, &data) || data.file_type != BLURAY_UDF_FILE_TYPE_DIRECTORY || bluray_udf_read(udf, &data, &dir, &dir_length, &copy)) {
+			free(data.extents);
+			return 1;
+		}
+
+		found = false;
+		for(offset = 0; (next = bluray_udf_fid(dir, dir_length, offset, name, &characteristics, &entry_map, &entry_block)) != 0; offset = next) {
+			if(characteristics & (BLURAY_UDF_FID_DELETED | BLURAY_UDF_FID_PARENT))
+				continue;
+			if(strlen(name) == component_length && strncasecmp(name, path, component_length) == 0) {
+				*map = entry_map;
+				*block = entry_block;
+				found = true;
+				break;
+			}
+		}
+
+		free(copy);
+		free(data.extents);
+
+		if(!found)
+			return 1;
+
+		path += component_length;
+
+	}
+
+	return 0;
+
+}
+
+/**
+ * Read the volume descriptor sequence: the partition and the logical volume,
+ * with its partition maps and where its file set descriptor is.
+ */
+static int bluray_udf_vds(struct bluray_udf *udf, uint32_t sector, uint32_t length, uint16_t *fsd_map, uint32_t *fsd_block, uint32_t *metadata_file, uint32_t *metadata_mirror) {
+
+	const uint8_t *p = NULL;
+	bool partition = false;
+	bool volume = false;
+	uint32_t end = sector + length / BLURAY_UDF_SECTOR;
+	uint32_t num_maps = 0;
+	uint32_t map_ix = 0;
+	const uint8_t *map = NULL;
+	const uint8_t *maps_end = NULL;
+
+	for(; sector < end && !(partition && volume); sector++) {
+
+		if((p = bluray_udf_tag(udf, sector, BLURAY_UDF_TAG_TD)) != NULL)
+			break;
+
+		if(!partition && (p = bluray_udf_tag(udf, sector, BLURAY_UDF_TAG_PD)) != NULL) {
+			udf->partition_start = bluray_udf_u32(p + 188);
+			udf->partition_length = bluray_udf_u32(p + 192);
+			partition = true;
+			continue;
+		}
+
+		if(!volume && (p = bluray_udf_tag(udf, sector, BLURAY_UDF_TAG_LVD)) != NULL) {
+
+			if(bluray_udf_u32(p + 212) != BLURAY_UDF_SECTOR)
+				return 1;
+
+			*fsd_block = bluray_udf_u32(p + 252);
+			*fsd_map = bluray_udf_u16(p + 256);
+			num_maps = bluray_udf_u32(p + 268);
+
+			map = p + 440;
+			maps_end = p + BLURAY_UDF_SECTOR;
+			udf->num_maps = 0;
+			for(map_ix = 0; map_ix < num_maps && map_ix < BLURAY_UDF_MAPS && map + 2 <= maps_end && map[1] && map + map[1] <= maps_end; map_ix++) {
+				udf->metadata_map[map_ix] = false;
+				if(map[0] == 2 && map[1] >= 52 && memcmp(map + 5, "*UDF Metadata Partition", 23) == 0) {
+					udf->metadata_map[map_ix] = true;
+					*metadata_file = bluray_udf_u32(map + 40);
+					*metadata_mirror = bluray_udf_u32(map + 44);
+				} else if(map[0] != 1) {
+					// Virtual and sparable partitions aren't used on BD-ROMs
+					return 1;
+				} else {
+					udf->physical_map = (uint16_t)map_ix;
+				}
+				udf->num_maps++;
+				map += map[1];
+			}
+
+			volume = true;
+
+		}
+
+	}
+
+	return (partition && volume && udf->num_maps ? 0 : 1);
+
+}
+
+int bluray_udf_open(struct bluray_udf *udf, const uint8_t *data, size_t size) {
+
+	memset(udf, 0, sizeof(struct bluray_udf));
+	udf->data = data;
+	udf->size = size;
+
+	// Anchor volume descriptor pointer
+	const uint8_t *p = bluray_udf_tag(udf, 256, BLURAY_UDF_TAG_AVDP);
+	if(p == NULL)
+		return 1;
+
+	uint16_t fsd_map = 0;
+	uint32_t fsd_block = 0;
+	uint32_t metadata_file = 0;
+	uint32_t metadata_mirror = 0;
+
+	// Main volume descriptor sequence, or the reserve one
+	if(bluray_udf_vds(udf, bluray_udf_u32(p + 20), bluray_udf_u32(p + 16), &fsd_map, &fsd_block, &metadata_file, &metadata_mirror) && bluray_udf_vds(udf, bluray_udf_u32(p + 28), bluray_udf_u32(p + 24), &fsd_map, &fsd_block, &metadata_file, &metadata_mirror))
+		return 1;
+
+	// The metadata partition is made up of the metadata file's extents
+	struct bluray_udf_data metadata;
+	uint16_t map_ix = 0;
+	for(map_ix = 0; map_ix < udf->num_maps; map_ix++) {
+		if(!udf->metadata_map[map_ix])
+			continue;
+		if(bluray_udf_entry(udf, udf->physical_map, metadata_file, &metadata) || metadata.embedded != NULL) {
+			free(metadata.extents);
+			if(bluray_udf_entry(udf, udf->physical_map, metadata_mirror, &metadata) || metadata.embedded != NULL) {
+				free(metadata.extents);
+				return 1;
+			}
+		}
+		udf->metadata = metadata.extents;
+		udf->num_metadata = metadata.num_extents;
+		break;
+	}
+
+	// File set descriptor, which has the root directory
+	uint32_t sector = 0;
+	if(bluray_udf_map(udf, fsd_map, fsd_block, &sector) || (p = bluray_udf_tag(udf, sector, BLURAY_UDF_TAG_FSD)) == NULL) {
+		bluray_udf_close(udf);
+		return 1;
+	}
+
+	udf->root_block = bluray_udf_u32(p + 404);
+	udf->root_map = bluray_udf_u16(p + 408);
+
+	return 0;
+
+}
+
+void bluray_udf_close(struct bluray_udf *udf) {
+
+	free(udf->metadata);
+	udf->metadata = NULL;
+	udf->num_metadata = 0;
+
+}
+
+/**
+ * Get the contents of a file. data points into the image, unless the file had
+ * to be put together from several extents, in which case it's also returned
+ * in copy, to be freed afterwards.
+ */
+int bluray_udf_file(struct bluray_udf *udf, const char *filename, const uint8_t **data, size_t *length, uint8_t **copy) {
+
+	uint16_t map = 0;
+	uint32_t block = 0;
+	struct bluray_udf_data entry;
+
+	*copy = NULL;
+
+	if(bluray_udf_lookup(udf, filename, &map, &block))
+		return 1;
+
+	if(bluray_udf_entry(udf, map, block, &entry) || entry.file_type == BLURAY_UDF_FILE_TYPE_DIRECTORY || bluray_udf_read(udf, &entry, data, length, copy)) {
+		free(entry.extents);
+		return 1;
+	}
+
+	free(entry.extents);
+
+	return 0;
+
+}
+
+/**
+ * Get where a file is in the image, for reading it without mapping it, like
+ * the stream files. Unrecorded extents have BLURAY_UDF_UNRECORDED for a
+ * sector. The extents are to be freed afterwards.
+ */
+int bluray_udf_extents(struct bluray_udf *udf, const char *filename, struct bluray_udf_extent **extents, size_t *num_extents, uint64_t *length) {
+
+	uint16_t map = 0;
+	uint32_t block = 0;
+	struct bluray_udf_data entry;
+	uint64_t available = 0;
+	size_t ix = 0;
+
+	*extents = NULL;
+	*num_extents = 0;
+
+	if(bluray_udf_lookup(udf, filename, &map, &block))
+		return 1;
+
+	// Files embedded in their entry aren't in any extent
+	if(bluray_udf_entry(udf, map, block, &entry) || entry.file_type == BLURAY_UDF_FILE_TYPE_DIRECTORY || entry.embedded != NULL) {
+		free(entry.extents);
+		return 1;
+	}
+
+	for(ix = 0; ix < entry.num_extents; ix++) {
+		if(entry.extents[ix].sector != BLURAY_UDF_UNRECORDED && (uint64_t)entry.extents[ix].sector * BLURAY_UDF_SECTOR + entry.extents[ix].length > udf->size) {
+			free(entry.extents);
+			return 1;
+		}
+		available += entry.extents[ix].length;
+	}
+
+	if(entry.length > available) {
+		free(entry.extents);
+		return 1;
+	}
+
+	*extents = entry.extents;
+	*num_extents = entry.num_extents;
+	*length = entry.length;
+
+	return 0;
+
+}
+
+/**
+ * List the names in a directory, in the order they are recorded, leaving out
+ * the parent directory and deleted entries
+ */
+int bluray_udf_dir(struct bluray_udf *udf, const char *dirname, char ***names, size_t *num_names) {
+
+	uint16_t map = 0;
+	uint32_t block = 0;
+	struct bluray_udf_data entry;
+	const uint8_t *dir = NULL;
+	size_t dir_length = 0;
+	uint8_t *copy = NULL;
+
+	*names = NULL;
+	*num_names = 0;
+
+	if(bluray_udf_lookup(udf, dirname, &map, &block))
+		return 1;
+
+	if(bluray_udf_entry(udf, map, block, &entry) || entry.file_type != BLURAY_UDF_FILE_TYPE_DIRECTORY || bluray_udf_read(udf, &entry, &dir, &dir_length, &copy)) {
+		free(entry.extents);
+		return 1;
+	}
+
+	free(entry.extents);
+
+	size_t offset = 0;
+	size_t next = 0;
+	size_t size = 0;
+	char name[BLURAY_UDF_NAME_MAX];
+	uint8_t characteristics = 0;
+	uint16_t entry_map = 0;
+	uint32_t entry_block = 0;
+	char **p = NULL;
+	int retval = 0;
+
+	for(offset = 0; (next = bluray_udf_fid(dir, dir_length, offset, name, &characteristics, &entry_map, &entry_block)) != 0; offset = next) {
+
+		if(characteristics & (BLURAY_UDF_FID_DELETED | BLURAY_UDF_FID_PARENT))
+			continue;
+
+		if(*num_names == size) {
+			size = (size ? size * 2 : 64);
+			p = realloc(*names, size * sizeof(char *));
+			if(p == NULL) {
+				retval = 1;
+				break;
+			}
+			*names = p;
+		}
+
+		(*names)[*num_names] = strdup(name);
+		if((*names)[*num_names] == NULL) {
+			retval = 1;
+			break;
+		}
+		(*num_names)++;
+
+	}
+
+	free(copy);
+
+	if(retval) {
+		while(*num_names)
+			free((*names)[--(*num_names)]);
+		free(*names);
+		*names = NULL;
+	}
+
+	return retval;
+
+}
@@ -0,0 +1,57 @@
+#ifndef BLURAY_INFO_UDF_H
+#define BLURAY_INFO_UDF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Minimal read-only UDF reader, for looking up files in a Blu-ray image
+ *
+ * The image is mapped into memory by the caller, and files that are recorded
+ * in one extent are returned as pointers into it, without copying. Only what
+ * BD-ROM images use is supported: 2048 byte sectors, one physical partition,
+ * and optionally a UDF 2.50 metadata partition, which holds the file entries
+ * and directories.
+ *
+ * Directory entries are listed in the order they are recorded, which is the
+ * order libbluray (through libudfread) reads them in as well.
+ */
+
+#define BLURAY_UDF_SECTOR 2048
+#define BLURAY_UDF_MAPS 4
+#define BLURAY_UDF_NAME_MAX 256
+
+// Extents that are allocated but not recorded read back as zeros
+#define BLURAY_UDF_UNRECORDED UINT32_MAX
+
+struct bluray_udf_extent {
+	uint32_t sector;
+	uint32_t length;
+};
+
+struct bluray_udf {
+	const uint8_t *data;
+	size_t size;
+	uint32_t partition_start;
+	uint32_t partition_length;
+	uint8_t num_maps;
+	bool metadata_map[BLURAY_UDF_MAPS];
+	uint16_t physical_map;
+	struct bluray_udf_extent *metadata;
+	size_t num_metadata;
+	uint32_t root_block;
+	uint16_t root_map;
+};
+
+int bluray_udf_open(struct bluray_udf *udf, const uint8_t *data, size_t size);
+
+void bluray_udf_close(struct bluray_udf *udf);
+
+int bluray_udf_file(struct bluray_udf *udf, const char *filename, const uint8_t **data, size_t *length, uint8_t **copy);
+
+int bluray_udf_extents(struct bluray_udf *udf, const char *filename, struct bluray_udf_extent **extents, size_t *num_extents, uint64_t *length);
+
+int bluray_udf_dir(struct bluray_udf *udf, const char *dirname, char ***names, size_t *num_names);
+
+#endif
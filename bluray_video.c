@@ -154,3 +154,23 @@ void bluray_video_aspect_ratio(char *str, uint8_t aspect) {
 	}
 
 }
+
+/**
+ * Fill in everything displayed about a video stream, with libbluray's codes
+ * for its enumerated values along with their names
+ */
+void bluray_video_stream(struct bluray_handle_video *video, const BLURAY_STREAM_INFO *bd_stream) {
+
+	memset(video, 0, sizeof(struct bluray_handle_video));
+	video->pid = bd_stream->pid;
+	video->coding_type = bd_stream->coding_type;
+	bluray_video_codec(video->codec, bd_stream->coding_type);
+	bluray_video_codec_name(video->codec_name, bd_stream->coding_type);
+	bluray_video_format(video->format, bd_stream->format);
+	video->framerate = bluray_video_framerate(bd_stream->rate);
+	bluray_video_aspect_ratio(video->aspect_ratio, bd_stream->aspect);
+	video->format_code = bd_stream->format;
+	video->rate_code = bd_stream->rate;
+	video->aspect_ratio_code = bd_stream->aspect;
+
+}
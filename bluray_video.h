@@ -4,6 +4,7 @@
 #include <string.h>
 #include "libbluray/bluray.h"
 #include "libbluray/bluray-version.h"
+#include "bluray_handle.h"
 
 #define BLURAY_UHD_MIN_VER 10002	// HEVC and 2160p support was added in libbluray 1.0.2
 
@@ -30,4 +31,6 @@ double bluray_video_framerate(uint8_t rate);
 
 void bluray_video_aspect_ratio(char *str, uint8_t aspect);
 
+void bluray_video_stream(struct bluray_handle_video *video, const BLURAY_STREAM_INFO *bd_stream);
+
 #endif
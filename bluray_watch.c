@@ -0,0 +1,658 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "config.h"
+#include "bluray_watch.h"
+#include "bluray_batch.h"
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+void bluray_watch_init(struct bluray_watch *watch, const char *dirname, const char *key_db_filename) {
+
+	watch->dirname = dirname;
+	watch->index_filename = NULL;
+	watch->key_db_filename = key_db_filename;
+	watch->jobs = 0;
+	watch->timeout = BLURAY_BATCH_TIMEOUT;
+	watch->settle = BLURAY_WATCH_SETTLE;
+	watch->fd = -1;
+	watch->entries = NULL;
+	watch->num_entries = 0;
+	watch->dirs = NULL;
+	watch->num_dirs = 0;
+	watch->pending = NULL;
+	watch->num_pending = 0;
+	watch->changed = false;
+
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+#define BLURAY_WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE)
+
+/**
+ * Read a JSON string starting at its opening quote into dest. Returns a
+ * pointer past the closing quote, or NULL if it isn't a valid string.
+ *
+ * Only the escapes the JSON writer produces are handled.
+ */
+static const char *bluray_watch_json_string(const char *str, char *dest, size_t size) {
+
+	if(*str != '"')
+		return NULL;
+	str++;
+
+	size_t length = 0;
+	char c = '\0';
+	char hex[3];
+	hex[2] = '\0';
+
+	while(*str != '"') {
+
+		if(*str == '\0' || length + 1 >= size)
+			return NULL;
+
+		c = *str++;
+
+		if(c == '\\') {
+			c = *str++;
+			switch(c) {
+				case 'b': c = '\b'; break;
+				case 'f': c = '\f'; break;
+				case 'n': c = '\n'; break;
+				case 'r': c = '\r'; break;
+				case 't': c = '\t'; break;
+				case 'u':
+					if(strncmp(str, "00", 2) != 0 || str[2] == '\0' || str[3] == '\0')
+						return NULL;
+					hex[0] = str[2];
+					hex[1] = str[3];
+					c = (char)strtol(hex, NULL, 16);
+					str += 4;
+					break;
+				case '"':
+				case '\\':
+				case '/':
+					break;
+				default:
+					return NULL;
+			}
+		}
+
+		dest[length++] = c;
+
+	}
+
+	dest[length] = '\0';
+
+	return str + 1;
+
+}
+
+/**
+ * Get the id and path from the start of a record: {"id":"...","path":"..."
+ */
+static int bluray_watch_record_keys(const char *record, char *id, char *path) {
+
+	if(strncmp(record, "{\"id\":", 6) != 0)
+		return 1;
+
+	record = bluray_watch_json_string(record + 6, id, PATH_MAX);
+	if(record == NULL || strncmp(record, ",\"path\":", 8) != 0)
+		return 1;
+
+	record = bluray_watch_json_string(record + 8, path, PATH_MAX);
+	if(record == NULL)
+		return 1;
+
+	return 0;
+
+}
+
+static void bluray_watch_entry_free(struct bluray_watch_entry *entry) {
+
+	free(entry->id);
+	free(entry->path);
+	free(entry->record);
+
+}
+
+/**
+ * Drop the entry for path, and everything under it if it's a directory
+ */
+static void bluray_watch_drop(struct bluray_watch *watch, const char *path) {
+
+	size_t path_length = strlen(path);
+	size_t ix = 0;
+	struct bluray_watch_entry *entry = NULL;
+
+	while(ix < watch->num_entries) {
+		entry = &watch->entries[ix];
+		if(strncmp(entry->path, path, path_length) == 0 && (entry->path[path_length] == '\0' || entry->path[path_length] == '/')) {
+			fprintf(stderr, "Removed %s\n", entry->path);
+			bluray_watch_entry_free(entry);
+			watch->entries[ix] = watch->entries[--watch->num_entries];
+			watch->changed = true;
+			continue;
+		}
+		ix++;
+	}
+
+}
+
+/**
+ * Add or replace an index entry. Entries are keyed by path, since two copies
+ * of a disc have the same id. A disc that moves is dropped from its old path
+ * and scanned again at the new one.
+ */
+static int bluray_watch_set(struct bluray_watch *watch, const char *record, size_t length) {
+
+	char id[PATH_MAX];
+	char path[PATH_MAX];
+
+	if(bluray_watch_record_keys(record, id, path))
+		return 1;
+
+	size_t ix = 0;
+	struct bluray_watch_entry *entry = NULL;
+
+	while(ix < watch->num_entries) {
+		entry = &watch->entries[ix];
+		if(strcmp(entry->path, path) == 0) {
+			bluray_watch_entry_free(entry);
+			watch->entries[ix] = watch->entries[--watch->num_entries];
+			continue;
+		}
+		ix++;
+	}
+
+	struct bluray_watch_entry *entries = realloc(watch->entries, (watch->num_entries + 1) * sizeof(struct bluray_watch_entry));
+	if(entries == NULL)
+		return 1;
+	watch->entries = entries;
+
+	entry = &watch->entries[watch->num_entries];
+	entry->id = strdup(id);
+	entry->path = strdup(path);
+	entry->record = malloc(length);
+	entry->length = length;
+	if(entry->id == NULL || entry->path == NULL || entry->record == NULL) {
+		bluray_watch_entry_free(entry);
+		return 1;
+	}
+	memcpy(entry->record, record, length);
+	watch->num_entries++;
+	watch->changed = true;
+
+	return 0;
+
+}
+
+static void bluray_watch_record(const char *path, const char *record, size_t length, void *user_data) {
+
+	struct bluray_watch *watch = user_data;
+
+	if(bluray_watch_set(watch, record, length))
+		fprintf(stderr, "Could not add %s to the index\n", path);
+	else
+		fprintf(stderr, "Indexed %s\n", path);
+
+}
+
+static int bluray_watch_load(struct bluray_watch *watch) {
+
+	FILE *io = fopen(watch->index_filename, "r");
+	if(io == NULL)
+		return (errno == ENOENT ? 0 : 1);
+
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t length = 0;
+
+	while((length = getline(&line, &size, io)) > 0) {
+		if(line[length - 1] != '\n')
+			break;
+		bluray_watch_set(watch, line, (size_t)length);
+	}
+
+	free(line);
+	fclose(io);
+
+	watch->changed = false;
+
+	return 0;
+
+}
+
+/**
+ * Replace the index file with the current entries
+ */
+static int bluray_watch_save(struct bluray_watch *watch) {
+
+	char tmp_filename[PATH_MAX];
+	if(snprintf(tmp_filename, PATH_MAX, "%s.tmp", watch->index_filename) >= PATH_MAX)
+		return 1;
+
+	FILE *io = fopen(tmp_filename, "w");
+	if(io == NULL) {
+		fprintf(stderr, "Could not write index %s: %s\n", tmp_filename, strerror(errno));
+		return 1;
+	}
+
+	size_t ix = 0;
+	for(ix = 0; ix < watch->num_entries; ix++)
+		fwrite(watch->entries[ix].record, 1, watch->entries[ix].length, io);
+
+	if(fflush(io) || fsync(fileno(io)) || fclose(io) || rename(tmp_filename, watch->index_filename)) {
+		fprintf(stderr, "Could not write index %s: %s\n", watch->index_filename, strerror(errno));
+		unlink(tmp_filename);
+		return 1;
+	}
+
+	watch->changed = false;
+
+	return 0;
+
+}
+
+/**
+ * Watch a directory and everything under it
+ */
+static void bluray_watch_add_dir(struct bluray_watch *watch, const char *dirname) {
+
+	int wd = inotify_add_watch(watch->fd, dirname, BLURAY_WATCH_EVENTS | IN_ONLYDIR | IN_DONT_FOLLOW);
+	if(wd < 0) {
+		fprintf(stderr, "Could not watch %s: %s\n", dirname, strerror(errno));
+		return;
+	}
+
+	// The same directory gives the same descriptor if it's added again
+	size_t ix = 0;
+	for(ix = 0; ix < watch->num_dirs; ix++) {
+		if(watch->dirs[ix].wd == wd)
+			break;
+	}
+
+	if(ix == watch->num_dirs) {
+		struct bluray_watch_dir *dirs = realloc(watch->dirs, (watch->num_dirs + 1) * sizeof(struct bluray_watch_dir));
+		if(dirs == NULL)
+			return;
+		watch->dirs = dirs;
+		watch->dirs[ix].wd = wd;
+		watch->dirs[ix].path = NULL;
+		watch->num_dirs++;
+	}
+
+	free(watch->dirs[ix].path);
+	watch->dirs[ix].path = strdup(dirname);
+
+	DIR *dir = opendir(dirname);
+	if(dir == NULL)
+		return;
+
+	struct dirent *entry = NULL;
+	struct stat entry_stat;
+	char filename[PATH_MAX];
+
+	while((entry = readdir(dir)) != NULL) {
+		if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			continue;
+		if(snprintf(filename, PATH_MAX, "%s/%s", dirname, entry->d_name) >= PATH_MAX)
+			continue;
+		if(lstat(filename, &entry_stat) == 0 && S_ISDIR(entry_stat.st_mode))
+			bluray_watch_add_dir(watch, filename);
+	}
+
+	closedir(dir);
+
+}
+
+static void bluray_watch_remove_dir(struct bluray_watch *watch, int wd) {
+
+	size_t ix = 0;
+	for(ix = 0; ix < watch->num_dirs; ix++) {
+		if(watch->dirs[ix].wd == wd) {
+			free(watch->dirs[ix].path);
+			watch->dirs[ix] = watch->dirs[--watch->num_dirs];
+			return;
+		}
+	}
+
+}
+
+static const char *bluray_watch_dir_path(struct bluray_watch *watch, int wd) {
+
+	size_t ix = 0;
+	for(ix = 0; ix < watch->num_dirs; ix++) {
+		if(watch->dirs[ix].wd == wd)
+			return watch->dirs[ix].path;
+	}
+
+	return NULL;
+
+}
+
+/**
+ * Schedule a path to be scanned once it has settled. Another event for the
+ * same path pushes it back.
+ */
+static void bluray_watch_queue(struct bluray_watch *watch, const char *path, time_t due) {
+
+	size_t ix = 0;
+	for(ix = 0; ix < watch->num_pending; ix++) {
+		if(strcmp(watch->pending[ix].path, path) == 0) {
+			watch->pending[ix].due = due;
+			return;
+		}
+	}
+
+	struct bluray_watch_pending *pending = realloc(watch->pending, (watch->num_pending + 1) * sizeof(struct bluray_watch_pending));
+	if(pending == NULL)
+		return;
+	watch->pending = pending;
+	watch->pending[watch->num_pending].path = strdup(path);
+	watch->pending[watch->num_pending].due = due;
+	if(watch->pending[watch->num_pending].path != NULL)
+		watch->num_pending++;
+
+}
+
+/**
+ * Stop waiting on a path and anything under it
+ */
+static void bluray_watch_unqueue(struct bluray_watch *watch, const char *path) {
+
+	size_t path_length = strlen(path);
+	size_t ix = 0;
+
+	while(ix < watch->num_pending) {
+		if(strncmp(watch->pending[ix].path, path, path_length) == 0 && (watch->pending[ix].path[path_length] == '\0' || watch->pending[ix].path[path_length] == '/')) {
+			free(watch->pending[ix].path);
+			watch->pending[ix] = watch->pending[--watch->num_pending];
+			continue;
+		}
+		ix++;
+	}
+
+}
+
+static bool bluray_watch_iso(const char *filename) {
+
+	size_t length = strlen(filename);
+
+	return (length > 4 && strcasecmp(filename + length - 4, ".iso") == 0);
+
+}
+
+/**
+ * If path is inside a disc folder, set root to the folder, the parent of its
+ * BDMV directory
+ */
+static bool bluray_watch_disc_root(const char *path, char *root) {
+
+	const char *bdmv = strstr(path, "/BDMV");
+
+	while(bdmv != NULL && bdmv[5] != '\0' && bdmv[5] != '/')
+		bdmv = strstr(bdmv + 1, "/BDMV");
+
+	if(bdmv == NULL || bdmv == path)
+		return false;
+
+	memcpy(root, path, (size_t)(bdmv - path));
+	root[bdmv - path] = '\0';
+
+	return true;
+
+}
+
+/**
+ * Compare the index with what's on disk: drop entries that are gone, and
+ * queue discs that aren't indexed yet
+ */
+static void bluray_watch_reconcile(struct bluray_watch *watch, time_t now) {
+
+	struct stat path_stat;
+	size_t ix = 0;
+
+	while(ix < watch->num_entries) {
+		if(stat(watch->entries[ix].path, &path_stat)) {
+			bluray_watch_drop(watch, watch->entries[ix].path);
+			continue;
+		}
+		ix++;
+	}
+
+	struct bluray_batch bluray_batch;
+	bluray_batch_init(&bluray_batch, watch->key_db_filename);
+	bluray_batch_find(&bluray_batch, watch->dirname);
+
+	size_t entry_ix = 0;
+	for(ix = 0; ix < bluray_batch.num_paths; ix++) {
+		for(entry_ix = 0; entry_ix < watch->num_entries; entry_ix++) {
+			if(strcmp(watch->entries[entry_ix].path, bluray_batch.paths[ix]) == 0)
+				break;
+		}
+		if(entry_ix == watch->num_entries)
+			bluray_watch_queue(watch, bluray_batch.paths[ix], now);
+	}
+
+	bluray_batch_free(&bluray_batch);
+
+}
+
+static void bluray_watch_event(struct bluray_watch *watch, const struct inotify_event *event, time_t now) {
+
+	if(event->mask & IN_Q_OVERFLOW) {
+		// Events were lost, so compare the index with the directory again
+		bluray_watch_reconcile(watch, now);
+		return;
+	}
+
+	if(event->mask & IN_IGNORED) {
+		bluray_watch_remove_dir(watch, event->wd);
+		return;
+	}
+
+	const char *dirname = bluray_watch_dir_path(watch, event->wd);
+	if(dirname == NULL || event->len == 0)
+		return;
+
+	char path[PATH_MAX];
+	char root[PATH_MAX];
+	if(snprintf(path, PATH_MAX, "%s/%s", dirname, event->name) >= PATH_MAX)
+		return;
+
+	bool is_dir = (event->mask & IN_ISDIR);
+	bool removed = (event->mask & (IN_DELETE | IN_MOVED_FROM));
+	time_t due = now + (time_t)watch->settle;
+
+	if(is_dir && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+		bluray_watch_add_dir(watch, path);
+
+	// Anything changing inside a disc folder means scanning it again, unless
+	// the whole BDMV directory or the folder itself is gone
+	if(bluray_watch_disc_root(path, root)) {
+		if(removed && is_dir && strlen(path) == strlen(root) + 5) {
+			bluray_watch_unqueue(watch, root);
+			bluray_watch_drop(watch, root);
+		} else {
+			bluray_watch_queue(watch, root, due);
+		}
+		return;
+	}
+
+	if(removed) {
+		bluray_watch_unqueue(watch, path);
+		bluray_watch_drop(watch, path);
+		return;
+	}
+
+	// A directory being created is empty, its contents will have their own
+	// events. One that is moved in is complete, and is searched for discs.
+	if(is_dir && (event->mask & IN_MOVED_TO))
+		bluray_watch_queue(watch, path, due);
+	else if(!is_dir && (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && bluray_watch_iso(event->name))
+		bluray_watch_queue(watch, path, due);
+
+}
+
+/**
+ * Scan the paths that have settled, and update the index
+ */
+static void bluray_watch_scan(struct bluray_watch *watch, time_t now) {
+
+	struct bluray_batch bluray_batch;
+	bluray_batch_init(&bluray_batch, watch->key_db_filename);
+	bluray_batch.timeout = watch->timeout;
+	bluray_batch.record_cb = bluray_watch_record;
+	bluray_batch.user_data = watch;
+	if(watch->jobs)
+		bluray_batch.jobs = watch->jobs;
+
+	char path[PATH_MAX];
+	struct stat path_stat;
+	size_t ix = 0;
+
+	while(ix < watch->num_pending) {
+
+		if(watch->pending[ix].due > now) {
+			ix++;
+			continue;
+		}
+
+		snprintf(path, PATH_MAX, "%s", watch->pending[ix].path);
+		free(watch->pending[ix].path);
+		watch->pending[ix] = watch->pending[--watch->num_pending];
+
+		// Whatever was indexed here before is replaced by what's found now
+		if(stat(path, &path_stat) || S_ISDIR(path_stat.st_mode))
+			bluray_watch_drop(watch, path);
+
+		if(stat(path, &path_stat) == 0)
+			bluray_batch_find(&bluray_batch, path);
+
+	}
+
+	if(bluray_batch.num_paths)
+		bluray_batch_run(&bluray_batch, stdout);
+
+	bluray_batch_free(&bluray_batch);
+
+	if(watch->changed)
+		bluray_watch_save(watch);
+
+}
+
+int bluray_watch_run(struct bluray_watch *watch) {
+
+	// Paths from events and from searching have to match the index
+	char dirname[PATH_MAX];
+	snprintf(dirname, PATH_MAX, "%s", watch->dirname);
+	size_t dirname_length = strlen(dirname);
+	while(dirname_length > 1 && dirname[dirname_length - 1] == '/')
+		dirname[--dirname_length] = '\0';
+	watch->dirname = dirname;
+
+	char index_filename[PATH_MAX];
+	if(watch->index_filename == NULL) {
+		snprintf(index_filename, PATH_MAX, "%s/%s", watch->dirname, BLURAY_WATCH_INDEX_FILENAME);
+		watch->index_filename = index_filename;
+	}
+
+	if(bluray_watch_load(watch)) {
+		fprintf(stderr, "Could not read index %s: %s\n", watch->index_filename, strerror(errno));
+		return 1;
+	}
+
+	watch->fd = inotify_init1(IN_CLOEXEC);
+	if(watch->fd < 0) {
+		fprintf(stderr, "Could not start inotify: %s\n", strerror(errno));
+		return 1;
+	}
+
+	bluray_watch_add_dir(watch, watch->dirname);
+	if(watch->num_dirs == 0) {
+		close(watch->fd);
+		return 1;
+	}
+
+	time_t now = time(NULL);
+	bluray_watch_reconcile(watch, now);
+	bluray_watch_scan(watch, now);
+	if(watch->changed)
+		bluray_watch_save(watch);
+
+	// Events are aligned in the buffer, see inotify(7)
+	char buffer[65536] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *event = NULL;
+	struct pollfd pollfd;
+	pollfd.fd = watch->fd;
+	pollfd.events = POLLIN;
+	ssize_t length = 0;
+	ssize_t offset = 0;
+	int poll_timeout = -1;
+	time_t next_due = 0;
+	size_t ix = 0;
+
+	while(true) {
+
+		// Sleep until there's an event, or the next path has settled
+		poll_timeout = -1;
+		if(watch->num_pending) {
+			next_due = watch->pending[0].due;
+			for(ix = 1; ix < watch->num_pending; ix++) {
+				if(watch->pending[ix].due < next_due)
+					next_due = watch->pending[ix].due;
+			}
+			now = time(NULL);
+			poll_timeout = (next_due > now ? (int)(next_due - now) * 1000 : 0);
+		}
+
+		if(poll(&pollfd, 1, poll_timeout) < 0 && errno != EINTR)
+			break;
+
+		now = time(NULL);
+
+		if(pollfd.revents & POLLIN) {
+			length = read(watch->fd, buffer, sizeof(buffer));
+			for(offset = 0; length > 0 && offset < length; offset += (ssize_t)(sizeof(struct inotify_event) + event->len)) {
+				event = (const struct inotify_event *)(buffer + offset);
+				bluray_watch_event(watch, event, now);
+			}
+			if(watch->changed)
+				bluray_watch_save(watch);
+		}
+
+		if(watch->num_pending)
+			bluray_watch_scan(watch, now);
+
+	}
+
+	close(watch->fd);
+
+	return 1;
+
+}
+
+#else
+
+int bluray_watch_run(struct bluray_watch *watch) {
+
+	(void)watch;
+
+	fprintf(stderr, "Watching directories is not supported on this system\n");
+
+	return 1;
+
+}
+
+#endif
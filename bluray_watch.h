@@ -0,0 +1,73 @@
+#ifndef BLURAY_INFO_WATCH_H
+#define BLURAY_INFO_WATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+
+/**
+ * bluray_info --watch: keep an index of a directory of discs up to date
+ *
+ * The index is a NDJSON file with one --batch record per disc, keyed by the
+ * record's "path". Copies of the same disc at different paths each have
+ * their own entry, with the same "id". On startup, discs that are missing from the index are
+ * scanned and entries whose path is gone are dropped. After that, inotify
+ * events are used to scan only what changes:
+ *
+ * - an ISO that is closed after writing, or moved in
+ * - a disc folder (with a BDMV/ directory) after files in it are written
+ * - a directory that is moved in, which is searched for discs
+ *
+ * Paths are scanned once they have had no events for BLURAY_WATCH_SETTLE
+ * seconds, so copies in progress are only scanned when they're done. Deleted
+ * or moved away paths are dropped from the index. The index file is replaced
+ * atomically each time it changes.
+ *
+ * Between events the process sleeps in poll() with no timeout.
+ *
+ * Only available where inotify is (Linux).
+ */
+
+#define BLURAY_WATCH_SETTLE 5
+#define BLURAY_WATCH_INDEX_FILENAME ".bluray_info.ndjson"
+
+struct bluray_watch_entry {
+	char *id;
+	char *path;
+	char *record;
+	size_t length;
+};
+
+struct bluray_watch_dir {
+	int wd;
+	char *path;
+};
+
+struct bluray_watch_pending {
+	char *path;
+	time_t due;
+};
+
+struct bluray_watch {
+	const char *dirname;
+	const char *index_filename;
+	const char *key_db_filename;
+	uint32_t jobs;
+	uint32_t timeout;
+	uint32_t settle;
+	int fd;
+	struct bluray_watch_entry *entries;
+	size_t num_entries;
+	struct bluray_watch_dir *dirs;
+	size_t num_dirs;
+	struct bluray_watch_pending *pending;
+	size_t num_pending;
+	bool changed;
+};
+
+void bluray_watch_init(struct bluray_watch *watch, const char *dirname, const char *key_db_filename);
+
+int bluray_watch_run(struct bluray_watch *watch);
+
+#endif
@@ -0,0 +1,545 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "bluray_where.h"
+#include "bluray_time.h"
+#include "bluray_audio.h"
+#include "bluray_video.h"
+#include "bluray_pgs.h"
+
+// Parentheses and negations nested deeper than this are refused
+#define BLURAY_WHERE_DEPTH 32
+
+#define BLURAY_WHERE_NODE_AND 1
+#define BLURAY_WHERE_NODE_OR 2
+#define BLURAY_WHERE_NODE_NOT 3
+#define BLURAY_WHERE_NODE_CMP 4
+
+#define BLURAY_WHERE_OP_EQ 1
+#define BLURAY_WHERE_OP_NE 2
+#define BLURAY_WHERE_OP_LT 3
+#define BLURAY_WHERE_OP_LE 4
+#define BLURAY_WHERE_OP_GT 5
+#define BLURAY_WHERE_OP_GE 6
+
+enum bluray_where_field_id {
+	BLURAY_WHERE_TITLE,
+	BLURAY_WHERE_PLAYLIST,
+	BLURAY_WHERE_SECONDS,
+	BLURAY_WHERE_MINUTES,
+	BLURAY_WHERE_MSECS,
+	BLURAY_WHERE_CHAPTERS,
+	BLURAY_WHERE_CLIPS,
+	BLURAY_WHERE_ANGLES,
+	BLURAY_WHERE_VIDEO,
+	BLURAY_WHERE_AUDIO,
+	BLURAY_WHERE_SUBTITLES,
+	BLURAY_WHERE_FILESIZE,
+	BLURAY_WHERE_VIDEO_CODEC,
+	BLURAY_WHERE_VIDEO_FORMAT,
+	BLURAY_WHERE_AUDIO_LANGUAGE,
+	BLURAY_WHERE_AUDIO_CODEC,
+	BLURAY_WHERE_SUBTITLES_LANGUAGE
+};
+
+struct bluray_where_field {
+	const char *name;
+	uint8_t field;
+	uint8_t stage;
+	bool string;
+};
+
+static const struct bluray_where_field bluray_where_fields[] = {
+	{ "title", BLURAY_WHERE_TITLE, BLURAY_WHERE_STAGE_LIST, false },
+	{ "playlist", BLURAY_WHERE_PLAYLIST, BLURAY_WHERE_STAGE_LIST, false },
+	{ "seconds", BLURAY_WHERE_SECONDS, BLURAY_WHERE_STAGE_LIST, false },
+	{ "minutes", BLURAY_WHERE_MINUTES, BLURAY_WHERE_STAGE_LIST, false },
+	{ "msecs", BLURAY_WHERE_MSECS, BLURAY_WHERE_STAGE_LIST, false },
+	{ "chapters", BLURAY_WHERE_CHAPTERS, BLURAY_WHERE_STAGE_INFO, false },
+	{ "clips", BLURAY_WHERE_CLIPS, BLURAY_WHERE_STAGE_INFO, false },
+	{ "angles", BLURAY_WHERE_ANGLES, BLURAY_WHERE_STAGE_INFO, false },
+	{ "video", BLURAY_WHERE_VIDEO, BLURAY_WHERE_STAGE_INFO, false },
+	{ "audio", BLURAY_WHERE_AUDIO, BLURAY_WHERE_STAGE_INFO, false },
+	{ "subtitles", BLURAY_WHERE_SUBTITLES, BLURAY_WHERE_STAGE_INFO, false },
+	{ "filesize", BLURAY_WHERE_FILESIZE, BLURAY_WHERE_STAGE_SIZE, false },
+	{ "video.codec", BLURAY_WHERE_VIDEO_CODEC, BLURAY_WHERE_STAGE_INFO, true },
+	{ "video.format", BLURAY_WHERE_VIDEO_FORMAT, BLURAY_WHERE_STAGE_INFO, true },
+	{ "audio.language", BLURAY_WHERE_AUDIO_LANGUAGE, BLURAY_WHERE_STAGE_INFO, true },
+	{ "audio.lang", BLURAY_WHERE_AUDIO_LANGUAGE, BLURAY_WHERE_STAGE_INFO, true },
+	{ "audio.codec", BLURAY_WHERE_AUDIO_CODEC, BLURAY_WHERE_STAGE_INFO, true },
+	{ "subtitles.language", BLURAY_WHERE_SUBTITLES_LANGUAGE, BLURAY_WHERE_STAGE_INFO, true },
+	{ "subtitles.lang", BLURAY_WHERE_SUBTITLES_LANGUAGE, BLURAY_WHERE_STAGE_INFO, true },
+	{ NULL, 0, 0, false }
+};
+
+struct bluray_where_parser {
+	struct bluray_where *where;
+	const char *str;
+	const char *p;
+	uint32_t depth;
+};
+
+void bluray_where_init(struct bluray_where *where) {
+
+	where->num_nodes = 0;
+	where->root = -1;
+	where->stages = 0;
+	where->error = NULL;
+	where->error_offset = 0;
+
+}
+
+static int32_t bluray_where_error(struct bluray_where_parser *parser, const char *error) {
+
+	if(parser->where->error == NULL) {
+		parser->where->error = error;
+		parser->where->error_offset = (size_t)(parser->p - parser->str);
+	}
+
+	return -1;
+
+}
+
+static int32_t bluray_where_node(struct bluray_where_parser *parser, uint8_t type, int32_t left, int32_t right) {
+
+	if(left < 0 || (type != BLURAY_WHERE_NODE_NOT && type != BLURAY_WHERE_NODE_CMP && right < 0))
+		return -1;
+
+	if(parser->where->num_nodes == BLURAY_WHERE_NODES)
+		return bluray_where_error(parser, "expression is too long");
+
+	struct bluray_where_node *node = &parser->where->nodes[parser->where->num_nodes];
+	memset(node, 0, sizeof(struct bluray_where_node));
+	node->type = type;
+	node->left = left;
+	node->right = right;
+
+	return (int32_t)parser->where->num_nodes++;
+
+}
+
+static void bluray_where_space(struct bluray_where_parser *parser) {
+
+	while(isspace((unsigned char)*parser->p))
+		parser->p++;
+
+}
+
+/**
+ * Match a token, skipping any space in front of it
+ */
+static bool bluray_where_token(struct bluray_where_parser *parser, const char *token) {
+
+	bluray_where_space(parser);
+
+	size_t len = strlen(token);
+	if(strncmp(parser->p, token, len) != 0)
+		return false;
+
+	parser->p += len;
+
+	return true;
+
+}
+
+static bool bluray_where_word_char(char c) {
+
+	return isalnum((unsigned char)c) || c == '.' || c == '_' || c == '-';
+
+}
+
+static int32_t bluray_where_expr(struct bluray_where_parser *parser);
+
+static int32_t bluray_where_comparison(struct bluray_where_parser *parser) {
+
+	bluray_where_space(parser);
+
+	const char *name = parser->p;
+	while(bluray_where_word_char(*parser->p))
+		parser->p++;
+	size_t name_len = (size_t)(parser->p - name);
+
+	if(name_len == 0)
+		return bluray_where_error(parser, "expected a field");
+
+	const struct bluray_where_field *field = NULL;
+	for(field = bluray_where_fields; field->name != NULL; field++) {
+		if(strlen(field->name) == name_len && strncmp(field->name, name, name_len) == 0)
+			break;
+	}
+
+	if(field->name == NULL) {
+		parser->p = name;
+		return bluray_where_error(parser, "unknown field");
+	}
+
+	uint8_t op = 0;
+	if(bluray_where_token(parser, "=="))
+		op = BLURAY_WHERE_OP_EQ;
+	else if(bluray_where_token(parser, "!="))
+		op = BLURAY_WHERE_OP_NE;
+	else if(bluray_where_token(parser, "<="))
+		op = BLURAY_WHERE_OP_LE;
+	else if(bluray_where_token(parser, ">="))
+		op = BLURAY_WHERE_OP_GE;
+	else if(bluray_where_token(parser, "<"))
+		op = BLURAY_WHERE_OP_LT;
+	else if(bluray_where_token(parser, ">"))
+		op = BLURAY_WHERE_OP_GT;
+	else if(bluray_where_token(parser, "="))
+		op = BLURAY_WHERE_OP_EQ;
+	else
+		return bluray_where_error(parser, "expected a comparison");
+
+	if(field->string && op != BLURAY_WHERE_OP_EQ && op != BLURAY_WHERE_OP_NE)
+		return bluray_where_error(parser, "only == and != compare words");
+
+	bluray_where_space(parser);
+
+	// Words can be quoted
+	char quote = '\0';
+	if(*parser->p == '\'' || *parser->p == '"')
+		quote = *parser->p++;
+
+	const char *value = parser->p;
+	while(*parser->p != '\0' && (quote ? *parser->p != quote : bluray_where_word_char(*parser->p)))
+		parser->p++;
+	size_t value_len = (size_t)(parser->p - value);
+
+	if(quote) {
+		if(*parser->p != quote)
+			return bluray_where_error(parser, "missing closing quote");
+		parser->p++;
+	}
+
+	if(value_len == 0)
+		return bluray_where_error(parser, "expected a value");
+
+	int32_t ix = bluray_where_node(parser, BLURAY_WHERE_NODE_CMP, 0, -1);
+	if(ix < 0)
+		return -1;
+
+	struct bluray_where_node *node = &parser->where->nodes[ix];
+	node->field = field->field;
+	node->op = op;
+
+	if(field->string) {
+		if(value_len >= BLURAY_WHERE_STRLEN) {
+			parser->p = value;
+			return bluray_where_error(parser, "value is too long");
+		}
+		memcpy(node->str, value, value_len);
+		node->str[value_len] = '\0';
+	} else {
+		char *end = NULL;
+		node->number = strtoull(value, &end, 10);
+		if(end != parser->p - (quote ? 1 : 0)) {
+			parser->p = value;
+			return bluray_where_error(parser, "expected a number");
+		}
+	}
+
+	parser->where->stages |= field->stage;
+
+	return ix;
+
+}
+
+static int32_t bluray_where_unary(struct bluray_where_parser *parser) {
+
+	bluray_where_space(parser);
+
+	if(parser->depth == BLURAY_WHERE_DEPTH)
+		return bluray_where_error(parser, "expression is nested too deep");
+
+	int32_t ix = 0;
+
+	if(parser->p[0] == '!' && parser->p[1] != '=') {
+		parser->p++;
+		parser->depth++;
+		ix = bluray_where_node(parser, BLURAY_WHERE_NODE_NOT, bluray_where_unary(parser), -1);
+		parser->depth--;
+		return ix;
+	}
+
+	if(bluray_where_token(parser, "(")) {
+		parser->depth++;
+		ix = bluray_where_expr(parser);
+		parser->depth--;
+		if(ix < 0)
+			return -1;
+		if(!bluray_where_token(parser, ")"))
+			return bluray_where_error(parser, "missing closing parenthesis");
+		return ix;
+	}
+
+	return bluray_where_comparison(parser);
+
+}
+
+static int32_t bluray_where_conjunction(struct bluray_where_parser *parser) {
+
+	int32_t ix = bluray_where_unary(parser);
+
+	while(ix >= 0 && bluray_where_token(parser, "&&"))
+		ix = bluray_where_node(parser, BLURAY_WHERE_NODE_AND, ix, bluray_where_unary(parser));
+
+	return ix;
+
+}
+
+static int32_t bluray_where_expr(struct bluray_where_parser *parser) {
+
+	int32_t ix = bluray_where_conjunction(parser);
+
+	while(ix >= 0 && bluray_where_token(parser, "||"))
+		ix = bluray_where_node(parser, BLURAY_WHERE_NODE_OR, ix, bluray_where_conjunction(parser));
+
+	return ix;
+
+}
+
+/**
+ * Parse an expression, and require it as well as any given before. Returns 1
+ * if it's invalid, with the reason and where it was found in error and
+ * error_offset, and leaves the filter as it was.
+ */
+int bluray_where_and(struct bluray_where *where, const char *str) {
+
+	struct bluray_where_parser parser;
+	parser.where = where;
+	parser.str = str;
+	parser.p = str;
+	parser.depth = 0;
+
+	uint32_t num_nodes = where->num_nodes;
+	uint8_t stages = where->stages;
+	where->error = NULL;
+
+	int32_t ix = bluray_where_expr(&parser);
+
+	bluray_where_space(&parser);
+	if(ix >= 0 && *parser.p != '\0')
+		ix = bluray_where_error(&parser, "unexpected text");
+
+	if(ix >= 0 && where->root >= 0)
+		ix = bluray_where_node(&parser, BLURAY_WHERE_NODE_AND, where->root, ix);
+
+	if(ix < 0) {
+		if(where->error == NULL)
+			bluray_where_error(&parser, "invalid expression");
+		where->num_nodes = num_nodes;
+		where->stages = stages;
+		return 1;
+	}
+
+	where->root = ix;
+
+	return 0;
+
+}
+
+static int bluray_where_compare(uint8_t op, uint64_t value, uint64_t number) {
+
+	switch(op) {
+		case BLURAY_WHERE_OP_EQ:
+			return value == number;
+		case BLURAY_WHERE_OP_NE:
+			return value != number;
+		case BLURAY_WHERE_OP_LT:
+			return value < number;
+		case BLURAY_WHERE_OP_LE:
+			return value <= number;
+		case BLURAY_WHERE_OP_GT:
+			return value > number;
+		case BLURAY_WHERE_OP_GE:
+			return value >= number;
+	}
+
+	return BLURAY_WHERE_FALSE;
+
+}
+
+/**
+ * Check if any of the first clip's streams of a kind has the value, which is
+ * where a title's streams are displayed from
+ */
+static bool bluray_where_stream(const BLURAY_CLIP_INFO *clip, uint8_t field, const char *str) {
+
+	char value[BLURAY_WHERE_STRLEN];
+	uint8_t ix = 0;
+
+	switch(field) {
+
+		case BLURAY_WHERE_VIDEO_CODEC:
+		case BLURAY_WHERE_VIDEO_FORMAT:
+			for(ix = 0; ix < clip->video_stream_count; ix++) {
+				if(field == BLURAY_WHERE_VIDEO_CODEC)
+					bluray_video_codec(value, clip->video_streams[ix].coding_type);
+				else
+					bluray_video_format(value, clip->video_streams[ix].format);
+				if(strcasecmp(value, str) == 0)
+					return true;
+			}
+			break;
+
+		case BLURAY_WHERE_AUDIO_LANGUAGE:
+		case BLURAY_WHERE_AUDIO_CODEC:
+			for(ix = 0; ix < clip->audio_stream_count; ix++) {
+				if(field == BLURAY_WHERE_AUDIO_LANGUAGE)
+					bluray_audio_lang(value, clip->audio_streams[ix].lang);
+				else
+					bluray_audio_codec(value, clip->audio_streams[ix].coding_type);
+				if(strcasecmp(value, str) == 0)
+					return true;
+			}
+			break;
+
+		case BLURAY_WHERE_SUBTITLES_LANGUAGE:
+			for(ix = 0; ix < clip->pg_stream_count; ix++) {
+				bluray_pgs_lang(value, clip->pg_streams[ix].lang);
+				if(strcasecmp(value, str) == 0)
+					return true;
+			}
+			break;
+
+	}
+
+	return false;
+
+}
+
+static int bluray_where_node_eval(const struct bluray_where *where, int32_t ix, const struct bluray_where_title *title) {
+
+	const struct bluray_where_node *node = &where->nodes[ix];
+	const BLURAY_TITLE_INFO *title_info = title->title_info;
+	const BLURAY_CLIP_INFO *clip = (title_info != NULL && title_info->clip_count ? &title_info->clips[0] : NULL);
+	int left = 0;
+	int right = 0;
+	uint64_t value = 0;
+
+	switch(node->type) {
+
+		case BLURAY_WHERE_NODE_AND:
+			left = bluray_where_node_eval(where, node->left, title);
+			if(left == BLURAY_WHERE_FALSE)
+				return BLURAY_WHERE_FALSE;
+			right = bluray_where_node_eval(where, node->right, title);
+			if(right == BLURAY_WHERE_FALSE)
+				return BLURAY_WHERE_FALSE;
+			return (left == BLURAY_WHERE_TRUE && right == BLURAY_WHERE_TRUE ? BLURAY_WHERE_TRUE : BLURAY_WHERE_UNKNOWN);
+
+		case BLURAY_WHERE_NODE_OR:
+			left = bluray_where_node_eval(where, node->left, title);
+			if(left == BLURAY_WHERE_TRUE)
+				return BLURAY_WHERE_TRUE;
+			right = bluray_where_node_eval(where, node->right, title);
+			if(right == BLURAY_WHERE_TRUE)
+				return BLURAY_WHERE_TRUE;
+			return (left == BLURAY_WHERE_FALSE && right == BLURAY_WHERE_FALSE ? BLURAY_WHERE_FALSE : BLURAY_WHERE_UNKNOWN);
+
+		case BLURAY_WHERE_NODE_NOT:
+			left = bluray_where_node_eval(where, node->left, title);
+			if(left == BLURAY_WHERE_UNKNOWN)
+				return BLURAY_WHERE_UNKNOWN;
+			return (left == BLURAY_WHERE_TRUE ? BLURAY_WHERE_FALSE : BLURAY_WHERE_TRUE);
+
+	}
+
+	// Playlist and duration are in the title list or the title info, whichever
+	// is known first
+	uint32_t playlist = (title_info != NULL ? title_info->playlist : title->playlist);
+	uint64_t duration = (title_info != NULL ? title_info->duration : title->duration);
+	bool list = (title->list || title_info != NULL);
+
+	switch(node->field) {
+
+		case BLURAY_WHERE_TITLE:
+			value = title->number;
+			break;
+
+		case BLURAY_WHERE_PLAYLIST:
+			if(!list)
+				return BLURAY_WHERE_UNKNOWN;
+			value = playlist;
+			break;
+
+		case BLURAY_WHERE_SECONDS:
+		case BLURAY_WHERE_MINUTES:
+		case BLURAY_WHERE_MSECS:
+			if(!list)
+				return BLURAY_WHERE_UNKNOWN;
+			if(node->field == BLURAY_WHERE_SECONDS)
+				value = bluray_duration_seconds(duration);
+			else if(node->field == BLURAY_WHERE_MINUTES)
+				value = bluray_duration_minutes(duration);
+			else
+				value = duration / 90;
+			break;
+
+		case BLURAY_WHERE_FILESIZE:
+			if(!title->size_known)
+				return BLURAY_WHERE_UNKNOWN;
+			value = title->size;
+			break;
+
+		default:
+			if(title_info == NULL)
+				return BLURAY_WHERE_UNKNOWN;
+			break;
+
+	}
+
+	switch(node->field) {
+
+		case BLURAY_WHERE_CHAPTERS:
+			value = title_info->chapter_count;
+			break;
+
+		case BLURAY_WHERE_CLIPS:
+			value = title_info->clip_count;
+			break;
+
+		case BLURAY_WHERE_ANGLES:
+			value = title_info->angle_count;
+			break;
+
+		case BLURAY_WHERE_VIDEO:
+			value = (clip != NULL ? clip->video_stream_count : 0);
+			break;
+
+		case BLURAY_WHERE_AUDIO:
+			value = (clip != NULL ? clip->audio_stream_count : 0);
+			break;
+
+		case BLURAY_WHERE_SUBTITLES:
+			value = (clip != NULL ? clip->pg_stream_count : 0);
+			break;
+
+		case BLURAY_WHERE_VIDEO_CODEC:
+		case BLURAY_WHERE_VIDEO_FORMAT:
+		case BLURAY_WHERE_AUDIO_LANGUAGE:
+		case BLURAY_WHERE_AUDIO_CODEC:
+		case BLURAY_WHERE_SUBTITLES_LANGUAGE:
+			left = (clip != NULL && bluray_where_stream(clip, node->field, node->str));
+			return (left == (node->op == BLURAY_WHERE_OP_EQ) ? BLURAY_WHERE_TRUE : BLURAY_WHERE_FALSE);
+
+	}
+
+	return (bluray_where_compare(node->op, value, node->number) ? BLURAY_WHERE_TRUE : BLURAY_WHERE_FALSE);
+
+}
+
+/**
+ * Evaluate the filter on what is known about a title. An empty filter matches
+ * every title.
+ */
+int bluray_where_eval(const struct bluray_where *where, const struct bluray_where_title *title) {
+
+	if(where->root < 0)
+		return BLURAY_WHERE_TRUE;
+
+	return bluray_where_node_eval(where, where->root, title);
+
+}
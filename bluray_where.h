@@ -0,0 +1,80 @@
+#ifndef BLURAY_INFO_WHERE_H
+#define BLURAY_INFO_WHERE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "libbluray/bluray.h"
+
+/**
+ * Title filter expressions for --where, such as:
+ *
+ *   minutes>=60 && audio.language==eng && chapters>5
+ *
+ * A comparison is a field, an operator (== != < <= > >=) and a number or a
+ * word. Comparisons can be combined with && and ||, negated with !, and
+ * grouped with parentheses. Stream fields (audio.language, audio.codec,
+ * subtitles.language, video.codec, video.format) match if any of the title's
+ * streams does, and only take == and !=.
+ *
+ * Fields come from one of three stages, from cheapest to most expensive to
+ * look up: the title list (title number, and the playlist and duration when
+ * the list has them), the title info (chapters, clips, angles, streams) and
+ * the title filesize. A title can be evaluated with only some of them known.
+ * Comparisons on unknown fields are neither true nor false, so the result is
+ * only false if the title can't match whatever the rest turns out to be, and
+ * the expensive lookups can be skipped for it.
+ */
+
+#define BLURAY_WHERE_NODES 64
+#define BLURAY_WHERE_STRLEN 16
+
+#define BLURAY_WHERE_STAGE_LIST 0x01
+#define BLURAY_WHERE_STAGE_INFO 0x02
+#define BLURAY_WHERE_STAGE_SIZE 0x04
+
+#define BLURAY_WHERE_FALSE 0
+#define BLURAY_WHERE_TRUE 1
+#define BLURAY_WHERE_UNKNOWN 2
+
+struct bluray_where_node {
+	uint8_t type;
+	uint8_t field;
+	uint8_t op;
+	int32_t left;
+	int32_t right;
+	uint64_t number;
+	char str[BLURAY_WHERE_STRLEN];
+};
+
+struct bluray_where {
+	struct bluray_where_node nodes[BLURAY_WHERE_NODES];
+	uint32_t num_nodes;
+	int32_t root;
+	uint8_t stages;
+	const char *error;
+	size_t error_offset;
+};
+
+/**
+ * What is known about a title so far. Set list when the playlist and duration
+ * are known before the title info is, title_info once it's been fetched, and
+ * size_known once the filesize has been.
+ */
+struct bluray_where_title {
+	uint32_t number;
+	bool list;
+	uint32_t playlist;
+	uint64_t duration;
+	const BLURAY_TITLE_INFO *title_info;
+	bool size_known;
+	uint64_t size;
+};
+
+void bluray_where_init(struct bluray_where *where);
+
+int bluray_where_and(struct bluray_where *where, const char *str);
+
+int bluray_where_eval(const struct bluray_where *where, const struct bluray_where_title *title);
+
+#endif
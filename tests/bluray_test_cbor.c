@@ -0,0 +1,438 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "bluray_json.h"
+#include "bluray_cbor.h"
+#include "bluray_video.h"
+#include "bluray_audio.h"
+
+/**
+ * bluray_test_cbor - turn bluray_info --format cbor back into JSON
+ *
+ * Usage: bluray_test_cbor < input.cbor > output.json
+ *
+ * Decodes the CBOR document on stdin and writes it out again through the
+ * JSON writer, undoing each of the ways CBOR output differs from JSON:
+ * numeric codes for codecs, formats, aspect ratios and audio rates are turned
+ * back into names, PIDs into hexadecimal strings, decimal fractions (tag 4)
+ * into fixed-point numbers, and string references (tag 25) into the strings
+ * they refer to, in the stringref namespace (tag 256). The result should be
+ * byte for byte what bluray_info --json writes for the same disc.
+ *
+ * The string table is built the way the stringref extension says a decoder
+ * should, not with bluray_cbor's encoder, so the two are checked against each
+ * other.
+ */
+
+#define BLURAY_TEST_CBOR_DEPTH_MAX 16
+
+// Which stream array values are in, to know what an enumerated code means
+#define BLURAY_TEST_CBOR_OTHER 0
+#define BLURAY_TEST_CBOR_VIDEO 1
+#define BLURAY_TEST_CBOR_AUDIO 2
+#define BLURAY_TEST_CBOR_PGS 3
+
+struct bluray_test_cbor {
+	const uint8_t *data;
+	size_t length;
+	size_t offset;
+	bool error;
+	char **strings;
+	size_t num_strings;
+	size_t strings_size;
+};
+
+static bool bluray_test_cbor_byte(struct bluray_test_cbor *cbor, uint8_t *byte) {
+
+	if(cbor->error || cbor->offset >= cbor->length) {
+		cbor->error = true;
+		return false;
+	}
+
+	*byte = cbor->data[cbor->offset++];
+
+	return true;
+
+}
+
+/**
+ * Read an initial byte and its argument. Indefinite lengths set indefinite,
+ * and simple values are left in value as their initial byte.
+ */
+static bool bluray_test_cbor_head(struct bluray_test_cbor *cbor, uint8_t *major, uint64_t *value, bool *indefinite) {
+
+	uint8_t ib = 0;
+	uint8_t byte = 0;
+	uint8_t len = 0;
+	uint8_t ix = 0;
+
+	if(!bluray_test_cbor_byte(cbor, &ib))
+		return false;
+
+	*major = ib >> 5;
+	*value = ib & 0x1f;
+	*indefinite = false;
+
+	if(*major == 7) {
+		*value = ib;
+		return true;
+	}
+
+	if(*value == 31) {
+		*indefinite = true;
+		return true;
+	}
+
+	if(*value < 24)
+		return true;
+
+	if(*value > 27) {
+		cbor->error = true;
+		return false;
+	}
+
+	len = (uint8_t)(1 << (*value - 24));
+	*value = 0;
+	for(ix = 0; ix < len; ix++) {
+		if(!bluray_test_cbor_byte(cbor, &byte))
+			return false;
+		*value = (*value << 8) | byte;
+	}
+
+	return true;
+
+}
+
+/**
+ * A text string is added to the namespace's table if a reference to it would
+ * be shorter than the string, based on the index it would get
+ */
+static void bluray_test_cbor_remember(struct bluray_test_cbor *cbor, const char *str, size_t len) {
+
+	size_t index = cbor->num_strings;
+	size_t min_len = (index < 24 ? 3 : index < 256 ? 4 : index < 65536 ? 5 : 7);
+
+	if(len < min_len)
+		return;
+
+	if(cbor->num_strings == cbor->strings_size) {
+		size_t size = (cbor->strings_size ? cbor->strings_size * 2 : 256);
+		char **strings = realloc(cbor->strings, size * sizeof(char *));
+		if(strings == NULL) {
+			cbor->error = true;
+			return;
+		}
+		cbor->strings = strings;
+		cbor->strings_size = size;
+	}
+
+	cbor->strings[cbor->num_strings] = malloc(len + 1);
+	if(cbor->strings[cbor->num_strings] == NULL) {
+		cbor->error = true;
+		return;
+	}
+	memcpy(cbor->strings[cbor->num_strings], str, len);
+	cbor->strings[cbor->num_strings][len] = '\0';
+	cbor->num_strings++;
+
+}
+
+static void bluray_test_cbor_namespace(struct bluray_test_cbor *cbor) {
+
+	size_t ix = 0;
+	for(ix = 0; ix < cbor->num_strings; ix++)
+		free(cbor->strings[ix]);
+	cbor->num_strings = 0;
+
+}
+
+/**
+ * Read a text string, or a reference to one, after its head. Returns a copy
+ * to free, or NULL.
+ */
+static char *bluray_test_cbor_text(struct bluray_test_cbor *cbor, uint8_t major, uint64_t value) {
+
+	char *str = NULL;
+	uint64_t index = 0;
+	bool indefinite = false;
+
+	if(major == BLURAY_CBOR_TAG && value == BLURAY_CBOR_TAG_STRINGREF) {
+		if(!bluray_test_cbor_head(cbor, &major, &index, &indefinite) || major != BLURAY_CBOR_UINT || index >= cbor->num_strings) {
+			cbor->error = true;
+			return NULL;
+		}
+		return strdup(cbor->strings[index]);
+	}
+
+	if(major != BLURAY_CBOR_TEXT || value > cbor->length - cbor->offset) {
+		cbor->error = true;
+		return NULL;
+	}
+
+	str = malloc(value + 1);
+	if(str == NULL) {
+		cbor->error = true;
+		return NULL;
+	}
+	memcpy(str, cbor->data + cbor->offset, value);
+	str[value] = '\0';
+	cbor->offset += value;
+
+	bluray_test_cbor_remember(cbor, str, value);
+
+	return str;
+
+}
+
+/**
+ * Whether a key in a stream is one CBOR has to write as a number: the PID,
+ * and the enumerated values, which are libbluray's codes
+ */
+static bool bluray_test_cbor_coded(const char *key, uint8_t context) {
+
+	if(key == NULL || context == BLURAY_TEST_CBOR_OTHER)
+		return false;
+
+	if(strcmp(key, "stream") == 0)
+		return true;
+
+	if(context == BLURAY_TEST_CBOR_VIDEO)
+		return (strcmp(key, "codec") == 0 || strcmp(key, "format") == 0 || strcmp(key, "aspect ratio") == 0);
+
+	if(context == BLURAY_TEST_CBOR_AUDIO)
+		return (strcmp(key, "codec") == 0 || strcmp(key, "format") == 0 || strcmp(key, "rate") == 0);
+
+	return false;
+
+}
+
+/**
+ * Write an unsigned integer, which is a name or a PID in the JSON output if
+ * it's one of the keys CBOR writes as a code
+ */
+static void bluray_test_cbor_uint(struct bluray_json *json, const char *key, uint64_t value, uint8_t context) {
+
+	char name[32];
+	memset(name, 0, sizeof(name));
+
+	if(key != NULL && strcmp(key, "stream") == 0 && context != BLURAY_TEST_CBOR_OTHER) {
+		bluray_json_hex(json, key, value);
+		return;
+	}
+
+	if(key != NULL && context == BLURAY_TEST_CBOR_VIDEO) {
+		if(strcmp(key, "codec") == 0) {
+			bluray_video_codec(name, (uint8_t)value);
+			bluray_json_string(json, key, name);
+			return;
+		} else if(strcmp(key, "format") == 0) {
+			bluray_video_format(name, (uint8_t)value);
+			bluray_json_string(json, key, name);
+			return;
+		} else if(strcmp(key, "aspect ratio") == 0) {
+			bluray_video_aspect_ratio(name, (uint8_t)value);
+			bluray_json_string(json, key, name);
+			return;
+		}
+	}
+
+	if(key != NULL && context == BLURAY_TEST_CBOR_AUDIO) {
+		if(strcmp(key, "codec") == 0) {
+			bluray_audio_codec(name, (uint8_t)value);
+			bluray_json_string(json, key, name);
+			return;
+		} else if(strcmp(key, "format") == 0) {
+			bluray_audio_format(name, (uint8_t)value);
+			bluray_json_string(json, key, name);
+			return;
+		} else if(strcmp(key, "rate") == 0) {
+			bluray_audio_rate(name, (uint8_t)value);
+			bluray_json_string(json, key, name);
+			return;
+		}
+	}
+
+	bluray_json_uint(json, key, value);
+
+}
+
+static void bluray_test_cbor_item(struct bluray_test_cbor *cbor, struct bluray_json *json, const char *key, uint8_t context, uint8_t depth) {
+
+	uint8_t major = 0;
+	uint64_t value = 0;
+	bool indefinite = false;
+	uint8_t exponent_major = 0;
+	uint64_t exponent = 0;
+	uint64_t mantissa = 0;
+	uint64_t count = 0;
+	uint8_t key_major = 0;
+	uint64_t key_value = 0;
+	bool key_indefinite = false;
+	char *str = NULL;
+	uint8_t child_context = context;
+
+	if(depth > BLURAY_TEST_CBOR_DEPTH_MAX || !bluray_test_cbor_head(cbor, &major, &value, &indefinite)) {
+		cbor->error = true;
+		return;
+	}
+
+	switch(major) {
+
+		case BLURAY_CBOR_UINT:
+			bluray_test_cbor_uint(json, key, value, context);
+			break;
+
+		case BLURAY_CBOR_TEXT:
+			if(bluray_test_cbor_coded(key, context)) {
+				fprintf(stderr, "\"%s\" is a string, not a code\n", key);
+				cbor->error = true;
+				break;
+			}
+			str = bluray_test_cbor_text(cbor, major, value);
+			if(str != NULL)
+				bluray_json_string(json, key, str);
+			free(str);
+			break;
+
+		case BLURAY_CBOR_TAG:
+			if(value == BLURAY_CBOR_TAG_SELF_DESCRIBE) {
+				bluray_test_cbor_item(cbor, json, key, context, depth + 1);
+			} else if(value == BLURAY_CBOR_TAG_STRINGREF_NAMESPACE) {
+				bluray_test_cbor_namespace(cbor);
+				bluray_test_cbor_item(cbor, json, key, context, depth + 1);
+			} else if(value == BLURAY_CBOR_TAG_STRINGREF) {
+				if(bluray_test_cbor_coded(key, context)) {
+					fprintf(stderr, "\"%s\" is a string, not a code\n", key);
+					cbor->error = true;
+					break;
+				}
+				str = bluray_test_cbor_text(cbor, major, value);
+				if(str != NULL)
+					bluray_json_string(json, key, str);
+				free(str);
+			} else if(value == BLURAY_CBOR_TAG_DECIMAL_FRACTION) {
+				// [ exponent, mantissa ], where the exponent is -decimals
+				if(!bluray_test_cbor_head(cbor, &major, &value, &indefinite) || major != BLURAY_CBOR_ARRAY || value != 2)
+					cbor->error = true;
+				else if(!bluray_test_cbor_head(cbor, &exponent_major, &exponent, &indefinite) || (exponent_major != BLURAY_CBOR_NINT && !(exponent_major == BLURAY_CBOR_UINT && exponent == 0)))
+					cbor->error = true;
+				else if(!bluray_test_cbor_head(cbor, &major, &mantissa, &indefinite) || major != BLURAY_CBOR_UINT)
+					cbor->error = true;
+				else
+					bluray_json_fixed(json, key, mantissa, (uint8_t)(exponent_major == BLURAY_CBOR_NINT ? exponent + 1 : 0));
+			} else {
+				cbor->error = true;
+			}
+			break;
+
+		case BLURAY_CBOR_ARRAY:
+			if(key != NULL && strcmp(key, "video") == 0)
+				child_context = BLURAY_TEST_CBOR_VIDEO;
+			else if(key != NULL && strcmp(key, "audio") == 0)
+				child_context = BLURAY_TEST_CBOR_AUDIO;
+			else if(key != NULL && strcmp(key, "subtitles") == 0)
+				child_context = BLURAY_TEST_CBOR_PGS;
+			else if(key != NULL)
+				child_context = BLURAY_TEST_CBOR_OTHER;
+			bluray_json_array_open(json, key);
+			for(count = 0; !cbor->error && (indefinite || count < value); count++) {
+				if(indefinite && cbor->offset < cbor->length && cbor->data[cbor->offset] == BLURAY_CBOR_BREAK) {
+					cbor->offset++;
+					break;
+				}
+				bluray_test_cbor_item(cbor, json, NULL, child_context, depth + 1);
+			}
+			bluray_json_array_close(json);
+			break;
+
+		case BLURAY_CBOR_MAP:
+			bluray_json_object_open(json, key);
+			for(count = 0; !cbor->error && (indefinite || count < value); count++) {
+				if(indefinite && cbor->offset < cbor->length && cbor->data[cbor->offset] == BLURAY_CBOR_BREAK) {
+					cbor->offset++;
+					break;
+				}
+				if(!bluray_test_cbor_head(cbor, &key_major, &key_value, &key_indefinite))
+					break;
+				str = bluray_test_cbor_text(cbor, key_major, key_value);
+				if(str == NULL)
+					break;
+				bluray_test_cbor_item(cbor, json, str, context, depth + 1);
+				free(str);
+			}
+			bluray_json_object_close(json);
+			break;
+
+		case 7:
+			if(value == BLURAY_CBOR_TRUE || value == BLURAY_CBOR_FALSE)
+				bluray_json_bool(json, key, value == BLURAY_CBOR_TRUE);
+			else
+				cbor->error = true;
+			break;
+
+		default:
+			cbor->error = true;
+			break;
+
+	}
+
+}
+
+int main(void) {
+
+	struct bluray_test_cbor cbor;
+	memset(&cbor, 0, sizeof(cbor));
+
+	size_t size = 65536;
+	size_t bytes = 0;
+	uint8_t *data = malloc(size);
+	while(data != NULL && (bytes = fread(data + cbor.length, 1, size - cbor.length, stdin)) > 0) {
+		cbor.length += bytes;
+		if(cbor.length == size) {
+			size *= 2;
+			uint8_t *p = realloc(data, size);
+			if(p == NULL) {
+				free(data);
+				data = NULL;
+				break;
+			}
+			data = p;
+		}
+	}
+
+	if(data == NULL || cbor.length == 0) {
+		fprintf(stderr, "No CBOR on stdin\n");
+		free(data);
+		return 1;
+	}
+	cbor.data = data;
+
+	struct bluray_json json;
+	if(bluray_json_init(&json, stdout, BLURAY_JSON_FORMAT_JSON)) {
+		fprintf(stderr, "Could not allocate JSON output buffer\n");
+		return 1;
+	}
+
+	bluray_test_cbor_item(&cbor, &json, NULL, BLURAY_TEST_CBOR_OTHER, 0);
+	bluray_json_end(&json);
+	bluray_json_flush(&json);
+
+	int retval = 0;
+	if(cbor.error || cbor.offset != cbor.length) {
+		fprintf(stderr, "Invalid CBOR at byte %zu of %zu\n", cbor.offset, cbor.length);
+		retval = 1;
+	} else if(json.error) {
+		fprintf(stderr, "Could not write JSON\n");
+		retval = 1;
+	}
+
+	bluray_json_free(&json);
+	bluray_test_cbor_namespace(&cbor);
+	free(cbor.strings);
+	free(data);
+
+	return retval;
+
+}
@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/**
+ * bluray_test_http - check what bluray_serve sends against a file
+ *
+ * Usage: bluray_test_http <port> <target> <filename> [requests]
+ *
+ * Gets the whole target from bluray_serve on localhost, and then random byte
+ * ranges of it, over one connection, and compares each response with the
+ * same bytes of the file, which is the title or chapters copied with
+ * bluray_copy. The ranges start anywhere, so most of them need a seek into
+ * the middle of an aligned unit. Exits 1 at the first difference, or if the
+ * server hangs up in the middle of a response.
+ */
+
+#define BLURAY_TEST_HTTP_REQUESTS 200
+#define BLURAY_TEST_HTTP_HEADERS_MAX 4096
+#define BLURAY_TEST_HTTP_RANGE_MAX 1048576
+
+static uint64_t bluray_test_http_state = 0x2545f4914f6cdd1d;
+
+static uint64_t bluray_test_http_random(void) {
+
+	bluray_test_http_state ^= bluray_test_http_state << 13;
+	bluray_test_http_state ^= bluray_test_http_state >> 7;
+	bluray_test_http_state ^= bluray_test_http_state << 17;
+
+	return bluray_test_http_state;
+
+}
+
+static int bluray_test_http_connect(uint16_t port) {
+
+	struct sockaddr_in addr;
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if(fd == -1)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if(connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+
+}
+
+static int bluray_test_http_write(int fd, const char *buffer, size_t length) {
+
+	ssize_t written = 0;
+
+	while(length > 0) {
+		written = write(fd, buffer, length);
+		if(written < 0 && errno == EINTR)
+			continue;
+		if(written <= 0)
+			return 1;
+		buffer += written;
+		length -= (size_t)written;
+	}
+
+	return 0;
+
+}
+
+static int bluray_test_http_read(int fd, uint8_t *buffer, size_t length) {
+
+	ssize_t received = 0;
+
+	while(length > 0) {
+		received = read(fd, buffer, length);
+		if(received < 0 && errno == EINTR)
+			continue;
+		if(received <= 0)
+			return 1;
+		buffer += received;
+		length -= (size_t)received;
+	}
+
+	return 0;
+
+}
+
+/**
+ * Request bytes first to last of the target, or all of it if it's not a
+ * range, and compare the response body with the same bytes of data
+ */
+static int bluray_test_http_get(int fd, const char *target, const uint8_t *data, uint64_t size, bool range, uint64_t first, uint64_t last, uint8_t *body) {
+
+	char request[1024];
+	char headers[BLURAY_TEST_HTTP_HEADERS_MAX + 1];
+	size_t headers_length = 0;
+	int expected_status = (range ? 206 : 200);
+	int status = 0;
+	uint64_t content_length = UINT64_MAX;
+	uint64_t expected_length = (range ? last - first + 1 : size);
+	char *line = NULL;
+
+	if(range)
+		snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: localhost\r\nRange: bytes=%" PRIu64 "-%" PRIu64 "\r\n\r\n", target, first, last);
+	else
+		snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: localhost\r\n\r\n", target);
+
+	if(bluray_test_http_write(fd, request, strlen(request))) {
+		fprintf(stderr, "Could not send request for bytes %" PRIu64 "-%" PRIu64 "\n", first, last);
+		return 1;
+	}
+
+	// Headers, a byte at a time so the body is left on the socket
+	while(headers_length < 4 || memcmp(headers + headers_length - 4, "\r\n\r\n", 4)) {
+		if(headers_length == BLURAY_TEST_HTTP_HEADERS_MAX || bluray_test_http_read(fd, (uint8_t *)headers + headers_length, 1)) {
+			fprintf(stderr, "No response for bytes %" PRIu64 "-%" PRIu64 "\n", first, last);
+			return 1;
+		}
+		headers_length++;
+	}
+	headers[headers_length] = '\0';
+
+	if(sscanf(headers, "HTTP/1.1 %d", &status) != 1 || status != expected_status) {
+		fprintf(stderr, "Status %d for bytes %" PRIu64 "-%" PRIu64 ", expected %d\n", status, first, last, expected_status);
+		return 1;
+	}
+
+	for(line = strtok(headers, "\r\n"); line != NULL; line = strtok(NULL, "\r\n")) {
+		if(strncasecmp(line, "Content-Length:", 15) == 0)
+			content_length = strtoull(line + 15, NULL, 10);
+	}
+
+	if(content_length != expected_length) {
+		fprintf(stderr, "Content-Length %" PRIu64 " for bytes %" PRIu64 "-%" PRIu64 ", expected %" PRIu64 "\n", content_length, first, last, expected_length);
+		return 1;
+	}
+
+	if(bluray_test_http_read(fd, body, (size_t)content_length)) {
+		fprintf(stderr, "Connection closed in the middle of bytes %" PRIu64 "-%" PRIu64 "\n", first, last);
+		return 1;
+	}
+
+	if(memcmp(body, data + first, (size_t)content_length)) {
+		fprintf(stderr, "Bytes %" PRIu64 "-%" PRIu64 " differ from the file\n", first, first + content_length - 1);
+		return 1;
+	}
+
+	return 0;
+
+}
+
+int main(int argc, char **argv) {
+
+	if(argc < 4) {
+		fprintf(stderr, "Usage: bluray_test_http <port> <target> <filename> [requests]\n");
+		return 1;
+	}
+
+	uint16_t port = (uint16_t)strtoul(argv[1], NULL, 10);
+	const char *target = argv[2];
+	unsigned long int requests = (argc > 4 ? strtoul(argv[4], NULL, 10) : BLURAY_TEST_HTTP_REQUESTS);
+
+	FILE *io = fopen(argv[3], "rb");
+	if(io == NULL) {
+		fprintf(stderr, "Could not open %s: %s\n", argv[3], strerror(errno));
+		return 1;
+	}
+
+	fseeko(io, 0, SEEK_END);
+	uint64_t size = (uint64_t)ftello(io);
+	fseeko(io, 0, SEEK_SET);
+
+	uint8_t *data = malloc(size ? size : 1);
+	uint8_t *body = malloc(size ? size : 1);
+	if(data == NULL || body == NULL || fread(data, 1, size, io) != size) {
+		fprintf(stderr, "Could not read %s\n", argv[3]);
+		return 1;
+	}
+	fclose(io);
+
+	if(size == 0) {
+		fprintf(stderr, "%s is empty\n", argv[3]);
+		return 1;
+	}
+
+	int fd = bluray_test_http_connect(port);
+	if(fd == -1) {
+		fprintf(stderr, "Could not connect to port %" PRIu16 ": %s\n", port, strerror(errno));
+		return 1;
+	}
+
+	int retval = bluray_test_http_get(fd, target, data, size, false, 0, size - 1, body);
+
+	uint64_t first = 0;
+	uint64_t length = 0;
+	unsigned long int request = 0;
+
+	for(request = 0; retval == 0 && request < requests; request++) {
+
+		// Some ranges run to the end, the rest are up to a MB long
+		first = bluray_test_http_random() % size;
+		length = bluray_test_http_random() % BLURAY_TEST_HTTP_RANGE_MAX + 1;
+		if(request % 10 == 0 || length > size - first)
+			length = size - first;
+
+		retval = bluray_test_http_get(fd, target, data, size, true, first, first + length - 1, body);
+
+	}
+
+	close(fd);
+	free(data);
+	free(body);
+
+	if(retval == 0)
+		printf("%s: %lu ranges match\n", target, requests);
+
+	return retval;
+
+}
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/**
+ * bluray_test_socket - send requests to bluray_info --serve
+ *
+ * Usage: bluray_test_socket <socket> <idle clients> <request>...
+ *
+ * Connects as many idle clients as asked, which never send anything, and
+ * then one more, which sends each request in turn and writes each response
+ * line to stdout. Exits 1 if a response doesn't come within
+ * BLURAY_TEST_SOCKET_TIMEOUT seconds, which is what happens when the idle
+ * clients are holding every worker.
+ */
+
+#define BLURAY_TEST_SOCKET_TIMEOUT 10
+#define BLURAY_TEST_SOCKET_LINE_MAX 65536
+
+static int bluray_test_socket_connect(const char *socket_filename) {
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	if(strlen(socket_filename) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr.sun_path, socket_filename);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd == -1)
+		return -1;
+
+	if(connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+
+}
+
+static int bluray_test_socket_write(int fd, const char *buffer, size_t length) {
+
+	ssize_t written = 0;
+
+	while(length > 0) {
+		written = write(fd, buffer, length);
+		if(written < 0 && errno == EINTR)
+			continue;
+		if(written <= 0)
+			return 1;
+		buffer += written;
+		length -= (size_t)written;
+	}
+
+	return 0;
+
+}
+
+/**
+ * Read one response line, without the newline
+ */
+static int bluray_test_socket_line(int fd, char *line, size_t size) {
+
+	size_t length = 0;
+	ssize_t received = 0;
+
+	while(length + 1 < size) {
+		received = read(fd, line + length, 1);
+		if(received < 0 && errno == EINTR)
+			continue;
+		if(received <= 0)
+			return 1;
+		if(line[length] == '\n') {
+			line[length] = '\0';
+			return 0;
+		}
+		length++;
+	}
+
+	return 1;
+
+}
+
+int main(int argc, char **argv) {
+
+	if(argc < 4) {
+		fprintf(stderr, "Usage: bluray_test_socket <socket> <idle clients> <request>...\n");
+		return 1;
+	}
+
+	const char *socket_filename = argv[1];
+	unsigned long int idle_clients = strtoul(argv[2], NULL, 10);
+	unsigned long int ix = 0;
+	int fd = -1;
+
+	// Left open until exit
+	for(ix = 0; ix < idle_clients; ix++) {
+		fd = bluray_test_socket_connect(socket_filename);
+		if(fd == -1) {
+			fprintf(stderr, "Could not connect idle client %lu to %s: %s\n", ix + 1, socket_filename, strerror(errno));
+			return 1;
+		}
+	}
+
+	fd = bluray_test_socket_connect(socket_filename);
+	if(fd == -1) {
+		fprintf(stderr, "Could not connect to %s: %s\n", socket_filename, strerror(errno));
+		return 1;
+	}
+
+	struct timeval timeout;
+	timeout.tv_sec = BLURAY_TEST_SOCKET_TIMEOUT;
+	timeout.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	char *line = malloc(BLURAY_TEST_SOCKET_LINE_MAX);
+	if(line == NULL)
+		return 1;
+
+	int arg_ix = 0;
+	for(arg_ix = 3; arg_ix < argc; arg_ix++) {
+
+		snprintf(line, BLURAY_TEST_SOCKET_LINE_MAX, "%s\n", argv[arg_ix]);
+
+		if(bluray_test_socket_write(fd, line, strlen(line))) {
+			fprintf(stderr, "Could not send request: %s\n", argv[arg_ix]);
+			free(line);
+			return 1;
+		}
+
+		if(bluray_test_socket_line(fd, line, BLURAY_TEST_SOCKET_LINE_MAX)) {
+			fprintf(stderr, "No response to request: %s\n", argv[arg_ix]);
+			free(line);
+			return 1;
+		}
+
+		printf("%s\n", line);
+
+	}
+
+	free(line);
+	close(fd);
+
+	return 0;
+
+}
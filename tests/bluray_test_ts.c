@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include "bluray_ts.h"
+
+/**
+ * bluray_test_ts - check bluray_ts_check() on crafted source packets
+ *
+ * Usage: bluray_test_ts
+ *
+ * Each case writes a few packets, with the timestamps, PIDs and continuity
+ * counters it's about, checks them, and compares the counts of bad packets
+ * and of each kind of error with what they should be. Every case is checked
+ * both in one read and in reads that split packets. Exits 1 if any case
+ * doesn't match.
+ */
+
+#define BLURAY_TEST_TS_PACKETS_MAX 256
+
+// Read sizes for splitting a stream, in turn
+static const size_t bluray_test_ts_reads[] = { 1, 191, 200, 5, 383, 192 };
+
+#define BLURAY_TEST_TS_NUM_READS (sizeof(bluray_test_ts_reads) / sizeof(bluray_test_ts_reads[0]))
+
+struct bluray_test_ts_stream {
+	uint8_t data[BLURAY_TEST_TS_PACKETS_MAX * BLURAY_TS_PACKET_SIZE];
+	uint32_t packets;
+};
+
+struct bluray_test_ts_counts {
+	uint64_t bad_packets;
+	uint64_t sync_errors;
+	uint64_t ats_errors;
+	uint64_t continuity_errors;
+};
+
+/**
+ * Add a source packet: the arrival timestamp, then the transport packet
+ * header, with an adaptation field if adaptation_field_control has one
+ */
+static void bluray_test_ts_packet(struct bluray_test_ts_stream *stream, uint32_t ats, uint16_t pid, uint8_t adaptation_field_control, uint8_t counter, bool discontinuity) {
+
+	uint8_t *packet = stream->data + stream->packets * BLURAY_TS_PACKET_SIZE;
+	memset(packet, 0xa5, BLURAY_TS_PACKET_SIZE);
+
+	packet[0] = (uint8_t)(ats >> 24) & 0x3f;
+	packet[1] = (uint8_t)(ats >> 16);
+	packet[2] = (uint8_t)(ats >> 8);
+	packet[3] = (uint8_t)ats;
+	packet[4] = 0x47;
+	packet[5] = (uint8_t)(pid >> 8) & 0x1f;
+	packet[6] = (uint8_t)pid;
+	packet[7] = (uint8_t)((adaptation_field_control << 4) | (counter & 0x0f));
+
+	if(adaptation_field_control & 0x02) {
+		packet[8] = 1;
+		packet[9] = (discontinuity ? 0x80 : 0x00);
+	}
+
+	stream->packets++;
+
+}
+
+/**
+ * Add packets with a payload on one PID, the counter going up by one and the
+ * timestamp by step from each packet to the next
+ */
+static void bluray_test_ts_packets(struct bluray_test_ts_stream *stream, uint32_t count, uint32_t ats, uint32_t step, uint16_t pid, uint8_t counter) {
+
+	uint32_t ix = 0;
+
+	for(ix = 0; ix < count; ix++)
+		bluray_test_ts_packet(stream, (ats + ix * step) & 0x3fffffff, pid, 0x01, (uint8_t)(counter + ix), false);
+
+}
+
+/**
+ * Check a stream, in one read or split into reads, in a title that's one clip
+ * or has clips of clip_packets packets each, starting at a packet. Returns 1
+ * if the counts aren't the expected ones.
+ */
+static int bluray_test_ts_run(const char *name, const struct bluray_test_ts_stream *stream, uint32_t clip_packets, uint32_t first_packet, bool split, const struct bluray_test_ts_counts *expected) {
+
+	struct bluray_title bluray_title;
+	BLURAY_CLIP_INFO clip_info[BLURAY_TEST_TS_PACKETS_MAX];
+	memset(&bluray_title, 0, sizeof(bluray_title));
+	memset(clip_info, 0, sizeof(clip_info));
+
+	uint32_t total_packets = first_packet + stream->packets;
+	uint32_t clip_ix = 0;
+
+	bluray_title.clip_info = clip_info;
+	if(clip_packets == 0) {
+		clip_info[0].pkt_count = total_packets;
+		bluray_title.clips = 1;
+	} else {
+		for(clip_ix = 0; clip_ix * clip_packets < total_packets; clip_ix++)
+			clip_info[clip_ix].pkt_count = clip_packets;
+		bluray_title.clips = clip_ix;
+	}
+
+	struct bluray_ts_check ts_check;
+	if(bluray_ts_check_init(&ts_check, &bluray_title, (uint64_t)first_packet * BLURAY_TS_PACKET_SIZE)) {
+		fprintf(stderr, "%s: could not allocate the clips\n", name);
+		return 1;
+	}
+
+	size_t length = (size_t)stream->packets * BLURAY_TS_PACKET_SIZE;
+	size_t offset = 0;
+	size_t read_length = 0;
+	uint32_t read_ix = 0;
+	uint64_t bad_packets = 0;
+
+	while(offset < length) {
+		read_length = (split ? bluray_test_ts_reads[read_ix++ % BLURAY_TEST_TS_NUM_READS] : length);
+		if(read_length > length - offset)
+			read_length = length - offset;
+		bad_packets += bluray_ts_check(&ts_check, stream->data + offset, read_length);
+		offset += read_length;
+	}
+
+	int retval = 0;
+
+	if(ts_check.packets != stream->packets || bad_packets != ts_check.bad_packets || ts_check.bad_packets != expected->bad_packets || ts_check.sync_errors != expected->sync_errors || ts_check.ats_errors != expected->ats_errors || ts_check.continuity_errors != expected->continuity_errors) {
+		fprintf(stderr, "%s%s: packets %" PRIu64 " of %" PRIu32 ", bad %" PRIu64 " (returned %" PRIu64 "), sync %" PRIu64 ", timestamps %" PRIu64 ", continuity %" PRIu64 "; expected bad %" PRIu64 ", sync %" PRIu64 ", timestamps %" PRIu64 ", continuity %" PRIu64 "\n", name, (split ? ", split" : ""), ts_check.packets, stream->packets, ts_check.bad_packets, bad_packets, ts_check.sync_errors, ts_check.ats_errors, ts_check.continuity_errors, expected->bad_packets, expected->sync_errors, expected->ats_errors, expected->continuity_errors);
+		retval = 1;
+	}
+
+	bluray_ts_check_free(&ts_check);
+
+	return retval;
+
+}
+
+static int bluray_test_ts_case(const char *name, const struct bluray_test_ts_stream *stream, uint32_t clip_packets, uint32_t first_packet, uint64_t bad_packets, uint64_t sync_errors, uint64_t ats_errors, uint64_t continuity_errors) {
+
+	struct bluray_test_ts_counts expected;
+	expected.bad_packets = bad_packets;
+	expected.sync_errors = sync_errors;
+	expected.ats_errors = ats_errors;
+	expected.continuity_errors = continuity_errors;
+
+	int retval = bluray_test_ts_run(name, stream, clip_packets, first_packet, false, &expected);
+	retval |= bluray_test_ts_run(name, stream, clip_packets, first_packet, true, &expected);
+
+	if(retval == 0)
+		printf("%s: ok\n", name);
+
+	return retval;
+
+}
+
+/**
+ * Whether the start of a stream is taken for one that isn't decrypted
+ */
+static bool bluray_test_ts_garbage(const struct bluray_test_ts_stream *stream) {
+
+	struct bluray_title bluray_title;
+	memset(&bluray_title, 0, sizeof(bluray_title));
+
+	struct bluray_ts_check ts_check;
+	bluray_ts_check_init(&ts_check, &bluray_title, 0);
+	bluray_ts_check(&ts_check, stream->data, (size_t)stream->packets * BLURAY_TS_PACKET_SIZE);
+	bool garbage = bluray_ts_check_garbage(&ts_check);
+	bluray_ts_check_free(&ts_check);
+
+	return garbage;
+
+}
+
+int main(void) {
+
+	struct bluray_test_ts_stream *stream = malloc(sizeof(struct bluray_test_ts_stream));
+	if(stream == NULL)
+		return 1;
+
+	int retval = 0;
+	uint32_t ix = 0;
+	uint32_t random = 0x2545f491;
+
+	// The counter wraps around from 15 to 0
+	stream->packets = 0;
+	bluray_test_ts_packets(stream, 40, 1000, 300, 0x1011, 0);
+	retval |= bluray_test_ts_case("in order", stream, 0, 0, 0, 0, 0, 0);
+
+	stream->packets = 0;
+	bluray_test_ts_packets(stream, 10, 1000, 300, 0x1011, 0);
+	bluray_test_ts_packets(stream, 10, 4000, 300, 0x1011, 11);
+	retval |= bluray_test_ts_case("skipped counter", stream, 0, 0, 1, 0, 0, 1);
+
+	stream->packets = 0;
+	bluray_test_ts_packets(stream, 20, 0x3ffff000, 0x200, 0x1011, 0);
+	retval |= bluray_test_ts_case("timestamp wraps around", stream, 0, 0, 0, 0, 0, 0);
+
+	stream->packets = 0;
+	bluray_test_ts_packets(stream, 5, 10000, 300, 0x1011, 0);
+	bluray_test_ts_packets(stream, 5, 9000, 300, 0x1011, 5);
+	retval |= bluray_test_ts_case("timestamp goes back", stream, 0, 0, 1, 0, 1, 0);
+
+	// A repeated counter is a duplicate packet
+	stream->packets = 0;
+	bluray_test_ts_packets(stream, 4, 1000, 300, 0x1011, 0);
+	bluray_test_ts_packets(stream, 4, 2200, 300, 0x1011, 3);
+	retval |= bluray_test_ts_case("duplicate packet", stream, 0, 0, 0, 0, 0, 0);
+
+	stream->packets = 0;
+	bluray_test_ts_packets(stream, 4, 1000, 300, 0x1011, 0);
+	bluray_test_ts_packet(stream, 2200, 0x1011, 0x03, 9, true);
+	bluray_test_ts_packets(stream, 4, 2500, 300, 0x1011, 10);
+	retval |= bluray_test_ts_case("discontinuity indicator", stream, 0, 0, 0, 0, 0, 0);
+
+	stream->packets = 0;
+	bluray_test_ts_packets(stream, 4, 1000, 300, 0x1011, 0);
+	bluray_test_ts_packet(stream, 2200, 0x1011, 0x03, 9, false);
+	retval |= bluray_test_ts_case("jump without discontinuity indicator", stream, 0, 0, 1, 0, 0, 1);
+
+	// Without a payload, the counter stays where it is
+	stream->packets = 0;
+	bluray_test_ts_packets(stream, 4, 1000, 300, 0x1011, 0);
+	bluray_test_ts_packet(stream, 2200, 0x1011, 0x02, 3, false);
+	bluray_test_ts_packets(stream, 4, 2500, 300, 0x1011, 4);
+	bluray_test_ts_packet(stream, 3700, 0x1011, 0x02, 8, false);
+	retval |= bluray_test_ts_case("adaptation field only", stream, 0, 0, 1, 0, 0, 1);
+
+	// Each PID has its own counter, and null packets have none
+	stream->packets = 0;
+	for(ix = 0; ix < 32; ix++) {
+		bluray_test_ts_packet(stream, 1000 + ix * 300, (ix % 2 ? 0x1100 : 0x1011), 0x01, (uint8_t)(ix / 2 + (ix % 2) * 7), false);
+		bluray_test_ts_packet(stream, 1100 + ix * 300, 0x1fff, 0x01, (uint8_t)(ix * 5), false);
+	}
+	retval |= bluray_test_ts_case("PIDs and null packets", stream, 0, 0, 0, 0, 0, 0);
+
+	// A packet without a sync byte isn't looked at further, so its timestamp
+	// and counter don't count, and the next one follows on from the one
+	// before
+	stream->packets = 0;
+	bluray_test_ts_packets(stream, 3, 1000, 300, 0x1011, 0);
+	bluray_test_ts_packet(stream, 0, 0x1011, 0x01, 9, false);
+	stream->data[3 * BLURAY_TS_PACKET_SIZE + 4] = 0x00;
+	bluray_test_ts_packets(stream, 5, 1900, 300, 0x1011, 3);
+	retval |= bluray_test_ts_case("sync byte", stream, 0, 0, 1, 1, 0, 0);
+
+	// Timestamps and counters start over in each clip, and only there
+	stream->packets = 0;
+	bluray_test_ts_packets(stream, 6, 90000, 300, 0x1011, 0);
+	bluray_test_ts_packets(stream, 6, 1000, 300, 0x1011, 9);
+	bluray_test_ts_packets(stream, 6, 5000, 300, 0x1011, 4);
+	retval |= bluray_test_ts_case("clips", stream, 6, 0, 0, 0, 0, 0);
+	retval |= bluray_test_ts_case("clips in one", stream, 0, 0, 2, 0, 1, 2);
+
+	// Starting in the middle of the second clip of three
+	stream->packets = 0;
+	bluray_test_ts_packets(stream, 3, 90000, 300, 0x1011, 3);
+	bluray_test_ts_packets(stream, 6, 1000, 300, 0x1011, 9);
+	retval |= bluray_test_ts_case("starting in a clip", stream, 6, 9, 0, 0, 0, 0);
+
+	// Not decrypted, and damaged
+	stream->packets = 0;
+	for(ix = 0; ix < 128 * BLURAY_TS_PACKET_SIZE; ix++) {
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		stream->data[ix] = (uint8_t)random;
+	}
+	stream->packets = 128;
+	if(!bluray_test_ts_garbage(stream)) {
+		fprintf(stderr, "random data: not taken for garbage\n");
+		retval = 1;
+	} else {
+		printf("random data: ok\n");
+	}
+
+	stream->packets = 0;
+	for(ix = 0; ix < 8; ix++) {
+		bluray_test_ts_packets(stream, 15, 1000 + ix * 4800, 300, 0x1011, (uint8_t)(ix * 15));
+		bluray_test_ts_packet(stream, 0, 0x1011, 0x01, 0, false);
+		stream->data[(stream->packets - 1) * BLURAY_TS_PACKET_SIZE + 4] = 0x00;
+	}
+	if(bluray_test_ts_garbage(stream)) {
+		fprintf(stderr, "one bad packet in 16: taken for garbage\n");
+		retval = 1;
+	} else {
+		printf("one bad packet in 16: ok\n");
+	}
+
+	free(stream);
+
+	return retval;
+
+}
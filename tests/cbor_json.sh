@@ -0,0 +1,19 @@
+#!/bin/sh
+# bluray_info --format cbor has the same data as --json: decoded, with codes
+# turned back into names, PIDs into hex strings, decimal fractions into
+# numbers and string references into strings, it's written out as exactly the
+# same JSON. The disc has more strings than fit in one byte of reference, and
+# all of the stream fields.
+
+. "$srcdir/tests/common.sh"
+
+fixture "$tmpdir/disc" --playlists 30 --items 2 --chapters 8 --streams 6 --duplicates 2
+
+for options in "-x" "--main -x" "--fields title,video,audio.codec,audio.rate,subtitles"; do
+	"$builddir/bluray_info" "$tmpdir/disc" --json $options >"$tmpdir/json" 2>"$tmpdir/err" || fail "bluray_info --json $options: $(cat "$tmpdir/err")"
+	"$builddir/bluray_info" "$tmpdir/disc" --format cbor $options >"$tmpdir/cbor" 2>"$tmpdir/err" || fail "bluray_info --format cbor $options: $(cat "$tmpdir/err")"
+	"$builddir/tests/bluray_test_cbor" <"$tmpdir/cbor" >"$tmpdir/decoded" || fail "bluray_info --format cbor $options doesn't decode"
+	diff -u "$tmpdir/json" "$tmpdir/decoded" >&2 || fail "bluray_info --format cbor $options doesn't match --json"
+done
+
+exit 0
@@ -0,0 +1,47 @@
+# Setup shared by the tests, run by make check from the build directory: a
+# scratch directory that's removed on exit, along with any servers started,
+# and discs written by the fixture generator (see bluray_fixture.h).
+#
+# Exit status is automake's: 0 passed, 1 failed, 77 skipped, 99 couldn't run.
+
+builddir=.
+tmpdir=$(mktemp -d "${TMPDIR:-/tmp}/bluray_info_test.XXXXXX") || exit 99
+pids=
+
+cleanup() {
+	for pid in $pids; do
+		kill "$pid" 2>/dev/null
+	done
+	rm -rf "$tmpdir"
+}
+
+trap cleanup EXIT
+trap 'exit 1' HUP INT TERM
+
+fail() {
+	echo "FAIL: $*" >&2
+	exit 1
+}
+
+skip() {
+	echo "SKIP: $*" >&2
+	exit 77
+}
+
+# fixture <path> [bluray_bench options]
+fixture() {
+	path=$1
+	shift
+	"$builddir/bluray_bench" --fixture "$path" "$@" || exit 99
+}
+
+# wait_for <file> <text>: wait up to 10 seconds for a server to say it's ready
+wait_for() {
+	tries=0
+	until grep -q "$2" "$1" 2>/dev/null; do
+		tries=$((tries + 1))
+		[ $tries -gt 100 ] && return 1
+		sleep 0.1
+	done
+	return 0
+}
@@ -0,0 +1,39 @@
+#!/bin/sh
+# bluray_info --serve: the socket is private to the user, requests are
+# answered, and clients that connect and send nothing don't keep anyone else
+# from being answered once they time out, even when there are more of them
+# than workers. A request that's too long gets one error, not one for each
+# piece of it, and title numbers past 32 bits aren't read as smaller ones.
+
+. "$srcdir/tests/common.sh"
+
+fixture "$tmpdir/disc" --playlists 3 --chapters 4
+
+socket="$tmpdir/daemon.sock"
+"$builddir/bluray_info" --serve "$socket" --workers 2 --client-timeout 1 2>"$tmpdir/daemon.err" &
+pids="$pids $!"
+
+tries=0
+until [ -S "$socket" ]; do
+	tries=$((tries + 1))
+	[ $tries -gt 100 ] && fail "bluray_info --serve didn't start: $(cat "$tmpdir/daemon.err")"
+	sleep 0.1
+done
+
+case "$(ls -l "$socket")" in
+	srw-------*) ;;
+	*) fail "socket is accessible to others: $(ls -l "$socket")" ;;
+esac
+
+long_path="$tmpdir/$(printf '%10000s' '' | tr ' ' a)"
+
+"$builddir/tests/bluray_test_socket" "$socket" 4 "disc $tmpdir/disc" "title 1 $tmpdir/disc" "chapters 1 $tmpdir/disc" "title 9 $tmpdir/disc" "title 4294967297 $tmpdir/disc" "disc $long_path" "stats" >"$tmpdir/responses" || fail "requests behind 4 idle clients weren't answered"
+
+[ "$(wc -l <"$tmpdir/responses")" -eq 7 ] || fail "expected 7 responses: $(cat "$tmpdir/responses")"
+sed -n 1,3p "$tmpdir/responses" | grep -q '"error"' && fail "disc, title or chapters failed: $(cat "$tmpdir/responses")"
+sed -n 4p "$tmpdir/responses" | grep -q '"error"' || fail "no error for a title that doesn't exist: $(sed -n 4p "$tmpdir/responses")"
+sed -n 5p "$tmpdir/responses" | grep -q '"invalid title number"' || fail "title 4294967297 was answered: $(sed -n 5p "$tmpdir/responses")"
+sed -n 6p "$tmpdir/responses" | grep -q '"request too long"' || fail "no error for a request that's too long: $(sed -n 6p "$tmpdir/responses")"
+sed -n 7p "$tmpdir/responses" | grep -q '"open discs"' || fail "stats after a request that's too long: $(sed -n 7p "$tmpdir/responses")"
+
+exit 0
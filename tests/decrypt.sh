@@ -0,0 +1,36 @@
+#!/bin/sh
+# bluray_copy --decrypt: chapters of an AACS encrypted disc, decrypted with the
+# key from its KEYDB entry, match the same disc written unencrypted, and what
+# libbluray reads through libaacs, where it can decrypt the disc.
+
+. "$srcdir/tests/common.sh"
+
+XDG_CACHE_HOME="$tmpdir/cache"
+export XDG_CACHE_HOME
+
+disc="--playlists 1 --clips 3 --items 3 --chapters 6 --packets-per-second 100"
+fixture "$tmpdir/plain" $disc --fill
+fixture "$tmpdir/aacs" $disc --aacs --keydb "$tmpdir/KEYDB.cfg"
+
+libaacs=yes
+
+for chapters in 1-6 3 2-5; do
+
+	"$builddir/bluray_copy" "$tmpdir/plain" --playlist 0 --chapter $chapters --output "$tmpdir/plain.m2ts" >/dev/null 2>"$tmpdir/copy.err" || fail "bluray_copy --chapter $chapters, unencrypted: $(cat "$tmpdir/copy.err")"
+
+	"$builddir/bluray_copy" "$tmpdir/aacs" --playlist 0 --chapter $chapters --keydb "$tmpdir/KEYDB.cfg" --decrypt 2 --output "$tmpdir/decrypt.m2ts" >/dev/null 2>"$tmpdir/copy.err" || fail "bluray_copy --chapter $chapters --decrypt: $(cat "$tmpdir/copy.err")"
+	grep "Not decrypting" "$tmpdir/copy.err" && fail "bluray_copy --chapter $chapters --decrypt didn't decrypt"
+	cmp "$tmpdir/plain.m2ts" "$tmpdir/decrypt.m2ts" || fail "chapters $chapters differ with --decrypt"
+
+	if [ $libaacs = yes ]; then
+		if "$builddir/bluray_copy" "$tmpdir/aacs" --playlist 0 --chapter $chapters --keydb "$tmpdir/KEYDB.cfg" --output "$tmpdir/libbluray.m2ts" >/dev/null 2>"$tmpdir/copy.err"; then
+			cmp "$tmpdir/plain.m2ts" "$tmpdir/libbluray.m2ts" || fail "chapters $chapters differ through libbluray"
+		else
+			echo "libbluray can't decrypt the disc, only comparing with the unencrypted one: $(tail -n 1 "$tmpdir/copy.err")"
+			libaacs=no
+		fi
+	fi
+
+done
+
+exit 0
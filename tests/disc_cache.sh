@@ -0,0 +1,24 @@
+#!/bin/sh
+# bluray_copy --disc-cache: chapters copied through the cache, first from the
+# disc and then from the cache, match the ones copied straight from the disc.
+# The clips don't end on an aligned unit, so the cache's blocks start in the
+# middle of one.
+
+. "$srcdir/tests/common.sh"
+
+XDG_CACHE_HOME="$tmpdir/cache"
+export XDG_CACHE_HOME
+
+fixture "$tmpdir/disc" --playlists 1 --clips 3 --items 3 --chapters 6 --packets-per-second 100 --fill
+
+for chapters in 1 3 2-5 6; do
+	"$builddir/bluray_copy" "$tmpdir/disc" --playlist 0 --chapter $chapters --output "$tmpdir/disc.m2ts" >/dev/null 2>"$tmpdir/copy.err" || fail "bluray_copy --chapter $chapters: $(cat "$tmpdir/copy.err")"
+	for pass in disc cache; do
+		"$builddir/bluray_copy" "$tmpdir/disc" --playlist 0 --chapter $chapters --disc-cache 64 --output "$tmpdir/cache.m2ts" >/dev/null 2>"$tmpdir/copy.err" || fail "bluray_copy --chapter $chapters --disc-cache, from the $pass: $(cat "$tmpdir/copy.err")"
+		cmp "$tmpdir/disc.m2ts" "$tmpdir/cache.m2ts" || fail "chapters $chapters differ through the cache, from the $pass"
+	done
+done
+
+ls "$XDG_CACHE_HOME"/bluray_info/discs/*.blocks >/dev/null 2>&1 || fail "nothing was cached"
+
+exit 0
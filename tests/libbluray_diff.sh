@@ -0,0 +1,29 @@
+#!/bin/sh
+# bluray_info reads titles straight from the playlists and clip info, and
+# --libbluray gets them from libbluray instead: both display the same titles,
+# durations, chapters, stream tables and sizes, on discs with shared clips,
+# play items, near-duplicate playlists and ones that play a clip twice, which
+# is as often as a title may.
+
+. "$srcdir/tests/common.sh"
+
+fixture "$tmpdir/items" --playlists 8 --clips 5 --items 3 --chapters 5 --streams 3 --duplicates 2
+fixture "$tmpdir/repeats" --playlists 6 --clips 4 --items 6 --chapters 7
+fixture "$tmpdir/titles" --playlists 40 --chapters 12 --streams 1
+
+for disc in items repeats titles; do
+
+	# If the title lists don't match, bluray_info quietly uses libbluray, and
+	# there'd be nothing to compare
+	"$builddir/bluray_info" "$tmpdir/$disc" --timings >/dev/null 2>"$tmpdir/timings" || fail "bluray_info on $disc"
+	grep -q "^bdmv_title_info " "$tmpdir/timings" || fail "the playlists on $disc don't give libbluray's title list"
+
+	for options in "-x" "--json -x" "--format ndjson -x"; do
+		"$builddir/bluray_info" "$tmpdir/$disc" $options >"$tmpdir/native" 2>&1 || fail "bluray_info $options on $disc"
+		"$builddir/bluray_info" "$tmpdir/$disc" $options --libbluray >"$tmpdir/libbluray" 2>&1 || fail "bluray_info $options --libbluray on $disc"
+		diff -u "$tmpdir/libbluray" "$tmpdir/native" >&2 || fail "bluray_info $options on $disc differs from libbluray"
+	done
+
+done
+
+exit 0
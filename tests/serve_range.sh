@@ -0,0 +1,22 @@
+#!/bin/sh
+# bluray_serve: whole titles, chapter ranges and random byte ranges, compared
+# with what bluray_copy copies. The clips don't end on an aligned unit, so
+# most ranges start in the middle of one, where bd_seek() doesn't go.
+
+. "$srcdir/tests/common.sh"
+
+fixture "$tmpdir/disc" --playlists 2 --clips 6 --items 3 --chapters 5 --packets-per-second 100 --fill
+
+"$builddir/bluray_copy" "$tmpdir/disc" --playlist 0 --output "$tmpdir/playlist_0.m2ts" >/dev/null || fail "bluray_copy --playlist 0"
+"$builddir/bluray_copy" "$tmpdir/disc" --playlist 1 --chapter 2-4 --output "$tmpdir/playlist_1.m2ts" >/dev/null || fail "bluray_copy --playlist 1 --chapter 2-4"
+
+# A small cache, so ranges aren't all served from it
+"$builddir/bluray_serve" "$tmpdir/disc" --port 0 --cache 1 >"$tmpdir/serve.out" 2>&1 &
+pids="$pids $!"
+wait_for "$tmpdir/serve.out" "^Serving at" || fail "bluray_serve didn't start: $(cat "$tmpdir/serve.out")"
+port=$(sed -n 's|^Serving at http://.*:\([0-9]*\)/$|\1|p' "$tmpdir/serve.out")
+
+"$builddir/tests/bluray_test_http" "$port" /playlist/0.m2ts "$tmpdir/playlist_0.m2ts" || fail "playlist 0"
+"$builddir/tests/bluray_test_http" "$port" "/playlist/1.m2ts?chapters=2-4" "$tmpdir/playlist_1.m2ts" || fail "playlist 1, chapters 2-4"
+
+exit 0
@@ -0,0 +1,11 @@
+#!/bin/sh
+# The packet checker bluray_copy runs on what it reads: crafted packets with
+# timestamps that wrap around or go back, counters that skip, repeat or start
+# over at a discontinuity indicator or a clip, and packets without a sync
+# byte, are counted as the errors they are, however the reads split them.
+
+. "$srcdir/tests/common.sh"
+
+"$builddir/tests/bluray_test_ts" || fail "bad packets weren't counted as expected"
+
+exit 0
@@ -0,0 +1,65 @@
+#!/bin/sh
+# bluray_info --where: the titles each expression selects, whether the title
+# list has the playlists and durations (native) or not (--libbluray), so
+# fields are unknown at different stages, and the error and position for
+# expressions that don't parse.
+#
+# The disc's titles, by title number:
+#   1 14:06 1550 MBs   2 9:44 1070 MBs   3 7:33 830 MBs   4 1:00 110 MBs
+#   5 11:55 1310 MBs   6 3:11 350 MBs    7 5:22 590 MBs   8 0:59 110 MBs
+#   9 16:17 1789 MBs   10 0:58 109 MBs
+# with playlists 6 4 3 0 5 1 2 8 7 9, and each has 6 chapters and eng, fre
+# and spa audio and subtitles.
+
+. "$srcdir/tests/common.sh"
+
+fixture "$tmpdir/disc" --playlists 8 --chapters 6 --streams 3 --duplicates 2
+
+titles() {
+	"$builddir/bluray_info" "$tmpdir/disc" "$@" 2>"$tmpdir/err" >"$tmpdir/out" || fail "bluray_info $*: $(cat "$tmpdir/err")"
+	sed -n 's/^Title: 0*\([0-9][0-9]*\),.*/\1/p' "$tmpdir/out" | tr '\n' ' ' | sed 's/ $//'
+}
+
+selects() {
+	for list in native --libbluray; do
+		[ $list = native ] && list=
+		got=$(titles $list --where "$1") || exit 1
+		[ "$got" = "$2" ] || fail "--where '$1' ${list:-native}: titles '$got', expected '$2'"
+	done
+}
+
+# Only the title list
+selects "minutes>=10" "1 5 9"
+selects "title<=3 && playlist!=4" "1 3"
+selects "playlist>=5 && seconds>=59" "1 5 8 9"
+
+# Negating a field that isn't known yet is still unknown, not true or false
+selects "!(chapters>6) && minutes<2" "4 8 10"
+selects "!(filesize<100000000) && seconds<60" "8 10"
+selects "!(title==3 || chapters==6) || playlist==2" "7"
+
+# Or and and with one side unknown until a later stage
+selects "seconds<60 || filesize>1800000000" "8 9 10"
+selects "audio.language==spa && (seconds>=900 || filesize<120000000)" "4 8 9 10"
+selects "subtitles.language!=fre || audio>3" ""
+selects "audio.lang==ENG && video.format==1080p && title<=2" "1 2"
+
+# Each --where is required as well as the ones before
+got=$(titles --where "minutes<2" --where "title!=8") || exit 1
+[ "$got" = "4 10" ] || fail "two --where: titles '$got', expected '4 10'"
+
+rejects() {
+	"$builddir/bluray_info" "$tmpdir/disc" --where "$1" >/dev/null 2>"$tmpdir/err" && fail "--where '$1' was accepted"
+	grep -qF "Invalid --where expression, $2: $1" "$tmpdir/err" || fail "--where '$1': $(cat "$tmpdir/err"), expected $2"
+}
+
+rejects "foo==1" "unknown field at position 1"
+rejects "minutes>=" "expected a value at position 10"
+rejects "minutes>abc" "expected a number at position 9"
+rejects "audio.language>eng" "only == and != compare words at position 16"
+rejects "audio.language=='eng" "missing closing quote at position 21"
+rejects "(minutes>1" "missing closing parenthesis at position 11"
+rejects "minutes>1 chapters>2" "unexpected text at position 11"
+rejects "title==1 || (chapters>2 && !)" "expected a field at position 29"
+
+exit 0